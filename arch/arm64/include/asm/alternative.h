@@ -260,6 +260,37 @@ alternative_endif
 		_asm_extable	8889b,\l;
 	.endm
 
+	/*
+	 * Non-temporal pairs have no post-increment form, so these take an
+	 * offset and leave \addr alone.  With UAO they degrade to ordinary
+	 * unprivileged accesses.
+	 */
+	.macro uao_ldnp l, reg1, reg2, addr, offset
+		alternative_if_not ARM64_HAS_UAO
+8888:			ldnp	\reg1, \reg2, [\addr, \offset];
+8889:			nop;
+		alternative_else
+			ldtr	\reg1, [\addr, \offset];
+			ldtr	\reg2, [\addr, \offset + 8];
+		alternative_endif
+
+		_asm_extable	8888b,\l;
+		_asm_extable	8889b,\l;
+	.endm
+
+	.macro uao_stnp l, reg1, reg2, addr, offset
+		alternative_if_not ARM64_HAS_UAO
+8888:			stnp	\reg1, \reg2, [\addr, \offset];
+8889:			nop;
+		alternative_else
+			sttr	\reg1, [\addr, \offset];
+			sttr	\reg2, [\addr, \offset + 8];
+		alternative_endif
+
+		_asm_extable	8888b,\l;
+		_asm_extable	8889b,\l;
+	.endm
+
 	.macro uao_user_alternative l, inst, alt_inst, reg, addr, post_inc
 		alternative_if_not ARM64_HAS_UAO
 8888:			\inst	\reg, [\addr], \post_inc;
@@ -278,6 +309,12 @@ alternative_endif
 	.macro uao_stp l, reg1, reg2, addr, post_inc
 		USER(\l, stp \reg1, \reg2, [\addr], \post_inc)
 	.endm
+	.macro uao_ldnp l, reg1, reg2, addr, offset
+		USER(\l, ldnp \reg1, \reg2, [\addr, \offset])
+	.endm
+	.macro uao_stnp l, reg1, reg2, addr, offset
+		USER(\l, stnp \reg1, \reg2, [\addr, \offset])
+	.endm
 	.macro uao_user_alternative l, inst, alt_inst, reg, addr, post_inc
 		USER(\l, \inst \reg, [\addr], \post_inc)
 	.endm
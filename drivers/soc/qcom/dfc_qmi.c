@@ -689,6 +689,17 @@ static struct qmi_elem_info dfc_tx_link_status_ind_v01_ei[] = {
 	},
 };
 
+#ifdef CONFIG_QCOM_QMI_CODEGEN
+/* Encoders/decoders generated from the tables above at build time */
+#include "dfc_qmi_codec.h"
+
+static int __init dfc_qmi_codec_init(void)
+{
+	return qmi_register_codecs(dfc_qmi_codecs, ARRAY_SIZE(dfc_qmi_codecs));
+}
+subsys_initcall(dfc_qmi_codec_init);
+#endif
+
 static int
 dfc_bind_client_req(struct qmi_handle *dfc_handle,
 		    struct sockaddr_qrtr *ssctl, struct svc_info *svc)
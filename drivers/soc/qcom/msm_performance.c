@@ -19,6 +19,8 @@
 #include <linux/cpufreq.h>
 #include <linux/slab.h>
 #include <linux/sched.h>
+#include <linux/sched/signal.h>
+#include <linux/sched/task.h>
 #include <linux/tick.h>
 #include <trace/events/power.h>
 #include <linux/sysfs.h>
@@ -197,6 +199,82 @@ static const struct kernel_param_ops param_ops_cpu_max_freq = {
 };
 module_param_cb(cpu_max_freq, &param_ops_cpu_max_freq, NULL, 0644);
 
+#ifdef CONFIG_UCLAMP_TASK
+/*
+ * Per-task utilization hints, written as "pid:min:max" with min and max in
+ * SCHED_CAPACITY_SCALE units. Unlike cpu_min_freq/cpu_max_freq they do not
+ * touch the cpufreq policy: schedutil honours the highest floor and cap
+ * of the tasks runnable on a CPU, so concurrent clients do not override
+ * each other. task_util_clamp applies to a single thread, proc_util_clamp
+ * to every thread of the process the pid belongs to.
+ */
+static struct task_struct *get_util_clamp_task(const char *buf,
+					       unsigned int *min,
+					       unsigned int *max)
+{
+	struct task_struct *p;
+	struct pid *pid;
+	int nr;
+
+	if (sscanf(buf, "%d:%u:%u", &nr, min, max) != 3 || nr <= 0)
+		return ERR_PTR(-EINVAL);
+
+	pid = find_get_pid(nr);
+	p = get_pid_task(pid, PIDTYPE_PID);
+	put_pid(pid);
+
+	return p ? p : ERR_PTR(-ESRCH);
+}
+
+static int set_task_util_clamp(const char *buf, const struct kernel_param *kp)
+{
+	unsigned int min, max;
+	struct task_struct *p;
+	int ret;
+
+	p = get_util_clamp_task(buf, &min, &max);
+	if (IS_ERR(p))
+		return PTR_ERR(p);
+
+	ret = sched_set_util_clamp(p, min, max);
+	put_task_struct(p);
+
+	return ret;
+}
+
+static const struct kernel_param_ops param_ops_task_util_clamp = {
+	.set = set_task_util_clamp,
+};
+module_param_cb(task_util_clamp, &param_ops_task_util_clamp, NULL, 0200);
+
+static int set_proc_util_clamp(const char *buf, const struct kernel_param *kp)
+{
+	unsigned int min, max;
+	struct task_struct *p, *t;
+	int ret = 0;
+
+	p = get_util_clamp_task(buf, &min, &max);
+	if (IS_ERR(p))
+		return PTR_ERR(p);
+
+	rcu_read_lock();
+	for_each_thread(p, t) {
+		ret = sched_set_util_clamp(t, min, max);
+		if (ret)
+			break;
+	}
+	rcu_read_unlock();
+	put_task_struct(p);
+
+	return ret;
+}
+
+static const struct kernel_param_ops param_ops_proc_util_clamp = {
+	.set = set_proc_util_clamp,
+};
+module_param_cb(proc_util_clamp, &param_ops_proc_util_clamp, NULL, 0200);
+#endif /* CONFIG_UCLAMP_TASK */
+
 static struct kobject *events_kobj;
 
 static ssize_t show_cpu_hotplug(struct kobject *kobj,
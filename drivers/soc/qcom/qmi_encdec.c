@@ -20,6 +20,9 @@
 #include <linux/errno.h>
 #include <linux/io.h>
 #include <linux/string.h>
+#include <linux/hashtable.h>
+#include <linux/rcupdate.h>
+#include <linux/spinlock.h>
 #include <linux/soc/qcom/qmi.h>
 
 #define QMI_ENCDEC_ENCODE_TLV(type, length, p_dst) do { \
@@ -270,7 +273,12 @@ static int qmi_encode_string_elem(struct qmi_elem_info *ei_array,
 			return -ETOOSMALL;
 		}
 	} else {
-		if (string_len + string_len_sz > out_buf_len) {
+		/*
+		 * Like every other check, leave room for the TLV header the
+		 * outermost level reserved ahead of encoded_bytes.
+		 */
+		if (string_len + string_len_sz + TLV_LEN_SIZE + TLV_TYPE_SIZE >
+		    out_buf_len) {
 			pr_err("%s: Output len %d > Out Buf len %d\n",
 			       __func__, string_len, out_buf_len);
 			return -ETOOSMALL;
@@ -740,6 +748,113 @@ static int qmi_decode(struct qmi_elem_info *ei_array, void *out_c_struct,
 	return decoded_bytes;
 }
 
+#ifdef CONFIG_QCOM_QMI_CODEGEN
+/* Generated codecs, keyed by the address of their message descriptor */
+static DEFINE_HASHTABLE(qmi_codecs, 6);
+static DEFINE_SPINLOCK(qmi_codecs_lock);
+
+static struct qmi_codec *qmi_find_codec(struct qmi_elem_info *ei)
+{
+	struct qmi_codec *codec;
+
+	hash_for_each_possible_rcu(qmi_codecs, codec, node, (unsigned long)ei)
+		if (codec->ei == ei)
+			return codec;
+	return NULL;
+}
+
+/**
+ * qmi_register_codecs() - Register generated encoders/decoders
+ * @codecs:	array of codecs, as emitted by scripts/qmi_codegen.py
+ * @count:	number of entries in @codecs
+ *
+ * Once registered, qmi_encode_message() and qmi_decode_message() use the
+ * codec of a message descriptor instead of interpreting the descriptor.
+ * The codecs must stay valid until qmi_unregister_codecs() returns.
+ *
+ * Returns 0 on success, -EEXIST if a descriptor already has a codec.
+ */
+int qmi_register_codecs(struct qmi_codec *codecs, size_t count)
+{
+	size_t i;
+
+	spin_lock(&qmi_codecs_lock);
+	for (i = 0; i < count; i++) {
+		if (qmi_find_codec(codecs[i].ei)) {
+			pr_err("%s: %ps already has a codec\n",
+			       __func__, codecs[i].ei);
+			while (i--)
+				hash_del_rcu(&codecs[i].node);
+			spin_unlock(&qmi_codecs_lock);
+			synchronize_rcu();
+			return -EEXIST;
+		}
+		hash_add_rcu(qmi_codecs, &codecs[i].node,
+			     (unsigned long)codecs[i].ei);
+	}
+	spin_unlock(&qmi_codecs_lock);
+
+	return 0;
+}
+EXPORT_SYMBOL(qmi_register_codecs);
+
+/**
+ * qmi_unregister_codecs() - Unregister codecs added by qmi_register_codecs()
+ * @codecs:	array of codecs passed to qmi_register_codecs()
+ * @count:	number of entries in @codecs
+ */
+void qmi_unregister_codecs(struct qmi_codec *codecs, size_t count)
+{
+	size_t i;
+
+	spin_lock(&qmi_codecs_lock);
+	for (i = 0; i < count; i++)
+		hash_del_rcu(&codecs[i].node);
+	spin_unlock(&qmi_codecs_lock);
+	synchronize_rcu();
+}
+EXPORT_SYMBOL(qmi_unregister_codecs);
+#else
+static inline struct qmi_codec *qmi_find_codec(struct qmi_elem_info *ei)
+{
+	return NULL;
+}
+#endif
+
+static int qmi_encode_msg(struct qmi_elem_info *ei, void *out_buf,
+			  const void *c_struct, u32 out_buf_len)
+{
+	struct qmi_codec *codec;
+	int ret;
+
+	rcu_read_lock();
+	codec = qmi_find_codec(ei);
+	if (codec)
+		ret = codec->encode(out_buf, c_struct, out_buf_len);
+	else
+		ret = qmi_encode(ei, out_buf, c_struct, out_buf_len, 1);
+	rcu_read_unlock();
+
+	return ret;
+}
+
+static int qmi_decode_msg(struct qmi_elem_info *ei, void *c_struct,
+			  const void *in_buf, u32 in_buf_len)
+{
+	struct qmi_codec *codec;
+	int ret;
+
+	rcu_read_lock();
+	codec = qmi_find_codec(ei);
+	if (codec)
+		ret = codec->decode(c_struct, in_buf, in_buf_len);
+	else
+		ret = qmi_decode(ei, c_struct, in_buf, in_buf_len, 1);
+	rcu_read_unlock();
+
+	return ret;
+}
+
 /**
  * qmi_encode_message() - Encode C structure as QMI encoded message
  * @type:	Type of QMI message
@@ -778,7 +893,7 @@ void *qmi_encode_message(int type, unsigned int msg_id, size_t *len,
 
 	/* Encode message, if we have a message */
 	if (c_struct) {
-		msglen = qmi_encode(ei, msg + sizeof(*hdr), c_struct, *len, 1);
+		msglen = qmi_encode_msg(ei, msg + sizeof(*hdr), c_struct, *len);
 		if (msglen < 0) {
 			kfree(msg);
 			return ERR_PTR(msglen);
@@ -816,8 +931,8 @@ int qmi_decode_message(const void *buf, size_t len,
 	if (!c_struct || !buf || !len)
 		return -EINVAL;
 
-	return qmi_decode(ei, c_struct, buf + sizeof(struct qmi_header),
-			  len - sizeof(struct qmi_header), 1);
+	return qmi_decode_msg(ei, c_struct, buf + sizeof(struct qmi_header),
+			      len - sizeof(struct qmi_header));
 }
 EXPORT_SYMBOL(qmi_decode_message);
 
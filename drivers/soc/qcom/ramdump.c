@@ -28,6 +28,10 @@
 #include <soc/qcom/ramdump.h>
 #include <linux/dma-mapping.h>
 #include <linux/of.h>
+#include <linux/crypto.h>
+#include <linux/vmalloc.h>
+#include <linux/xxhash.h>
+#include <asm/unaligned.h>
 
 
 #define RAMDUMP_NUM_DEVICES	256
@@ -42,6 +46,8 @@ static bool ramdump_devnode_inited;
 #define MAX_STRTBL_SIZE 512
 #define MAX_NAME_LENGTH 16
 
+struct ramdump_lz4_stream;
+
 struct consumer_entry {
 	bool data_ready;
 	struct ramdump_device *rd_dev;
@@ -66,8 +72,10 @@ struct ramdump_device {
 	struct ramdump_segment *segments;
 	size_t elfcore_size;
 	char *elfcore_buf;
-	unsigned long attrs;
 	bool complete_ramdump;
+
+	struct mutex lz4_lock;
+	struct ramdump_lz4_stream *lz4;
 };
 
 static int ramdump_open(struct inode *inode, struct file *filep)
@@ -156,16 +164,65 @@ static unsigned long offset_translate(loff_t user_offset,
 
 #define MAX_IOREMAP_SIZE SZ_1M
 
+/*
+ * Copy @size bytes of segment memory at physical address @addr, or at
+ * @vaddr when the client mapped the segment itself, into @dst.
+ */
+static int ramdump_copy_segment(struct ramdump_device *rd_dev, void *dst,
+				unsigned long addr, void *vaddr, size_t size)
+{
+	void *device_mem, *origdevice_mem;
+	unsigned long bytes_before, bytes_after;
+	size_t alignsize = size;
+
+	device_mem = vaddr ?: dma_remap(rd_dev->dev->parent, NULL, addr,
+					size, DMA_ATTR_SKIP_ZEROING);
+	origdevice_mem = device_mem;
+
+	if (device_mem == NULL) {
+		pr_err("Ramdump(%s): Unable to ioremap: addr %lx, size %zd\n",
+			rd_dev->name, addr, size);
+		return -ENOMEM;
+	}
+
+	if ((unsigned long)device_mem & 0x7) {
+		bytes_before = 8 - ((unsigned long)device_mem & 0x7);
+		bytes_before = min_t(unsigned long, bytes_before, alignsize);
+		memcpy_fromio(dst, device_mem, bytes_before);
+		device_mem += bytes_before;
+		dst += bytes_before;
+		alignsize -= bytes_before;
+	}
+
+	if (alignsize & 0x7) {
+		bytes_after = alignsize & 0x7;
+		memcpy(dst, device_mem, alignsize - bytes_after);
+		device_mem += alignsize - bytes_after;
+		dst += (alignsize - bytes_after);
+		alignsize = bytes_after;
+		memcpy_fromio(dst, device_mem, alignsize);
+	} else
+		memcpy(dst, device_mem, alignsize);
+
+	if (!vaddr)
+		dma_unremap(rd_dev->dev->parent, origdevice_mem, size);
+
+	return 0;
+}
+
+static ssize_t ramdump_read_lz4(struct consumer_entry *entry,
+				char __user *buf, size_t count, loff_t *pos);
+
 static ssize_t ramdump_read(struct file *filep, char __user *buf, size_t count,
 			loff_t *pos)
 {
 	struct consumer_entry *entry = filep->private_data;
 	struct ramdump_device *rd_dev = entry->rd_dev;
-	void *device_mem = NULL, *origdevice_mem = NULL, *vaddr = NULL;
-	unsigned long data_left = 0, bytes_before, bytes_after;
+	void *vaddr = NULL;
+	unsigned long data_left = 0;
 	unsigned long addr = 0;
-	size_t copy_size = 0, alignsize;
-	unsigned char *alignbuf = NULL, *finalbuf = NULL;
+	size_t copy_size = 0;
+	unsigned char *finalbuf = NULL;
 	int ret = 0;
 	loff_t orig_pos = *pos;
 
@@ -176,6 +233,9 @@ static ssize_t ramdump_read(struct file *filep, char __user *buf, size_t count,
 	if (ret)
 		return ret;
 
+	if (READ_ONCE(rd_dev->lz4))
+		return ramdump_read_lz4(entry, buf, count, pos);
+
 	if (*pos < rd_dev->elfcore_size) {
 		copy_size = rd_dev->elfcore_size - *pos;
 		copy_size = min(copy_size, count);
@@ -206,48 +266,19 @@ static ssize_t ramdump_read(struct file *filep, char __user *buf, size_t count,
 	copy_size = min_t(size_t, count, (size_t)MAX_IOREMAP_SIZE);
 	copy_size = min_t(unsigned long, (unsigned long)copy_size, data_left);
 
-	rd_dev->attrs = 0;
-	rd_dev->attrs |= DMA_ATTR_SKIP_ZEROING;
-	device_mem = vaddr ?: dma_remap(rd_dev->dev->parent, NULL, addr,
-						copy_size, rd_dev->attrs);
-	origdevice_mem = device_mem;
-
-	if (device_mem == NULL) {
-		pr_err("Ramdump(%s): Unable to ioremap: addr %lx, size %zd\n",
-			rd_dev->name, addr, copy_size);
+	finalbuf = kzalloc(copy_size, GFP_KERNEL);
+	if (!finalbuf) {
 		rd_dev->ramdump_status = -1;
 		ret = -ENOMEM;
 		goto ramdump_done;
 	}
 
-	alignbuf = kzalloc(copy_size, GFP_KERNEL);
-	if (!alignbuf) {
+	ret = ramdump_copy_segment(rd_dev, finalbuf, addr, vaddr, copy_size);
+	if (ret) {
 		rd_dev->ramdump_status = -1;
-		ret = -ENOMEM;
 		goto ramdump_done;
 	}
 
-	finalbuf = alignbuf;
-	alignsize = copy_size;
-
-	if ((unsigned long)device_mem & 0x7) {
-		bytes_before = 8 - ((unsigned long)device_mem & 0x7);
-		memcpy_fromio(alignbuf, device_mem, bytes_before);
-		device_mem += bytes_before;
-		alignbuf += bytes_before;
-		alignsize -= bytes_before;
-	}
-
-	if (alignsize & 0x7) {
-		bytes_after = alignsize & 0x7;
-		memcpy(alignbuf, device_mem, alignsize - bytes_after);
-		device_mem += alignsize - bytes_after;
-		alignbuf += (alignsize - bytes_after);
-		alignsize = bytes_after;
-		memcpy_fromio(alignbuf, device_mem, alignsize);
-	} else
-		memcpy(alignbuf, device_mem, alignsize);
-
 	if (copy_to_user(buf, finalbuf, copy_size)) {
 		pr_err("Ramdump(%s): Couldn't copy all data to user.",
 			rd_dev->name);
@@ -257,8 +288,6 @@ static ssize_t ramdump_read(struct file *filep, char __user *buf, size_t count,
 	}
 
 	kfree(finalbuf);
-	if (!vaddr && origdevice_mem)
-		dma_unremap(rd_dev->dev->parent, origdevice_mem, copy_size);
 
 	*pos += copy_size;
 
@@ -268,15 +297,339 @@ static ssize_t ramdump_read(struct file *filep, char __user *buf, size_t count,
 	return *pos - orig_pos;
 
 ramdump_done:
-	if (!vaddr && origdevice_mem)
-		dma_unremap(rd_dev->dev->parent, origdevice_mem, copy_size);
-
 	kfree(finalbuf);
 	*pos = 0;
 	reset_ramdump_entry(entry);
 	return ret;
 }
 
+#ifdef CONFIG_MSM_RAMDUMP_COMPRESS
+/*
+ * Compressed stream mode.
+ *
+ * The dump, ELF header included, is sent as a single LZ4 frame made of
+ * independent blocks of at most MAX_IOREMAP_SIZE bytes, so that "lz4 -d"
+ * on the collected file gives back exactly what the uncompressed mode
+ * would have produced.  Blocks never straddle a segment boundary.  Up to
+ * one block per slot is compressed ahead of the reader, in parallel on
+ * the unbound workqueue, each slot with its own crypto lz4 transform.
+ */
+static bool compress;
+module_param(compress, bool, 0644);
+MODULE_PARM_DESC(compress, "Stream ramdumps as an LZ4 frame");
+
+#define LZ4F_MAGIC		0x184D2204
+#define LZ4F_FLG		0x68	/* v01, independent blocks, size */
+#define LZ4F_BD_1M		0x60	/* 1 MiB maximum block size */
+#define LZ4F_BLOCK_RAW		0x80000000
+#define LZ4F_HDR_SIZE		15
+#define LZ4F_ENDMARK_SIZE	4
+#define RAMDUMP_LZ4_MAX_SLOTS	8
+
+struct ramdump_lz4_block {
+	int seg;		/* segment index, -1 for the ELF header */
+	unsigned long offset;
+	size_t len;
+};
+
+struct ramdump_lz4_slot {
+	struct work_struct work;
+	struct completion done;
+	struct ramdump_device *rd_dev;
+	struct ramdump_lz4_stream *st;
+	struct crypto_comp *tfm;
+	unsigned int block;
+	void *raw;
+	void *out;		/* block size word followed by the data */
+	size_t out_len;
+	int err;
+};
+
+struct ramdump_lz4_stream {
+	struct ramdump_lz4_block *blocks;
+	unsigned int nblocks;
+	struct ramdump_lz4_slot *slots;
+	unsigned int nslots;
+	u8 hdr[LZ4F_HDR_SIZE];
+	unsigned int cur;	/* 0: frame header, 1..nblocks, then end mark */
+	size_t cur_off;
+};
+
+static void ramdump_lz4_work(struct work_struct *work)
+{
+	struct ramdump_lz4_slot *slot = container_of(work,
+					struct ramdump_lz4_slot, work);
+	struct ramdump_device *rd_dev = slot->rd_dev;
+	struct ramdump_lz4_block *blk = &slot->st->blocks[slot->block];
+	struct ramdump_segment *seg;
+	unsigned int dlen = blk->len;
+	u32 word;
+
+	slot->err = 0;
+	if (blk->seg < 0) {
+		memcpy(slot->raw, rd_dev->elfcore_buf + blk->offset, blk->len);
+	} else {
+		seg = &rd_dev->segments[blk->seg];
+		slot->err = ramdump_copy_segment(rd_dev, slot->raw,
+				seg->address + blk->offset,
+				seg->v_address ? seg->v_address + blk->offset :
+						 NULL,
+				blk->len);
+		if (slot->err)
+			goto out;
+	}
+
+	/* Anything that does not shrink is stored as is */
+	if (crypto_comp_compress(slot->tfm, slot->raw, blk->len,
+				 slot->out + 4, &dlen) || dlen >= blk->len) {
+		memcpy(slot->out + 4, slot->raw, blk->len);
+		dlen = blk->len;
+		word = dlen | LZ4F_BLOCK_RAW;
+	} else {
+		word = dlen;
+	}
+	put_unaligned_le32(word, slot->out);
+	slot->out_len = dlen + 4;
+out:
+	complete(&slot->done);
+}
+
+static void ramdump_lz4_queue(struct ramdump_lz4_stream *st,
+			      unsigned int block)
+{
+	struct ramdump_lz4_slot *slot = &st->slots[block % st->nslots];
+
+	slot->block = block;
+	reinit_completion(&slot->done);
+	queue_work(system_unbound_wq, &slot->work);
+}
+
+static void ramdump_lz4_free(struct ramdump_lz4_stream *st)
+{
+	unsigned int i;
+
+	for (i = 0; i < st->nslots; i++) {
+		struct ramdump_lz4_slot *slot = &st->slots[i];
+
+		cancel_work_sync(&slot->work);
+		if (!IS_ERR_OR_NULL(slot->tfm))
+			crypto_free_comp(slot->tfm);
+		vfree(slot->raw);
+		vfree(slot->out);
+	}
+	kfree(st->slots);
+	kfree(st->blocks);
+	kfree(st);
+}
+
+/*
+ * Set up the compressed stream for the current session and start
+ * compressing the first blocks.  Called with the consumer lock held.
+ */
+static int ramdump_lz4_start(struct ramdump_device *rd_dev)
+{
+	struct ramdump_lz4_stream *st;
+	unsigned int i, nslots, n = 0;
+	unsigned long off;
+	u64 total = rd_dev->elfcore_size;
+	int ret = -ENOMEM;
+
+	st = kzalloc(sizeof(*st), GFP_KERNEL);
+	if (!st)
+		return -ENOMEM;
+
+	/* the ELF header grows with the segments, it may not fit a block */
+	st->nblocks = DIV_ROUND_UP(rd_dev->elfcore_size, MAX_IOREMAP_SIZE);
+	for (i = 0; i < rd_dev->nsegments; i++) {
+		st->nblocks += DIV_ROUND_UP(rd_dev->segments[i].size,
+					    MAX_IOREMAP_SIZE);
+		total += rd_dev->segments[i].size;
+	}
+
+	st->blocks = kcalloc(st->nblocks, sizeof(*st->blocks), GFP_KERNEL);
+	if (!st->blocks && st->nblocks)
+		goto err;
+
+	for (off = 0; off < rd_dev->elfcore_size; off += MAX_IOREMAP_SIZE) {
+		st->blocks[n].seg = -1;
+		st->blocks[n].offset = off;
+		st->blocks[n++].len = min_t(unsigned long, MAX_IOREMAP_SIZE,
+					    rd_dev->elfcore_size - off);
+	}
+	for (i = 0; i < rd_dev->nsegments; i++) {
+		for (off = 0; off < rd_dev->segments[i].size;
+		     off += MAX_IOREMAP_SIZE) {
+			st->blocks[n].seg = i;
+			st->blocks[n].offset = off;
+			st->blocks[n++].len = min_t(unsigned long,
+					MAX_IOREMAP_SIZE,
+					rd_dev->segments[i].size - off);
+		}
+	}
+
+	nslots = clamp_t(unsigned int, num_online_cpus(), 1,
+			 RAMDUMP_LZ4_MAX_SLOTS);
+	st->slots = kcalloc(nslots, sizeof(*st->slots), GFP_KERNEL);
+	if (!st->slots)
+		goto err;
+	st->nslots = nslots;
+
+	for (i = 0; i < st->nslots; i++) {
+		INIT_WORK(&st->slots[i].work, ramdump_lz4_work);
+		init_completion(&st->slots[i].done);
+		st->slots[i].rd_dev = rd_dev;
+		st->slots[i].st = st;
+	}
+
+	for (i = 0; i < st->nslots; i++) {
+		struct ramdump_lz4_slot *slot = &st->slots[i];
+
+		slot->tfm = crypto_alloc_comp("lz4", 0, 0);
+		if (IS_ERR(slot->tfm)) {
+			ret = PTR_ERR(slot->tfm);
+			goto err;
+		}
+		slot->raw = vmalloc(MAX_IOREMAP_SIZE);
+		slot->out = vmalloc(MAX_IOREMAP_SIZE + 4);
+		if (!slot->raw || !slot->out) {
+			ret = -ENOMEM;
+			goto err;
+		}
+	}
+
+	put_unaligned_le32(LZ4F_MAGIC, st->hdr);
+	st->hdr[4] = LZ4F_FLG;
+	st->hdr[5] = LZ4F_BD_1M;
+	put_unaligned_le64(total, st->hdr + 6);
+	st->hdr[14] = (xxh32(st->hdr + 4, 10, 0) >> 8) & 0xff;
+
+	rd_dev->lz4 = st;
+	for (i = 0; i < min(st->nslots, st->nblocks); i++)
+		ramdump_lz4_queue(st, i);
+	return 0;
+
+err:
+	ramdump_lz4_free(st);
+	return ret;
+}
+
+static void ramdump_lz4_stop(struct ramdump_device *rd_dev)
+{
+	struct ramdump_lz4_stream *st;
+
+	mutex_lock(&rd_dev->lz4_lock);
+	st = rd_dev->lz4;
+	WRITE_ONCE(rd_dev->lz4, NULL);
+	mutex_unlock(&rd_dev->lz4_lock);
+
+	if (st)
+		ramdump_lz4_free(st);
+}
+
+static ssize_t ramdump_read_lz4(struct consumer_entry *entry,
+				char __user *buf, size_t count, loff_t *pos)
+{
+	static const u8 endmark[LZ4F_ENDMARK_SIZE];
+	struct ramdump_device *rd_dev = entry->rd_dev;
+	struct ramdump_lz4_stream *st;
+	struct ramdump_lz4_slot *slot = NULL;
+	size_t copied = 0, len, n;
+	const void *src;
+	int ret = 0;
+
+	mutex_lock(&rd_dev->lz4_lock);
+	st = rd_dev->lz4;
+	if (!st) {
+		ret = -EPIPE;
+		goto ramdump_done;
+	}
+
+	while (count) {
+		if (st->cur == 0) {
+			src = st->hdr;
+			len = sizeof(st->hdr);
+		} else if (st->cur <= st->nblocks) {
+			slot = &st->slots[(st->cur - 1) % st->nslots];
+			ret = wait_for_completion_interruptible(&slot->done);
+			if (ret)
+				break;
+			if (slot->err) {
+				ret = slot->err;
+				rd_dev->ramdump_status = -1;
+				goto ramdump_done;
+			}
+			src = slot->out;
+			len = slot->out_len;
+		} else if (st->cur == st->nblocks + 1) {
+			src = endmark;
+			len = sizeof(endmark);
+		} else {
+			break;
+		}
+
+		n = min(len - st->cur_off, count);
+		if (copy_to_user(buf, src + st->cur_off, n)) {
+			pr_err("Ramdump(%s): Couldn't copy all data to user.",
+				rd_dev->name);
+			rd_dev->ramdump_status = -1;
+			ret = -EFAULT;
+			goto ramdump_done;
+		}
+		buf += n;
+		count -= n;
+		copied += n;
+		st->cur_off += n;
+		if (st->cur_off < len)
+			continue;
+
+		/* Done with this piece, reuse its slot further ahead */
+		if (st->cur && st->cur <= st->nblocks &&
+		    st->cur - 1 + st->nslots < st->nblocks)
+			ramdump_lz4_queue(st, st->cur - 1 + st->nslots);
+		st->cur++;
+		st->cur_off = 0;
+	}
+
+	if (copied) {
+		*pos += copied;
+		mutex_unlock(&rd_dev->lz4_lock);
+		return copied;
+	}
+	if (ret) {
+		/* Interrupted, the stream picks up where it left off */
+		mutex_unlock(&rd_dev->lz4_lock);
+		return ret;
+	}
+
+	pr_debug("Ramdump(%s): Ramdump complete. %lld bytes read.",
+		 rd_dev->name, *pos);
+	rd_dev->ramdump_status = 0;
+
+ramdump_done:
+	mutex_unlock(&rd_dev->lz4_lock);
+	*pos = 0;
+	reset_ramdump_entry(entry);
+	return ret;
+}
+#else
+static bool compress;
+
+static int ramdump_lz4_start(struct ramdump_device *rd_dev)
+{
+	return -ENODEV;
+}
+
+static void ramdump_lz4_stop(struct ramdump_device *rd_dev)
+{
+}
+
+static ssize_t ramdump_read_lz4(struct consumer_entry *entry,
+				char __user *buf, size_t count, loff_t *pos)
+{
+	return -EINVAL;
+}
+#endif /* CONFIG_MSM_RAMDUMP_COMPRESS */
+
 static unsigned int ramdump_poll(struct file *filep,
 					struct poll_table_struct *wait)
 {
@@ -374,6 +727,7 @@ void *create_ramdump_device(const char *dev_name, struct device *parent)
 	}
 
 	mutex_init(&rd_dev->consumer_lock);
+	mutex_init(&rd_dev->lz4_lock);
 	atomic_set(&rd_dev->readers_left, 0);
 	cdev_init(&rd_dev->cdev, &ramdump_file_ops);
 
@@ -484,6 +838,18 @@ static int _do_ramdump(void *handle, struct ramdump_segment *segments,
 		}
 	}
 
+	/*
+	 * The compressed stream has a single read cursor, so it is only
+	 * used when there is one reader.  Fall back to the plain dump if
+	 * it cannot be set up.
+	 */
+	if (compress && rd_dev->consumers == 1) {
+		ret = ramdump_lz4_start(rd_dev);
+		if (ret)
+			pr_warn("Ramdump(%s): compression unavailable (%d)\n",
+				rd_dev->name, ret);
+	}
+
 	list_for_each_entry(entry, &rd_dev->consumer_list, list)
 		entry->data_ready = true;
 	rd_dev->ramdump_status = -1;
@@ -506,6 +872,7 @@ static int _do_ramdump(void *handle, struct ramdump_segment *segments,
 	} else
 		ret = (rd_dev->ramdump_status == 0) ? 0 : -EPIPE;
 
+	ramdump_lz4_stop(rd_dev);
 	rd_dev->elfcore_size = 0;
 	kfree(rd_dev->elfcore_buf);
 	rd_dev->elfcore_buf = NULL;
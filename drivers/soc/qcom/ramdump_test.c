@@ -0,0 +1,352 @@
+/* Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Ramdump throughput test: dumps a synthetic list of vmalloc()ed
+ * segments with do_elf_ramdump(), reads the dump back from the device
+ * node like a collector would, reports the throughput and checks every
+ * byte of it.  Compressed dumps (ramdump.compress=1) are decompressed
+ * block by block for the check.  The module always fails to load once
+ * the test is done.
+ *
+ * A large nr_segs, e.g. nr_segs=40000 seg_kb=4, makes the ELF header
+ * span several compressed blocks.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/fs.h>
+#include <linux/elf.h>
+#include <linux/ktime.h>
+#include <linux/random.h>
+#include <linux/crypto.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/sizes.h>
+#include <asm/unaligned.h>
+#include <soc/qcom/ramdump.h>
+
+static unsigned int nr_segs = 16;
+module_param(nr_segs, uint, 0444);
+MODULE_PARM_DESC(nr_segs, "Number of segments");
+
+static unsigned int seg_kb = 4096;
+module_param(seg_kb, uint, 0444);
+MODULE_PARM_DESC(seg_kb, "Size of each segment in KiB");
+
+static char *devnode = "/dev/ramdump_test";
+module_param(devnode, charp, 0444);
+MODULE_PARM_DESC(devnode, "Device node of the test ramdump device");
+
+#define LZ4F_MAGIC		0x184D2204
+#define LZ4F_HDR_SIZE		15
+#define LZ4F_BLOCK_RAW		0x80000000
+#define LZ4F_BLOCK_MAX		SZ_1M
+
+struct ramdump_test {
+	void *handle;
+	struct ramdump_segment *segs;
+	unsigned long seg_size;
+	struct completion done;
+	int dump_ret;
+
+	/* what was read, and how far the check has got */
+	u8 *hdr;
+	size_t hdr_size;
+	u64 checked;
+	bool bad;
+};
+
+static int ramdump_test_dumper(void *data)
+{
+	struct ramdump_test *t = data;
+
+	t->dump_ret = do_elf_ramdump(t->handle, t->segs, nr_segs);
+	complete_and_exit(&t->done, 0);
+}
+
+/* check @len bytes of the uncompressed dump at the current offset */
+static void ramdump_test_check(struct ramdump_test *t, const u8 *data,
+			       size_t len)
+{
+	size_t n;
+	u64 off;
+	int seg;
+
+	while (len && !t->bad) {
+		if (t->checked < t->hdr_size) {
+			n = min_t(size_t, len, t->hdr_size - t->checked);
+			memcpy(t->hdr + t->checked, data, n);
+		} else {
+			off = t->checked - t->hdr_size;
+			seg = div64_u64(off, t->seg_size);
+			off -= (u64)seg * t->seg_size;
+			if (seg >= nr_segs) {
+				pr_err("dump longer than expected\n");
+				t->bad = true;
+				return;
+			}
+			n = min_t(size_t, len, t->seg_size - off);
+			if (memcmp(data, t->segs[seg].v_address + off, n)) {
+				pr_err("segment %d differs near offset %llu\n",
+				       seg, off);
+				t->bad = true;
+				return;
+			}
+		}
+		t->checked += n;
+		data += n;
+		len -= n;
+	}
+}
+
+static int ramdump_test_check_hdr(struct ramdump_test *t)
+{
+	Elf32_Ehdr *ehdr = (Elf32_Ehdr *)t->hdr;
+	Elf32_Phdr *phdr = (Elf32_Phdr *)(ehdr + 1);
+	unsigned long offset = t->hdr_size;
+	int i;
+
+	if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) ||
+	    ehdr->e_phnum != (u16)nr_segs) {
+		pr_err("bad ELF header\n");
+		return -EINVAL;
+	}
+
+	for (i = 0; i < nr_segs; i++, phdr++) {
+		if (phdr->p_offset != offset ||
+		    phdr->p_filesz != t->seg_size ||
+		    phdr->p_paddr != t->segs[i].address) {
+			pr_err("bad program header %d\n", i);
+			return -EINVAL;
+		}
+		offset += t->seg_size;
+	}
+
+	return 0;
+}
+
+/* decompress the LZ4 frame in @buf and check its content */
+static int ramdump_test_check_lz4(struct ramdump_test *t, const u8 *buf,
+				  size_t len, u64 total)
+{
+	struct crypto_comp *tfm;
+	unsigned int blen, dlen;
+	size_t pos = LZ4F_HDR_SIZE;
+	u8 *out;
+	u32 word;
+	int ret = 0;
+
+	if (len < LZ4F_HDR_SIZE || get_unaligned_le64(buf + 6) != total) {
+		pr_err("bad LZ4 frame header\n");
+		return -EINVAL;
+	}
+
+	tfm = crypto_alloc_comp("lz4", 0, 0);
+	if (IS_ERR(tfm))
+		return PTR_ERR(tfm);
+	out = vmalloc(LZ4F_BLOCK_MAX);
+	if (!out) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (;;) {
+		if (pos + 4 > len) {
+			pr_err("truncated LZ4 frame\n");
+			ret = -EINVAL;
+			break;
+		}
+		word = get_unaligned_le32(buf + pos);
+		pos += 4;
+		if (!word)
+			break;
+
+		blen = word & ~LZ4F_BLOCK_RAW;
+		if (blen > LZ4F_BLOCK_MAX || pos + blen > len) {
+			pr_err("bad LZ4 block size %u\n", blen);
+			ret = -EINVAL;
+			break;
+		}
+
+		if (word & LZ4F_BLOCK_RAW) {
+			ramdump_test_check(t, buf + pos, blen);
+		} else {
+			dlen = LZ4F_BLOCK_MAX;
+			if (crypto_comp_decompress(tfm, buf + pos, blen, out,
+						   &dlen)) {
+				pr_err("LZ4 block doesn't decompress\n");
+				ret = -EINVAL;
+				break;
+			}
+			ramdump_test_check(t, out, dlen);
+		}
+		pos += blen;
+	}
+
+	vfree(out);
+out:
+	crypto_free_comp(tfm);
+	return ret;
+}
+
+/*
+ * Half of each segment is a repeated pattern and half is random, which
+ * is roughly how compressible subsystem dumps are.
+ */
+static void ramdump_test_fill(struct ramdump_test *t, int seg)
+{
+	struct rnd_state rnd;
+	u32 *p = t->segs[seg].v_address;
+	unsigned long i, n = t->seg_size / sizeof(u32);
+
+	prandom_seed_state(&rnd, seg);
+	for (i = 0; i < n; i++) {
+		if ((i * sizeof(u32) / PAGE_SIZE) & 1)
+			p[i] = prandom_u32_state(&rnd);
+		else
+			p[i] = seg << 16 | (u32)(i % 64);
+	}
+}
+
+static int __init ramdump_test_init(void)
+{
+	struct ramdump_test *t;
+	struct task_struct *tsk;
+	struct file *file;
+	u64 total, ns;
+	size_t cap, len = 0;
+	ssize_t n;
+	loff_t pos = 0;
+	u8 *buf = NULL;
+	ktime_t start;
+	bool lz4;
+	int i, ret;
+
+	if (!nr_segs || nr_segs > U16_MAX || !seg_kb)
+		return -EINVAL;
+
+	t = kzalloc(sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return -ENOMEM;
+	init_completion(&t->done);
+	t->seg_size = (unsigned long)seg_kb * SZ_1K;
+	t->hdr_size = sizeof(Elf32_Ehdr) + nr_segs * sizeof(Elf32_Phdr);
+	total = t->hdr_size + (u64)nr_segs * t->seg_size;
+
+	ret = -ENOMEM;
+	t->segs = vzalloc(nr_segs * sizeof(*t->segs));
+	t->hdr = vmalloc(t->hdr_size);
+	/* worst case of the compressed frame: every block stored raw */
+	cap = total + 4 * (DIV_ROUND_UP(t->hdr_size, LZ4F_BLOCK_MAX) +
+			   nr_segs * DIV_ROUND_UP(t->seg_size, LZ4F_BLOCK_MAX)) +
+	      LZ4F_HDR_SIZE + 4 + 1;
+	buf = vmalloc(cap);
+	if (!t->segs || !t->hdr || !buf)
+		goto out;
+
+	for (i = 0; i < nr_segs; i++) {
+		t->segs[i].address = 0x80000000UL + i * t->seg_size;
+		t->segs[i].size = t->seg_size;
+		t->segs[i].v_address = vmalloc(t->seg_size);
+		if (!t->segs[i].v_address)
+			goto out;
+		ramdump_test_fill(t, i);
+	}
+
+	t->handle = create_ramdump_device("test", NULL);
+	if (IS_ERR_OR_NULL(t->handle)) {
+		ret = t->handle ? PTR_ERR(t->handle) : -ENODEV;
+		t->handle = NULL;
+		goto out;
+	}
+
+	/* the dump is only sent to readers that have the node open */
+	file = filp_open(devnode, O_RDONLY, 0);
+	if (IS_ERR(file)) {
+		ret = PTR_ERR(file);
+		pr_err("can't open %s: %d\n", devnode, ret);
+		goto out;
+	}
+
+	tsk = kthread_run(ramdump_test_dumper, t, "ramdump_test");
+	if (IS_ERR(tsk)) {
+		ret = PTR_ERR(tsk);
+		filp_close(file, NULL);
+		goto out;
+	}
+
+	/* the first read waits for the dump, don't time that */
+	n = kernel_read(file, buf, 1, &pos);
+	start = ktime_get();
+	while (n > 0) {
+		len += n;
+		n = kernel_read(file, buf + len,
+				min_t(size_t, cap - len, SZ_1M), &pos);
+		if (n > 0 && len + n == cap) {
+			pr_err("dump longer than expected\n");
+			n = -EFBIG;
+		}
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	filp_close(file, NULL);
+	wait_for_completion(&t->done);
+
+	if (n < 0 || t->dump_ret) {
+		pr_err("read %zu bytes, read error %zd, dump error %d\n", len,
+		       n, t->dump_ret);
+		ret = n < 0 ? n : t->dump_ret;
+		goto out;
+	}
+
+	lz4 = len >= 4 && get_unaligned_le32(buf) == LZ4F_MAGIC;
+	if (lz4 && IS_ENABLED(CONFIG_MSM_RAMDUMP_COMPRESS))
+		ret = ramdump_test_check_lz4(t, buf, len, total);
+	else
+		ramdump_test_check(t, buf, len);
+
+	if (!ret && (t->bad || t->checked != total)) {
+		pr_err("checked %llu of %llu bytes\n", t->checked, total);
+		ret = -EINVAL;
+	}
+	if (!ret)
+		ret = ramdump_test_check_hdr(t);
+	if (ret)
+		goto out;
+
+	pr_info("%s: %u segments, %llu bytes dumped as %zu in %llu ms, %llu MB/s\n",
+		lz4 ? "lz4" : "plain", nr_segs, total, len,
+		div_u64(ns, NSEC_PER_MSEC),
+		ns ? div64_u64(total * NSEC_PER_SEC, ns) >> 20 : 0);
+	ret = -EAGAIN;
+
+out:
+	if (t->handle)
+		destroy_ramdump_device(t->handle);
+	if (t->segs) {
+		for (i = 0; i < nr_segs; i++)
+			vfree(t->segs[i].v_address);
+	}
+	vfree(t->segs);
+	vfree(t->hdr);
+	vfree(buf);
+	kfree(t);
+	return ret;
+}
+module_init(ramdump_test_init);
+
+MODULE_DESCRIPTION("Ramdump throughput test");
+MODULE_LICENSE("GPL v2");
@@ -13,12 +13,161 @@
 
 #include <linux/init.h>
 #include <linux/cpu.h>
+#include <linux/cpufreq.h>
+#include <linux/fs.h>
 #include <linux/kobject.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/sched/stat.h>
 #include <linux/sysfs.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
 #include <linux/rq_stats.h>
+#include <uapi/linux/rq_stats.h>
 
 #define MAX_LONG_SIZE 24
 #define DEFAULT_DEF_TIMER_JIFFIES 5
+#define DEFAULT_STATS_PERIOD_MS 10
+
+/*
+ * Shared statistics page behind /dev/rq_stats, see uapi/linux/rq_stats.h.
+ * It is only refreshed while somebody has it mapped.
+ */
+static struct rq_stats_page *stats_page;
+static size_t stats_size;
+static unsigned int stats_period_ms = DEFAULT_STATS_PERIOD_MS;
+static atomic_t stats_mapped = ATOMIC_INIT(0);
+static DEFINE_MUTEX(stats_lock);
+
+static void stats_work_fn(struct work_struct *work);
+static DECLARE_DEFERRABLE_WORK(stats_work, stats_work_fn);
+
+static void update_stats_page(void)
+{
+	struct rq_stats_page *page = stats_page;
+	struct sched_nr_sum sum;
+	int cpu;
+
+	lockdep_assert_held(&stats_lock);
+
+	WRITE_ONCE(page->seq, page->seq + 1);
+	smp_wmb();
+
+	page->period_ms = stats_period_ms;
+	for_each_possible_cpu(cpu) {
+		struct rq_stats_cpu *c = &page->cpu[cpu];
+
+		sched_get_nr_running_sum(cpu, &sum);
+		c->time_ns = sum.time;
+		c->nr_sum = sum.nr;
+		c->nr_big_sum = sum.nr_big;
+		c->nr_running = sum.nr_running;
+		c->busy_pct = sched_get_cpu_util(cpu);
+		c->cur_freq = cpufreq_quick_get(cpu);
+		c->online = cpu_online(cpu);
+	}
+
+	smp_wmb();
+	WRITE_ONCE(page->seq, page->seq + 1);
+}
+
+static void stats_work_fn(struct work_struct *work)
+{
+	if (!atomic_read(&stats_mapped))
+		return;
+
+	mutex_lock(&stats_lock);
+	update_stats_page();
+	mutex_unlock(&stats_lock);
+
+	queue_delayed_work(system_power_efficient_wq, &stats_work,
+			   msecs_to_jiffies(stats_period_ms));
+}
+
+static void stats_vm_open(struct vm_area_struct *vma)
+{
+	if (atomic_inc_return(&stats_mapped) == 1)
+		mod_delayed_work(system_power_efficient_wq, &stats_work, 0);
+}
+
+static void stats_vm_close(struct vm_area_struct *vma)
+{
+	atomic_dec(&stats_mapped);
+}
+
+static const struct vm_operations_struct stats_vm_ops = {
+	.open = stats_vm_open,
+	.close = stats_vm_close,
+};
+
+static int rq_stats_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	int ret;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	ret = remap_vmalloc_range(vma, stats_page, vma->vm_pgoff);
+	if (ret)
+		return ret;
+
+	vma->vm_ops = &stats_vm_ops;
+	stats_vm_open(vma);
+	return 0;
+}
+
+static ssize_t rq_stats_read(struct file *file, char __user *buf,
+			     size_t count, loff_t *ppos)
+{
+	ssize_t ret;
+
+	mutex_lock(&stats_lock);
+	if (!*ppos && !atomic_read(&stats_mapped))
+		update_stats_page();
+	ret = simple_read_from_buffer(buf, count, ppos, stats_page,
+				      stats_size);
+	mutex_unlock(&stats_lock);
+
+	return ret;
+}
+
+static const struct file_operations rq_stats_fops = {
+	.owner = THIS_MODULE,
+	.read = rq_stats_read,
+	.mmap = rq_stats_mmap,
+	.llseek = default_llseek,
+};
+
+static struct miscdevice rq_stats_misc = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "rq_stats",
+	.fops = &rq_stats_fops,
+	.mode = 0444,
+};
+
+static int init_rq_stats_page(void)
+{
+	int err;
+
+	stats_size = sizeof(*stats_page) +
+		     nr_cpu_ids * sizeof(stats_page->cpu[0]);
+	stats_page = vmalloc_user(PAGE_ALIGN(stats_size));
+	if (!stats_page)
+		return -ENOMEM;
+
+	stats_page->version = RQ_STATS_VERSION;
+	stats_page->nr_cpus = nr_cpu_ids;
+	stats_page->period_ms = stats_period_ms;
+
+	err = misc_register(&rq_stats_misc);
+	if (err) {
+		vfree(stats_page);
+		stats_page = NULL;
+	}
+
+	return err;
+}
 
 static void def_work_fn(struct work_struct *work)
 {
@@ -57,8 +206,31 @@ static struct kobj_attribute def_timer_ms_attr =
 	__ATTR(def_timer_ms, 0600, show_def_timer_ms,
 			store_def_timer_ms);
 
+static ssize_t show_stats_period_ms(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	return snprintf(buf, MAX_LONG_SIZE, "%u\n", stats_period_ms);
+}
+
+static ssize_t store_stats_period_ms(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	unsigned int val = 0;
+
+	if (kstrtouint(buf, 0, &val) || !val)
+		return -EINVAL;
+
+	stats_period_ms = val;
+	return count;
+}
+
+static struct kobj_attribute stats_period_ms_attr =
+	__ATTR(stats_period_ms, 0600, show_stats_period_ms,
+			store_stats_period_ms);
+
 static struct attribute *rq_attrs[] = {
 	&def_timer_ms_attr.attr,
+	&stats_period_ms_attr.attr,
 	NULL,
 };
 
@@ -104,6 +276,8 @@ static int __init msm_rq_stats_init(void)
 	rq_info.def_timer_jiffies = DEFAULT_DEF_TIMER_JIFFIES;
 	rq_info.def_timer_last_jiffy = 0;
 	ret = init_rq_attribs();
+	if (init_rq_stats_page())
+		pr_warn("rq_stats: shared statistics page unavailable\n");
 
 	rq_info.init = 1;
 
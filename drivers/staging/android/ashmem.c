@@ -31,6 +31,8 @@
 #include <linux/personality.h>
 #include <linux/bitops.h>
 #include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
 #include <linux/shmem_fs.h>
 #include "ashmem.h"
 
@@ -38,6 +40,25 @@
 #define ASHMEM_NAME_PREFIX_LEN (sizeof(ASHMEM_NAME_PREFIX) - 1)
 #define ASHMEM_FULL_NAME_LEN (ASHMEM_NAME_LEN + ASHMEM_NAME_PREFIX_LEN)
 
+/*
+ * Unpinned ranges are kept on ASHMEM_LRU_SHARDS LRU lists rather than a
+ * single global one, so that pin and unpin on unrelated areas do not
+ * contend. All ranges of an area live on the same shard.
+ */
+#define ASHMEM_LRU_SHARDS	16
+
+/**
+ * struct ashmem_lru - One shard of the LRU of unpinned ranges
+ * @lock:	Protects @list, @count and the ranges on @list
+ * @list:	The ranges, least recently unpinned first
+ * @count:	The number of pages on @list
+ */
+struct ashmem_lru {
+	spinlock_t lock;
+	struct list_head list;
+	unsigned long count;
+} ____cacheline_aligned_in_smp;
+
 /**
  * struct ashmem_area - The anonymous shared memory area
  * @name:		The optional name in /proc/pid/maps
@@ -45,9 +66,12 @@
  * @file:		The shmem-based backing file
  * @size:		The size of the mapping, in bytes
  * @prot_mask:		The allowed protection bits, as vm_flags
+ * @lock:		Protects all of the above
+ * @lru:		The LRU shard of this area's unpinned ranges
+ * @purging:		Ranges of this area the shrinker is punching out
  *
  * The lifecycle of this structure is from our parent file's open() until
- * its release(). It is also protected by 'ashmem_mutex'
+ * its release().
  *
  * Warning: Mappings do NOT pin this structure; It dies on close()
  */
@@ -57,6 +81,10 @@ struct ashmem_area {
 	struct file *file;
 	size_t size;
 	unsigned long prot_mask;
+	struct mutex lock;
+	struct ashmem_lru *lru;
+	atomic_t purging;
+	struct ashmem_range *spare_range;
 };
 
 /**
@@ -69,7 +97,8 @@ struct ashmem_area {
  * @purged:	         The purge status (ASHMEM_NOT or ASHMEM_WAS_PURGED)
  *
  * The lifecycle of this structure is from unpin to pin.
- * It is protected by 'ashmem_mutex'
+ * It is protected by its area's 'lock' and, as the shrinker only takes
+ * the latter, by the area's LRU shard 'lock'.
  */
 struct ashmem_range {
 	struct list_head lru;
@@ -80,22 +109,18 @@ struct ashmem_range {
 	unsigned int purged;
 };
 
-/* LRU list of unpinned pages, protected by ashmem_mutex */
-static LIST_HEAD(ashmem_lru_list);
-
 /*
- * long lru_count - The count of pages on our LRU list.
+ * Lock Ordering: ashmem_area.lock -> ashmem_lru.lock
+ *		  ashmem_area.lock -> i_mutex -> i_alloc_sem
  *
- * This is protected by ashmem_mutex.
+ * The shrinker takes no area lock: it unlinks a range from its shard and
+ * punches the hole with no lock held, counted in the area's 'purging'.
+ * Pinning waits for those to finish, and so does release() before the
+ * area is freed; ashmem_purge_wait is woken when a count drops to zero.
  */
-static unsigned long lru_count;
-
-/*
- * ashmem_mutex - protects the list of and each individual ashmem_area
- *
- * Lock Ordering: ashmex_mutex -> i_mutex -> i_alloc_sem
- */
-static DEFINE_MUTEX(ashmem_mutex);
+static struct ashmem_lru ashmem_lru[ASHMEM_LRU_SHARDS];
+static atomic_t ashmem_lru_next = ATOMIC_INIT(0);
+static DECLARE_WAIT_QUEUE_HEAD(ashmem_purge_wait);
 
 static struct kmem_cache *ashmem_area_cachep __read_mostly;
 static struct kmem_cache *ashmem_range_cachep __read_mostly;
@@ -154,50 +179,54 @@ static inline bool range_before_page(struct ashmem_range *range, size_t page)
  * lru_add() - Adds a range of memory to the LRU list
  * @range:     The memory range being added.
  *
- * The range is first added to the end (tail) of the LRU list.
- * After this, the size of the range is added to @lru_count
+ * The range is first added to the end (tail) of its area's LRU shard.
+ * After this, the size of the range is added to the shard's count.
+ * Caller must hold the shard lock.
  */
 static inline void lru_add(struct ashmem_range *range)
 {
-	list_add_tail(&range->lru, &ashmem_lru_list);
-	lru_count += range_size(range);
+	struct ashmem_lru *lru = range->asma->lru;
+
+	list_add_tail(&range->lru, &lru->list);
+	lru->count += range_size(range);
 }
 
 /**
  * lru_del() - Removes a range of memory from the LRU list
  * @range:     The memory range being removed
  *
- * The range is first deleted from the LRU list.
- * After this, the size of the range is removed from @lru_count
+ * The range is first deleted from its LRU shard.
+ * After this, the size of the range is removed from the shard's count.
+ * Caller must hold the shard lock.
  */
 static inline void lru_del(struct ashmem_range *range)
 {
+	struct ashmem_lru *lru = range->asma->lru;
+
 	list_del(&range->lru);
-	lru_count -= range_size(range);
+	lru->count -= range_size(range);
 }
 
 /**
- * range_alloc() - Allocates and initializes a new ashmem_range structure
+ * range_alloc() - Initializes a new ashmem_range structure
  * @asma:	   The associated ashmem_area
  * @prev_range:	   The previous ashmem_range in the sorted asma->unpinned list
  * @purged:	   Initial purge status (ASMEM_NOT_PURGED or ASHMEM_WAS_PURGED)
  * @start:	   The starting page (inclusive)
  * @end:	   The ending page (inclusive)
+ * @new_range:	   The placeholder for the new range, the area's spare or
+ *		   allocated by the caller; cleared once consumed
  *
- * This function is protected by ashmem_mutex.
- *
- * Return: 0 if successful, or -ENOMEM if there is an error
+ * Caller must hold the area lock and its LRU shard lock.
  */
-static int range_alloc(struct ashmem_area *asma,
-		       struct ashmem_range *prev_range, unsigned int purged,
-		       size_t start, size_t end)
+static void range_alloc(struct ashmem_area *asma,
+			struct ashmem_range *prev_range, unsigned int purged,
+			size_t start, size_t end,
+			struct ashmem_range **new_range)
 {
-	struct ashmem_range *range;
-
-	range = kmem_cache_zalloc(ashmem_range_cachep, GFP_KERNEL);
-	if (unlikely(!range))
-		return -ENOMEM;
+	struct ashmem_range *range = *new_range;
 
+	*new_range = NULL;
 	range->asma = asma;
 	range->pgstart = start;
 	range->pgend = end;
@@ -207,8 +236,6 @@ static int range_alloc(struct ashmem_area *asma,
 
 	if (range_on_lru(range))
 		lru_add(range);
-
-	return 0;
 }
 
 /**
@@ -223,6 +250,25 @@ static void range_del(struct ashmem_range *range)
 	kmem_cache_free(ashmem_range_cachep, range);
 }
 
+/**
+ * range_recycle() - Deletes an ashmem_range, keeping it as the spare
+ * @range:	     The associated ashmem_range that has previously been allocated
+ * @spare:	     The caller's spare range, freed instead if already set
+ */
+static void range_recycle(struct ashmem_range *range,
+			  struct ashmem_range **spare)
+{
+	if (*spare) {
+		range_del(range);
+		return;
+	}
+
+	list_del(&range->unpinned);
+	if (range_on_lru(range))
+		lru_del(range);
+	*spare = range;
+}
+
 /**
  * range_shrink() - Shrinks an ashmem_range
  * @range:	    The associated ashmem_range being shrunk
@@ -233,7 +279,7 @@ static void range_del(struct ashmem_range *range)
  * simply shrinks the boundaries of the range.
  *
  * Theoretically, with a little tweaking, this could eventually be changed
- * to range_resize, and expand the lru_count if the new range is larger.
+ * to range_resize, and expand the LRU count if the new range is larger.
  */
 static inline void range_shrink(struct ashmem_range *range,
 				size_t start, size_t end)
@@ -244,7 +290,7 @@ static inline void range_shrink(struct ashmem_range *range,
 	range->pgend = end;
 
 	if (range_on_lru(range))
-		lru_count -= pre - range_size(range);
+		range->asma->lru->count -= pre - range_size(range);
 }
 
 /**
@@ -273,6 +319,10 @@ static int ashmem_open(struct inode *inode, struct file *file)
 	INIT_LIST_HEAD(&asma->unpinned_list);
 	memcpy(asma->name, ASHMEM_NAME_PREFIX, ASHMEM_NAME_PREFIX_LEN);
 	asma->prot_mask = PROT_MASK;
+	mutex_init(&asma->lock);
+	asma->lru = &ashmem_lru[(unsigned int)atomic_inc_return(&ashmem_lru_next) %
+				ASHMEM_LRU_SHARDS];
+	atomic_set(&asma->purging, 0);
 	file->private_data = asma;
 
 	return 0;
@@ -291,13 +341,18 @@ static int ashmem_release(struct inode *ignored, struct file *file)
 	struct ashmem_area *asma = file->private_data;
 	struct ashmem_range *range, *next;
 
-	mutex_lock(&ashmem_mutex);
+	spin_lock(&asma->lru->lock);
 	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned)
 		range_del(range);
-	mutex_unlock(&ashmem_mutex);
+	spin_unlock(&asma->lru->lock);
+
+	/* the shrinker may still be punching a range it took off the LRU */
+	wait_event(ashmem_purge_wait, !atomic_read(&asma->purging));
 
 	if (asma->file)
 		fput(asma->file);
+	if (asma->spare_range)
+		kmem_cache_free(ashmem_range_cachep, asma->spare_range);
 	kmem_cache_free(ashmem_area_cachep, asma);
 
 	return 0;
@@ -308,7 +363,7 @@ static ssize_t ashmem_read_iter(struct kiocb *iocb, struct iov_iter *iter)
 	struct ashmem_area *asma = iocb->ki_filp->private_data;
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->lock);
 
 	/* If size is not set, or set to 0, always return EOF. */
 	if (asma->size == 0)
@@ -325,13 +380,13 @@ static ssize_t ashmem_read_iter(struct kiocb *iocb, struct iov_iter *iter)
 	 * be destroyed until all references to the file are dropped and
 	 * ashmem_release is called.
 	 */
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->lock);
 	ret = vfs_iter_read(asma->file, iter, &iocb->ki_pos, 0);
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->lock);
 	if (ret > 0)
 		asma->file->f_pos = iocb->ki_pos;
 out_unlock:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->lock);
 	return ret;
 }
 
@@ -340,19 +395,19 @@ static loff_t ashmem_llseek(struct file *file, loff_t offset, int origin)
 	struct ashmem_area *asma = file->private_data;
 	int ret;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->lock);
 
 	if (asma->size == 0) {
-		mutex_unlock(&ashmem_mutex);
+		mutex_unlock(&asma->lock);
 		return -EINVAL;
 	}
 
 	if (!asma->file) {
-		mutex_unlock(&ashmem_mutex);
+		mutex_unlock(&asma->lock);
 		return -EBADF;
 	}
 
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->lock);
 
 	ret = vfs_llseek(asma->file, offset, origin);
 	if (ret < 0)
@@ -390,7 +445,7 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	struct ashmem_area *asma = file->private_data;
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->lock);
 
 	/* user needs to SET_SIZE before mapping */
 	if (unlikely(!asma->size)) {
@@ -455,7 +510,7 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	}
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->lock);
 	return ret;
 }
 
@@ -471,48 +526,79 @@ out:
  *
  * We approximate LRU via least-recently-unpinned, jettisoning unpinned partial
  * chunks of ashmem regions LRU-wise one-at-a-time until we hit 'nr_to_scan'
- * pages freed.
+ * pages freed. The shards are visited round robin, oldest range first.
+ *
+ * A range is marked purged and unlinked from its shard under the shard
+ * lock only; the hole is punched with no lock held, so pin and unpin on
+ * other areas, and on other ranges of the same area, are not held up.
  */
 static unsigned long
 ashmem_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 {
-	struct ashmem_range *range, *next;
+	static atomic_t next_shard = ATOMIC_INIT(0);
+	unsigned int shard, empty = 0;
 	unsigned long freed = 0;
 
 	/* We might recurse into filesystem code, so bail out if necessary */
 	if (!(sc->gfp_mask & __GFP_FS))
 		return SHRINK_STOP;
 
-	if (!mutex_trylock(&ashmem_mutex))
-		return -1;
-
-	list_for_each_entry_safe(range, next, &ashmem_lru_list, lru) {
-		loff_t start = range->pgstart * PAGE_SIZE;
-		loff_t end = (range->pgend + 1) * PAGE_SIZE;
+	shard = atomic_inc_return(&next_shard);
+	while (empty < ASHMEM_LRU_SHARDS) {
+		struct ashmem_lru *lru = &ashmem_lru[shard++ % ASHMEM_LRU_SHARDS];
+		struct ashmem_range *range;
+		struct ashmem_area *asma;
+		struct file *f;
+		loff_t start, end;
+
+		spin_lock(&lru->lock);
+		range = list_first_entry_or_null(&lru->list,
+						 struct ashmem_range, lru);
+		if (!range) {
+			spin_unlock(&lru->lock);
+			empty++;
+			continue;
+		}
+		empty = 0;
 
-		range->asma->file->f_op->fallocate(range->asma->file,
-				FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
-				start, end - start);
+		asma = range->asma;
+		start = range->pgstart * PAGE_SIZE;
+		end = (range->pgend + 1) * PAGE_SIZE;
+		f = get_file(asma->file);
+		atomic_inc(&asma->purging);
 		range->purged = ASHMEM_WAS_PURGED;
 		lru_del(range);
+		spin_unlock(&lru->lock);
+
+		f->f_op->fallocate(f, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+				   start, end - start);
+		fput(f);
+		/* asma may be freed as soon as this drops to zero */
+		if (atomic_dec_and_test(&asma->purging))
+			wake_up_all(&ashmem_purge_wait);
 
-		freed += range_size(range);
+		freed += (end - start) >> PAGE_SHIFT;
 		if (--sc->nr_to_scan <= 0)
 			break;
 	}
-	mutex_unlock(&ashmem_mutex);
 	return freed;
 }
 
 static unsigned long
 ashmem_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
 {
+	unsigned long count = 0;
+	int i;
+
 	/*
-	 * note that lru_count is count of pages on the lru, not a count of
+	 * note that the count is count of pages on the lru, not a count of
 	 * objects on the list. This means the scan function needs to return the
 	 * number of pages freed, not the number of objects scanned.
 	 */
-	return lru_count;
+	for (i = 0; i < ASHMEM_LRU_SHARDS; i++)
+		count += READ_ONCE(ashmem_lru[i].count);
+
+	return count;
 }
 
 static struct shrinker ashmem_shrinker = {
@@ -529,7 +615,7 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->lock);
 
 	/* the user can only remove, not add, protection bits */
 	if (unlikely((asma->prot_mask & prot) != prot)) {
@@ -544,7 +630,7 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 	asma->prot_mask = prot;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->lock);
 	return ret;
 }
 
@@ -555,10 +641,10 @@ static int set_name(struct ashmem_area *asma, void __user *name)
 	char local_name[ASHMEM_NAME_LEN];
 
 	/*
-	 * Holding the ashmem_mutex while doing a copy_from_user might cause
+	 * Holding the area lock while doing a copy_from_user might cause
 	 * an data abort which would try to access mmap_sem. If another
 	 * thread has invoked ashmem_mmap then it will be holding the
-	 * semaphore and will be waiting for ashmem_mutex, there by leading to
+	 * semaphore and will be waiting for the area lock, there by leading to
 	 * deadlock. We'll release the mutex  and take the name to a local
 	 * variable that does not need protection and later copy the local
 	 * variable to the structure member with lock held.
@@ -568,14 +654,14 @@ static int set_name(struct ashmem_area *asma, void __user *name)
 		return len;
 	if (len == ASHMEM_NAME_LEN)
 		local_name[ASHMEM_NAME_LEN - 1] = '\0';
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->lock);
 	/* cannot change an existing mapping's name */
 	if (unlikely(asma->file))
 		ret = -EINVAL;
 	else
 		strcpy(asma->name + ASHMEM_NAME_PREFIX_LEN, local_name);
 
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->lock);
 	return ret;
 }
 
@@ -591,7 +677,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 	 */
 	char local_name[ASHMEM_NAME_LEN];
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->lock);
 	if (asma->name[ASHMEM_NAME_PREFIX_LEN] != '\0') {
 		/*
 		 * Copying only `len', instead of ASHMEM_NAME_LEN, bytes
@@ -603,7 +689,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 		len = sizeof(ASHMEM_NAME_DEF);
 		memcpy(local_name, ASHMEM_NAME_DEF, len);
 	}
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->lock);
 
 	/*
 	 * Now we are just copying from the stack variable to userland
@@ -617,10 +703,14 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 /*
  * ashmem_pin - pin the given ashmem region, returning whether it was
  * previously purged (ASHMEM_WAS_PURGED) or not (ASHMEM_NOT_PURGED).
+ * Deleted ranges are kept in @new_range if it's empty.  Returns -EAGAIN,
+ * without changing anything, if a range has to be split and @new_range
+ * is empty.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold the area lock and its LRU shard lock.
  */
-static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
+static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend,
+		      struct ashmem_range **new_range)
 {
 	struct ashmem_range *range, *next;
 	int ret = ASHMEM_NOT_PURGED;
@@ -650,7 +740,7 @@ static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 
 			/* Case #1: Easy. Just nuke the whole thing. */
 			if (page_range_subsumes_range(range, pgstart, pgend)) {
-				range_del(range);
+				range_recycle(range, new_range);
 				continue;
 			}
 
@@ -671,9 +761,12 @@ static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 			 * Case #4: We eat a chunk out of the middle. A bit
 			 * more complicated, we allocate a new range for the
 			 * second half and adjust the first chunk's endpoint.
+			 * No other range overlaps, nothing was changed yet.
 			 */
+			if (!*new_range)
+				return -EAGAIN;
 			range_alloc(asma, range, range->purged,
-				    pgend + 1, range->pgend);
+				    pgend + 1, range->pgend, new_range);
 			range_shrink(range, range->pgstart, pgstart - 1);
 			break;
 		}
@@ -684,10 +777,13 @@ static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 
 /*
  * ashmem_unpin - unpin the given range of pages. Returns zero on success.
+ * Merged ranges are reused for the new one.  Returns -EAGAIN, without
+ * changing anything, if a range is needed and @new_range is empty.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold the area lock and its LRU shard lock.
  */
-static int ashmem_unpin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
+static int ashmem_unpin(struct ashmem_area *asma, size_t pgstart, size_t pgend,
+			struct ashmem_range **new_range)
 {
 	struct ashmem_range *range, *next;
 	unsigned int purged = ASHMEM_NOT_PURGED;
@@ -708,19 +804,22 @@ restart:
 			pgstart = min(range->pgstart, pgstart);
 			pgend = max(range->pgend, pgend);
 			purged |= range->purged;
-			range_del(range);
+			range_recycle(range, new_range);
 			goto restart;
 		}
 	}
 
-	return range_alloc(asma, range, purged, pgstart, pgend);
+	if (!*new_range)
+		return -EAGAIN;
+	range_alloc(asma, range, purged, pgstart, pgend, new_range);
+	return 0;
 }
 
 /*
  * ashmem_get_pin_status - Returns ASHMEM_IS_UNPINNED if _any_ pages in the
  * given interval are unpinned and ASHMEM_IS_PINNED otherwise.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold the area lock.
  */
 static int ashmem_get_pin_status(struct ashmem_area *asma, size_t pgstart,
 				 size_t pgend)
@@ -743,6 +842,7 @@ static int ashmem_get_pin_status(struct ashmem_area *asma, size_t pgstart,
 static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 			    void __user *p)
 {
+	struct ashmem_range *range;
 	struct ashmem_pin pin;
 	size_t pgstart, pgend;
 	int ret = -EINVAL;
@@ -750,7 +850,15 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 	if (unlikely(copy_from_user(&pin, p, sizeof(pin))))
 		return -EFAULT;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->lock);
+
+	/*
+	 * Pinning may split a range, unpinning may add one.  They use the
+	 * area's spare range, and give back the ones they delete, so an
+	 * unpin/pin cycle doesn't allocate.
+	 */
+	range = asma->spare_range;
+	asma->spare_range = NULL;
 
 	if (unlikely(!asma->file))
 		goto out_unlock;
@@ -771,20 +879,48 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 	pgstart = pin.offset / PAGE_SIZE;
 	pgend = pgstart + (pin.len / PAGE_SIZE) - 1;
 
+retry:
 	switch (cmd) {
 	case ASHMEM_PIN:
-		ret = ashmem_pin(asma, pgstart, pgend);
+		spin_lock(&asma->lru->lock);
+		ret = ashmem_pin(asma, pgstart, pgend, &range);
+		spin_unlock(&asma->lru->lock);
 		break;
 	case ASHMEM_UNPIN:
-		ret = ashmem_unpin(asma, pgstart, pgend);
+		spin_lock(&asma->lru->lock);
+		ret = ashmem_unpin(asma, pgstart, pgend, &range);
+		spin_unlock(&asma->lru->lock);
 		break;
 	case ASHMEM_GET_PIN_STATUS:
 		ret = ashmem_get_pin_status(asma, pgstart, pgend);
 		break;
 	}
 
+	/* no spare range and one is needed: allocate it and start over */
+	if (ret == -EAGAIN) {
+		range = kmem_cache_zalloc(ashmem_range_cachep, GFP_KERNEL);
+		if (likely(range))
+			goto retry;
+		ret = -ENOMEM;
+	}
+
 out_unlock:
-	mutex_unlock(&ashmem_mutex);
+	if (range && !asma->spare_range) {
+		asma->spare_range = range;
+		range = NULL;
+	}
+	mutex_unlock(&asma->lock);
+
+	/*
+	 * A range the shrinker took off the LRU is already reported as
+	 * purged, but its pages must be gone before the caller repopulates
+	 * them.
+	 */
+	if (cmd == ASHMEM_PIN && ret >= 0)
+		wait_event(ashmem_purge_wait, !atomic_read(&asma->purging));
+
+	if (range)
+		kmem_cache_free(ashmem_range_cachep, range);
 
 	return ret;
 }
@@ -803,12 +939,12 @@ static long ashmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		break;
 	case ASHMEM_SET_SIZE:
 		ret = -EINVAL;
-		mutex_lock(&ashmem_mutex);
+		mutex_lock(&asma->lock);
 		if (!asma->file) {
 			ret = 0;
 			asma->size = (size_t)arg;
 		}
-		mutex_unlock(&ashmem_mutex);
+		mutex_unlock(&asma->lock);
 		break;
 	case ASHMEM_GET_SIZE:
 		ret = asma->size;
@@ -878,7 +1014,12 @@ static struct miscdevice ashmem_misc = {
 
 static int __init ashmem_init(void)
 {
-	int ret = -ENOMEM;
+	int i, ret = -ENOMEM;
+
+	for (i = 0; i < ASHMEM_LRU_SHARDS; i++) {
+		spin_lock_init(&ashmem_lru[i].lock);
+		INIT_LIST_HEAD(&ashmem_lru[i].list);
+	}
 
 	ashmem_area_cachep = kmem_cache_create("ashmem_area_cache",
 					       sizeof(struct ashmem_area),
@@ -41,6 +41,7 @@
 #include <linux/cred.h>
 #include <linux/dax.h>
 #include <linux/uaccess.h>
+#include <linux/hashtable.h>
 #include <asm/param.h>
 #include <asm/page.h>
 
@@ -395,6 +396,300 @@ static unsigned long total_mapping_size(struct elf_phdr *cmds, int nr)
 				ELF_PAGESTART(cmds[first_idx].p_vaddr);
 }
 
+#ifdef CONFIG_BINFMT_ELF_CACHE
+/*
+ * Cache of parsed ELF headers for frequently executed binaries.
+ *
+ * Each entry remembers the ELF header, the program headers and, for
+ * dynamically linked binaries, the PT_INTERP path of one inode, so that
+ * repeated execs of the same file (sh, toybox, app_process, the dynamic
+ * linker itself) don't have to go through the filesystem read path again.
+ * Entries are keyed by superblock, inode number and generation and are
+ * only considered valid while the inode's size, mtime, ctime and, where
+ * the filesystem maintains it, i_version still match what was seen when
+ * the entry was filled in; writes are denied while the file is being
+ * exec'd, so this is enough to catch any local change.
+ *
+ * Files whose dentries need revalidation (NFS, FUSE, CIFS, ...) can be
+ * changed behind the kernel's back without these attributes being
+ * updated in time, so they are never cached.
+ */
+#define ELF_CACHE_HASH_BITS	6
+#define ELF_CACHE_MAX_ENTRIES	64
+
+struct elf_cache_entry {
+	struct hlist_node	hash;
+	struct list_head	lru;
+	struct super_block	*sb;
+	unsigned long		ino;
+	__u32			generation;
+	u64			version;
+	loff_t			size;
+	struct timespec		mtime;
+	struct timespec		ctime;
+	struct elfhdr		ehdr;
+	char			*interp;
+	loff_t			interp_off;
+	size_t			interp_len;
+	struct elf_phdr		phdata[0];
+};
+
+static DEFINE_HASHTABLE(elf_cache_hash, ELF_CACHE_HASH_BITS);
+static LIST_HEAD(elf_cache_lru);
+static DEFINE_SPINLOCK(elf_cache_lock);
+static unsigned int elf_cache_nr;
+
+static inline unsigned long elf_cache_key(struct inode *inode)
+{
+	return (unsigned long)inode->i_sb ^ inode->i_ino;
+}
+
+static bool elf_cache_stable(struct file *file)
+{
+	return !(file->f_path.dentry->d_flags & DCACHE_OP_REVALIDATE);
+}
+
+static bool elf_cache_match(struct elf_cache_entry *e, struct inode *inode)
+{
+	return e->sb == inode->i_sb && e->ino == inode->i_ino &&
+	       e->generation == inode->i_generation &&
+	       (!IS_I_VERSION(inode) || e->version == inode->i_version) &&
+	       e->size == i_size_read(inode) &&
+	       timespec_equal(&e->mtime, &inode->i_mtime) &&
+	       timespec_equal(&e->ctime, &inode->i_ctime);
+}
+
+static void elf_cache_free(struct elf_cache_entry *e)
+{
+	kfree(e->interp);
+	kfree(e);
+}
+
+static void elf_cache_unlink(struct elf_cache_entry *e)
+{
+	hash_del(&e->hash);
+	list_del(&e->lru);
+	elf_cache_nr--;
+}
+
+/*
+ * Look up the entry for @inode, dropping any stale entry for the same
+ * inode number along the way.  Called with elf_cache_lock held; a hit is
+ * moved to the head of the LRU.
+ */
+static struct elf_cache_entry *elf_cache_find(struct inode *inode,
+					      struct elf_cache_entry **stale)
+{
+	struct elf_cache_entry *e;
+
+	*stale = NULL;
+	hash_for_each_possible(elf_cache_hash, e, hash, elf_cache_key(inode)) {
+		if (e->sb != inode->i_sb || e->ino != inode->i_ino)
+			continue;
+		if (!elf_cache_match(e, inode)) {
+			elf_cache_unlink(e);
+			*stale = e;
+			return NULL;
+		}
+		list_move(&e->lru, &elf_cache_lru);
+		return e;
+	}
+	return NULL;
+}
+
+/*
+ * Returns a private copy of the cached program headers of @file if they
+ * were cached for the same header layout as @elf_ex, NULL otherwise.
+ */
+static struct elf_phdr *elf_cache_get_phdrs(struct file *file,
+					    struct elfhdr *elf_ex, int size)
+{
+	struct inode *inode = file_inode(file);
+	struct elf_cache_entry *e, *stale;
+	struct elf_phdr *elf_phdata = NULL;
+
+	if (!elf_cache_stable(file))
+		return NULL;
+
+	elf_phdata = kmalloc(size, GFP_KERNEL);
+	if (!elf_phdata)
+		return NULL;
+
+	spin_lock(&elf_cache_lock);
+	e = elf_cache_find(inode, &stale);
+	if (e && e->ehdr.e_phoff == elf_ex->e_phoff &&
+	    e->ehdr.e_phnum == elf_ex->e_phnum)
+		memcpy(elf_phdata, e->phdata, size);
+	else
+		e = NULL;
+	spin_unlock(&elf_cache_lock);
+
+	if (stale)
+		elf_cache_free(stale);
+	if (!e) {
+		kfree(elf_phdata);
+		elf_phdata = NULL;
+	}
+	return elf_phdata;
+}
+
+/* Remember the ELF and program headers just read from @file. */
+static void elf_cache_add(struct file *file, struct elfhdr *elf_ex,
+			  struct elf_phdr *elf_phdata, int size)
+{
+	struct inode *inode = file_inode(file);
+	struct elf_cache_entry *e, *old, *stale, *victim = NULL;
+
+	if (!elf_cache_stable(file))
+		return;
+
+	e = kmalloc(sizeof(*e) + size, GFP_KERNEL);
+	if (!e)
+		return;
+
+	e->sb = inode->i_sb;
+	e->ino = inode->i_ino;
+	e->generation = inode->i_generation;
+	e->version = inode->i_version;
+	e->size = i_size_read(inode);
+	e->mtime = inode->i_mtime;
+	e->ctime = inode->i_ctime;
+	e->ehdr = *elf_ex;
+	e->interp = NULL;
+	e->interp_off = 0;
+	e->interp_len = 0;
+	memcpy(e->phdata, elf_phdata, size);
+
+	spin_lock(&elf_cache_lock);
+	old = elf_cache_find(inode, &stale);
+	if (old) {
+		/* Somebody else raced us to it, or the layout changed. */
+		elf_cache_unlink(old);
+		stale = old;
+	}
+	hash_add(elf_cache_hash, &e->hash, elf_cache_key(inode));
+	list_add(&e->lru, &elf_cache_lru);
+	if (++elf_cache_nr > ELF_CACHE_MAX_ENTRIES) {
+		victim = list_last_entry(&elf_cache_lru,
+					 struct elf_cache_entry, lru);
+		elf_cache_unlink(victim);
+	}
+	spin_unlock(&elf_cache_lock);
+
+	if (stale)
+		elf_cache_free(stale);
+	if (victim)
+		elf_cache_free(victim);
+}
+
+/*
+ * Fill in @elf_ex with the cached ELF header of @file.  Used for the
+ * interpreter, whose header would otherwise be read on every exec.
+ */
+static bool elf_cache_get_ehdr(struct file *file, struct elfhdr *elf_ex)
+{
+	struct inode *inode = file_inode(file);
+	struct elf_cache_entry *e, *stale;
+
+	if (!elf_cache_stable(file))
+		return false;
+
+	spin_lock(&elf_cache_lock);
+	e = elf_cache_find(inode, &stale);
+	if (e)
+		*elf_ex = e->ehdr;
+	spin_unlock(&elf_cache_lock);
+
+	if (stale)
+		elf_cache_free(stale);
+	return e != NULL;
+}
+
+/* Copy the cached PT_INTERP path of @file described by @phdr to @buf. */
+static bool elf_cache_get_interp(struct file *file, struct elf_phdr *phdr,
+				 char *buf)
+{
+	struct inode *inode = file_inode(file);
+	struct elf_cache_entry *e, *stale;
+	bool found = false;
+
+	if (!elf_cache_stable(file))
+		return false;
+
+	spin_lock(&elf_cache_lock);
+	e = elf_cache_find(inode, &stale);
+	if (e && e->interp && e->interp_off == phdr->p_offset &&
+	    e->interp_len == phdr->p_filesz) {
+		memcpy(buf, e->interp, e->interp_len);
+		found = true;
+	}
+	spin_unlock(&elf_cache_lock);
+
+	if (stale)
+		elf_cache_free(stale);
+	return found;
+}
+
+static void elf_cache_set_interp(struct file *file, struct elf_phdr *phdr,
+				 const char *interp)
+{
+	struct inode *inode = file_inode(file);
+	struct elf_cache_entry *e, *stale;
+	char *copy;
+
+	if (!elf_cache_stable(file))
+		return;
+
+	copy = kmemdup(interp, phdr->p_filesz, GFP_KERNEL);
+	if (!copy)
+		return;
+
+	spin_lock(&elf_cache_lock);
+	e = elf_cache_find(inode, &stale);
+	if (e && !e->interp) {
+		e->interp = copy;
+		e->interp_off = phdr->p_offset;
+		e->interp_len = phdr->p_filesz;
+		copy = NULL;
+	}
+	spin_unlock(&elf_cache_lock);
+
+	if (stale)
+		elf_cache_free(stale);
+	kfree(copy);
+}
+#else
+static inline struct elf_phdr *elf_cache_get_phdrs(struct file *file,
+						   struct elfhdr *elf_ex,
+						   int size)
+{
+	return NULL;
+}
+
+static inline void elf_cache_add(struct file *file, struct elfhdr *elf_ex,
+				 struct elf_phdr *elf_phdata, int size)
+{
+}
+
+static inline bool elf_cache_get_ehdr(struct file *file,
+				      struct elfhdr *elf_ex)
+{
+	return false;
+}
+
+static inline bool elf_cache_get_interp(struct file *file,
+					struct elf_phdr *phdr, char *buf)
+{
+	return false;
+}
+
+static inline void elf_cache_set_interp(struct file *file,
+					struct elf_phdr *phdr,
+					const char *interp)
+{
+}
+#endif /* CONFIG_BINFMT_ELF_CACHE */
+
 /**
  * load_elf_phdrs() - load ELF program headers
  * @elf_ex:   ELF header of the binary whose program headers should be loaded
@@ -428,6 +723,10 @@ static struct elf_phdr *load_elf_phdrs(struct elfhdr *elf_ex,
 	if (size > ELF_MIN_ALIGN)
 		goto out;
 
+	elf_phdata = elf_cache_get_phdrs(elf_file, elf_ex, size);
+	if (elf_phdata)
+		return elf_phdata;
+
 	elf_phdata = kmalloc(size, GFP_KERNEL);
 	if (!elf_phdata)
 		goto out;
@@ -438,6 +737,7 @@ static struct elf_phdr *load_elf_phdrs(struct elfhdr *elf_ex,
 		err = (retval < 0) ? retval : -EIO;
 		goto out;
 	}
+	elf_cache_add(elf_file, elf_ex, elf_phdata, size);
 
 	/* Success! */
 	err = 0;
@@ -751,18 +1051,24 @@ static int load_elf_binary(struct linux_binprm *bprm)
 			if (!elf_interpreter)
 				goto out_free_ph;
 
-			pos = elf_ppnt->p_offset;
-			retval = kernel_read(bprm->file, elf_interpreter,
-					     elf_ppnt->p_filesz, &pos);
-			if (retval != elf_ppnt->p_filesz) {
-				if (retval >= 0)
-					retval = -EIO;
-				goto out_free_interp;
+			if (!elf_cache_get_interp(bprm->file, elf_ppnt,
+						  elf_interpreter)) {
+				pos = elf_ppnt->p_offset;
+				retval = kernel_read(bprm->file,
+						     elf_interpreter,
+						     elf_ppnt->p_filesz, &pos);
+				if (retval != elf_ppnt->p_filesz) {
+					if (retval >= 0)
+						retval = -EIO;
+					goto out_free_interp;
+				}
+				/* make sure path is NULL terminated */
+				retval = -ENOEXEC;
+				if (elf_interpreter[elf_ppnt->p_filesz - 1] != '\0')
+					goto out_free_interp;
+				elf_cache_set_interp(bprm->file, elf_ppnt,
+						     elf_interpreter);
 			}
-			/* make sure path is NULL terminated */
-			retval = -ENOEXEC;
-			if (elf_interpreter[elf_ppnt->p_filesz - 1] != '\0')
-				goto out_free_interp;
 
 			interpreter = open_exec(elf_interpreter);
 			retval = PTR_ERR(interpreter);
@@ -777,6 +1083,8 @@ static int load_elf_binary(struct linux_binprm *bprm)
 			would_dump(bprm, interpreter);
 
 			/* Get the exec headers */
+			if (elf_cache_get_ehdr(interpreter, &loc->interp_elf_ex))
+				break;
 			pos = 0;
 			retval = kernel_read(interpreter, &loc->interp_elf_ex,
 					     sizeof(loc->interp_elf_ex), &pos);
@@ -114,6 +114,7 @@
 #include <linux/dvb/video.h>
 
 #include <linux/sort.h>
+#include <linux/readdirplus.h>
 
 #ifdef CONFIG_SPARC
 #include <asm/fbio.h>
@@ -1584,6 +1585,7 @@ COMPAT_SYSCALL_DEFINE3(ioctl, unsigned int, fd, unsigned int, cmd,
 		goto do_ioctl;
 	case FICLONERANGE:
 	case FIDEDUPERANGE:
+	case FS_IOC_READDIRPLUS:
 		goto found_handler;
 
 	case FIBMAP:
@@ -396,9 +396,12 @@ static int __init fscrypt_init(void)
 	 *
 	 * Also use a high-priority workqueue to prioritize decryption work,
 	 * which blocks reads from completing, over regular application tasks.
+	 * As readers wait on it, mark it latency critical so decryption
+	 * doesn't end up on the slowest cores.
 	 */
 	fscrypt_read_workqueue = alloc_workqueue("fscrypt_read_queue",
-						 WQ_UNBOUND | WQ_HIGHPRI,
+						 WQ_UNBOUND | WQ_HIGHPRI |
+						 WQ_LATENCY_CRITICAL,
 						 num_online_cpus());
 	if (!fscrypt_read_workqueue)
 		goto fail;
@@ -10,9 +10,14 @@
  *  Copyright (C) 2012-2013 Samsung Electronics Co., Ltd.
  */
 
+#include <linux/version.h>
+#include <linux/mm.h>
 #include <linux/slab.h>
 #include <asm/unaligned.h>
 #include <linux/buffer_head.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
+#include <linux/sched/mm.h>
+#endif
 
 #include "exfat_raw.h"
 #include "exfat_fs.h"
@@ -208,6 +213,193 @@ static void __exfat_cache_inval_inode(struct inode *inode)
 		ei->cache_valid_id++;
 }
 
+/*
+ * The LRU above only keeps EXFAT_MAX_CACHE fragments per file, so seeking
+ * around in a big fragmented file keeps walking the FAT chain from the
+ * nearest one.  Files with a FAT chain therefore also get a map of the
+ * whole chain: an array of contiguous runs sorted by file cluster, built
+ * by a single walk of the chain on the first lookup and searched with a
+ * binary search after that.  Appended clusters are added to the end of
+ * the map, truncating the file drops it.  Files without a FAT chain are
+ * contiguous and are mapped by exfat_map_cluster() without the FAT.
+ *
+ * The map is only used and changed with sbi->s_lock held.  Files with more
+ * than EXFAT_MAX_EXTENTS runs, or whose map cannot be allocated, use the
+ * LRU until they are truncated.
+ */
+#define EXFAT_MAX_EXTENTS	65536
+
+struct exfat_extent {
+	unsigned int fcluster;	/* first cluster number in the file */
+	unsigned int dcluster;	/* first cluster number on disk */
+	unsigned int len;	/* number of contiguous clusters */
+};
+
+static void exfat_extent_map_free(struct exfat_inode_info *ei)
+{
+	kvfree(ei->extents);
+	ei->extents = NULL;
+	ei->nr_extents = 0;
+	ei->max_extents = 0;
+	ei->extent_clusters = 0;
+}
+
+static int exfat_extent_map_grow(struct exfat_inode_info *ei)
+{
+	unsigned int max = ei->max_extents ? ei->max_extents * 2 : 8;
+	struct exfat_extent *extents;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 12, 0)
+	unsigned int nofs_flags;
+#endif
+
+	if (ei->max_extents >= EXFAT_MAX_EXTENTS)
+		return -E2BIG;
+	max = min_t(unsigned int, max, EXFAT_MAX_EXTENTS);
+
+	/* s_lock is held, which writeback takes as well */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 12, 0)
+	nofs_flags = memalloc_nofs_save();
+	extents = kvmalloc_array(max, sizeof(*extents), GFP_KERNEL);
+	memalloc_nofs_restore(nofs_flags);
+#else
+	extents = kmalloc_array(max, sizeof(*extents),
+				GFP_NOFS | __GFP_NOWARN);
+#endif
+	if (!extents)
+		return -ENOMEM;
+
+	if (ei->nr_extents)
+		memcpy(extents, ei->extents,
+		       ei->nr_extents * sizeof(*extents));
+	kvfree(ei->extents);
+	ei->extents = extents;
+	ei->max_extents = max;
+	return 0;
+}
+
+/* Add the next cluster of the chain to the end of the map */
+static int exfat_extent_map_add(struct exfat_inode_info *ei,
+		unsigned int dclus)
+{
+	struct exfat_extent *ext;
+	int err;
+
+	if (ei->nr_extents) {
+		ext = &ei->extents[ei->nr_extents - 1];
+		if (ext->dcluster + ext->len == dclus) {
+			ext->len++;
+			ei->extent_clusters++;
+			return 0;
+		}
+	}
+
+	if (ei->nr_extents == ei->max_extents) {
+		err = exfat_extent_map_grow(ei);
+		if (err)
+			return err;
+	}
+
+	ext = &ei->extents[ei->nr_extents++];
+	ext->fcluster = ei->extent_clusters++;
+	ext->dcluster = dclus;
+	ext->len = 1;
+	return 0;
+}
+
+static int exfat_extent_map_build(struct inode *inode)
+{
+	struct super_block *sb = inode->i_sb;
+	struct exfat_inode_info *ei = EXFAT_I(inode);
+	unsigned int limit = EXFAT_SB(sb)->num_clusters;
+	unsigned int clu = ei->start_clu;
+	int err;
+
+	while (clu != EXFAT_EOF_CLUSTER) {
+		/* prevent the infinite loop of cluster chain */
+		if (ei->extent_clusters > limit) {
+			exfat_fs_error(sb,
+				"detected the cluster chain loop (i_pos %u)",
+				ei->extent_clusters);
+			err = -EIO;
+			goto out_free;
+		}
+
+		err = exfat_extent_map_add(ei, clu);
+		if (err)
+			goto out_disable;
+
+		if (exfat_ent_get(sb, clu, &clu)) {
+			err = -EIO;
+			goto out_free;
+		}
+	}
+	return 0;
+
+out_disable:
+	ei->no_extent_map = true;
+out_free:
+	exfat_extent_map_free(ei);
+	return err;
+}
+
+static void exfat_extent_map_lookup(struct exfat_inode_info *ei,
+		unsigned int cluster, unsigned int *fclus,
+		unsigned int *dclus, unsigned int *last_dclus)
+{
+	unsigned int lo = 0, hi = ei->nr_extents - 1, mid;
+	struct exfat_extent *ext;
+
+	if (cluster >= ei->extent_clusters) {
+		ext = &ei->extents[hi];
+		*fclus = ei->extent_clusters;
+		*dclus = EXFAT_EOF_CLUSTER;
+		*last_dclus = ext->dcluster + ext->len - 1;
+		return;
+	}
+
+	/* Find the last run starting at or before "cluster" */
+	while (lo < hi) {
+		mid = hi - (hi - lo) / 2;
+		if (ei->extents[mid].fcluster <= cluster)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	ext = &ei->extents[lo];
+	*fclus = cluster;
+	*dclus = ext->dcluster + (cluster - ext->fcluster);
+	if (cluster > ext->fcluster)
+		*last_dclus = *dclus - 1;
+	else	/* cluster > 0, so this is not the first run */
+		*last_dclus = ext[-1].dcluster + ext[-1].len - 1;
+}
+
+/*
+ * Called by exfat_map_cluster() for every cluster @dclus it appends to the
+ * FAT chain, @fclus being the cluster number in the file.
+ */
+void exfat_cache_append(struct inode *inode, unsigned int fclus,
+		unsigned int dclus)
+{
+	struct exfat_inode_info *ei = EXFAT_I(inode);
+	int err;
+
+	if (!ei->extents)
+		return;
+
+	if (fclus != ei->extent_clusters) {
+		exfat_extent_map_free(ei);
+		return;
+	}
+
+	err = exfat_extent_map_add(ei, dclus);
+	if (err) {
+		ei->no_extent_map = true;
+		exfat_extent_map_free(ei);
+	}
+}
+
 void exfat_cache_inval_inode(struct inode *inode)
 {
 	struct exfat_inode_info *ei = EXFAT_I(inode);
@@ -215,6 +407,9 @@ void exfat_cache_inval_inode(struct inode *inode)
 	spin_lock(&ei->cache_lru_lock);
 	__exfat_cache_inval_inode(inode);
 	spin_unlock(&ei->cache_lru_lock);
+
+	exfat_extent_map_free(ei);
+	ei->no_extent_map = false;
 }
 
 static inline int cache_contiguous(struct exfat_cache_id *cid,
@@ -261,6 +456,22 @@ int exfat_get_cluster(struct inode *inode, unsigned int cluster,
 	if (cluster == 0 || *dclus == EXFAT_EOF_CLUSTER)
 		return 0;
 
+	if (!ei->extents && !ei->no_extent_map &&
+	    exfat_extent_map_build(inode) == -EIO)
+		return -EIO;
+
+	if (ei->extents) {
+		exfat_extent_map_lookup(ei, cluster, fclus, dclus,
+					last_dclus);
+		if (*dclus == EXFAT_EOF_CLUSTER && !allow_eof) {
+			exfat_fs_error(sb,
+			       "invalid cluster chain (i_pos %u, last_clus 0x%08x is EOF)",
+			       *fclus, (*last_dclus));
+			return -EIO;
+		}
+		return 0;
+	}
+
 	cache_init(&cid, EXFAT_EOF_CLUSTER, EXFAT_EOF_CLUSTER);
 
 	if (exfat_cache_lookup(inode, cluster, &cid, fclus, dclus) ==
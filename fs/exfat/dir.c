@@ -8,6 +8,12 @@
 #include <linux/compat.h>
 #include <linux/bio.h>
 #include <linux/buffer_head.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
+#include <linux/sched/mm.h>
+#endif
 
 #include "exfat_raw.h"
 #include "exfat_fs.h"
@@ -978,6 +984,552 @@ static inline void exfat_set_empty_hint(struct exfat_inode_info *ei,
 	}
 }
 
+/*
+ * Name hash index of big directories
+ *
+ * exfat_find_dir_entry() reads every entry of a directory up to the one it
+ * looks for, and all of them for a name that does not exist, which is
+ * what every create looks up first.  Directories of at least
+ * EXFAT_DIR_INDEX_MIN_SIZE bytes therefore get an index of their file
+ * entry sets on the first lookup, hashed both by the name hash of their
+ * stream entry and by their position.  A lookup then only reads the entry
+ * sets with the same name hash, usually one, and creates, unlinks and
+ * renames keep the index up to date.
+ *
+ * The index also remembers, for every entry set size, the first entry at
+ * which a run of that many free entries may start.  exfat_find_empty_entry()
+ * starts its search there instead of at the start of the directory, so a
+ * hole left by an unlink that is too small for the new entry set is gone
+ * over once, not by every later create.  Where known, the clusters holding
+ * these entries are kept too, so that finding the cluster of a new entry
+ * set does not walk the FAT chain from the start of the directory either.
+ *
+ * Everything here runs with sbi->s_lock held.
+ */
+#define EXFAT_DIR_INDEX_MIN_SIZE	(64 * 1024)
+#define EXFAT_DIR_INDEX_MIN_BITS	6
+#define EXFAT_DIR_INDEX_MAX_BITS	14
+
+/* An entry of the directory and the cluster holding it */
+struct exfat_dir_index_pos {
+	int eidx;
+	unsigned int clu;	/* EXFAT_EOF_CLUSTER if not known */
+};
+
+struct exfat_dir_index {
+	unsigned int bits;
+	/*
+	 * no run of n free entries starts before free[n].eidx, and
+	 * free[n].eidx <= free[n + 1].eidx; free[0] is not used
+	 */
+	struct exfat_dir_index_pos free[ES_MAX_ENTRY_NUM + 1];
+	/* the last entry whose cluster was looked up */
+	struct exfat_dir_index_pos cur;
+	/* all entries from this one on are unused */
+	int end_eidx;
+	/* size and start of the search last handed out, 0 if none */
+	int hint_num;
+	int hint_eidx;
+	/* 1 << bits buckets by name hash followed by as many by position */
+	struct hlist_head *buckets;
+};
+
+struct exfat_dir_index_entry {
+	struct hlist_node hash_node;
+	struct hlist_node pos_node;
+	int eidx;		/* entry index of the file entry */
+	unsigned int clu;	/* cluster holding the file entry */
+	u16 name_hash;
+	u8 num_entries;		/* size of the entry set */
+};
+
+static struct kmem_cache *exfat_dir_index_cachep;
+
+int exfat_dir_index_init(void)
+{
+	exfat_dir_index_cachep = kmem_cache_create("exfat_dir_index",
+				sizeof(struct exfat_dir_index_entry),
+				0, SLAB_RECLAIM_ACCOUNT|SLAB_MEM_SPREAD, NULL);
+	if (!exfat_dir_index_cachep)
+		return -ENOMEM;
+	return 0;
+}
+
+void exfat_dir_index_shutdown(void)
+{
+	kmem_cache_destroy(exfat_dir_index_cachep);
+}
+
+static inline struct hlist_head *exfat_dir_index_hash_head(
+		struct exfat_dir_index *di, u16 name_hash)
+{
+	return &di->buckets[hash_32(name_hash, di->bits)];
+}
+
+static inline struct hlist_head *exfat_dir_index_pos_head(
+		struct exfat_dir_index *di, int eidx)
+{
+	return &di->buckets[(1U << di->bits) + hash_32(eidx, di->bits)];
+}
+
+void exfat_dir_index_free(struct inode *dir)
+{
+	struct exfat_inode_info *ei = EXFAT_I(dir);
+	struct exfat_dir_index *di = ei->dir_index;
+	struct exfat_dir_index_entry *de;
+	struct hlist_node *tmp;
+	unsigned int i;
+
+	if (!di)
+		return;
+
+	for (i = 0; i < (1U << di->bits); i++)
+		hlist_for_each_entry_safe(de, tmp, &di->buckets[i], hash_node)
+			kmem_cache_free(exfat_dir_index_cachep, de);
+	kvfree(di->buckets);
+	kfree(di);
+	ei->dir_index = NULL;
+}
+
+static int exfat_dir_index_insert(struct exfat_dir_index *di, int eidx,
+		unsigned int clu, int num_entries, u16 name_hash)
+{
+	struct exfat_dir_index_entry *de;
+
+	de = kmem_cache_alloc(exfat_dir_index_cachep, GFP_NOFS);
+	if (!de)
+		return -ENOMEM;
+
+	de->eidx = eidx;
+	de->clu = clu;
+	de->name_hash = name_hash;
+	de->num_entries = num_entries;
+	hlist_add_head(&de->hash_node,
+		       exfat_dir_index_hash_head(di, name_hash));
+	hlist_add_head(&de->pos_node, exfat_dir_index_pos_head(di, eidx));
+	return 0;
+}
+
+/* The entry set starting at @eidx, if it is indexed */
+static struct exfat_dir_index_entry *exfat_dir_index_at(
+		struct exfat_dir_index *di, int eidx)
+{
+	struct exfat_dir_index_entry *de;
+
+	hlist_for_each_entry(de, exfat_dir_index_pos_head(di, eidx), pos_node)
+		if (de->eidx == eidx)
+			return de;
+	return NULL;
+}
+
+/* Does an indexed entry set end right before @eidx? */
+static bool exfat_dir_index_ends_at(struct exfat_dir_index *di, int eidx)
+{
+	struct exfat_dir_index_entry *de;
+	int num;
+
+	for (num = ES_ENTRY_NUM(1); num <= ES_MAX_ENTRY_NUM; num++) {
+		if (eidx < num)
+			break;
+		de = exfat_dir_index_at(di, eidx - num);
+		if (de && de->num_entries == num)
+			return true;
+	}
+	return false;
+}
+
+static struct exfat_dir_index *exfat_dir_index_alloc(unsigned int bits)
+{
+	struct exfat_dir_index *di;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 12, 0)
+	unsigned int nofs_flags;
+#endif
+	unsigned int i;
+
+	di = kzalloc(sizeof(*di), GFP_NOFS);
+	if (!di)
+		return NULL;
+
+	di->bits = bits;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 12, 0)
+	nofs_flags = memalloc_nofs_save();
+	di->buckets = kvmalloc_array(2U << bits, sizeof(*di->buckets),
+				     GFP_KERNEL);
+	memalloc_nofs_restore(nofs_flags);
+#else
+	di->buckets = kmalloc_array(2U << bits, sizeof(*di->buckets),
+				    GFP_NOFS | __GFP_NOWARN);
+#endif
+	if (!di->buckets) {
+		kfree(di);
+		return NULL;
+	}
+
+	for (i = 0; i < (2U << bits); i++)
+		INIT_HLIST_HEAD(&di->buckets[i]);
+	return di;
+}
+
+static inline void exfat_dir_index_set_pos(struct exfat_dir_index_pos *pos,
+		int eidx, unsigned int clu)
+{
+	pos->eidx = eidx;
+	pos->clu = clu;
+}
+
+/*
+ * Find the cluster holding entry @eidx of @p_dir, walking the FAT chain
+ * from the closest known cluster before it, from the start if there is
+ * none.
+ */
+static int exfat_dir_index_clu(struct super_block *sb,
+		struct exfat_dir_index *di, struct exfat_chain *p_dir,
+		int eidx, unsigned int *clu)
+{
+	int dentries_per_clu = EXFAT_SB(sb)->dentries_per_clu;
+	struct exfat_dir_index_pos *pos, *best = NULL;
+	unsigned int cur;
+	int n, nr;
+
+	for (n = 0; n <= ES_MAX_ENTRY_NUM; n++) {
+		pos = n ? &di->free[n] : &di->cur;
+		if (pos->clu != EXFAT_EOF_CLUSTER && pos->eidx <= eidx &&
+		    (!best || pos->eidx > best->eidx))
+			best = pos;
+	}
+
+	if (!best) {
+		if (exfat_walk_fat_chain(sb, p_dir, EXFAT_DEN_TO_B(eidx), clu))
+			return -EIO;
+		goto out;
+	}
+
+	nr = eidx / dentries_per_clu - best->eidx / dentries_per_clu;
+	cur = best->clu;
+	if (p_dir->flags == ALLOC_NO_FAT_CHAIN) {
+		cur += nr;
+	} else {
+		while (nr-- > 0) {
+			if (exfat_get_next_cluster(sb, &cur) ||
+			    cur == EXFAT_EOF_CLUSTER)
+				return -EIO;
+		}
+	}
+	*clu = cur;
+out:
+	exfat_dir_index_set_pos(&di->cur, eidx, *clu);
+	return 0;
+}
+
+/* Read the whole directory once and index its file entry sets */
+static int exfat_dir_index_build(struct super_block *sb,
+		struct exfat_inode_info *ei, struct exfat_chain *p_dir)
+{
+	struct exfat_sb_info *sbi = EXFAT_SB(sb);
+	int dentries_per_clu = sbi->dentries_per_clu;
+	int total = p_dir->size * dentries_per_clu;
+	int i, n, dentry = 0, file_eidx = -1, file_num = 0;
+	int run_eidx = 0, run_len = 0;
+	unsigned int file_clu = 0, run_clu = EXFAT_EOF_CLUSTER, bits;
+	struct exfat_dir_index *di;
+	struct exfat_chain clu;
+	int ret = 0;
+
+	bits = clamp_t(unsigned int, ilog2(max(total, 2)) - 1,
+		       EXFAT_DIR_INDEX_MIN_BITS, EXFAT_DIR_INDEX_MAX_BITS);
+	di = exfat_dir_index_alloc(bits);
+	if (!di)
+		return -ENOMEM;
+	ei->dir_index = di;
+	for (n = 1; n <= ES_MAX_ENTRY_NUM; n++)
+		di->free[n].eidx = -1;
+	di->end_eidx = total;
+	di->cur.clu = EXFAT_EOF_CLUSTER;
+
+	exfat_chain_dup(&clu, p_dir);
+	while (clu.dir != EXFAT_EOF_CLUSTER) {
+		for (i = 0; i < dentries_per_clu; i++, dentry++) {
+			struct exfat_dentry *ep;
+			struct buffer_head *bh;
+			unsigned int type;
+
+			ep = exfat_get_dentry(sb, &clu, i, &bh);
+			if (!ep) {
+				ret = -EIO;
+				goto out;
+			}
+			type = exfat_get_entry_type(ep);
+
+			if (type == TYPE_UNUSED || type == TYPE_DELETED) {
+				/* the first run to reach n entries is free[n] */
+				if (!run_len++) {
+					run_eidx = dentry;
+					run_clu = clu.dir;
+				}
+				if (run_len <= ES_MAX_ENTRY_NUM &&
+				    di->free[run_len].eidx < 0)
+					exfat_dir_index_set_pos(
+						&di->free[run_len], run_eidx,
+						run_clu);
+				file_eidx = -1;
+			} else if (type == TYPE_FILE || type == TYPE_DIR) {
+				run_len = 0;
+				file_eidx = dentry;
+				file_clu = clu.dir;
+				file_num = ep->dentry.file.num_ext + 1;
+			} else if (type == TYPE_STREAM && file_eidx >= 0) {
+				run_len = 0;
+				ret = exfat_dir_index_insert(di, file_eidx,
+					file_clu, file_num,
+					le16_to_cpu(ep->dentry.stream.name_hash));
+				file_eidx = -1;
+			} else {
+				run_len = 0;
+				if (type != TYPE_EXTEND &&
+				    !(type & (TYPE_CRITICAL_SEC |
+					      TYPE_BENIGN_SEC)))
+					file_eidx = -1;
+			}
+			brelse(bh);
+
+			if (ret)
+				goto out;
+			if (type == TYPE_UNUSED) {
+				di->end_eidx = dentry;
+				goto out;
+			}
+		}
+
+		/* a full directory grows after its last cluster */
+		exfat_dir_index_set_pos(&di->cur, dentry - 1, clu.dir);
+
+		if (clu.flags == ALLOC_NO_FAT_CHAIN) {
+			if (--clu.size > 0)
+				clu.dir++;
+			else
+				clu.dir = EXFAT_EOF_CLUSTER;
+		} else {
+			if (exfat_get_next_cluster(sb, &clu.dir)) {
+				ret = -EIO;
+				goto out;
+			}
+		}
+	}
+out:
+	if (ret) {
+		exfat_dir_index_free(&ei->vfs_inode);
+		return ret;
+	}
+	/* bigger runs can only start in the free entries at the end */
+	for (n = 1; n <= ES_MAX_ENTRY_NUM; n++) {
+		if (di->free[n].eidx >= 0)
+			continue;
+		if (run_len)
+			exfat_dir_index_set_pos(&di->free[n], run_eidx,
+						run_clu);
+		else
+			exfat_dir_index_set_pos(&di->free[n], total,
+						EXFAT_EOF_CLUSTER);
+	}
+	return 0;
+}
+
+/*
+ * Called after the entry set of a name with @name_hash has been written to
+ * @num_entries entries at @entry of @dir.
+ */
+void exfat_dir_index_add(struct inode *dir, struct exfat_chain *p_dir,
+		int entry, int num_entries, u16 name_hash)
+{
+	struct exfat_dir_index *di = EXFAT_I(dir)->dir_index;
+	struct super_block *sb = dir->i_sb;
+	int dentries_per_clu = EXFAT_SB(sb)->dentries_per_clu;
+	int n, end = entry + num_entries;
+	unsigned int clu, end_clu;
+	bool searched;
+
+	if (!di)
+		return;
+
+	/*
+	 * If @entry is what the first fit search handed out by
+	 * exfat_dir_index_empty_hint() found, no run of @num_entries or more
+	 * free entries starts before it.
+	 */
+	searched = di->hint_num == num_entries && di->hint_eidx <= entry;
+	di->hint_num = 0;
+
+	if (exfat_dir_index_clu(sb, di, p_dir, entry, &clu) ||
+	    exfat_dir_index_insert(di, entry, clu, num_entries, name_hash)) {
+		exfat_dir_index_free(dir);
+		return;
+	}
+
+	end_clu = entry / dentries_per_clu == end / dentries_per_clu ?
+		clu : EXFAT_EOF_CLUSTER;
+	for (n = 1; n <= ES_MAX_ENTRY_NUM; n++) {
+		struct exfat_dir_index_pos *pos = &di->free[n];
+
+		if (pos->eidx < end &&
+		    (pos->eidx >= entry || (searched && n >= num_entries)))
+			exfat_dir_index_set_pos(pos, end, end_clu);
+	}
+	if (end > di->end_eidx)
+		di->end_eidx = end;
+}
+
+/* Called after the entry set at @entry of @dir has been deleted */
+void exfat_dir_index_del(struct inode *dir, int entry)
+{
+	struct exfat_dir_index *di = EXFAT_I(dir)->dir_index;
+	int dentries_per_clu = EXFAT_SB(dir->i_sb)->dentries_per_clu;
+	struct exfat_dir_index_entry *de;
+	unsigned int clu = EXFAT_EOF_CLUSTER;
+	int n, num = 0, start;
+
+	if (!di)
+		return;
+	di->hint_num = 0;
+
+	de = exfat_dir_index_at(di, entry);
+	if (de) {
+		clu = de->clu;
+		num = de->num_entries;
+		hlist_del(&de->hash_node);
+		hlist_del(&de->pos_node);
+		kmem_cache_free(exfat_dir_index_cachep, de);
+	}
+
+	/*
+	 * The hole may have joined free entries around it, so a run of any
+	 * size may now start as far back as ES_MAX_ENTRY_NUM - 1 entries
+	 * before it.  With indexed entry sets right before and after it, it
+	 * is a run of its own size starting at @entry.
+	 */
+	if (num && (!entry || exfat_dir_index_ends_at(di, entry))) {
+		start = entry;
+		if (!exfat_dir_index_at(di, entry + num))
+			num = ES_MAX_ENTRY_NUM;
+	} else {
+		start = max(entry - ES_MAX_ENTRY_NUM + 1, 0);
+		num = ES_MAX_ENTRY_NUM;
+	}
+	if (start / dentries_per_clu != entry / dentries_per_clu)
+		clu = EXFAT_EOF_CLUSTER;
+
+	for (n = 1; n <= num; n++)
+		if (di->free[n].eidx > start)
+			exfat_dir_index_set_pos(&di->free[n], start, clu);
+}
+
+/*
+ * Point @hint_femp at the first entry of @dir where a run of @num_entries
+ * free entries may start
+ */
+void exfat_dir_index_empty_hint(struct inode *dir, struct exfat_chain *p_dir,
+		int num_entries, struct exfat_hint_femp *hint_femp)
+{
+	struct exfat_dir_index *di = EXFAT_I(dir)->dir_index;
+	struct exfat_sb_info *sbi = EXFAT_SB(dir->i_sb);
+	int total = p_dir->size * sbi->dentries_per_clu;
+	struct exfat_dir_index_pos *pos;
+	unsigned int clu;
+
+	if (!di)
+		return;
+
+	di->hint_num = 0;
+	pos = &di->free[clamp(num_entries, 1, ES_MAX_ENTRY_NUM)];
+
+	if (pos->eidx >= total) {
+		hint_femp->eidx = total;
+		hint_femp->count = 0;
+		exfat_chain_set(&hint_femp->cur, EXFAT_EOF_CLUSTER, 0,
+				p_dir->flags);
+		goto out;
+	}
+
+	if (exfat_dir_index_clu(dir->i_sb, di, p_dir, pos->eidx, &clu))
+		return;
+	pos->clu = clu;
+
+	hint_femp->eidx = pos->eidx;
+	/* everything from end_eidx on is known to be free */
+	hint_femp->count = pos->eidx >= di->end_eidx ?
+		total - pos->eidx : 0;
+	exfat_chain_set(&hint_femp->cur, clu,
+			p_dir->size - pos->eidx / sbi->dentries_per_clu,
+			p_dir->flags);
+out:
+	di->hint_num = num_entries;
+	di->hint_eidx = pos->eidx;
+}
+
+/* Does the entry set indexed by @de hold the name @p_uniname? */
+static int exfat_dir_index_match(struct super_block *sb,
+		struct exfat_chain *p_dir, struct exfat_dir_index_entry *de,
+		struct exfat_uni_name *p_uniname)
+{
+	int dentries_per_clu = EXFAT_SB(sb)->dentries_per_clu;
+	unsigned short entry_uniname[16], *uniname = p_uniname->name;
+	struct exfat_entry_set_cache es;
+	struct exfat_dentry *ep;
+	struct exfat_chain clu;
+	int i, len, name_len = 0, ret = 0;
+
+	exfat_chain_set(&clu, de->clu,
+			p_dir->size - de->eidx / dentries_per_clu,
+			p_dir->flags);
+	if (exfat_get_dentry_set(&es, sb, &clu,
+				 de->eidx & (dentries_per_clu - 1),
+				 ES_ALL_ENTRIES))
+		return 0;
+
+	ep = exfat_get_dentry_cached(&es, ES_IDX_STREAM);
+	if (ep->dentry.stream.name_len != p_uniname->name_len ||
+	    le16_to_cpu(ep->dentry.stream.name_hash) != p_uniname->name_hash)
+		goto out;
+
+	for (i = ES_IDX_FIRST_FILENAME;
+	     i < es.num_entries && name_len < p_uniname->name_len; i++) {
+		ep = exfat_get_dentry_cached(&es, i);
+		if (exfat_get_entry_type(ep) != TYPE_EXTEND)
+			goto out;
+
+		len = exfat_extract_uni_name(ep, entry_uniname);
+		if (name_len + len > p_uniname->name_len ||
+		    exfat_uniname_ncmp(sb, uniname, entry_uniname, len))
+			goto out;
+		name_len += len;
+		uniname += EXFAT_FILE_NAME_LEN;
+	}
+	ret = name_len == p_uniname->name_len;
+out:
+	exfat_put_dentry_set(&es, false);
+	return ret;
+}
+
+static int exfat_dir_index_lookup(struct super_block *sb,
+		struct exfat_inode_info *ei, struct exfat_chain *p_dir,
+		struct exfat_uni_name *p_uniname, struct exfat_hint *hint_opt)
+{
+	struct exfat_dir_index *di = ei->dir_index;
+	struct exfat_dir_index_entry *de;
+
+	hlist_for_each_entry(de,
+			exfat_dir_index_hash_head(di, p_uniname->name_hash),
+			hash_node) {
+		if (de->name_hash != p_uniname->name_hash ||
+		    !exfat_dir_index_match(sb, p_dir, de, p_uniname))
+			continue;
+
+		hint_opt->clu = de->clu;
+		hint_opt->eidx = de->eidx & (EXFAT_SB(sb)->dentries_per_clu - 1);
+		return de->eidx;
+	}
+	return -ENOENT;
+}
+
 enum {
 	DIRENT_STEP_FILE,
 	DIRENT_STEP_STRM,
@@ -1014,6 +1566,18 @@ int exfat_find_dir_entry(struct super_block *sb, struct exfat_inode_info *ei,
 	if (num_entries < 0)
 		return num_entries;
 
+	if (!ei->dir_index &&
+	    i_size_read(&ei->vfs_inode) >= EXFAT_DIR_INDEX_MIN_SIZE &&
+	    exfat_dir_index_build(sb, ei, p_dir) == -EIO)
+		return -EIO;
+
+	if (ei->dir_index) {
+		/* exfat_find_empty_entry() asks the index instead */
+		exfat_reset_empty_hint(&ei->hint_femp);
+		return exfat_dir_index_lookup(sb, ei, p_dir, p_uniname,
+					      hint_opt);
+	}
+
 	dentries_per_clu = sbi->dentries_per_clu;
 
 	exfat_chain_dup(&clu, p_dir);
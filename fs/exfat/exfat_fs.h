@@ -328,6 +328,18 @@ struct exfat_inode_info {
 	/* for avoiding the race between alloc and free */
 	unsigned int cache_valid_id;
 
+	/* map of the whole FAT chain, protected by sbi->s_lock */
+	struct exfat_extent *extents;
+	unsigned int nr_extents;
+	unsigned int max_extents;
+	/* number of clusters covered by the map */
+	unsigned int extent_clusters;
+	/* too fragmented for the map, use the cache_lru only */
+	bool no_extent_map;
+
+	/* name hash index of a big directory, protected by sbi->s_lock */
+	struct exfat_dir_index *dir_index;
+
 	/*
 	 * NOTE: i_size_ondisk is 64bits, so must hold ->inode_lock to access.
 	 * physically allocated size.
@@ -515,6 +527,8 @@ extern const struct dentry_operations exfat_utf8_dentry_ops;
 int exfat_cache_init(void);
 void exfat_cache_shutdown(void);
 void exfat_cache_inval_inode(struct inode *inode);
+void exfat_cache_append(struct inode *inode, unsigned int fclus,
+		unsigned int dclus);
 int exfat_get_cluster(struct inode *inode, unsigned int cluster,
 		unsigned int *fclus, unsigned int *dclus,
 		unsigned int *last_dclus, int allow_eof);
@@ -547,6 +561,14 @@ int exfat_get_dentry_set(struct exfat_entry_set_cache *es,
 		unsigned int type);
 int exfat_put_dentry_set(struct exfat_entry_set_cache *es, int sync);
 int exfat_count_dir_entries(struct super_block *sb, struct exfat_chain *p_dir);
+int exfat_dir_index_init(void);
+void exfat_dir_index_shutdown(void);
+void exfat_dir_index_free(struct inode *dir);
+void exfat_dir_index_add(struct inode *dir, struct exfat_chain *p_dir,
+		int entry, int num_entries, u16 name_hash);
+void exfat_dir_index_del(struct inode *dir, int entry);
+void exfat_dir_index_empty_hint(struct inode *dir, struct exfat_chain *p_dir,
+		int num_entries, struct exfat_hint_femp *hint_femp);
 
 /* inode.c */
 extern const struct inode_operations exfat_file_inode_operations;
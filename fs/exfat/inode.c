@@ -252,9 +252,15 @@ static int exfat_map_cluster(struct inode *inode, unsigned int clu_offset,
 		if (ei->flags == ALLOC_NO_FAT_CHAIN) {
 			*clu += num_to_be_allocated - 1;
 		} else {
+			unsigned int fclus = num_clusters - num_to_be_allocated;
+
+			exfat_cache_append(inode, fclus, *clu);
 			while (num_to_be_allocated > 1) {
-				if (exfat_get_next_cluster(sb, clu))
+				if (exfat_get_next_cluster(sb, clu)) {
+					exfat_cache_inval_inode(inode);
 					return -EIO;
+				}
+				exfat_cache_append(inode, ++fclus, *clu);
 				num_to_be_allocated--;
 			}
 		}
@@ -758,5 +764,6 @@ void exfat_evict_inode(struct inode *inode)
 	invalidate_inode_buffers(inode);
 	clear_inode(inode);
 	exfat_cache_inval_inode(inode);
+	exfat_dir_index_free(inode);
 	exfat_unhash_inode(inode);
 }
@@ -365,7 +365,10 @@ static int exfat_find_empty_entry(struct inode *inode,
 
 	hint_femp.eidx = EXFAT_HINT_NONE;
 
-	if (ei->hint_femp.eidx != EXFAT_HINT_NONE) {
+	if (ei->dir_index) {
+		exfat_dir_index_empty_hint(inode, p_dir, num_entries,
+					   &hint_femp);
+	} else if (ei->hint_femp.eidx != EXFAT_HINT_NONE) {
 		hint_femp = ei->hint_femp;
 		ei->hint_femp.eidx = EXFAT_HINT_NONE;
 	}
@@ -565,6 +568,8 @@ static int exfat_add_entry(struct inode *inode, const char *path,
 	ret = exfat_init_ext_entry(inode, p_dir, dentry, num_entries, &uniname);
 	if (ret)
 		goto out;
+	exfat_dir_index_add(inode, p_dir, dentry, num_entries,
+			uniname.name_hash);
 
 	info->dir = *p_dir;
 	info->entry = dentry;
@@ -910,6 +915,7 @@ static int exfat_unlink(struct inode *dir, struct dentry *dentry)
 		err = -EIO;
 		goto unlock;
 	}
+	exfat_dir_index_del(dir, entry);
 
 	/* This doesn't modify ei */
 	ei->dir.dir = DIR_DELETED;
@@ -1156,6 +1162,7 @@ static int exfat_rmdir(struct inode *dir, struct dentry *dentry)
 		exfat_err(sb, "failed to exfat_remove_entries : err(%d)", err);
 		goto unlock;
 	}
+	exfat_dir_index_del(dir, entry);
 	ei->dir.dir = DIR_DELETED;
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 16, 0)
@@ -1449,6 +1456,18 @@ static int __exfat_rename(struct inode *old_parent_inode,
 		ret = exfat_move_file(new_parent_inode, &olddir, dentry,
 				&newdir, &uni_name, ei);
 
+	if (!ret) {
+		exfat_dir_index_del(old_parent_inode, dentry);
+		exfat_dir_index_add(new_parent_inode,
+				olddir.dir == newdir.dir ? &olddir : &newdir,
+				ei->entry, exfat_calc_num_entries(&uni_name),
+				uni_name.name_hash);
+	} else {
+		/* the entries may have been moved only in part */
+		exfat_dir_index_free(old_parent_inode);
+		exfat_dir_index_free(new_parent_inode);
+	}
+
 	if (!ret && new_inode) {
 		/* delete entries of new_dir */
 		ep = exfat_get_dentry(sb, p_dir, new_entry, &new_bh);
@@ -1469,6 +1488,7 @@ static int __exfat_rename(struct inode *old_parent_inode,
 			ret = -EIO;
 			goto del_out;
 		}
+		exfat_dir_index_del(new_parent_inode, new_entry);
 
 		/* Free the clusters if new_inode is a dir(as if exfat_rmdir) */
 		if (new_entry_type == TYPE_DIR &&
@@ -1488,8 +1508,11 @@ static int __exfat_rename(struct inode *old_parent_inode,
 			i_size_write(new_inode, 0);
 			new_ei->start_clu = EXFAT_EOF_CLUSTER;
 			new_ei->flags = ALLOC_NO_FAT_CHAIN;
+			exfat_cache_inval_inode(new_inode);
 		}
 del_out:
+		if (ret)
+			exfat_dir_index_free(new_parent_inode);
 		/* Update new_inode ei
 		 * Prevent syncing removed new_inode
 		 * (new_ei is already initialized above code ("if (new_inode)")
@@ -1142,6 +1142,12 @@ static void exfat_inode_init_once(void *foo)
 	ei->nr_caches = 0;
 	ei->cache_valid_id = EXFAT_CACHE_VALID + 1;
 	INIT_LIST_HEAD(&ei->cache_lru);
+	ei->extents = NULL;
+	ei->nr_extents = 0;
+	ei->max_extents = 0;
+	ei->extent_clusters = 0;
+	ei->no_extent_map = false;
+	ei->dir_index = NULL;
 	INIT_HLIST_NODE(&ei->i_hash_fat);
 	inode_init_once(&ei->vfs_inode);
 }
@@ -1154,13 +1160,17 @@ static int __init init_exfat_fs(void)
 	if (err)
 		return err;
 
+	err = exfat_dir_index_init();
+	if (err)
+		goto shutdown_cache;
+
 	exfat_inode_cachep = kmem_cache_create("exfat_inode_cache",
 			sizeof(struct exfat_inode_info),
 			0, SLAB_RECLAIM_ACCOUNT | SLAB_MEM_SPREAD,
 			exfat_inode_init_once);
 	if (!exfat_inode_cachep) {
 		err = -ENOMEM;
-		goto shutdown_cache;
+		goto shutdown_dir_index;
 	}
 
 	err = register_filesystem(&exfat_fs_type);
@@ -1171,6 +1181,8 @@ static int __init init_exfat_fs(void)
 
 destroy_cache:
 	kmem_cache_destroy(exfat_inode_cachep);
+shutdown_dir_index:
+	exfat_dir_index_shutdown();
 shutdown_cache:
 	exfat_cache_shutdown();
 	return err;
@@ -1185,6 +1197,7 @@ static void __exit exit_exfat_fs(void)
 	rcu_barrier();
 	kmem_cache_destroy(exfat_inode_cachep);
 	unregister_filesystem(&exfat_fs_type);
+	exfat_dir_index_shutdown();
 	exfat_cache_shutdown();
 }
 
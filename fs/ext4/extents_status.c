@@ -113,12 +113,17 @@
  *	next extent, adding a extent(a range of blocks) and removing a extent.
  *
  *   --	race on a extent status tree
- *	Extent status tree is protected by inode->i_es_lock.
+ *	Extent status tree is protected by inode->i_es_lock.  Every change
+ *	to the tree is also made inside a write section of inode->i_es_seq,
+ *	so that ext4_es_lookup_extent() can walk the tree under RCU and
+ *	only take i_es_lock when it raced with a writer.  For that extent
+ *	status entries come from a SLAB_TYPESAFE_BY_RCU cache.
  *
  *   --	memory consumption
  *      Fragmented extent tree will make extent status tree cost too much
  *      memory.  Hence, we will reclaim written/unwritten/hole extents from
- *      the tree under a heavy memory pressure.
+ *      the tree under a heavy memory pressure.  Inodes with reclaimable
+ *      extents sit on per-cpu LRU lists which the shrinker visits in turn.
  *
  *
  * ==========================================================================
@@ -153,8 +158,9 @@ static int __es_shrink(struct ext4_sb_info *sbi, int nr_to_scan,
 int __init ext4_init_es(void)
 {
 	ext4_es_cachep = kmem_cache_create("ext4_extent_status",
-					   sizeof(struct extent_status),
-					   0, (SLAB_RECLAIM_ACCOUNT), NULL);
+					   sizeof(struct extent_status), 0,
+					   (SLAB_RECLAIM_ACCOUNT |
+					    SLAB_TYPESAFE_BY_RCU), NULL);
 	if (ext4_es_cachep == NULL)
 		return -ENOMEM;
 	return 0;
@@ -296,34 +302,42 @@ out:
 	trace_ext4_es_find_delayed_extent_range_exit(inode, es);
 }
 
+/*
+ * Both are called with i_es_lock held for writing, which keeps
+ * ei->i_es_lru stable.
+ */
 static void ext4_es_list_add(struct inode *inode)
 {
 	struct ext4_inode_info *ei = EXT4_I(inode);
-	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	struct ext4_es_lru *lru;
 
 	if (!list_empty(&ei->i_es_list))
 		return;
 
-	spin_lock(&sbi->s_es_lock);
-	if (list_empty(&ei->i_es_list)) {
-		list_add_tail(&ei->i_es_list, &sbi->s_es_list);
-		sbi->s_es_nr_inode++;
-	}
-	spin_unlock(&sbi->s_es_lock);
+	lru = raw_cpu_ptr(EXT4_SB(inode->i_sb)->s_es_lru);
+	spin_lock(&lru->lock);
+	list_add_tail(&ei->i_es_list, &lru->list);
+	lru->nr_inode++;
+	ei->i_es_lru = lru;
+	spin_unlock(&lru->lock);
 }
 
 static void ext4_es_list_del(struct inode *inode)
 {
 	struct ext4_inode_info *ei = EXT4_I(inode);
-	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	struct ext4_es_lru *lru = ei->i_es_lru;
 
-	spin_lock(&sbi->s_es_lock);
+	if (!lru)
+		return;
+
+	spin_lock(&lru->lock);
 	if (!list_empty(&ei->i_es_list)) {
 		list_del_init(&ei->i_es_list);
-		sbi->s_es_nr_inode--;
-		WARN_ON_ONCE(sbi->s_es_nr_inode < 0);
+		lru->nr_inode--;
+		WARN_ON_ONCE(lru->nr_inode < 0);
 	}
-	spin_unlock(&sbi->s_es_lock);
+	spin_unlock(&lru->lock);
+	ei->i_es_lru = NULL;
 }
 
 static struct extent_status *
@@ -674,11 +688,13 @@ static int __es_insert_extent(struct inode *inode, struct extent_status *newes)
 				  newes->es_pblk);
 	if (!es)
 		return -ENOMEM;
-	rb_link_node(&es->rb_node, parent, p);
+	/* lockless readers must not find it before it is initialised */
+	rb_link_node_rcu(&es->rb_node, parent, p);
 	rb_insert_color(&es->rb_node, &tree->root);
 
 out:
-	tree->cache_es = es;
+	/* ordered after the initialisation of a new @es as well */
+	smp_store_release(&tree->cache_es, es);
 	return 0;
 }
 
@@ -720,6 +736,7 @@ int ext4_es_insert_extent(struct inode *inode, ext4_lblk_t lblk,
 	ext4_es_insert_extent_check(inode, &newes);
 
 	write_lock(&EXT4_I(inode)->i_es_lock);
+	write_seqcount_begin(&EXT4_I(inode)->i_es_seq);
 	err = __es_remove_extent(inode, lblk, end);
 	if (err != 0)
 		goto error;
@@ -732,6 +749,7 @@ retry:
 		err = 0;
 
 error:
+	write_seqcount_end(&EXT4_I(inode)->i_es_seq);
 	write_unlock(&EXT4_I(inode)->i_es_lock);
 
 	ext4_es_print_tree(inode);
@@ -765,11 +783,91 @@ void ext4_es_cache_extent(struct inode *inode, ext4_lblk_t lblk,
 	write_lock(&EXT4_I(inode)->i_es_lock);
 
 	es = __es_tree_search(&EXT4_I(inode)->i_es_tree.root, lblk);
-	if (!es || es->es_lblk > end)
+	if (!es || es->es_lblk > end) {
+		write_seqcount_begin(&EXT4_I(inode)->i_es_seq);
 		__es_insert_extent(inode, &newes);
+		write_seqcount_end(&EXT4_I(inode)->i_es_seq);
+	}
 	write_unlock(&EXT4_I(inode)->i_es_lock);
 }
 
+/*
+ * A tree of n extents is at most 2 * log2(n + 1) deep. A walk that gets
+ * further than this is running through entries that were freed and
+ * reused under it.
+ */
+#define ES_RCU_MAX_DEPTH	64
+
+/*
+ * Look up @lblk without taking i_es_lock. New entries are published
+ * with rb_link_node_rcu(), so a reader that finds one sees it fully
+ * initialised. Rebalancing and erasing only update child pointers with
+ * WRITE_ONCE(), which keeps a lockless walk from faulting or looping
+ * but not from taking a wrong turn and missing an extent. An entry may
+ * also be freed and reused for another inode during the walk, though
+ * not returned to the page allocator before a grace period, and the
+ * depth bound stops a walk that went astray that way. i_es_seq tells
+ * whether any of this happened, and the result is only trusted if not.
+ *
+ * Return 1 if an extent that was referenced already is found, 0 if there
+ * is none, and -EAGAIN if the caller has to look again under i_es_lock.
+ */
+static int ext4_es_lookup_extent_rcu(struct inode *inode, ext4_lblk_t lblk,
+				     struct extent_status *es)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct extent_status *es1;
+	struct rb_node *node;
+	ext4_lblk_t start, len;
+	unsigned int seq, depth = 0;
+	int ret = -EAGAIN;
+
+	es->es_lblk = es->es_len = es->es_pblk = 0;
+	rcu_read_lock();
+	seq = raw_read_seqcount(&ei->i_es_seq);
+	if (seq & 1)
+		goto out;
+
+	es1 = READ_ONCE(ei->i_es_tree.cache_es);
+	if (es1) {
+		start = READ_ONCE(es1->es_lblk);
+		len = READ_ONCE(es1->es_len);
+		if (lblk - start < len)
+			goto found;
+	}
+
+	node = READ_ONCE(ei->i_es_tree.root.rb_node);
+	while (node) {
+		if (++depth > ES_RCU_MAX_DEPTH)
+			goto out;
+		es1 = rb_entry(node, struct extent_status, rb_node);
+		start = READ_ONCE(es1->es_lblk);
+		len = READ_ONCE(es1->es_len);
+		if (lblk < start)
+			node = READ_ONCE(node->rb_left);
+		else if (lblk - start >= len)
+			node = READ_ONCE(node->rb_right);
+		else
+			goto found;
+	}
+
+	if (!read_seqcount_retry(&ei->i_es_seq, seq))
+		ret = 0;
+	goto out;
+
+found:
+	es->es_lblk = start;
+	es->es_len = len;
+	es->es_pblk = READ_ONCE(es1->es_pblk);
+	/* setting the referenced bit needs i_es_lock */
+	if (!read_seqcount_retry(&ei->i_es_seq, seq) &&
+	    ext4_es_is_referenced(es))
+		ret = 1;
+out:
+	rcu_read_unlock();
+	return ret;
+}
+
 /*
  * ext4_es_lookup_extent() looks up an extent in extent status tree.
  *
@@ -789,6 +887,18 @@ int ext4_es_lookup_extent(struct inode *inode, ext4_lblk_t lblk,
 	trace_ext4_es_lookup_extent_enter(inode, lblk);
 	es_debug("lookup extent in block %u\n", lblk);
 
+	stats = &EXT4_SB(inode->i_sb)->s_es_stats;
+	found = ext4_es_lookup_extent_rcu(inode, lblk, es);
+	if (found >= 0) {
+		if (found)
+			percpu_counter_inc(&stats->es_stats_cache_hits);
+		else
+			percpu_counter_inc(&stats->es_stats_cache_misses);
+		trace_ext4_es_lookup_extent_exit(inode, es, found);
+		return found;
+	}
+	found = 0;
+
 	tree = &EXT4_I(inode)->i_es_tree;
 	read_lock(&EXT4_I(inode)->i_es_lock);
 
@@ -818,7 +928,6 @@ int ext4_es_lookup_extent(struct inode *inode, ext4_lblk_t lblk,
 	}
 
 out:
-	stats = &EXT4_SB(inode->i_sb)->s_es_stats;
 	if (found) {
 		BUG_ON(!es1);
 		es->es_lblk = es1->es_lblk;
@@ -826,9 +935,9 @@ out:
 		es->es_pblk = es1->es_pblk;
 		if (!ext4_es_is_referenced(es1))
 			ext4_es_set_referenced(es1);
-		stats->es_stats_cache_hits++;
+		percpu_counter_inc(&stats->es_stats_cache_hits);
 	} else {
-		stats->es_stats_cache_misses++;
+		percpu_counter_inc(&stats->es_stats_cache_misses);
 	}
 
 	read_unlock(&EXT4_I(inode)->i_es_lock);
@@ -964,38 +1073,35 @@ int ext4_es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
 	 * is reclaimed.
 	 */
 	write_lock(&EXT4_I(inode)->i_es_lock);
+	write_seqcount_begin(&EXT4_I(inode)->i_es_seq);
 	err = __es_remove_extent(inode, lblk, end);
+	write_seqcount_end(&EXT4_I(inode)->i_es_seq);
 	write_unlock(&EXT4_I(inode)->i_es_lock);
 	ext4_es_print_tree(inode);
 	return err;
 }
 
-static int __es_shrink(struct ext4_sb_info *sbi, int nr_to_scan,
-		       struct ext4_inode_info *locked_ei)
+/*
+ * Reclaim extents from the inodes on one LRU, in LRU order. Returns the
+ * number of extents reclaimed.
+ */
+static int es_shrink_lru(struct ext4_es_lru *lru, int *nr_to_scan,
+			 struct ext4_inode_info *locked_ei, int retried,
+			 int *nr_skipped)
 {
 	struct ext4_inode_info *ei;
-	struct ext4_es_stats *es_stats;
-	ktime_t start_time;
-	u64 scan_time;
 	int nr_to_walk;
 	int nr_shrunk = 0;
-	int retried = 0, nr_skipped = 0;
 
-	es_stats = &sbi->s_es_stats;
-	start_time = ktime_get();
-
-retry:
-	spin_lock(&sbi->s_es_lock);
-	nr_to_walk = sbi->s_es_nr_inode;
+	spin_lock(&lru->lock);
+	nr_to_walk = lru->nr_inode;
 	while (nr_to_walk-- > 0) {
-		if (list_empty(&sbi->s_es_list)) {
-			spin_unlock(&sbi->s_es_lock);
-			goto out;
-		}
-		ei = list_first_entry(&sbi->s_es_list, struct ext4_inode_info,
+		if (list_empty(&lru->list))
+			break;
+		ei = list_first_entry(&lru->list, struct ext4_inode_info,
 				      i_es_list);
 		/* Move the inode to the tail */
-		list_move_tail(&ei->i_es_list, &sbi->s_es_list);
+		list_move_tail(&ei->i_es_list, &lru->list);
 
 		/*
 		 * Normally we try hard to avoid shrinking precached inodes,
@@ -1003,28 +1109,63 @@ retry:
 		 */
 		if (!retried && ext4_test_inode_state(&ei->vfs_inode,
 						EXT4_STATE_EXT_PRECACHED)) {
-			nr_skipped++;
+			(*nr_skipped)++;
 			continue;
 		}
 
 		if (ei == locked_ei || !write_trylock(&ei->i_es_lock)) {
-			nr_skipped++;
+			(*nr_skipped)++;
 			continue;
 		}
 		/*
 		 * Now we hold i_es_lock which protects us from inode reclaim
 		 * freeing inode under us
 		 */
-		spin_unlock(&sbi->s_es_lock);
+		spin_unlock(&lru->lock);
 
-		nr_shrunk += es_reclaim_extents(ei, &nr_to_scan);
+		write_seqcount_begin(&ei->i_es_seq);
+		nr_shrunk += es_reclaim_extents(ei, nr_to_scan);
+		write_seqcount_end(&ei->i_es_seq);
 		write_unlock(&ei->i_es_lock);
 
-		if (nr_to_scan <= 0)
+		if (*nr_to_scan <= 0)
+			return nr_shrunk;
+		spin_lock(&lru->lock);
+	}
+	spin_unlock(&lru->lock);
+
+	return nr_shrunk;
+}
+
+static int __es_shrink(struct ext4_sb_info *sbi, int nr_to_scan,
+		       struct ext4_inode_info *locked_ei)
+{
+	struct ext4_es_stats *es_stats;
+	ktime_t start_time;
+	u64 scan_time;
+	unsigned int i, cpu, start_cpu;
+	int nr_shrunk = 0;
+	int retried = 0, nr_skipped = 0;
+
+	es_stats = &sbi->s_es_stats;
+	start_time = ktime_get();
+
+	/* Start where the last scan stopped so that all LRUs age evenly */
+	start_cpu = READ_ONCE(sbi->s_es_shrink_cpu);
+retry:
+	for (i = 0; i < nr_cpu_ids; i++) {
+		cpu = (start_cpu + i) % nr_cpu_ids;
+		if (!cpu_possible(cpu))
+			continue;
+
+		nr_shrunk += es_shrink_lru(per_cpu_ptr(sbi->s_es_lru, cpu),
+					   &nr_to_scan, locked_ei, retried,
+					   &nr_skipped);
+		if (nr_to_scan <= 0) {
+			WRITE_ONCE(sbi->s_es_shrink_cpu, cpu + 1);
 			goto out;
-		spin_lock(&sbi->s_es_lock);
+		}
 	}
-	spin_unlock(&sbi->s_es_lock);
 
 	/*
 	 * If we skipped any inodes, and we weren't able to make any
@@ -1092,29 +1233,37 @@ int ext4_seq_es_shrinker_info_show(struct seq_file *seq, void *v)
 {
 	struct ext4_sb_info *sbi = EXT4_SB((struct super_block *) seq->private);
 	struct ext4_es_stats *es_stats = &sbi->s_es_stats;
-	struct ext4_inode_info *ei, *max = NULL;
+	struct ext4_inode_info *ei;
+	unsigned long max_ino = 0;
+	unsigned int max_all_nr = 0, max_shk_nr = 0;
 	unsigned int inode_cnt = 0;
+	int cpu;
 
 	if (v != SEQ_START_TOKEN)
 		return 0;
 
 	/* here we just find an inode that has the max nr. of objects */
-	spin_lock(&sbi->s_es_lock);
-	list_for_each_entry(ei, &sbi->s_es_list, i_es_list) {
-		inode_cnt++;
-		if (max && max->i_es_all_nr < ei->i_es_all_nr)
-			max = ei;
-		else if (!max)
-			max = ei;
+	for_each_possible_cpu(cpu) {
+		struct ext4_es_lru *lru = per_cpu_ptr(sbi->s_es_lru, cpu);
+
+		spin_lock(&lru->lock);
+		list_for_each_entry(ei, &lru->list, i_es_list) {
+			inode_cnt++;
+			if (!max_ino || max_all_nr < ei->i_es_all_nr) {
+				max_ino = ei->vfs_inode.i_ino;
+				max_all_nr = ei->i_es_all_nr;
+				max_shk_nr = ei->i_es_shk_nr;
+			}
+		}
+		spin_unlock(&lru->lock);
 	}
-	spin_unlock(&sbi->s_es_lock);
 
 	seq_printf(seq, "stats:\n  %lld objects\n  %lld reclaimable objects\n",
 		   percpu_counter_sum_positive(&es_stats->es_stats_all_cnt),
 		   percpu_counter_sum_positive(&es_stats->es_stats_shk_cnt));
-	seq_printf(seq, "  %lu/%lu cache hits/misses\n",
-		   es_stats->es_stats_cache_hits,
-		   es_stats->es_stats_cache_misses);
+	seq_printf(seq, "  %lld/%lld cache hits/misses\n",
+		   percpu_counter_sum_positive(&es_stats->es_stats_cache_hits),
+		   percpu_counter_sum_positive(&es_stats->es_stats_cache_misses));
 	if (inode_cnt)
 		seq_printf(seq, "  %d inodes on list\n", inode_cnt);
 
@@ -1125,7 +1274,7 @@ int ext4_seq_es_shrinker_info_show(struct seq_file *seq, void *v)
 		seq_printf(seq,
 		    "maximum:\n  %lu inode (%u objects, %u reclaimable)\n"
 		    "  %llu us max scan time\n",
-		    max->vfs_inode.i_ino, max->i_es_all_nr, max->i_es_shk_nr,
+		    max_ino, max_all_nr, max_shk_nr,
 		    div_u64(es_stats->es_stats_max_scan_time, 1000));
 
 	return 0;
@@ -1133,21 +1282,33 @@ int ext4_seq_es_shrinker_info_show(struct seq_file *seq, void *v)
 
 int ext4_es_register_shrinker(struct ext4_sb_info *sbi)
 {
-	int err;
+	int err, cpu;
 
 	/* Make sure we have enough bits for physical block number */
 	BUILD_BUG_ON(ES_SHIFT < 48);
-	INIT_LIST_HEAD(&sbi->s_es_list);
-	sbi->s_es_nr_inode = 0;
-	spin_lock_init(&sbi->s_es_lock);
+	sbi->s_es_lru = alloc_percpu(struct ext4_es_lru);
+	if (!sbi->s_es_lru)
+		return -ENOMEM;
+	for_each_possible_cpu(cpu) {
+		struct ext4_es_lru *lru = per_cpu_ptr(sbi->s_es_lru, cpu);
+
+		spin_lock_init(&lru->lock);
+		INIT_LIST_HEAD(&lru->list);
+		lru->nr_inode = 0;
+	}
+	sbi->s_es_shrink_cpu = 0;
 	sbi->s_es_stats.es_stats_shrunk = 0;
-	sbi->s_es_stats.es_stats_cache_hits = 0;
-	sbi->s_es_stats.es_stats_cache_misses = 0;
 	sbi->s_es_stats.es_stats_scan_time = 0;
 	sbi->s_es_stats.es_stats_max_scan_time = 0;
+	err = percpu_counter_init(&sbi->s_es_stats.es_stats_cache_hits, 0, GFP_KERNEL);
+	if (err)
+		goto err0;
+	err = percpu_counter_init(&sbi->s_es_stats.es_stats_cache_misses, 0, GFP_KERNEL);
+	if (err)
+		goto err_hits;
 	err = percpu_counter_init(&sbi->s_es_stats.es_stats_all_cnt, 0, GFP_KERNEL);
 	if (err)
-		return err;
+		goto err_misses;
 	err = percpu_counter_init(&sbi->s_es_stats.es_stats_shk_cnt, 0, GFP_KERNEL);
 	if (err)
 		goto err1;
@@ -1165,14 +1326,25 @@ err2:
 	percpu_counter_destroy(&sbi->s_es_stats.es_stats_shk_cnt);
 err1:
 	percpu_counter_destroy(&sbi->s_es_stats.es_stats_all_cnt);
+err_misses:
+	percpu_counter_destroy(&sbi->s_es_stats.es_stats_cache_misses);
+err_hits:
+	percpu_counter_destroy(&sbi->s_es_stats.es_stats_cache_hits);
+err0:
+	free_percpu(sbi->s_es_lru);
+	sbi->s_es_lru = NULL;
 	return err;
 }
 
 void ext4_es_unregister_shrinker(struct ext4_sb_info *sbi)
 {
+	percpu_counter_destroy(&sbi->s_es_stats.es_stats_cache_hits);
+	percpu_counter_destroy(&sbi->s_es_stats.es_stats_cache_misses);
 	percpu_counter_destroy(&sbi->s_es_stats.es_stats_all_cnt);
 	percpu_counter_destroy(&sbi->s_es_stats.es_stats_shk_cnt);
 	unregister_shrinker(&sbi->s_es_shrinker);
+	free_percpu(sbi->s_es_lru);
+	sbi->s_es_lru = NULL;
 }
 
 /*
@@ -68,10 +68,20 @@ struct ext4_es_tree {
 	struct extent_status *cache_es;	/* recently accessed extent */
 };
 
+/*
+ * Inodes with reclaimable extents are kept on per-cpu lists, the one of
+ * the CPU that cached their first such extent.
+ */
+struct ext4_es_lru {
+	spinlock_t lock;
+	struct list_head list;
+	long nr_inode;
+};
+
 struct ext4_es_stats {
 	unsigned long es_stats_shrunk;
-	unsigned long es_stats_cache_hits;
-	unsigned long es_stats_cache_misses;
+	struct percpu_counter es_stats_cache_hits;
+	struct percpu_counter es_stats_cache_misses;
 	u64 es_stats_scan_time;
 	u64 es_stats_max_scan_time;
 	struct percpu_counter es_stats_all_cnt;
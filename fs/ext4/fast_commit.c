@@ -0,0 +1,154 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * linux/fs/ext4/fast_commit.c
+ *
+ * Fast commits for fsync
+ *
+ * fsync() normally waits for the commit of the transaction holding the
+ * inode, which writes every metadata block changed by every process since
+ * the last commit and is done by a single kjournald2 thread at a time.
+ * Most fsync() calls of databases however only need the inode itself:
+ * the data was written in place or into preallocated blocks, and only
+ * i_size, the timestamps and the extent flags in the inode changed.
+ *
+ * For those a copy of the raw inode is written to the jbd2 fast commit
+ * area instead (see jbd2_fc_begin_commit()) and replayed over the inode
+ * table block if the transaction never made it to the log.  Anything
+ * else, in particular block allocation and freeing, link, unlink and
+ * rename, changes blocks other than the inode's and marks the inode
+ * ineligible for the rest of the transaction, so that fsync() falls back
+ * to a full commit.
+ */
+
+#include <linux/fs.h>
+#include <linux/slab.h>
+
+#include "ext4.h"
+#include "ext4_jbd2.h"
+
+/* A fast commit record: the inode number followed by the raw inode */
+struct ext4_fc_inode {
+	__le32	fc_ino;
+	__le32	fc_reserved;
+	__u8	fc_raw_inode[0];
+};
+
+/*
+ * Called before a change a fast commit cannot describe, and before the
+ * change reaches the raw inode.
+ */
+void ext4_fc_mark_ineligible(struct inode *inode, handle_t *handle)
+{
+	if (!test_opt(inode->i_sb, FAST_COMMIT) || !ext4_handle_valid(handle))
+		return;
+
+	WRITE_ONCE(EXT4_I(inode)->i_fc_ineligible_tid,
+		   handle->h_transaction->t_tid);
+	smp_wmb();
+	ext4_set_inode_state(inode, EXT4_STATE_FC_INELIGIBLE);
+}
+
+static bool ext4_fc_eligible(struct inode *inode, tid_t tid)
+{
+	if (!ext4_test_inode_state(inode, EXT4_STATE_FC_INELIGIBLE))
+		return true;
+	smp_rmb();
+	return READ_ONCE(EXT4_I(inode)->i_fc_ineligible_tid) != tid;
+}
+
+/*
+ * Make the changes to @inode in transaction @tid durable with a fast
+ * commit.  Returns 0 on success, otherwise @tid has to be committed.
+ */
+int ext4_fc_commit(struct inode *inode, tid_t tid)
+{
+	struct super_block *sb = inode->i_sb;
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	int inode_size = EXT4_INODE_SIZE(sb);
+	struct ext4_fc_inode *rec;
+	struct ext4_iloc iloc;
+	unsigned long blocknr;
+	int ret;
+
+	/* The fast commit only flushes the journal device */
+	if (!S_ISREG(inode->i_mode) || journal->j_dev != journal->j_fs_dev)
+		return -EOPNOTSUPP;
+	if (!ext4_fc_eligible(inode, tid))
+		return -EAGAIN;
+
+	rec = kmalloc(sizeof(*rec) + inode_size, GFP_NOFS);
+	if (!rec)
+		return -ENOMEM;
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		goto out_free;
+
+	ret = jbd2_fc_begin_commit(journal, tid);
+	if (ret)
+		goto out_brelse;
+
+	rec->fc_ino = cpu_to_le32(inode->i_ino);
+	rec->fc_reserved = 0;
+
+	/*
+	 * Reserve the block under i_raw_lock, so that records of the same
+	 * inode are replayed in the order they were copied.
+	 */
+	spin_lock(&ei->i_raw_lock);
+	memcpy(rec->fc_raw_inode, ext4_raw_inode(&iloc), inode_size);
+	ret = jbd2_fc_reserve_block(journal, &blocknr);
+	spin_unlock(&ei->i_raw_lock);
+
+	if (!ret && !ext4_fc_eligible(inode, tid))
+		ret = -EAGAIN;
+	if (!ret)
+		ret = jbd2_fc_write_block(journal, blocknr, rec,
+					  sizeof(*rec) + inode_size);
+	jbd2_fc_end_commit(journal);
+out_brelse:
+	brelse(iloc.bh);
+out_free:
+	kfree(rec);
+	return ret;
+}
+
+/*
+ * Called by jbd2 recovery, after the log has been replayed, for every
+ * record written in the transaction that did not make it.
+ */
+int ext4_fc_replay(journal_t *journal, void *buf, unsigned int len)
+{
+	struct super_block *sb = journal->j_private;
+	int inode_size = EXT4_INODE_SIZE(sb);
+	struct ext4_fc_inode *rec = buf;
+	struct ext4_group_desc *gdp;
+	struct buffer_head *bh;
+	unsigned long ino, offset;
+	ext4_fsblk_t block;
+
+	ino = le32_to_cpu(rec->fc_ino);
+	if (len != sizeof(*rec) + inode_size || !ext4_valid_inum(sb, ino)) {
+		ext4_msg(sb, KERN_ERR, "invalid fast commit record");
+		return -EFSCORRUPTED;
+	}
+
+	gdp = ext4_get_group_desc(sb, (ino - 1) / EXT4_INODES_PER_GROUP(sb),
+				  NULL);
+	if (!gdp)
+		return -EFSCORRUPTED;
+	offset = ((ino - 1) % EXT4_INODES_PER_GROUP(sb)) * inode_size;
+	block = ext4_inode_table(sb, gdp) + offset / sb->s_blocksize;
+	offset %= sb->s_blocksize;
+
+	bh = sb_bread(sb, block);
+	if (!bh)
+		return -EIO;
+	lock_buffer(bh);
+	memcpy(bh->b_data + offset, rec->fc_raw_inode, inode_size);
+	unlock_buffer(bh);
+	mark_buffer_dirty(bh);
+	brelse(bh);
+
+	return 0;
+}
@@ -5589,6 +5589,9 @@ int ext4_setattr(struct dentry *dentry, struct iattr *attr)
 			goto err_out;
 		}
 
+		/* The quota files change as well */
+		ext4_fc_mark_ineligible(inode, handle);
+
 		/* dquot_transfer() calls back ext4_get_inode_usage() which
 		 * counts xattr inode references.
 		 */
@@ -140,6 +140,8 @@ static long swap_inode_boot_loader(struct super_block *sb,
 
 	/* Protect extent tree against block allocations via delalloc */
 	ext4_double_down_write_data_sem(inode, inode_bl);
+	ext4_fc_mark_ineligible(inode, handle);
+	ext4_fc_mark_ineligible(inode_bl, handle);
 
 	if (is_bad_inode(inode_bl) || !S_ISREG(inode_bl->i_mode)) {
 		/* this inode has never been used as a BOOT_LOADER */
@@ -698,22 +698,38 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 
 /*
  * Cache the order of the largest free extent we have available in this block
- * group.
+ * group, and keep the group on the list of groups of that order.
+ *
+ * Caller must hold the group lock.
  */
 static void
 mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 {
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	int i;
-	int bits;
-
-	grp->bb_largest_free_order = -1; /* uninit */
 
-	bits = sb->s_blocksize_bits + 1;
-	for (i = bits; i >= 0; i--) {
-		if (grp->bb_counters[i] > 0) {
-			grp->bb_largest_free_order = i;
+	for (i = MB_NUM_ORDERS(sb) - 1; i >= 0; i--)
+		if (grp->bb_counters[i] > 0)
 			break;
-		}
+
+	if (i == grp->bb_largest_free_order &&
+	    !list_empty(&grp->bb_largest_free_order_node))
+		return;
+
+	if (!list_empty(&grp->bb_largest_free_order_node)) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[
+						grp->bb_largest_free_order]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[
+						grp->bb_largest_free_order]);
+	}
+
+	grp->bb_largest_free_order = i; /* -1 if the group is full */
+	if (i >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[i]);
+		list_add_tail(&grp->bb_largest_free_order_node,
+			      &sbi->s_mb_largest_free_orders[i]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[i]);
 	}
 }
 
@@ -2110,12 +2126,143 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 	return 0;
 }
 
+/*
+ * Could @grp satisfy the request at criteria @cr? Like ext4_mb_good_group()
+ * but without the group lock or initializing the buddy; groups on the
+ * largest free order lists have been initialized.
+ */
+static bool ext4_mb_order_group_ok(struct ext4_allocation_context *ac,
+				   struct ext4_group_info *grp, int cr,
+				   ext4_group_t ngroups)
+{
+	int flex_size = ext4_flex_bg_size(EXT4_SB(ac->ac_sb));
+	ext4_grpblk_t free = READ_ONCE(grp->bb_free);
+	ext4_grpblk_t fragments = READ_ONCE(grp->bb_fragments);
+
+	if (grp->bb_group >= ngroups || free < ac->ac_g_ex.fe_len ||
+	    fragments == 0 || EXT4_MB_GRP_BBITMAP_CORRUPT(grp))
+		return false;
+
+	if (cr == 1)
+		return free / fragments >= ac->ac_g_ex.fe_len;
+
+	/* Avoid using the first bg of a flexgroup for data files */
+	return !((ac->ac_flags & EXT4_MB_HINT_DATA) &&
+		 (flex_size >= EXT4_FLEX_SIZE_DIR_ALLOC_SCHEME) &&
+		 ((grp->bb_group % flex_size) == 0));
+}
+
+/*
+ * Pick a group for criteria 0 or 1 from the largest free order lists
+ * rather than scanning all groups, preferring one whose lock is not held
+ * so that parallel allocators spread out. A group with an average free
+ * extent of at least fe_len has a free buddy of at least half of it.
+ *
+ * Returns false if no initialized group can satisfy @cr, in which case
+ * only groups whose buddy has not been generated yet are left to try.
+ */
+static bool ext4_mb_choose_group(struct ext4_allocation_context *ac, int cr,
+				 ext4_group_t ngroups, ext4_group_t *group)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_info *grp, *busy = NULL;
+	int order;
+
+	if (cr == 0)
+		order = ac->ac_2order;
+	else
+		order = max(fls(ac->ac_g_ex.fe_len) - 2, 0);
+
+	for (; order < MB_NUM_ORDERS(sb); order++) {
+		if (list_empty_careful(&sbi->s_mb_largest_free_orders[order]))
+			continue;
+
+		read_lock(&sbi->s_mb_largest_free_orders_locks[order]);
+		list_for_each_entry(grp, &sbi->s_mb_largest_free_orders[order],
+				    bb_largest_free_order_node) {
+			if (!ext4_mb_order_group_ok(ac, grp, cr, ngroups))
+				continue;
+			if (spin_is_locked(ext4_group_lock_ptr(sb,
+							       grp->bb_group))) {
+				if (!busy)
+					busy = grp;
+				continue;
+			}
+			*group = grp->bb_group;
+			read_unlock(&sbi->s_mb_largest_free_orders_locks[order]);
+			return true;
+		}
+		read_unlock(&sbi->s_mb_largest_free_orders_locks[order]);
+	}
+
+	if (busy) {
+		*group = busy->bb_group;
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Try to allocate from @group at criteria @cr. Groups that do not qualify
+ * are skipped, with the first error they returned saved in @first_err.
+ */
+static int ext4_mb_scan_group(struct ext4_allocation_context *ac,
+			      ext4_group_t group, int cr, int *first_err)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_buddy e4b;
+	int ret, err;
+
+	/* This now checks without needing the buddy page */
+	ret = ext4_mb_good_group(ac, group, cr);
+	if (ret <= 0) {
+		if (!*first_err)
+			*first_err = ret;
+		return 0;
+	}
+
+	err = ext4_mb_load_buddy(sb, group, &e4b);
+	if (err)
+		return err;
+
+	ext4_lock_group(sb, group);
+
+	/*
+	 * We need to check again after locking the
+	 * block group
+	 */
+	ret = ext4_mb_good_group(ac, group, cr);
+	if (ret <= 0) {
+		ext4_unlock_group(sb, group);
+		ext4_mb_unload_buddy(&e4b);
+		if (!*first_err)
+			*first_err = ret;
+		return 0;
+	}
+
+	ac->ac_groups_scanned++;
+	if (cr == 0)
+		ext4_mb_simple_scan_group(ac, &e4b);
+	else if (cr == 1 && sbi->s_stripe &&
+			!(ac->ac_g_ex.fe_len % sbi->s_stripe))
+		ext4_mb_scan_aligned(ac, &e4b);
+	else
+		ext4_mb_complex_scan_group(ac, &e4b);
+
+	ext4_unlock_group(sb, group);
+	ext4_mb_unload_buddy(&e4b);
+	return 0;
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
 	ext4_group_t ngroups, group, i;
 	int cr;
 	int err = 0, first_err = 0;
+	bool uninit_only;
 	struct ext4_sb_info *sbi;
 	struct super_block *sb;
 	struct ext4_buddy e4b;
@@ -2184,8 +2331,32 @@ repeat:
 		 */
 		group = ac->ac_g_ex.fe_group;
 
+		uninit_only = false;
+
+		/*
+		 * Try the group the order lists suggest first, and fall
+		 * back to the linear scan only if it did not work out.
+		 */
+		if (cr < 2 && sbi->s_mb_optimize_scan &&
+		    !(ac->ac_flags & EXT4_MB_HINT_FIRST)) {
+			ext4_group_t best;
+
+			if (ext4_mb_choose_group(ac, cr, ngroups, &best)) {
+				err = ext4_mb_scan_group(ac, best, cr,
+							 &first_err);
+				if (err)
+					goto out;
+				if (ac->ac_status != AC_STATUS_CONTINUE) {
+					if (sbi->s_mb_stats)
+						atomic_inc(&sbi->s_bal_order_hits);
+					break;
+				}
+			} else {
+				uninit_only = true;
+			}
+		}
+
 		for (i = 0; i < ngroups; group++, i++) {
-			int ret = 0;
 			cond_resched();
 			/*
 			 * Artificially restricted ngroups for non-extent
@@ -2194,45 +2365,14 @@ repeat:
 			if (group >= ngroups)
 				group = 0;
 
-			/* This now checks without needing the buddy page */
-			ret = ext4_mb_good_group(ac, group, cr);
-			if (ret <= 0) {
-				if (!first_err)
-					first_err = ret;
+			if (uninit_only && !EXT4_MB_GRP_NEED_INIT(
+					ext4_get_group_info(sb, group)))
 				continue;
-			}
 
-			err = ext4_mb_load_buddy(sb, group, &e4b);
+			err = ext4_mb_scan_group(ac, group, cr, &first_err);
 			if (err)
 				goto out;
 
-			ext4_lock_group(sb, group);
-
-			/*
-			 * We need to check again after locking the
-			 * block group
-			 */
-			ret = ext4_mb_good_group(ac, group, cr);
-			if (ret <= 0) {
-				ext4_unlock_group(sb, group);
-				ext4_mb_unload_buddy(&e4b);
-				if (!first_err)
-					first_err = ret;
-				continue;
-			}
-
-			ac->ac_groups_scanned++;
-			if (cr == 0)
-				ext4_mb_simple_scan_group(ac, &e4b);
-			else if (cr == 1 && sbi->s_stripe &&
-					!(ac->ac_g_ex.fe_len % sbi->s_stripe))
-				ext4_mb_scan_aligned(ac, &e4b);
-			else
-				ext4_mb_complex_scan_group(ac, &e4b);
-
-			ext4_unlock_group(sb, group);
-			ext4_mb_unload_buddy(&e4b);
-
 			if (ac->ac_status != AC_STATUS_CONTINUE)
 				break;
 		}
@@ -2475,9 +2615,11 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	}
 
 	INIT_LIST_HEAD(&meta_group_info[i]->bb_prealloc_list);
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_largest_free_order_node);
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root = RB_ROOT;
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
+	meta_group_info[i]->bb_group = group;
 
 #ifdef DOUBLE_CHECK
 	{
@@ -2638,6 +2780,22 @@ int ext4_mb_init(struct super_block *sb)
 		goto out;
 	}
 
+	sbi->s_mb_largest_free_orders =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(struct list_head),
+			      GFP_KERNEL);
+	sbi->s_mb_largest_free_orders_locks =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(rwlock_t),
+			      GFP_KERNEL);
+	if (!sbi->s_mb_largest_free_orders ||
+	    !sbi->s_mb_largest_free_orders_locks) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < MB_NUM_ORDERS(sb); i++) {
+		INIT_LIST_HEAD(&sbi->s_mb_largest_free_orders[i]);
+		rwlock_init(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+
 	ret = ext4_groupinfo_create_slab(sb->s_blocksize);
 	if (ret < 0)
 		goto out;
@@ -2669,6 +2827,7 @@ int ext4_mb_init(struct super_block *sb)
 	sbi->s_mb_stats = MB_DEFAULT_STATS;
 	sbi->s_mb_stream_request = MB_DEFAULT_STREAM_THRESHOLD;
 	sbi->s_mb_order2_reqs = MB_DEFAULT_ORDER2_REQS;
+	sbi->s_mb_optimize_scan = MB_DEFAULT_OPTIMIZE_SCAN;
 	/*
 	 * The default group preallocation is 512, which for 4k block
 	 * sizes translates to 2 megabytes.  However for bigalloc file
@@ -2721,6 +2880,10 @@ out_free_locality_groups:
 	free_percpu(sbi->s_locality_groups);
 	sbi->s_locality_groups = NULL;
 out:
+	kfree(sbi->s_mb_largest_free_orders);
+	sbi->s_mb_largest_free_orders = NULL;
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	sbi->s_mb_largest_free_orders_locks = NULL;
 	kfree(sbi->s_mb_offsets);
 	sbi->s_mb_offsets = NULL;
 	kfree(sbi->s_mb_maxs);
@@ -2776,6 +2939,8 @@ int ext4_mb_release(struct super_block *sb)
 		kvfree(group_info);
 		rcu_read_unlock();
 	}
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
 	iput(sbi->s_buddy_cache);
@@ -2793,6 +2958,10 @@ int ext4_mb_release(struct super_block *sb)
 				atomic_read(&sbi->s_bal_2orders),
 				atomic_read(&sbi->s_bal_breaks),
 				atomic_read(&sbi->s_mb_lost_chunks));
+		ext4_msg(sb, KERN_INFO,
+		       "mballoc: %u groups scanned, %u order list hits",
+				atomic_read(&sbi->s_bal_groups_scanned),
+				atomic_read(&sbi->s_bal_order_hits));
 		ext4_msg(sb, KERN_INFO,
 		       "mballoc: %lu generated and it took %Lu",
 				sbi->s_mb_buddies_generated,
@@ -3338,6 +3507,7 @@ static void ext4_mb_collect_stats(struct ext4_allocation_context *ac)
 			atomic_inc(&sbi->s_bal_goals);
 		if (ac->ac_found > sbi->s_mb_max_to_scan)
 			atomic_inc(&sbi->s_bal_breaks);
+		atomic_add(ac->ac_groups_scanned, &sbi->s_bal_groups_scanned);
 	}
 
 	if (ac->ac_op == EXT4_MB_HISTORY_ALLOC)
@@ -4564,6 +4734,7 @@ ext4_fsblk_t ext4_mb_new_blocks(handle_t *handle,
 	might_sleep();
 	sb = ar->inode->i_sb;
 	sbi = EXT4_SB(sb);
+	ext4_fc_mark_ineligible(ar->inode, handle);
 
 	trace_ext4_request_blocks(ar);
 
@@ -4817,6 +4988,7 @@ void ext4_free_blocks(handle_t *handle, struct inode *inode,
 	}
 
 	sbi = EXT4_SB(sb);
+	ext4_fc_mark_ineligible(inode, handle);
 	if (!(flags & EXT4_FREE_BLOCKS_VALIDATED) &&
 	    !ext4_inode_block_valid(inode, block, count)) {
 		ext4_error(sb, "Freeing blocks not in datazone - "
@@ -77,6 +77,16 @@ do {									\
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * Pick the groups to try at criteria 0 and 1 from the lists of groups
+ * ordered by their largest free extent instead of scanning linearly,
+ * tunable via /sys/fs/ext4/<partition>/mb_optimize_scan
+ */
+#define MB_DEFAULT_OPTIMIZE_SCAN	1
+
+/* number of buddy orders, and so of largest free order lists */
+#define MB_NUM_ORDERS(sb)		((sb)->s_blocksize_bits + 2)
+
 
 struct ext4_free_data {
 	/* this links the free block information from sb_info */
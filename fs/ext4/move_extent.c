@@ -284,6 +284,8 @@ again:
 		*err = PTR_ERR(handle);
 		return 0;
 	}
+	ext4_fc_mark_ineligible(orig_inode, handle);
+	ext4_fc_mark_ineligible(donor_inode, handle);
 
 	orig_blk_offset = orig_page_offset * blocks_per_page +
 		data_offset_in_page;
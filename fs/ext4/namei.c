@@ -3083,6 +3083,8 @@ int ext4_orphan_add(handle_t *handle, struct inode *inode)
 	if (!list_empty(&EXT4_I(inode)->i_orphan))
 		return 0;
 
+	ext4_fc_mark_ineligible(inode, handle);
+
 	/*
 	 * Orphan handling is only valid for files with data blocks
 	 * being truncated, or files being unlinked. Note that we either
@@ -3165,6 +3167,7 @@ int ext4_orphan_del(handle_t *handle, struct inode *inode)
 		return 0;
 
 	if (handle) {
+		ext4_fc_mark_ineligible(inode, handle);
 		/* Grab inode buffer early before taking global s_orphan_lock */
 		err = ext4_reserve_inode_write(handle, inode, &iloc);
 	}
@@ -3203,6 +3206,7 @@ int ext4_orphan_del(handle_t *handle, struct inode *inode)
 
 		jbd_debug(4, "orphan inode %lu will point to %u\n",
 			  i_prev->i_ino, ino_next);
+		ext4_fc_mark_ineligible(i_prev, handle);
 		err = ext4_reserve_inode_write(handle, i_prev, &iloc2);
 		if (err) {
 			mutex_unlock(&sbi->s_orphan_lock);
@@ -3357,6 +3361,7 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 	if (IS_DIRSYNC(dir))
 		ext4_handle_sync(handle);
 
+	ext4_fc_mark_ineligible(inode, handle);
 	retval = ext4_delete_entry(handle, dir, de, bh);
 	if (retval)
 		goto end_unlink;
@@ -3555,6 +3560,7 @@ retry:
 	if (IS_DIRSYNC(dir))
 		ext4_handle_sync(handle);
 
+	ext4_fc_mark_ineligible(inode, handle);
 	inode->i_ctime = current_time(inode);
 	ext4_inc_count(handle, inode);
 	ihold(inode);
@@ -3948,6 +3954,10 @@ static int ext4_rename(struct inode *old_dir, struct dentry *old_dentry,
 	if (IS_DIRSYNC(old.dir) || IS_DIRSYNC(new.dir))
 		ext4_handle_sync(handle);
 
+	ext4_fc_mark_ineligible(old.inode, handle);
+	if (new.inode)
+		ext4_fc_mark_ineligible(new.inode, handle);
+
 	if (S_ISDIR(old.inode->i_mode)) {
 		if (new.inode) {
 			retval = -ENOTEMPTY;
@@ -4137,6 +4147,9 @@ static int ext4_cross_rename(struct inode *old_dir, struct dentry *old_dentry,
 	if (IS_DIRSYNC(old.dir) || IS_DIRSYNC(new.dir))
 		ext4_handle_sync(handle);
 
+	ext4_fc_mark_ineligible(old.inode, handle);
+	ext4_fc_mark_ineligible(new.inode, handle);
+
 	if (S_ISDIR(old.inode->i_mode)) {
 		old.is_dir = true;
 		retval = ext4_rename_dir_prepare(handle, &old);
@@ -1042,7 +1042,9 @@ static struct inode *ext4_alloc_inode(struct super_block *sb)
 	spin_lock_init(&ei->i_prealloc_lock);
 	ext4_es_init_tree(&ei->i_es_tree);
 	rwlock_init(&ei->i_es_lock);
+	seqcount_init(&ei->i_es_seq);
 	INIT_LIST_HEAD(&ei->i_es_list);
+	ei->i_es_lru = NULL;
 	ei->i_es_all_nr = 0;
 	ei->i_es_shk_nr = 0;
 	ei->i_es_shrink_lblk = 0;
@@ -1429,6 +1431,7 @@ enum {
 	Opt_auto_da_alloc, Opt_noauto_da_alloc, Opt_noload,
 	Opt_commit, Opt_min_batch_time, Opt_max_batch_time, Opt_journal_dev,
 	Opt_journal_path, Opt_journal_checksum, Opt_journal_async_commit,
+	Opt_fast_commit,
 	Opt_abort, Opt_data_journal, Opt_data_ordered, Opt_data_writeback,
 	Opt_data_err_abort, Opt_data_err_ignore, Opt_test_dummy_encryption,
 	Opt_inlinecrypt,
@@ -1478,6 +1481,7 @@ static const match_table_t tokens = {
 	{Opt_journal_checksum, "journal_checksum"},
 	{Opt_nojournal_checksum, "nojournal_checksum"},
 	{Opt_journal_async_commit, "journal_async_commit"},
+	{Opt_fast_commit, "fast_commit"},
 	{Opt_abort, "abort"},
 	{Opt_data_journal, "data=journal"},
 	{Opt_data_ordered, "data=ordered"},
@@ -1673,6 +1677,7 @@ static const struct mount_opts {
 	 MOPT_EXT4_ONLY | MOPT_CLEAR},
 	{Opt_journal_checksum, EXT4_MOUNT_JOURNAL_CHECKSUM,
 	 MOPT_EXT4_ONLY | MOPT_SET | MOPT_EXPLICIT},
+	{Opt_fast_commit, EXT4_MOUNT_FAST_COMMIT, MOPT_EXT4_ONLY | MOPT_SET},
 	{Opt_journal_async_commit, (EXT4_MOUNT_JOURNAL_ASYNC_COMMIT |
 				    EXT4_MOUNT_JOURNAL_CHECKSUM),
 	 MOPT_EXT4_ONLY | MOPT_SET | MOPT_EXPLICIT},
@@ -4381,6 +4386,11 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 				 "journal_async_commit, fs mounted w/o journal");
 			goto failed_mount_wq;
 		}
+		if (test_opt(sb, FAST_COMMIT)) {
+			ext4_msg(sb, KERN_ERR, "can't mount with "
+				 "fast_commit, fs mounted w/o journal");
+			goto failed_mount_wq;
+		}
 		if (sbi->s_commit_interval != JBD2_DEFAULT_MAX_COMMIT_AGE*HZ) {
 			ext4_msg(sb, KERN_ERR, "can't mount with "
 				 "commit=%lu, fs mounted w/o journal",
@@ -4448,6 +4458,33 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 		goto failed_mount_wq;
 	}
 
+	/*
+	 * fast_commit sets JBD2_FEATURE_INCOMPAT_INODE_FC in the journal
+	 * superblock, and only a clean unmount clears it again: while the
+	 * log is in use it ends before the fast commit area, so a tool that
+	 * does not know the feature would replay it wrong.  After a crash the
+	 * journal therefore needs recovery and carries a feature e2fsprogs
+	 * does not know, and e2fsck refuses to check the file system until
+	 * it has been mounted once by a kernel with fast commit support.  Do
+	 * not use fast_commit where e2fsck runs before the first mount, as
+	 * Android does for /data, unless e2fsprogs knows the feature.
+	 */
+	if (test_opt(sb, FAST_COMMIT)) {
+		if (test_opt(sb, DATA_FLAGS) == EXT4_MOUNT_JOURNAL_DATA) {
+			ext4_msg(sb, KERN_ERR, "can't mount with "
+				 "fast_commit in data=journal mode");
+			goto failed_mount_wq;
+		}
+		err = sb_rdonly(sb) ? -EROFS :
+			jbd2_fc_init(sbi->s_journal, 0);
+		if (err) {
+			ext4_msg(sb, KERN_WARNING, "fast commits disabled "
+				 "(error %d)", err);
+			clear_opt(sb, FAST_COMMIT);
+			err = 0;
+		}
+	}
+
 	set_task_ioprio(sbi->s_journal->j_task, journal_ioprio);
 
 	sbi->s_journal->j_commit_callback = ext4_journal_commit_callback;
@@ -4993,6 +5030,8 @@ static int ext4_load_journal(struct super_block *sb,
 	if (!(journal->j_flags & JBD2_BARRIER))
 		ext4_msg(sb, KERN_INFO, "barriers disabled");
 
+	journal->j_fc_replay_callback = ext4_fc_replay;
+
 	if (!ext4_has_feature_journal_needs_recovery(sb))
 		err = jbd2_journal_wipe(journal, !really_read_only);
 	if (!err) {
@@ -5450,6 +5489,12 @@ static int ext4_remount(struct super_block *sb, int *flags, char *data)
 		goto restore_opts;
 	}
 
+	if ((sbi->s_mount_opt ^ old_opts.s_mount_opt) & EXT4_MOUNT_FAST_COMMIT) {
+		ext4_msg(sb, KERN_ERR, "can't change fast_commit during remount");
+		err = -EINVAL;
+		goto restore_opts;
+	}
+
 	if ((sbi->s_mount_opt ^ old_opts.s_mount_opt) & EXT4_MOUNT_DAX) {
 		ext4_msg(sb, KERN_WARNING, "warning: refusing change of "
 			"dax flag with busy inodes while remounting");
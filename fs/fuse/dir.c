@@ -23,7 +23,7 @@ static bool fuse_use_readdirplus(struct inode *dir, struct dir_context *ctx)
 
 	if (!fc->do_readdirplus)
 		return false;
-	if (!fc->readdirplus_auto)
+	if (!fc->readdirplus_auto || ctx->want_attrs)
 		return true;
 	if (test_and_clear_bit(FUSE_I_ADVISE_RDPLUS, &fi->state))
 		return true;
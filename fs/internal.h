@@ -17,6 +17,8 @@ struct linux_binprm;
 struct path;
 struct mount;
 struct shrink_control;
+struct kstat;
+struct statx;
 
 /*
  * block_dev.c
@@ -174,6 +176,18 @@ extern int do_vfs_ioctl(struct file *file, unsigned int fd, unsigned int cmd,
 		    unsigned long arg);
 extern long vfs_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
 
+/*
+ * fs/readdir.c
+ */
+struct fs_readdirplus;
+extern long vfs_readdirplus(struct file *file,
+			    struct fs_readdirplus __user *argp);
+
+/*
+ * fs/stat.c
+ */
+extern void kstat_to_statx(const struct kstat *stat, struct statx *tmp);
+
 /*
  * iomap support:
  */
@@ -44,6 +44,7 @@
 #include <linux/bitops.h>
 #include <linux/ratelimit.h>
 #include <linux/sched/mm.h>
+#include <linux/crc32.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/jbd2.h>
@@ -1139,6 +1140,7 @@ static journal_t *journal_init_common(struct block_device *bdev,
 	init_waitqueue_head(&journal->j_wait_commit);
 	init_waitqueue_head(&journal->j_wait_updates);
 	init_waitqueue_head(&journal->j_wait_reserved);
+	init_waitqueue_head(&journal->j_fc_wait);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
@@ -1303,6 +1305,8 @@ static int journal_reset(journal_t *journal)
 
 	first = be32_to_cpu(sb->s_first);
 	last = be32_to_cpu(sb->s_maxlen);
+	if (jbd2_has_feature_inode_fc(journal))
+		last -= be32_to_cpu(sb->s_num_inode_fc_blks);
 	if (first + JBD2_MIN_JOURNAL_BLOCKS > last + 1) {
 		printk(KERN_ERR "JBD2: Journal too short (blocks %llu-%llu).\n",
 		       first, last);
@@ -1321,6 +1325,11 @@ static int journal_reset(journal_t *journal)
 	journal->j_commit_sequence = journal->j_transaction_sequence - 1;
 	journal->j_commit_request = journal->j_commit_sequence;
 
+	journal->j_fc_first = last;
+	journal->j_fc_last = be32_to_cpu(sb->s_maxlen);
+	journal->j_fc_off = 0;
+	journal->j_fc_tid = journal->j_commit_sequence;
+
 	journal->j_max_transaction_buffers = journal->j_maxlen / 4;
 
 	/*
@@ -1505,6 +1514,274 @@ void jbd2_journal_update_sb_errno(journal_t *journal)
 }
 EXPORT_SYMBOL(jbd2_journal_update_sb_errno);
 
+/*
+ * Fast commits
+ *
+ * A fast commit makes the changes a file system made to one object in the
+ * running transaction durable without committing the transaction.  The
+ * file system hands us a record which is written to its own block in the
+ * fast commit area at the end of the journal, tagged with the tid of the
+ * running transaction.  If we crash before that transaction commits,
+ * recovery passes the records of the first transaction it did not find
+ * in the log back to the file system once the log has been replayed.
+ *
+ * Fast commits only take j_state_lock to reserve their block, so they are
+ * written in parallel with each other and do not wait for kjournald2 to
+ * commit the running transaction.  The area is reused by the next
+ * transaction once the records in it are no longer needed.
+ */
+
+/**
+ * jbd2_fc_init() - Set up the fast commit area.
+ * @journal: Journal to act on.
+ * @nblocks: Size of the area, 0 for the default.
+ *
+ * Must be called after jbd2_journal_load() and before the first handle is
+ * started.  The feature and the size of the area are written to the
+ * journal superblock right away so that recovery finds the records.
+ */
+int jbd2_fc_init(journal_t *journal, unsigned int nblocks)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	int err = 0;
+
+	if (journal->j_format_version < 2)
+		return -EOPNOTSUPP;
+	/* Still there from a crash, journal_reset() has set it up */
+	if (jbd2_has_feature_inode_fc(journal))
+		return 0;
+
+	if (!nblocks)
+		nblocks = JBD2_DEFAULT_FC_BLOCKS;
+
+	write_lock(&journal->j_state_lock);
+	if (journal->j_running_transaction ||
+	    journal->j_committing_transaction ||
+	    journal->j_head != journal->j_tail)
+		err = -EBUSY;
+	else if (journal->j_last - journal->j_first <
+		 JBD2_MIN_JOURNAL_BLOCKS + nblocks)
+		err = -ENOSPC;
+	else {
+		journal->j_last -= nblocks;
+		journal->j_free -= nblocks;
+		journal->j_fc_first = journal->j_last;
+		journal->j_fc_last = journal->j_last + nblocks;
+		journal->j_fc_off = 0;
+		journal->j_fc_tid = journal->j_commit_sequence;
+	}
+	write_unlock(&journal->j_state_lock);
+	if (err)
+		return err;
+
+	mutex_lock_io(&journal->j_checkpoint_mutex);
+	lock_buffer(journal->j_sb_buffer);
+	jbd2_set_feature_inode_fc(journal);
+	sb->s_num_inode_fc_blks = cpu_to_be32(nblocks);
+	err = jbd2_write_superblock(journal, REQ_SYNC | REQ_FUA);
+	mutex_unlock(&journal->j_checkpoint_mutex);
+
+	return err;
+}
+EXPORT_SYMBOL(jbd2_fc_init);
+
+/*
+ * Drop the fast commit feature when the journal is destroyed, so that
+ * kernels and e2fsprogs without fast commit support can use the file
+ * system.  The log must be empty and marked as such on disk: while it is
+ * not, it may wrap at j_last, before the fast commit area, and only a
+ * journal with the feature set tells recovery so.
+ */
+static void jbd2_fc_release(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+
+	BUG_ON(!mutex_is_locked(&journal->j_checkpoint_mutex));
+	lock_buffer(journal->j_sb_buffer);
+	if (!jbd2_has_feature_inode_fc(journal) || sb->s_start) {
+		unlock_buffer(journal->j_sb_buffer);
+		return;
+	}
+
+	jbd2_clear_feature_inode_fc(journal);
+	sb->s_num_inode_fc_blks = 0;
+	jbd2_write_superblock(journal, REQ_SYNC | REQ_FUA);
+}
+
+/**
+ * jbd2_fc_begin_commit() - Start a fast commit.
+ * @journal: Journal to act on.
+ * @tid: Transaction holding the changes to be made durable.
+ *
+ * Returns 0 if a fast commit can be written for @tid, in which case
+ * jbd2_fc_end_commit() must be called once it is done.  Otherwise @tid has
+ * to be committed in full, or has been already.
+ *
+ * Records of @tid are only replayed if all transactions before it made it
+ * to the log, so this waits for the commit of the previous transaction.
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	transaction_t *running;
+	int ret = 0;
+
+	if (journal->j_fc_first == journal->j_fc_last)
+		return -EOPNOTSUPP;
+
+	write_lock(&journal->j_state_lock);
+	for (;;) {
+		DEFINE_WAIT(wait);
+
+		if (is_journal_aborted(journal)) {
+			ret = -EROFS;
+			break;
+		}
+		/*
+		 * Recovery ignores the fast commit area while the log is
+		 * marked empty on disk, the next commit will clear that.
+		 */
+		running = journal->j_running_transaction;
+		if (!running || running->t_tid != tid ||
+		    (journal->j_flags & JBD2_FLUSHED)) {
+			ret = -EALREADY;
+			break;
+		}
+
+		if (journal->j_commit_sequence + 1 == tid) {
+			if (journal->j_fc_tid == tid)
+				break;
+			/*
+			 * The records in the area belong to a committed
+			 * transaction, start over once their writers are
+			 * done.
+			 */
+			if (!journal->j_fc_writers) {
+				journal->j_fc_tid = tid;
+				journal->j_fc_off = 0;
+				break;
+			}
+		}
+
+		prepare_to_wait(&journal->j_fc_wait, &wait,
+				TASK_UNINTERRUPTIBLE);
+		write_unlock(&journal->j_state_lock);
+		schedule();
+		finish_wait(&journal->j_fc_wait, &wait);
+		write_lock(&journal->j_state_lock);
+	}
+	if (!ret)
+		journal->j_fc_writers++;
+	write_unlock(&journal->j_state_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+
+/**
+ * jbd2_fc_reserve_block() - Reserve a block for a fast commit record.
+ * @journal: Journal to act on.
+ * @blocknr: Returns the journal block to write the record to.
+ *
+ * Records are replayed in the order their blocks were reserved.  Returns
+ * -ENOSPC once the area is full, the transaction then has to be committed
+ * in full.  Does not sleep.
+ */
+int jbd2_fc_reserve_block(journal_t *journal, unsigned long *blocknr)
+{
+	int ret = 0;
+
+	write_lock(&journal->j_state_lock);
+	if (journal->j_fc_first + journal->j_fc_off >= journal->j_fc_last)
+		ret = -ENOSPC;
+	else
+		*blocknr = journal->j_fc_first + journal->j_fc_off++;
+	write_unlock(&journal->j_state_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL(jbd2_fc_reserve_block);
+
+__u32 jbd2_fc_checksum(jbd2_fc_header_t *fc)
+{
+	__be32 provided = fc->fc_checksum;
+	__u32 csum;
+
+	fc->fc_checksum = 0;
+	csum = crc32_be(~0, (unsigned char *)fc,
+			sizeof(*fc) + be32_to_cpu(fc->fc_len));
+	fc->fc_checksum = provided;
+
+	return csum;
+}
+
+/**
+ * jbd2_fc_write_block() - Write a fast commit record.
+ * @journal: Journal to act on.
+ * @blocknr: Block from jbd2_fc_reserve_block().
+ * @data: The record.
+ * @len: Length of the record, at most a block minus the block header.
+ *
+ * The block is written with a cache flush and FUA, so once this returns
+ * the record and all data that was written before are stable.
+ */
+int jbd2_fc_write_block(journal_t *journal, unsigned long blocknr,
+			const void *data, unsigned int len)
+{
+	int write_flags = REQ_SYNC;
+	unsigned long long pblock;
+	struct buffer_head *bh;
+	jbd2_fc_header_t *fc;
+	int err;
+
+	if (len > journal->j_blocksize - sizeof(*fc))
+		return -EINVAL;
+
+	err = jbd2_journal_bmap(journal, blocknr, &pblock);
+	if (err)
+		return err;
+	bh = __getblk(journal->j_dev, pblock, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+
+	lock_buffer(bh);
+	memset(bh->b_data, 0, journal->j_blocksize);
+	fc = (jbd2_fc_header_t *)bh->b_data;
+	fc->fc_header.h_magic = cpu_to_be32(JBD2_MAGIC_NUMBER);
+	fc->fc_header.h_blocktype = cpu_to_be32(JBD2_FC_BLOCK);
+	fc->fc_header.h_sequence = cpu_to_be32(journal->j_fc_tid);
+	fc->fc_len = cpu_to_be32(len);
+	memcpy(fc + 1, data, len);
+	fc->fc_checksum = cpu_to_be32(jbd2_fc_checksum(fc));
+	set_buffer_uptodate(bh);
+	clear_buffer_dirty(bh);
+
+	if (journal->j_flags & JBD2_BARRIER)
+		write_flags |= REQ_PREFLUSH | REQ_FUA;
+	get_bh(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	submit_bh(REQ_OP_WRITE, write_flags, bh);
+	wait_on_buffer(bh);
+	if (!buffer_uptodate(bh))
+		err = -EIO;
+	brelse(bh);
+
+	return err;
+}
+EXPORT_SYMBOL(jbd2_fc_write_block);
+
+/**
+ * jbd2_fc_end_commit() - Finish a fast commit.
+ * @journal: Journal to act on.
+ */
+void jbd2_fc_end_commit(journal_t *journal)
+{
+	write_lock(&journal->j_state_lock);
+	journal->j_fc_writers--;
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_fc_wait);
+}
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+
 /*
  * Read the superblock for a given journal, performing initial
  * validation of the format.
@@ -1568,6 +1845,16 @@ static int journal_get_superblock(journal_t *journal)
 		goto out;
 	}
 
+	if (jbd2_has_feature_inode_fc(journal) &&
+	    (!sb->s_num_inode_fc_blks ||
+	     be32_to_cpu(sb->s_num_inode_fc_blks) >
+	     journal->j_maxlen - be32_to_cpu(sb->s_first))) {
+		printk(KERN_WARNING
+			"JBD2: Invalid fast commit area size: %u\n",
+			be32_to_cpu(sb->s_num_inode_fc_blks));
+		goto out;
+	}
+
 	if (jbd2_has_feature_csum2(journal) &&
 	    jbd2_has_feature_csum3(journal)) {
 		/* Can't have checksum v2 and v3 at the same time! */
@@ -1641,6 +1928,8 @@ static int load_superblock(journal_t *journal)
 	journal->j_tail = be32_to_cpu(sb->s_start);
 	journal->j_first = be32_to_cpu(sb->s_first);
 	journal->j_last = be32_to_cpu(sb->s_maxlen);
+	if (jbd2_has_feature_inode_fc(journal))
+		journal->j_last -= be32_to_cpu(sb->s_num_inode_fc_blks);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
 	return 0;
@@ -1773,6 +2062,7 @@ int jbd2_journal_destroy(journal_t *journal)
 
 			jbd2_mark_journal_empty(journal,
 					REQ_SYNC | REQ_PREFLUSH | REQ_FUA);
+			jbd2_fc_release(journal);
 			mutex_unlock(&journal->j_checkpoint_mutex);
 		} else
 			err = -EIO;
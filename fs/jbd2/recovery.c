@@ -232,6 +232,53 @@ do {									\
 		var -= ((journal)->j_last - (journal)->j_first);	\
 } while (0)
 
+/*
+ * Hand the fast commit records of the first transaction that did not make
+ * it to the log back to the file system.  Blocks of the area are reserved
+ * in order but written in parallel, so a torn or stale block does not end
+ * the scan.
+ */
+static int fc_do_replay(journal_t *journal, tid_t tid)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	unsigned int first, last, offset;
+	struct buffer_head *bh;
+	int err = 0, nr = 0;
+
+	if (!jbd2_has_feature_inode_fc(journal) ||
+	    !journal->j_fc_replay_callback)
+		return 0;
+
+	last = be32_to_cpu(sb->s_maxlen);
+	first = last - be32_to_cpu(sb->s_num_inode_fc_blks);
+
+	for (offset = first; offset < last && !err; offset++) {
+		jbd2_fc_header_t *fc;
+		unsigned int len;
+
+		err = jread(&bh, journal, offset);
+		if (err)
+			break;
+
+		fc = (jbd2_fc_header_t *)bh->b_data;
+		len = be32_to_cpu(fc->fc_len);
+		if (fc->fc_header.h_magic == cpu_to_be32(JBD2_MAGIC_NUMBER) &&
+		    fc->fc_header.h_blocktype == cpu_to_be32(JBD2_FC_BLOCK) &&
+		    be32_to_cpu(fc->fc_header.h_sequence) == tid &&
+		    len <= journal->j_blocksize - sizeof(*fc) &&
+		    be32_to_cpu(fc->fc_checksum) == jbd2_fc_checksum(fc)) {
+			err = journal->j_fc_replay_callback(journal, fc + 1,
+							    len);
+			nr++;
+		}
+		brelse(bh);
+	}
+
+	jbd_debug(1, "JBD2: Replayed %d fast commit records of transaction "
+		  "%u\n", nr, tid);
+	return err;
+}
+
 /**
  * jbd2_journal_recover - recovers a on-disk journal
  * @journal: the journal to recover
@@ -242,7 +289,8 @@ do {									\
  * Recovery is done in three passes.  In the first pass, we look for the
  * end of the log.  In the second, we assemble the list of revoke
  * blocks.  In the third and final pass, we replay any un-revoked blocks
- * in the log.
+ * in the log.  Fast commit records written after the last complete
+ * transaction are then passed to the file system.
  */
 int jbd2_journal_recover(journal_t *journal)
 {
@@ -277,6 +325,8 @@ int jbd2_journal_recover(journal_t *journal)
 		err = do_one_pass(journal, &info, PASS_REVOKE);
 	if (!err)
 		err = do_one_pass(journal, &info, PASS_REPLAY);
+	if (!err)
+		err = fc_do_replay(journal, info.end_transaction);
 
 	jbd_debug(1, "JBD2: recovery, exit status %d, "
 		  "recovered transactions %u to %u\n",
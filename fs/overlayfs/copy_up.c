@@ -638,6 +638,8 @@ static int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 			err = ovl_do_copy_up(&ctx);
 		if (!err && !ovl_dentry_has_upper_alias(dentry))
 			err = ovl_link_up(&ctx);
+		/* The merged dir cache of parent does not know the new entry */
+		ovl_set_flag(OVL_DIR_STALE, d_inode(parent));
 		ovl_copy_up_end(dentry);
 	}
 	do_delayed_call(&done);
@@ -165,6 +165,7 @@ static void ovl_instantiate(struct dentry *dentry, struct inode *inode,
 		dput(newdentry);
 		inc_nlink(inode);
 	}
+	ovl_dir_cache_add(dentry->d_parent, &dentry->d_name, inode);
 	d_instantiate(dentry, inode);
 	/* Force lookup of new upper hardlink to find its lower */
 	if (hardlink)
@@ -685,6 +686,7 @@ static int ovl_remove_and_whiteout(struct dentry *dentry, bool is_dir)
 		ovl_cleanup(wdir, upper);
 
 	ovl_dentry_version_inc(dentry->d_parent, true);
+	ovl_dir_cache_del(dentry->d_parent, &dentry->d_name, true);
 out_d_drop:
 	d_drop(dentry);
 	dput(whiteout);
@@ -735,6 +737,8 @@ static int ovl_remove_upper(struct dentry *dentry, bool is_dir)
 	else
 		err = vfs_unlink(dir, upper, NULL);
 	ovl_dentry_version_inc(dentry->d_parent, ovl_type_origin(dentry));
+	if (!err)
+		ovl_dir_cache_del(dentry->d_parent, &dentry->d_name, false);
 
 	/*
 	 * Keeping this dentry hashed would mean having to release
@@ -1085,9 +1089,18 @@ static int ovl_rename(struct inode *olddir, struct dentry *old,
 			drop_nlink(d_inode(new));
 	}
 
+	/*
+	 * Update each parent right after its version bump, they may be the
+	 * same dir.  A whiteout may have been left in place of old.
+	 */
 	ovl_dentry_version_inc(old->d_parent,
 			       !overwrite && ovl_type_origin(new));
+	if (overwrite)
+		ovl_dir_cache_del(old->d_parent, &old->d_name, true);
+	else
+		ovl_dir_cache_add(old->d_parent, &old->d_name, d_inode(new));
 	ovl_dentry_version_inc(new->d_parent, ovl_type_origin(old));
+	ovl_dir_cache_add(new->d_parent, &new->d_name, d_inode(old));
 
 out_dput:
 	dput(newdentry);
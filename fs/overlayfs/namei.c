@@ -602,6 +602,7 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 	char *upperredirect = NULL;
 	struct dentry *this;
 	unsigned int i;
+	u64 layers;
 	int err;
 	struct ovl_lookup_data d = {
 		.name = dentry->d_name,
@@ -615,9 +616,12 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 	if (dentry->d_name.len > ofs->namelen)
 		return ERR_PTR(-ENAMETOOLONG);
 
+	/* Skip the layers that the merged dir cache knows lack the name */
+	layers = ovl_dir_cache_layers(dentry);
+
 	old_cred = ovl_override_creds(dentry->d_sb);
 	upperdir = ovl_dentry_upper(dentry->d_parent);
-	if (upperdir) {
+	if (upperdir && (layers & ovl_layer_bit(0))) {
 		err = ovl_lookup_layer(upperdir, &d, &upperdentry);
 		if (err)
 			goto out;
@@ -668,6 +672,10 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 		struct path lowerpath = poe->lowerstack[i];
 
 		d.last = i == poe->numlower - 1;
+		/* Redirects look up other names, maybe in other dirs */
+		if (!d.redirect && !(layers & ovl_layer_bit(i + 1)))
+			continue;
+
 		err = ovl_lookup_layer(lowerpath.dentry, &d, &this);
 		if (err)
 			goto out_put;
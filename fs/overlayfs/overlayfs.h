@@ -30,6 +30,8 @@ enum ovl_path_type {
 enum ovl_flag {
 	OVL_IMPURE,
 	OVL_INDEX,
+	/* An entry was copied up since the merged dir cache was filled */
+	OVL_DIR_STALE,
 };
 
 /*
@@ -215,6 +217,7 @@ void ovl_dentry_set_opaque(struct dentry *dentry);
 bool ovl_dentry_has_upper_alias(struct dentry *dentry);
 void ovl_dentry_set_upper_alias(struct dentry *dentry);
 bool ovl_redirect_dir(struct super_block *sb);
+bool ovl_dir_cache_keep(struct super_block *sb);
 const char *ovl_dentry_get_redirect(struct dentry *dentry);
 void ovl_dentry_set_redirect(struct dentry *dentry, const char *redirect);
 void ovl_inode_init(struct inode *inode, struct dentry *upperdentry,
@@ -262,6 +265,20 @@ int ovl_check_empty_dir(struct dentry *dentry, struct list_head *list);
 void ovl_cleanup_whiteouts(struct dentry *upper, struct list_head *list);
 void ovl_cache_free(struct list_head *list);
 void ovl_dir_cache_free(struct inode *inode);
+void ovl_dir_cache_add(struct dentry *dir, const struct qstr *name,
+		       struct inode *inode);
+void ovl_dir_cache_del(struct dentry *dir, const struct qstr *name,
+		       bool whiteout);
+u64 ovl_dir_cache_layers(struct dentry *dentry);
+
+/*
+ * Layers of a merged dir: 0 is upper and n > 0 is lowerstack[n - 1].  Layers
+ * past the last bit share the last bit.
+ */
+static inline u64 ovl_layer_bit(unsigned int layer)
+{
+	return 1ULL << min(layer, 63U);
+}
 int ovl_check_d_type_supported(struct path *realpath);
 void ovl_workdir_cleanup(struct inode *dir, struct vfsmount *mnt,
 			 struct dentry *dentry, int level);
@@ -16,6 +16,7 @@ struct ovl_config {
 	bool redirect_dir;
 	bool index;
 	bool override_creds;
+	bool dir_cache;
 };
 
 /* private information held for overlayfs's superblock */
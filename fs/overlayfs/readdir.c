@@ -23,6 +23,7 @@ struct ovl_cache_entry {
 	unsigned int type;
 	u64 real_ino;
 	u64 ino;
+	u64 layers;	/* layers the name was found in, see ovl_layer_bit() */
 	struct list_head l_node;
 	struct rb_node node;
 	struct ovl_cache_entry *next_maybe_whiteout;
@@ -47,6 +48,7 @@ struct ovl_readdir_data {
 	struct ovl_cache_entry *first_maybe_whiteout;
 	int count;
 	int err;
+	unsigned int layer;
 	bool is_upper;
 	bool d_type_supported;
 };
@@ -158,6 +160,7 @@ static struct ovl_cache_entry *ovl_cache_entry_new(struct ovl_readdir_data *rdd,
 	/* Defer setting d_ino for upper entry to ovl_iterate() */
 	if (ovl_calc_d_ino(rdd, p))
 		p->ino = 0;
+	p->layers = ovl_layer_bit(rdd->layer);
 	p->is_whiteout = false;
 
 	if (d_type == DT_CHR) {
@@ -175,8 +178,11 @@ static int ovl_cache_entry_add_rb(struct ovl_readdir_data *rdd,
 	struct rb_node *parent = NULL;
 	struct ovl_cache_entry *p;
 
-	if (ovl_cache_entry_find_link(name, len, &newp, &parent))
+	if (ovl_cache_entry_find_link(name, len, &newp, &parent)) {
+		p = ovl_cache_entry_from_node(parent);
+		p->layers |= ovl_layer_bit(rdd->layer);
 		return 0;
+	}
 
 	p = ovl_cache_entry_new(rdd, name, len, ino, d_type);
 	if (p == NULL) {
@@ -195,17 +201,27 @@ static int ovl_fill_lowest(struct ovl_readdir_data *rdd,
 			   const char *name, int namelen,
 			   loff_t offset, u64 ino, unsigned int d_type)
 {
+	struct rb_node **newp = &rdd->root->rb_node;
+	struct rb_node *parent = NULL;
 	struct ovl_cache_entry *p;
 
-	p = ovl_cache_entry_find(rdd->root, name, namelen);
-	if (p) {
+	/*
+	 * Lowest layer entries go into the tree too, so that lookup and
+	 * the updates of a kept cache can find every name.
+	 */
+	if (ovl_cache_entry_find_link(name, namelen, &newp, &parent)) {
+		p = ovl_cache_entry_from_node(parent);
+		p->layers |= ovl_layer_bit(rdd->layer);
 		list_move_tail(&p->l_node, &rdd->middle);
 	} else {
 		p = ovl_cache_entry_new(rdd, name, namelen, ino, d_type);
-		if (p == NULL)
+		if (p == NULL) {
 			rdd->err = -ENOMEM;
-		else
+		} else {
 			list_add_tail(&p->l_node, &rdd->middle);
+			rb_link_node(&p->node, parent, newp);
+			rb_insert_color(&p->node, rdd->root);
+		}
 	}
 
 	return rdd->err;
@@ -232,6 +248,17 @@ void ovl_dir_cache_free(struct inode *inode)
 	}
 }
 
+/*
+ * A merged dir cache is up to date if no entry was added or removed
+ * through the overlay and no entry was copied up since it was filled.
+ */
+static bool ovl_dir_cache_valid(struct dentry *dentry,
+				struct ovl_dir_cache *cache)
+{
+	return ovl_dentry_version_get(dentry) == cache->version &&
+	       !ovl_test_flag(OVL_DIR_STALE, d_inode(dentry));
+}
+
 static void ovl_cache_put(struct ovl_dir_file *od, struct dentry *dentry)
 {
 	struct ovl_dir_cache *cache = od->cache;
@@ -239,8 +266,13 @@ static void ovl_cache_put(struct ovl_dir_file *od, struct dentry *dentry)
 	WARN_ON(cache->refcount <= 0);
 	cache->refcount--;
 	if (!cache->refcount) {
-		if (ovl_dir_cache(d_inode(dentry)) == cache)
+		if (ovl_dir_cache(d_inode(dentry)) == cache) {
+			/* Keep it for the next open and for lookup */
+			if (ovl_dir_cache_keep(dentry->d_sb) &&
+			    ovl_dir_cache_valid(dentry, cache))
+				return;
 			ovl_set_dir_cache(d_inode(dentry), NULL);
+		}
 
 		ovl_cache_free(&cache->entries);
 		kfree(cache);
@@ -323,7 +355,7 @@ static void ovl_dir_reset(struct file *file)
 	struct dentry *dentry = file->f_path.dentry;
 	enum ovl_path_type type = ovl_path_type(dentry);
 
-	if (cache && ovl_dentry_version_get(dentry) != cache->version) {
+	if (cache && !ovl_dir_cache_valid(dentry, cache)) {
 		ovl_cache_put(od, dentry);
 		od->cache = NULL;
 		od->cursor = NULL;
@@ -350,6 +382,7 @@ static int ovl_dir_read_merged(struct dentry *dentry, struct list_head *list,
 	for (idx = 0; idx != -1; idx = next) {
 		next = ovl_path_next(idx, dentry, &realpath);
 		rdd.is_upper = ovl_dentry_upper(dentry) == realpath.dentry;
+		rdd.layer = rdd.is_upper ? 0 : max(idx, 1);
 
 		if (next != -1) {
 			err = ovl_dir_read(&realpath, &rdd);
@@ -389,12 +422,24 @@ static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 	struct ovl_dir_cache *cache;
 
 	cache = ovl_dir_cache(d_inode(dentry));
-	if (cache && ovl_dentry_version_get(dentry) == cache->version) {
-		WARN_ON(!cache->refcount);
+	if (cache && ovl_dir_cache_valid(dentry, cache)) {
+		struct ovl_cache_entry *p;
+
+		WARN_ON(!cache->refcount && !ovl_dir_cache_keep(dentry->d_sb));
 		cache->refcount++;
+
+		/* We may have been moved since ".." was filled in */
+		p = ovl_cache_entry_find(&cache->root, "..", 2);
+		if (p)
+			p->ino = 0;
 		return cache;
 	}
+	/* A cache kept after the last close is not used by any file */
+	if (cache && !cache->refcount)
+		ovl_dir_cache_free(d_inode(dentry));
 	ovl_set_dir_cache(d_inode(dentry), NULL);
+	/* Entries copied up from now on are not seen by this cache */
+	ovl_clear_flag(OVL_DIR_STALE, d_inode(dentry));
 
 	cache = kzalloc(sizeof(struct ovl_dir_cache), GFP_KERNEL);
 	if (!cache)
@@ -417,6 +462,125 @@ static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 	return cache;
 }
 
+/*
+ * Called with @dir locked after an entry of @dir was changed and the version
+ * of @dir was bumped.  Returns the merged dir cache of @dir if it was up to
+ * date before the change and is not used by an open file, in which case the
+ * caller updates it in place.  Otherwise an open file keeps its snapshot,
+ * and a stale unused cache is freed.
+ */
+static struct ovl_dir_cache *ovl_dir_cache_modified(struct dentry *dir)
+{
+	struct ovl_dir_cache *cache = ovl_dir_cache(d_inode(dir));
+	u64 version = ovl_dentry_version_get(dir);
+
+	if (!cache || cache->refcount || !OVL_TYPE_MERGE(ovl_path_type(dir)))
+		return NULL;
+
+	if (cache->version + 1 != version ||
+	    ovl_test_flag(OVL_DIR_STALE, d_inode(dir))) {
+		ovl_dir_cache_free(d_inode(dir));
+		ovl_set_dir_cache(d_inode(dir), NULL);
+		return NULL;
+	}
+	cache->version = version;
+
+	return cache;
+}
+
+/*
+ * @name of @dir now refers to @inode, which is in the upper layer.
+ */
+void ovl_dir_cache_add(struct dentry *dir, const struct qstr *name,
+		       struct inode *inode)
+{
+	struct ovl_dir_cache *cache = ovl_dir_cache_modified(dir);
+	struct rb_node **newp, *parent = NULL;
+	struct ovl_cache_entry *p;
+
+	if (!cache)
+		return;
+
+	newp = &cache->root.rb_node;
+	if (ovl_cache_entry_find_link(name->name, name->len, &newp, &parent)) {
+		p = ovl_cache_entry_from_node(parent);
+	} else {
+		p = kmalloc(offsetof(struct ovl_cache_entry,
+				     name[name->len + 1]), GFP_KERNEL);
+		if (!p) {
+			ovl_dir_cache_free(d_inode(dir));
+			ovl_set_dir_cache(d_inode(dir), NULL);
+			return;
+		}
+		memcpy(p->name, name->name, name->len);
+		p->name[name->len] = '\0';
+		p->len = name->len;
+		p->layers = 0;
+		list_add_tail(&p->l_node, &cache->entries);
+		rb_link_node(&p->node, parent, newp);
+		rb_insert_color(&p->node, &cache->root);
+	}
+
+	p->type = (inode->i_mode >> 12) & 15;
+	p->real_ino = ovl_inode_real(inode)->i_ino;
+	/* Let ovl_iterate() work out d_ino, the dir may be impure now */
+	p->ino = 0;
+	p->layers |= ovl_layer_bit(0);
+	p->is_whiteout = false;
+}
+
+/*
+ * @name of @dir was removed.  If a whiteout may have been left in its place,
+ * the entry is kept as a whiteout, so that lookup finds it in upper.
+ */
+void ovl_dir_cache_del(struct dentry *dir, const struct qstr *name,
+		       bool whiteout)
+{
+	struct ovl_dir_cache *cache = ovl_dir_cache_modified(dir);
+	struct ovl_cache_entry *p;
+
+	if (!cache)
+		return;
+
+	p = ovl_cache_entry_find(&cache->root, name->name, name->len);
+	if (!p) {
+		ovl_dir_cache_free(d_inode(dir));
+		ovl_set_dir_cache(d_inode(dir), NULL);
+		return;
+	}
+
+	if (whiteout) {
+		p->layers |= ovl_layer_bit(0);
+		p->is_whiteout = true;
+	} else {
+		rb_erase(&p->node, &cache->root);
+		list_del(&p->l_node);
+		kfree(p);
+	}
+}
+
+/*
+ * Returns the layers of the merged parent dir that may hold the name of
+ * @dentry, or 0 if the name is known to be absent from all of them.  Called
+ * from lookup with the parent locked.
+ */
+u64 ovl_dir_cache_layers(struct dentry *dentry)
+{
+	struct dentry *dir = dentry->d_parent;
+	struct ovl_dir_cache *cache = ovl_dir_cache(d_inode(dir));
+	struct ovl_cache_entry *p;
+
+	if (!cache || !ovl_dir_cache_keep(dentry->d_sb) ||
+	    !OVL_TYPE_MERGE(ovl_path_type(dir)) ||
+	    !ovl_dir_cache_valid(dir, cache))
+		return ~0ULL;
+
+	p = ovl_cache_entry_find(&cache->root, dentry->d_name.name,
+				 dentry->d_name.len);
+
+	return p ? p->layers : 0;
+}
+
 /*
  * Set d_ino for upper entries. Non-upper entries should always report
  * the uppermost real inode ino and should not call this function.
@@ -39,6 +39,11 @@ module_param_named(index, ovl_index_def, bool, 0644);
 MODULE_PARM_DESC(ovl_index_def,
 		 "Default to on or off for the inodes index feature");
 
+static bool ovl_dir_cache_def = IS_ENABLED(CONFIG_OVERLAY_FS_DIR_CACHE);
+module_param_named(dir_cache, ovl_dir_cache_def, bool, 0644);
+MODULE_PARM_DESC(ovl_dir_cache_def,
+		 "Default to on or off for keeping merged dir caches");
+
 static bool __read_mostly ovl_override_creds_def = true;
 module_param_named(override_creds, ovl_override_creds_def, bool, 0644);
 MODULE_PARM_DESC(ovl_override_creds_def,
@@ -323,6 +328,9 @@ static int ovl_show_options(struct seq_file *m, struct dentry *dentry)
 	if (ufs->config.index != ovl_index_def)
 		seq_printf(m, ",index=%s",
 			   ufs->config.index ? "on" : "off");
+	if (ufs->config.dir_cache != ovl_dir_cache_def)
+		seq_printf(m, ",dir_cache=%s",
+			   ufs->config.dir_cache ? "on" : "off");
 	if (ufs->config.override_creds != ovl_override_creds_def)
 		seq_show_option(m, "override_creds",
 				ufs->config.override_creds ? "on" : "off");
@@ -359,6 +367,8 @@ enum {
 	OPT_REDIRECT_DIR_OFF,
 	OPT_INDEX_ON,
 	OPT_INDEX_OFF,
+	OPT_DIR_CACHE_ON,
+	OPT_DIR_CACHE_OFF,
 	OPT_OVERRIDE_CREDS_ON,
 	OPT_OVERRIDE_CREDS_OFF,
 	OPT_ERR,
@@ -373,6 +383,8 @@ static const match_table_t ovl_tokens = {
 	{OPT_REDIRECT_DIR_OFF,		"redirect_dir=off"},
 	{OPT_INDEX_ON,			"index=on"},
 	{OPT_INDEX_OFF,			"index=off"},
+	{OPT_DIR_CACHE_ON,		"dir_cache=on"},
+	{OPT_DIR_CACHE_OFF,		"dir_cache=off"},
 	{OPT_OVERRIDE_CREDS_ON,		"override_creds=on"},
 	{OPT_OVERRIDE_CREDS_OFF,	"override_creds=off"},
 	{OPT_ERR,			NULL}
@@ -456,6 +468,14 @@ static int ovl_parse_opt(char *opt, struct ovl_config *config)
 			config->index = false;
 			break;
 
+		case OPT_DIR_CACHE_ON:
+			config->dir_cache = true;
+			break;
+
+		case OPT_DIR_CACHE_OFF:
+			config->dir_cache = false;
+			break;
+
 		case OPT_OVERRIDE_CREDS_ON:
 			config->override_creds = true;
 			break;
@@ -901,6 +921,7 @@ static int ovl_fill_super(struct super_block *sb, void *data, int silent)
 
 	ufs->config.redirect_dir = ovl_redirect_dir_def;
 	ufs->config.index = ovl_index_def;
+	ufs->config.dir_cache = ovl_dir_cache_def;
 	err = ovl_parse_opt((char *) data, &ufs->config);
 	if (err)
 		goto out_free_config;
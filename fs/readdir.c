@@ -20,9 +20,13 @@
 #include <linux/syscalls.h>
 #include <linux/unistd.h>
 #include <linux/compat.h>
+#include <linux/namei.h>
+#include <linux/readdirplus.h>
 
 #include <linux/uaccess.h>
 
+#include "internal.h"
+
 int iterate_dir(struct file *file, struct dir_context *ctx)
 {
 	struct inode *inode = file_inode(file);
@@ -370,6 +374,125 @@ SYSCALL_DEFINE3(getdents64, unsigned int, fd,
 	return error;
 }
 
+/* Entries are gathered in a kernel buffer of at most this size per call */
+#define READDIRPLUS_MAX_SIZE	(256 * 1024)
+
+struct readdirplus_callback {
+	struct dir_context ctx;
+	char *buf;
+	unsigned int size;
+	unsigned int used;
+	struct fs_readdirplus_entry *previous;
+	int error;
+};
+
+static int filldir_plus(struct dir_context *ctx, const char *name, int namlen,
+			loff_t offset, u64 ino, unsigned int d_type)
+{
+	struct fs_readdirplus_entry *dirent;
+	struct readdirplus_callback *buf =
+		container_of(ctx, struct readdirplus_callback, ctx);
+	int reclen = ALIGN(offsetof(struct fs_readdirplus_entry, d_name) +
+			   namlen + 1, sizeof(u64));
+
+	buf->error = verify_dirent_name(name, namlen);
+	if (unlikely(buf->error))
+		return buf->error;
+	buf->error = -EINVAL;	/* only used if we fail.. */
+	if (reclen > buf->size - buf->used)
+		return -EINVAL;
+	dirent = buf->previous;
+	if (dirent) {
+		if (signal_pending(current))
+			return -EINTR;
+		dirent->d_off = offset;
+	}
+	dirent = (void *)buf->buf + buf->used;
+	memset(dirent, 0, offsetof(struct fs_readdirplus_entry, d_name));
+	dirent->d_ino = ino;
+	dirent->d_reclen = reclen;
+	dirent->d_type = d_type;
+	memcpy(dirent->d_name, name, namlen);
+	dirent->d_name[namlen] = 0;
+	buf->previous = dirent;
+	buf->used += reclen;
+	return 0;
+}
+
+/*
+ * Fill in the attributes of an entry of @dir.  This runs after the
+ * directory has been read and unlocked, so the entry may have gone away.
+ * Dentries that are already in the dcache, for example because the
+ * filesystem instantiated them while reading the directory, are used
+ * without calling into the filesystem.
+ */
+static void readdirplus_stat(const struct path *dir,
+			     struct fs_readdirplus_entry *dirent,
+			     u32 mask, unsigned int flags)
+{
+	struct path path = { .mnt = dir->mnt };
+	struct kstat stat;
+
+	path.dentry = lookup_one_len_unlocked(dirent->d_name, dir->dentry,
+					      strlen(dirent->d_name));
+	if (IS_ERR(path.dentry))
+		return;
+
+	/* Leave mount points and automount points to statx() */
+	if (d_really_is_positive(path.dentry) && !d_managed(path.dentry) &&
+	    !vfs_getattr(&path, &stat, mask, flags))
+		kstat_to_statx(&stat, &dirent->stx);
+	dput(path.dentry);
+}
+
+long vfs_readdirplus(struct file *file, struct fs_readdirplus __user *argp)
+{
+	struct fs_readdirplus args;
+	struct readdirplus_callback buf = {
+		.ctx.actor = filldir_plus,
+		.ctx.want_attrs = true,
+	};
+	unsigned int pos;
+	int error;
+
+	if (copy_from_user(&args, argp, sizeof(args)))
+		return -EFAULT;
+	if (args.mask & STATX__RESERVED || args.reserved ||
+	    args.flags & ~AT_STATX_SYNC_TYPE ||
+	    (args.flags & AT_STATX_SYNC_TYPE) == AT_STATX_SYNC_TYPE)
+		return -EINVAL;
+	if (!access_ok(VERIFY_WRITE, u64_to_user_ptr(args.buf), args.size))
+		return -EFAULT;
+
+	buf.size = min_t(unsigned int, args.size, READDIRPLUS_MAX_SIZE);
+	buf.buf = kvmalloc(buf.size, GFP_KERNEL);
+	if (!buf.buf)
+		return -ENOMEM;
+
+	mutex_lock(&file->f_pos_lock);
+	error = iterate_dir(file, &buf.ctx);
+	if (error >= 0)
+		error = buf.error;
+	if (buf.previous) {
+		buf.previous->d_off = buf.ctx.pos;
+		error = buf.used;
+	}
+	mutex_unlock(&file->f_pos_lock);
+
+	for (pos = 0; pos < buf.used; ) {
+		struct fs_readdirplus_entry *dirent = (void *)buf.buf + pos;
+
+		readdirplus_stat(&file->f_path, dirent, args.mask, args.flags);
+		pos += dirent->d_reclen;
+	}
+
+	if (buf.used &&
+	    copy_to_user(u64_to_user_ptr(args.buf), buf.buf, buf.used))
+		error = -EFAULT;
+	kvfree(buf.buf);
+	return error;
+}
+
 #ifdef CONFIG_COMPAT
 struct compat_old_linux_dirent {
 	compat_ulong_t	d_ino;
@@ -74,7 +74,7 @@ static long __estimate_accuracy(struct timespec64 *tv)
 
 u64 select_estimate_accuracy(struct timespec64 *tv)
 {
-	u64 ret;
+	u64 ret, slack;
 	struct timespec64 now;
 
 	/*
@@ -87,8 +87,9 @@ u64 select_estimate_accuracy(struct timespec64 *tv)
 	ktime_get_ts64(&now);
 	now = timespec64_sub(*tv, now);
 	ret = __estimate_accuracy(&now);
-	if (ret < current->timer_slack_ns)
-		return current->timer_slack_ns;
+	slack = task_timer_slack_ns(current);
+	if (ret < slack)
+		return slack;
 	return ret;
 }
 
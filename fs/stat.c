@@ -21,6 +21,8 @@
 #include <linux/uaccess.h>
 #include <asm/unistd.h>
 
+#include "internal.h"
+
 /**
  * generic_fillattr - Fill in the basic attributes from the inode struct
  * @inode: Inode to use as the source
@@ -511,36 +513,41 @@ SYSCALL_DEFINE4(fstatat64, int, dfd, const char __user *, filename,
 }
 #endif /* __ARCH_WANT_STAT64 || __ARCH_WANT_COMPAT_STAT64 */
 
+void kstat_to_statx(const struct kstat *stat, struct statx *tmp)
+{
+	memset(tmp, 0, sizeof(*tmp));
+
+	tmp->stx_mask = stat->result_mask;
+	tmp->stx_blksize = stat->blksize;
+	tmp->stx_attributes = stat->attributes;
+	tmp->stx_nlink = stat->nlink;
+	tmp->stx_uid = from_kuid_munged(current_user_ns(), stat->uid);
+	tmp->stx_gid = from_kgid_munged(current_user_ns(), stat->gid);
+	tmp->stx_mode = stat->mode;
+	tmp->stx_ino = stat->ino;
+	tmp->stx_size = stat->size;
+	tmp->stx_blocks = stat->blocks;
+	tmp->stx_attributes_mask = stat->attributes_mask;
+	tmp->stx_atime.tv_sec = stat->atime.tv_sec;
+	tmp->stx_atime.tv_nsec = stat->atime.tv_nsec;
+	tmp->stx_btime.tv_sec = stat->btime.tv_sec;
+	tmp->stx_btime.tv_nsec = stat->btime.tv_nsec;
+	tmp->stx_ctime.tv_sec = stat->ctime.tv_sec;
+	tmp->stx_ctime.tv_nsec = stat->ctime.tv_nsec;
+	tmp->stx_mtime.tv_sec = stat->mtime.tv_sec;
+	tmp->stx_mtime.tv_nsec = stat->mtime.tv_nsec;
+	tmp->stx_rdev_major = MAJOR(stat->rdev);
+	tmp->stx_rdev_minor = MINOR(stat->rdev);
+	tmp->stx_dev_major = MAJOR(stat->dev);
+	tmp->stx_dev_minor = MINOR(stat->dev);
+}
+
 static noinline_for_stack int
 cp_statx(const struct kstat *stat, struct statx __user *buffer)
 {
 	struct statx tmp;
 
-	memset(&tmp, 0, sizeof(tmp));
-
-	tmp.stx_mask = stat->result_mask;
-	tmp.stx_blksize = stat->blksize;
-	tmp.stx_attributes = stat->attributes;
-	tmp.stx_nlink = stat->nlink;
-	tmp.stx_uid = from_kuid_munged(current_user_ns(), stat->uid);
-	tmp.stx_gid = from_kgid_munged(current_user_ns(), stat->gid);
-	tmp.stx_mode = stat->mode;
-	tmp.stx_ino = stat->ino;
-	tmp.stx_size = stat->size;
-	tmp.stx_blocks = stat->blocks;
-	tmp.stx_attributes_mask = stat->attributes_mask;
-	tmp.stx_atime.tv_sec = stat->atime.tv_sec;
-	tmp.stx_atime.tv_nsec = stat->atime.tv_nsec;
-	tmp.stx_btime.tv_sec = stat->btime.tv_sec;
-	tmp.stx_btime.tv_nsec = stat->btime.tv_nsec;
-	tmp.stx_ctime.tv_sec = stat->ctime.tv_sec;
-	tmp.stx_ctime.tv_nsec = stat->ctime.tv_nsec;
-	tmp.stx_mtime.tv_sec = stat->mtime.tv_sec;
-	tmp.stx_mtime.tv_nsec = stat->mtime.tv_nsec;
-	tmp.stx_rdev_major = MAJOR(stat->rdev);
-	tmp.stx_rdev_minor = MINOR(stat->rdev);
-	tmp.stx_dev_major = MAJOR(stat->dev);
-	tmp.stx_dev_minor = MINOR(stat->dev);
+	kstat_to_statx(stat, &tmp);
 
 	return copy_to_user(buffer, &tmp, sizeof(tmp)) ? -EFAULT : 0;
 }
@@ -1707,6 +1707,8 @@ typedef int (*filldir_t)(struct dir_context *, const char *, int, loff_t, u64,
 struct dir_context {
 	const filldir_t actor;
 	loff_t pos;
+	/* the caller stats every entry, see FS_IOC_READDIRPLUS */
+	bool want_attrs;
 };
 
 struct block_device_operations;
@@ -96,6 +96,15 @@ struct irq_desc {
 #ifdef CONFIG_GENERIC_IRQ_DEBUGFS
 	struct dentry		*debugfs_file;
 #endif
+#ifdef CONFIG_IRQ_BALANCE
+	u64			handle_time;	/* ns spent in the handlers */
+	u64			balance_time;	/* handle_time at last sample */
+	u64			balance_load;	/* handler ns in last interval */
+	unsigned int		balance_count;	/* tot_count at last sample */
+	unsigned int		balance_rate;	/* irqs in last interval */
+	unsigned long		balance_moved;	/* jiffies of the last move */
+	int			balance_cpu;	/* CPU placed on, or -1 */
+#endif
 #ifdef CONFIG_SPARSE_IRQ
 	struct rcu_head		rcu;
 	struct kobject		kobj;
@@ -70,6 +70,7 @@ extern void *jbd2_alloc(size_t size, gfp_t flags);
 extern void jbd2_free(void *ptr, size_t size);
 
 #define JBD2_MIN_JOURNAL_BLOCKS 1024
+#define JBD2_DEFAULT_FC_BLOCKS	256
 
 #ifdef __KERNEL__
 
@@ -126,6 +127,7 @@ typedef struct journal_s	journal_t;	/* Journal control structure */
 #define JBD2_SUPERBLOCK_V1	3
 #define JBD2_SUPERBLOCK_V2	4
 #define JBD2_REVOKE_BLOCK	5
+#define JBD2_FC_BLOCK		6
 
 /*
  * Standard header for all descriptor blocks:
@@ -215,6 +217,18 @@ typedef struct jbd2_journal_revoke_header_s
 	__be32		 r_count;	/* Count of bytes used in the block */
 } jbd2_journal_revoke_header_t;
 
+/*
+ * The fast commit block header, followed by fc_len bytes of a record that
+ * only the file system can interpret.  h_sequence is the transaction the
+ * record belongs to, fc_checksum is a crc32 of the header and the record.
+ */
+typedef struct jbd2_fc_header_s
+{
+	journal_header_t fc_header;
+	__be32		 fc_len;
+	__be32		 fc_checksum;
+} jbd2_fc_header_t;
+
 /* Definitions for the journal tag flags word: */
 #define JBD2_FLAG_ESCAPE		1	/* on-disk block is escaped */
 #define JBD2_FLAG_SAME_UUID	2	/* block has same uuid as previous */
@@ -265,7 +279,10 @@ typedef struct journal_superblock_s
 /* 0x0050 */
 	__u8	s_checksum_type;	/* checksum type */
 	__u8	s_padding2[3];
-	__u32	s_padding[42];
+/* 0x0054 */
+	__u32	s_padding[41];
+/* 0x00F8 */
+	__be32	s_num_inode_fc_blks;	/* Nr of inode fast commit blocks */
 	__be32	s_checksum;		/* crc32c(superblock) */
 
 /* 0x0100 */
@@ -291,6 +308,13 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
 #define JBD2_FEATURE_INCOMPAT_CSUM_V2		0x00000008
 #define JBD2_FEATURE_INCOMPAT_CSUM_V3		0x00000010
+/*
+ * Not mainline's FAST_COMMIT (0x20, s_num_fc_blks at 0x54): the inode fast
+ * commit area has its own format, so it uses a bit and field mainline does
+ * not.  Neither do e2fsprogs know it: e2fsck refuses a journal that needs
+ * recovery and has this bit set, which is the case after a crash.
+ */
+#define JBD2_FEATURE_INCOMPAT_INODE_FC		0x00010000
 
 /* See "journal feature predicate functions" below */
 
@@ -301,7 +325,8 @@ typedef struct journal_superblock_s
 					JBD2_FEATURE_INCOMPAT_64BIT | \
 					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
 					JBD2_FEATURE_INCOMPAT_CSUM_V2 | \
-					JBD2_FEATURE_INCOMPAT_CSUM_V3)
+					JBD2_FEATURE_INCOMPAT_CSUM_V3 | \
+					JBD2_FEATURE_INCOMPAT_INODE_FC)
 
 #ifdef __KERNEL__
 
@@ -918,6 +943,47 @@ struct journal_s
 	 */
 	unsigned long		j_last;
 
+	/**
+	 * @j_fc_first:
+	 *
+	 * The block number of the first block of the fast commit area, which
+	 * follows the log [j_state_lock].
+	 */
+	unsigned long		j_fc_first;
+
+	/**
+	 * @j_fc_last:
+	 *
+	 * The block number one beyond the last block of the fast commit area.
+	 * Equal to @j_fc_first if there is none [j_state_lock].
+	 */
+	unsigned long		j_fc_last;
+
+	/**
+	 * @j_fc_off: Number of fast commit blocks handed out [j_state_lock].
+	 */
+	unsigned long		j_fc_off;
+
+	/**
+	 * @j_fc_tid:
+	 *
+	 * Transaction the records in the fast commit area belong to
+	 * [j_state_lock].
+	 */
+	tid_t			j_fc_tid;
+
+	/**
+	 * @j_fc_writers: Number of fast commits in progress [j_state_lock].
+	 */
+	int			j_fc_writers;
+
+	/**
+	 * @j_fc_wait:
+	 *
+	 * Wait queue for fast commits waiting for the area to be reused.
+	 */
+	wait_queue_head_t	j_fc_wait;
+
 	/**
 	 * @j_dev: Device where we store the journal.
 	 */
@@ -1140,6 +1206,16 @@ struct journal_s
 	 */
 	void *j_private;
 
+	/**
+	 * @j_fc_replay_callback:
+	 *
+	 * Called by recovery for every fast commit record of the first
+	 * transaction that was not found in the log, in the order the records
+	 * were written.
+	 */
+	int (*j_fc_replay_callback)(journal_t *journal, void *buf,
+				    unsigned int len);
+
 	/**
 	 * @j_chksum_driver:
 	 *
@@ -1237,6 +1313,7 @@ JBD2_FEATURE_INCOMPAT_FUNCS(64bit,		64BIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(async_commit,	ASYNC_COMMIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum2,		CSUM_V2)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
+JBD2_FEATURE_INCOMPAT_FUNCS(inode_fc,		INODE_FC)
 
 /*
  * Journal flag definitions
@@ -1411,6 +1488,13 @@ extern int	   jbd2_journal_errno      (journal_t *);
 extern void	   jbd2_journal_ack_err    (journal_t *);
 extern int	   jbd2_journal_clear_err  (journal_t *);
 extern int	   jbd2_journal_bmap(journal_t *, unsigned long, unsigned long long *);
+extern int	   jbd2_fc_init(journal_t *, unsigned int);
+extern int	   jbd2_fc_begin_commit(journal_t *, tid_t);
+extern int	   jbd2_fc_reserve_block(journal_t *, unsigned long *);
+extern int	   jbd2_fc_write_block(journal_t *, unsigned long, const void *,
+				       unsigned int);
+extern void	   jbd2_fc_end_commit(journal_t *);
+extern __u32	   jbd2_fc_checksum(jbd2_fc_header_t *);
 extern int	   jbd2_journal_force_commit(journal_t *);
 extern int	   jbd2_journal_force_commit_nested(journal_t *);
 extern int	   jbd2_journal_inode_add_write(handle_t *handle, struct jbd2_inode *inode);
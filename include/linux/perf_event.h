@@ -710,6 +710,9 @@ struct perf_event {
 	perf_overflow_handler_t		orig_overflow_handler;
 	struct bpf_prog			*prog;
 #endif
+#ifdef CONFIG_PERF_EVENTS_AGGREGATE
+	struct perf_aggr		*aggr;
+#endif
 
 #ifdef CONFIG_EVENT_TRACING
 	struct trace_event_call		*tp_event;
@@ -33,6 +33,10 @@ struct rw_semaphore {
 	raw_spinlock_t wait_lock;
 #ifdef CONFIG_RWSEM_SPIN_ON_OWNER
 	struct optimistic_spin_queue osq; /* spinner MCS lock */
+#ifdef CONFIG_RWSEM_READER_SPIN
+	/* set when the lock must be granted to the head of wait_list */
+	int handoff;
+#endif
 	/*
 	 * Write owner. Used as a speculative check to see
 	 * if the owner is running on the cpu.
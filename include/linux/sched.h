@@ -709,6 +709,25 @@ struct sched_dl_entity {
 	struct hrtimer inactive_timer;
 };
 
+#ifdef CONFIG_UCLAMP_TASK
+enum uclamp_id {
+	UCLAMP_MIN = 0,	/* utilization floor */
+	UCLAMP_MAX,	/* utilization cap */
+	UCLAMP_CNT
+};
+
+/*
+ * Utilization clamp requested for a task, in SCHED_CAPACITY_SCALE units.
+ * @bucket_id and @active track the rq bucket the task is accounted in
+ * while it is runnable.
+ */
+struct uclamp_se {
+	unsigned int value		: 11;
+	unsigned int bucket_id		: 5;
+	unsigned int active		: 1;
+};
+#endif /* CONFIG_UCLAMP_TASK */
+
 union rcu_special {
 	struct {
 		u8			blocked;
@@ -803,6 +822,10 @@ struct task_struct {
 #endif
 	struct sched_dl_entity		dl;
 
+#ifdef CONFIG_UCLAMP_TASK
+	struct uclamp_se		uclamp[UCLAMP_CNT];
+#endif
+
 #ifdef CONFIG_PREEMPT_NOTIFIERS
 	/* List of struct preempt_notifier: */
 	struct hlist_head		preempt_notifiers;
@@ -1722,11 +1745,30 @@ static inline int task_nice(const struct task_struct *p)
 }
 
 extern int can_nice(const struct task_struct *p, const int nice);
+#ifdef CONFIG_CGROUP_TIMER_SLACK
+extern u64 task_timer_slack_ns(struct task_struct *p);
+#else
+static inline u64 task_timer_slack_ns(struct task_struct *p)
+{
+	return p->timer_slack_ns;
+}
+#endif
 extern int task_curr(const struct task_struct *p);
 extern int idle_cpu(int cpu);
+extern bool cpu_latency_sensitive(int cpu);
 extern int sched_setscheduler(struct task_struct *, int, const struct sched_param *);
 extern int sched_setscheduler_nocheck(struct task_struct *, int, const struct sched_param *);
 extern int sched_setattr(struct task_struct *, const struct sched_attr *);
+#ifdef CONFIG_UCLAMP_TASK
+extern int sched_set_util_clamp(struct task_struct *p, unsigned int min,
+				unsigned int max);
+#else
+static inline int sched_set_util_clamp(struct task_struct *p, unsigned int min,
+				       unsigned int max)
+{
+	return -EOPNOTSUPP;
+}
+#endif
 extern struct task_struct *idle_task(int cpu);
 
 /**
@@ -22,14 +22,30 @@ extern unsigned long nr_iowait(void);
 extern unsigned long nr_iowait_cpu(int cpu);
 extern void get_iowait_load(unsigned long *nr_waiters, unsigned long *load);
 
+/*
+ * Running totals of a CPU's nr_running, in task-nanoseconds, as of @time
+ * (sched_clock()). Averages are obtained by differencing two samples.
+ */
+struct sched_nr_sum {
+	u64 time;
+	u64 nr;
+	u64 nr_big;
+	unsigned long nr_running;
+};
+
 #ifdef CONFIG_SMP
 extern void sched_update_nr_prod(int cpu, long delta, bool inc);
+extern void sched_get_nr_running_sum(int cpu, struct sched_nr_sum *sum);
 extern unsigned int sched_get_cpu_util(int cpu);
 extern u64 sched_get_cpu_last_busy_time(int cpu);
 #else
 static inline void sched_update_nr_prod(int cpu, long delta, bool inc)
 {
 }
+static inline void sched_get_nr_running_sum(int cpu, struct sched_nr_sum *sum)
+{
+	*sum = (struct sched_nr_sum) { 0 };
+}
 static inline unsigned int sched_get_cpu_util(int cpu)
 {
 	return 0;
@@ -269,6 +269,39 @@ void *qmi_encode_message(int type, unsigned int msg_id, size_t *len,
 int qmi_decode_message(const void *buf, size_t len,
 		       struct qmi_elem_info *ei, void *c_struct);
 
+/**
+ * struct qmi_codec - specialized encoder/decoder for one message type
+ * @ei:		message descriptor the codec was generated from
+ * @encode:	encode @c_struct into @out_buf, same contract as qmi_encode()
+ * @decode:	decode @in_buf into @c_struct, same contract as qmi_decode()
+ * @node:	entry in the codec registry, owned by the QMI helpers
+ *
+ * Codecs are generated at build time by scripts/qmi_codegen.py from the
+ * @ei tables and are used by qmi_encode_message() and
+ * qmi_decode_message() in place of the table interpreter once registered.
+ */
+struct qmi_codec {
+	struct qmi_elem_info *ei;
+	int (*encode)(void *out_buf, const void *c_struct, u32 out_buf_len);
+	int (*decode)(void *c_struct, const void *in_buf, u32 in_buf_len);
+	struct hlist_node node;
+};
+
+#ifdef CONFIG_QCOM_QMI_CODEGEN
+int qmi_register_codecs(struct qmi_codec *codecs, size_t count);
+void qmi_unregister_codecs(struct qmi_codec *codecs, size_t count);
+#else
+static inline int qmi_register_codecs(struct qmi_codec *codecs, size_t count)
+{
+	return 0;
+}
+
+static inline void qmi_unregister_codecs(struct qmi_codec *codecs,
+					 size_t count)
+{
+}
+#endif
+
 int qmi_txn_init(struct qmi_handle *qmi, struct qmi_txn *txn,
 		 struct qmi_elem_info *ei, void *c_struct);
 int qmi_txn_wait(struct qmi_txn *txn, unsigned long timeout);
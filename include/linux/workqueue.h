@@ -121,6 +121,17 @@ struct delayed_work {
 	int cpu;
 };
 
+enum wq_capacity {
+	WQ_CAPACITY_ANY,	/* all CPUs in @cpumask */
+	WQ_CAPACITY_LITTLE,	/* the lowest capacity CPUs in @cpumask */
+	WQ_CAPACITY_BIG,	/* all but the lowest capacity CPUs */
+};
+
+enum wq_latency {
+	WQ_LATENCY_CLASS_NORMAL,
+	WQ_LATENCY_CLASS_CRITICAL,	/* per-cluster pools */
+};
+
 /**
  * struct workqueue_attrs - A struct for workqueue attributes.
  *
@@ -137,6 +148,27 @@ struct workqueue_attrs {
 	 */
 	cpumask_var_t cpumask;
 
+	/**
+	 * @min_idle: number of workers created along with the pool, which
+	 * idle management then doesn't destroy; workers that become busy
+	 * are not replaced ahead of time
+	 */
+	int min_idle;
+
+	/**
+	 * @capacity: CPU capacity class to run on, narrows down @cpumask
+	 *
+	 * Like ``no_numa``, ``capacity`` and ``latency`` only modify how
+	 * :c:func:`apply_workqueue_attrs` selects pools and aren't
+	 * properties of a worker_pool.
+	 */
+	enum wq_capacity capacity;
+
+	/**
+	 * @latency: latency class, selects per-cluster pools when critical
+	 */
+	enum wq_latency latency;
+
 	/**
 	 * @no_numa: disable NUMA affinity
 	 *
@@ -323,6 +355,16 @@ enum {
 	 */
 	WQ_POWER_EFFICIENT	= 1 << 7,
 
+	/*
+	 * Unbound work items that something waits on, such as decryption
+	 * or verification of data being read.  Such workqueues run on the
+	 * CPU capacity class selected by workqueue.critical_capacity,
+	 * start with a few pre-created workers and use a pool per CPU
+	 * cluster so work runs next to the CPU that queued it.  Only
+	 * meaningful together with WQ_UNBOUND.
+	 */
+	WQ_LATENCY_CRITICAL	= 1 << 8,
+
 	__WQ_DRAINING		= 1 << 16, /* internal: workqueue is draining */
 	__WQ_ORDERED		= 1 << 17, /* internal: workqueue is ordered */
 	__WQ_LEGACY		= 1 << 18, /* internal: create*_workqueue() */
@@ -8,6 +8,15 @@
 #define MFD_CLOEXEC		0x0001U
 #define MFD_ALLOW_SEALING	0x0002U
 #define MFD_HUGETLB		0x0004U
+/*
+ * Back the file with transparent huge pages where possible, whatever the
+ * shmem_enabled policy, falling back to small pages when huge pages cannot
+ * be allocated.  Like huge=within_size, a huge page is only used where the
+ * file already covers all of it, so size the file with ftruncate() before
+ * writing to it or faulting it in.  Unlike MFD_HUGETLB this needs no
+ * reserved pool and keeps sealing, swap and the shmem memory accounting.
+ */
+#define MFD_HUGE_PREFERRED	0x0020U
 
 /*
  * Huge page size encoding when MFD_HUGETLB is specified, and a huge page
@@ -433,11 +433,47 @@ struct perf_event_attr {
 #define PERF_EVENT_IOC_ID		_IOR('$', 7, __u64 *)
 #define PERF_EVENT_IOC_SET_BPF		_IOW('$', 8, __u32)
 #define PERF_EVENT_IOC_PAUSE_OUTPUT	_IOW('$', 9, __u32)
+#define PERF_EVENT_IOC_SET_AGGREGATE	_IOW('$', 10, __u32)
+#define PERF_EVENT_IOC_AGGREGATE_READ	_IOWR('$', 11, struct perf_aggr_read)
+#define PERF_EVENT_IOC_AGGREGATE_STACK	_IOWR('$', 12, struct perf_aggr_stack)
 
 enum perf_event_ioc_flags {
 	PERF_IOC_FLAG_GROUP		= 1U << 0,
 };
 
+/*
+ * In-kernel stack aggregation:
+ *
+ * PERF_EVENT_IOC_SET_AGGREGATE switches a sampling event with
+ * PERF_SAMPLE_CALLCHAIN to aggregation mode, with a table of
+ * (1 << arg) entries.  Samples are no longer written to the ring
+ * buffer but counted per (pid, stack), and the table is read with
+ * PERF_EVENT_IOC_AGGREGATE_READ.  The ips of a stack, in the same
+ * format as PERF_SAMPLE_CALLCHAIN, are read with
+ * PERF_EVENT_IOC_AGGREGATE_STACK; stack ids stay valid until the
+ * second reset after they were last reported.
+ */
+struct perf_aggr_entry {
+	__u32	pid;
+	__u32	stack_id;
+	__u64	count;
+};
+
+#define PERF_AGGR_READ_RESET		(1U << 0)
+
+struct perf_aggr_read {
+	__u64	entries;	/* pointer to struct perf_aggr_entry[nr] */
+	__u32	nr;		/* in: size of entries[], out: entries read */
+	__u32	flags;		/* PERF_AGGR_READ_* */
+	__u64	lost;		/* out: samples dropped since last reset */
+};
+
+struct perf_aggr_stack {
+	__u64	ips;		/* pointer to __u64[nr] */
+	__u32	stack_id;
+	__u32	nr;		/* in: size of ips[], out: stack depth */
+};
+
 /*
  * Structure of the page that can be mapped via mmap
  */
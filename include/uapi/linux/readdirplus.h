@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _UAPI_LINUX_READDIRPLUS_H
+#define _UAPI_LINUX_READDIRPLUS_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+#include <linux/stat.h>
+
+/*
+ * FS_IOC_READDIRPLUS reads the next entries of a directory like getdents64()
+ * and returns the statx() attributes of each entry with it, as if it had
+ * been passed to statx() with AT_SYMLINK_NOFOLLOW relative to the
+ * directory.  This saves a system call and a path walk per entry for
+ * directory scanners.
+ *
+ * The ioctl returns the number of bytes filled in at @buf, 0 at the end of
+ * the directory, or a negative error.  The entries are 8 byte aligned and
+ * walked by d_reclen.  The directory offset moves like with getdents64().
+ *
+ * The attributes of an entry are left to the caller, and stx.stx_mask is 0,
+ * if the entry is "." or "..", is a mount point, or has gone away or could
+ * not be looked up by the time it was stat'ed.
+ */
+struct fs_readdirplus {
+	__u64 buf;		/* buffer for struct fs_readdirplus_entry */
+	__u32 size;		/* size of @buf in bytes */
+	__u32 mask;		/* STATX_* attributes wanted */
+	__u32 flags;		/* AT_STATX_* sync flags */
+	__u32 reserved;		/* must be 0 */
+};
+
+struct fs_readdirplus_entry {
+	__u64 d_ino;
+	__s64 d_off;
+	__u16 d_reclen;
+	__u8 d_type;
+	__u8 __pad[5];
+	struct statx stx;
+	char d_name[0];
+};
+
+#define FS_IOC_READDIRPLUS	_IOW(0x94, 64, struct fs_readdirplus)
+
+#endif /* _UAPI_LINUX_READDIRPLUS_H */
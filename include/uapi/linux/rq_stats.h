@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _UAPI_LINUX_RQ_STATS_H
+#define _UAPI_LINUX_RQ_STATS_H
+
+#include <linux/types.h>
+
+/*
+ * Layout of /dev/rq_stats, a read-only device that can be mmap()ed and
+ * sampled without system calls while it is mapped.
+ *
+ * The kernel rewrites the page every period_ms. @seq is odd while an
+ * update is in progress; a reader retries until it sees the same even
+ * @seq before and after copying the data:
+ *
+ *	do {
+ *		while ((seq = READ_ONCE(p->seq)) & 1)
+ *			;
+ *		rmb();
+ *		copy = p->cpu[cpu];
+ *		rmb();
+ *	} while (READ_ONCE(p->seq) != seq);
+ *
+ * nr_sum and nr_big_sum are running totals of nr_running and of WALT big
+ * tasks in task-nanoseconds up to time_ns, so the average number of
+ * runnable tasks between two samples a and b is
+ * (b.nr_sum - a.nr_sum) / (b.time_ns - a.time_ns).
+ */
+
+#define RQ_STATS_VERSION	1
+
+struct rq_stats_cpu {
+	__u64 time_ns;		/* sched_clock() when sampled */
+	__u64 nr_sum;
+	__u64 nr_big_sum;
+	__u32 nr_running;
+	__u32 busy_pct;		/* utilization in the last WALT window */
+	__u32 cur_freq;		/* kHz, 0 if unknown */
+	__u32 online;
+};
+
+struct rq_stats_page {
+	__u32 seq;
+	__u32 version;
+	__u32 nr_cpus;
+	__u32 period_ms;
+	struct rq_stats_cpu cpu[0];
+};
+
+#endif /* _UAPI_LINUX_RQ_STATS_H */
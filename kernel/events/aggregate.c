@@ -0,0 +1,560 @@
+/*
+ * Performance events in-kernel stack aggregation:
+ *
+ * An event in aggregation mode doesn't write its samples to the ring
+ * buffer; it counts them per (pid, callchain) instead, with the
+ * callchains deduplicated in a table of the event.  Userspace periodically
+ * reads the compact table of counts and only fetches the callchains
+ * it hasn't seen yet, which costs a fraction of the memory bandwidth
+ * and wakeups of streaming every sample.
+ *
+ * Samples are mostly taken from NMI context, where neither the
+ * allocator nor the table lock can be used, so they are first staged
+ * in a small per-cpu buffer and folded into the table from irq_work.
+ *
+ * The callchain table is bounded by the size of the counts table and
+ * freed with the event; a callchain is dropped once it hasn't been
+ * counted for two resets, which is how long userspace may fetch it.
+ *
+ * For licensing details see kernel-base/COPYING
+ */
+
+#include <linux/perf_event.h>
+#include <linux/irq_work.h>
+#include <linux/jhash.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/uaccess.h>
+
+#include "internal.h"
+
+#define PERF_AGGR_STACK_MAX	64
+#define PERF_AGGR_STAGE_NR	16
+#define PERF_AGGR_BITS_MIN	6
+#define PERF_AGGR_BITS_MAX	14
+
+struct perf_aggr_stack_rec {
+	u32			id;
+	u32			hash;
+	u32			gen;	/* last period it was counted in */
+	u32			nr;
+	unsigned long		ips[];
+};
+
+struct perf_aggr_sample {
+	u32			pid;
+	u32			nr;
+	unsigned long		ips[PERF_AGGR_STACK_MAX];
+};
+
+/*
+ * Single producer (the overflow handler, made exclusive by ->nest) and
+ * single consumer (the irq_work), always on the owning cpu.
+ */
+struct perf_aggr_cpu {
+	struct perf_aggr	*aggr;
+	struct irq_work		work;
+	int			nest;
+	unsigned int		head;
+	unsigned int		tail;
+	struct perf_aggr_sample	samples[PERF_AGGR_STAGE_NR];
+};
+
+struct perf_aggr {
+	raw_spinlock_t			lock;
+	unsigned int			bits;
+	unsigned int			nr_entries;
+	struct perf_aggr_entry		*entries;
+	/*
+	 * Callchains, hashed by their ips and by their id, in tables of
+	 * (2 << bits) slots: there's at most one per entry, for this
+	 * period and the previous one.
+	 */
+	struct perf_aggr_stack_rec	**stacks;
+	struct perf_aggr_stack_rec	**stack_ids;
+	unsigned int			nr_stacks;
+	u32				next_id;
+	u32				gen;
+	struct perf_aggr_cpu __percpu	*cpu;
+	atomic64_t			lost;
+};
+
+static inline unsigned int perf_aggr_stack_mask(struct perf_aggr *aggr)
+{
+	return (2U << aggr->bits) - 1;
+}
+
+static u32 perf_aggr_stack_hash(unsigned long *ips, u32 nr)
+{
+	return jhash(ips, nr * sizeof(*ips), nr);
+}
+
+/* Called with aggr->lock held */
+static struct perf_aggr_stack_rec *
+perf_aggr_stack_lookup(struct perf_aggr *aggr, u32 hash,
+		       unsigned long *ips, u32 nr)
+{
+	unsigned int mask = perf_aggr_stack_mask(aggr);
+	struct perf_aggr_stack_rec *rec;
+	unsigned int i, n;
+
+	i = hash & mask;
+	for (n = 0; n <= mask; n++, i = (i + 1) & mask) {
+		rec = aggr->stacks[i];
+		if (!rec)
+			break;
+		if (rec->hash == hash && rec->nr == nr &&
+		    !memcmp(rec->ips, ips, nr * sizeof(*ips)))
+			return rec;
+	}
+
+	return NULL;
+}
+
+/* Called with aggr->lock held */
+static struct perf_aggr_stack_rec *
+perf_aggr_stack_by_id(struct perf_aggr *aggr, u32 id)
+{
+	unsigned int mask = perf_aggr_stack_mask(aggr);
+	struct perf_aggr_stack_rec *rec;
+	unsigned int i, n;
+
+	i = jhash_1word(id, 0) & mask;
+	for (n = 0; n <= mask; n++, i = (i + 1) & mask) {
+		rec = aggr->stack_ids[i];
+		if (!rec)
+			break;
+		if (rec->id == id)
+			return rec;
+	}
+
+	return NULL;
+}
+
+static void perf_aggr_stack_link(struct perf_aggr_stack_rec **table,
+				 unsigned int mask, unsigned int i,
+				 struct perf_aggr_stack_rec *rec)
+{
+	while (table[i])
+		i = (i + 1) & mask;
+	table[i] = rec;
+}
+
+/* Called with aggr->lock held, the caller checked there's room */
+static void perf_aggr_stack_insert(struct perf_aggr *aggr,
+				   struct perf_aggr_stack_rec *rec)
+{
+	unsigned int mask = perf_aggr_stack_mask(aggr);
+
+	/* ids only wrap after 4G distinct stacks, but don't hand out a live one */
+	do {
+		rec->id = ++aggr->next_id;
+	} while (!rec->id || perf_aggr_stack_by_id(aggr, rec->id));
+
+	perf_aggr_stack_link(aggr->stacks, mask, rec->hash & mask, rec);
+	perf_aggr_stack_link(aggr->stack_ids, mask,
+			     jhash_1word(rec->id, 0) & mask, rec);
+	aggr->nr_stacks++;
+}
+
+/*
+ * Called on reset, with aggr->lock held: free the stacks that weren't
+ * counted in the period that just ended nor the one before, and rehash
+ * the others, open addressing has no cheaper way to delete.
+ */
+static void perf_aggr_stack_expire(struct perf_aggr *aggr)
+{
+	unsigned int mask = perf_aggr_stack_mask(aggr);
+	struct perf_aggr_stack_rec *rec;
+	unsigned int i;
+
+	memset(aggr->stack_ids, 0, (mask + 1) * sizeof(*aggr->stack_ids));
+	for (i = 0; i <= mask; i++) {
+		rec = aggr->stacks[i];
+		if (!rec)
+			continue;
+		if (aggr->gen - rec->gen > 1) {
+			kfree(rec);
+			aggr->nr_stacks--;
+			continue;
+		}
+		perf_aggr_stack_link(aggr->stack_ids, mask,
+				     jhash_1word(rec->id, 0) & mask, rec);
+	}
+
+	memset(aggr->stacks, 0, (mask + 1) * sizeof(*aggr->stacks));
+	for (i = 0; i <= mask; i++) {
+		rec = aggr->stack_ids[i];
+		if (rec)
+			perf_aggr_stack_link(aggr->stacks, mask,
+					     rec->hash & mask, rec);
+	}
+}
+
+/* Called with aggr->lock held */
+static bool perf_aggr_account(struct perf_aggr *aggr, u32 pid,
+			      struct perf_aggr_stack_rec *rec)
+{
+	unsigned int mask = (1U << aggr->bits) - 1;
+	struct perf_aggr_entry *entry;
+	unsigned int i, n;
+
+	rec->gen = aggr->gen;
+
+	i = jhash_2words(pid, rec->id, 0) & mask;
+	for (n = 0; n <= mask; n++, i = (i + 1) & mask) {
+		entry = &aggr->entries[i];
+
+		if (entry->stack_id == rec->id && entry->pid == pid) {
+			entry->count++;
+			return true;
+		}
+
+		if (!entry->stack_id) {
+			/* keep the probe sequences short */
+			if (aggr->nr_entries >= mask - (mask >> 2))
+				return false;
+
+			entry->pid = pid;
+			entry->stack_id = rec->id;
+			entry->count = 1;
+			aggr->nr_entries++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Look up the stack of a staged sample and count it, adding the stack
+ * to the table if it's new.  The allocation is done without the lock,
+ * so another cpu may have added the same stack in the meantime.
+ */
+static bool perf_aggr_add_sample(struct perf_aggr *aggr,
+				 struct perf_aggr_sample *sample)
+{
+	unsigned int mask = perf_aggr_stack_mask(aggr);
+	struct perf_aggr_stack_rec *rec, *new;
+	u32 hash;
+	bool ok;
+
+	hash = perf_aggr_stack_hash(sample->ips, sample->nr);
+
+	raw_spin_lock(&aggr->lock);
+	rec = perf_aggr_stack_lookup(aggr, hash, sample->ips, sample->nr);
+	if (rec) {
+		ok = perf_aggr_account(aggr, sample->pid, rec);
+		raw_spin_unlock(&aggr->lock);
+		return ok;
+	}
+	raw_spin_unlock(&aggr->lock);
+
+	new = kmalloc(sizeof(*new) + sample->nr * sizeof(new->ips[0]),
+		      GFP_ATOMIC | __GFP_NOWARN);
+	if (!new)
+		return false;
+
+	new->hash = hash;
+	new->nr = sample->nr;
+	memcpy(new->ips, sample->ips, sample->nr * sizeof(new->ips[0]));
+
+	ok = false;
+	raw_spin_lock(&aggr->lock);
+	rec = perf_aggr_stack_lookup(aggr, hash, sample->ips, sample->nr);
+	if (!rec && aggr->nr_stacks < mask - (mask >> 2)) {
+		perf_aggr_stack_insert(aggr, new);
+		rec = new;
+		new = NULL;
+	}
+	if (rec)
+		ok = perf_aggr_account(aggr, sample->pid, rec);
+	raw_spin_unlock(&aggr->lock);
+
+	kfree(new);
+
+	return ok;
+}
+
+static void perf_aggr_work(struct irq_work *work)
+{
+	struct perf_aggr_cpu *cpu = container_of(work, struct perf_aggr_cpu,
+						 work);
+	struct perf_aggr *aggr = cpu->aggr;
+	struct perf_aggr_sample *sample;
+	unsigned int head;
+
+	head = READ_ONCE(cpu->head);
+	barrier();
+
+	while (cpu->tail != head) {
+		sample = &cpu->samples[cpu->tail % PERF_AGGR_STAGE_NR];
+
+		if (!perf_aggr_add_sample(aggr, sample))
+			atomic64_inc(&aggr->lost);
+
+		barrier();
+		WRITE_ONCE(cpu->tail, cpu->tail + 1);
+	}
+}
+
+static void perf_aggr_overflow(struct perf_event *event,
+			       struct perf_sample_data *data,
+			       struct pt_regs *regs)
+{
+	struct perf_event *parent = event->parent ? event->parent : event;
+	struct perf_aggr *aggr = READ_ONCE(parent->aggr);
+	struct perf_callchain_entry *callchain;
+	struct perf_aggr_sample *sample;
+	struct perf_aggr_cpu *cpu;
+	bool crosstask;
+	unsigned int i;
+
+	if (!aggr)
+		return;
+
+	cpu = this_cpu_ptr(aggr->cpu);
+
+	/* a sample from NMI interrupting one from IRQ context, etc. */
+	if (this_cpu_inc_return(aggr->cpu->nest) != 1)
+		goto lost;
+
+	if (cpu->head - READ_ONCE(cpu->tail) >= PERF_AGGR_STAGE_NR)
+		goto lost;
+
+	crosstask = event->ctx->task && event->ctx->task != current;
+	callchain = get_perf_callchain(regs, 0,
+				       !event->attr.exclude_callchain_kernel,
+				       !event->attr.exclude_callchain_user,
+				       PERF_AGGR_STACK_MAX, crosstask, true);
+	if (!callchain || !callchain->nr)
+		goto lost;
+
+	sample = &cpu->samples[cpu->head % PERF_AGGR_STAGE_NR];
+	sample->nr = min_t(u64, callchain->nr, PERF_AGGR_STACK_MAX);
+	for (i = 0; i < sample->nr; i++)
+		sample->ips[i] = callchain->ip[i];
+	sample->pid = task_tgid_nr_ns(current, event->ns);
+
+	barrier();
+	WRITE_ONCE(cpu->head, cpu->head + 1);
+	this_cpu_dec(aggr->cpu->nest);
+
+	irq_work_queue(&cpu->work);
+	return;
+ lost:
+	this_cpu_dec(aggr->cpu->nest);
+	atomic64_inc(&aggr->lost);
+}
+
+static void perf_aggr_destroy(struct perf_aggr *aggr)
+{
+	unsigned int i;
+
+	if (aggr->stacks) {
+		for (i = 0; i <= perf_aggr_stack_mask(aggr); i++)
+			kfree(aggr->stacks[i]);
+	}
+
+	free_percpu(aggr->cpu);
+	kvfree(aggr->stack_ids);
+	kvfree(aggr->stacks);
+	kvfree(aggr->entries);
+	kfree(aggr);
+}
+
+/*
+ * Samples of events inherited after this call are aggregated too, so
+ * it should be done before the event is enabled.
+ */
+int perf_aggr_set(struct perf_event *event, u32 bits)
+{
+	perf_overflow_handler_t handler = READ_ONCE(event->overflow_handler);
+	struct perf_aggr_cpu *c;
+	struct perf_aggr *aggr;
+	size_t size;
+	int cpu;
+
+	if (!is_sampling_event(event) ||
+	    !(event->attr.sample_type & PERF_SAMPLE_CALLCHAIN))
+		return -EINVAL;
+
+	if (bits < PERF_AGGR_BITS_MIN || bits > PERF_AGGR_BITS_MAX)
+		return -EINVAL;
+
+	if (event->aggr)
+		return -EEXIST;
+
+	/* bpf programs, hw breakpoints and kernel counters */
+	if (!__is_default_overflow_handler(handler) ||
+	    event->overflow_handler_context)
+		return -EBUSY;
+
+	aggr = kzalloc(sizeof(*aggr), GFP_KERNEL);
+	if (!aggr)
+		return -ENOMEM;
+
+	size = 1UL << bits;
+	aggr->bits = bits;
+	aggr->entries = kvzalloc(size * sizeof(*aggr->entries), GFP_KERNEL);
+	aggr->stacks = kvzalloc(2 * size * sizeof(*aggr->stacks), GFP_KERNEL);
+	aggr->stack_ids = kvzalloc(2 * size * sizeof(*aggr->stack_ids),
+				   GFP_KERNEL);
+	aggr->cpu = alloc_percpu(struct perf_aggr_cpu);
+	if (!aggr->entries || !aggr->stacks || !aggr->stack_ids ||
+	    !aggr->cpu) {
+		perf_aggr_destroy(aggr);
+		return -ENOMEM;
+	}
+
+	raw_spin_lock_init(&aggr->lock);
+	atomic64_set(&aggr->lost, 0);
+
+	for_each_possible_cpu(cpu) {
+		c = per_cpu_ptr(aggr->cpu, cpu);
+		c->aggr = aggr;
+		init_irq_work(&c->work, perf_aggr_work);
+	}
+
+	/* publish the table before samples can get to it */
+	smp_store_release(&event->aggr, aggr);
+	WRITE_ONCE(event->overflow_handler, perf_aggr_overflow);
+
+	return 0;
+}
+
+int perf_aggr_read(struct perf_event *event, void __user *arg)
+{
+	struct perf_aggr *aggr = event->aggr;
+	struct perf_aggr_entry *buf;
+	struct perf_aggr_read req;
+	unsigned int i, n = 0, size;
+	int ret = 0;
+
+	if (!aggr)
+		return -EINVAL;
+
+	if (copy_from_user(&req, arg, sizeof(req)))
+		return -EFAULT;
+
+	if (req.flags & ~PERF_AGGR_READ_RESET)
+		return -EINVAL;
+
+	size = 1U << aggr->bits;
+	buf = kvmalloc_array(size, sizeof(*buf), GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	raw_spin_lock_irq(&aggr->lock);
+
+	if (aggr->nr_entries > req.nr) {
+		/* tell userspace how much room it needs */
+		n = aggr->nr_entries;
+		raw_spin_unlock_irq(&aggr->lock);
+		ret = -ENOSPC;
+		goto out;
+	}
+
+	for (i = 0; i < size; i++) {
+		if (aggr->entries[i].stack_id)
+			buf[n++] = aggr->entries[i];
+	}
+	req.lost = atomic64_read(&aggr->lost);
+
+	if (req.flags & PERF_AGGR_READ_RESET) {
+		memset(aggr->entries, 0, size * sizeof(*aggr->entries));
+		aggr->nr_entries = 0;
+		atomic64_set(&aggr->lost, 0);
+
+		/* the ids just read can still be fetched until next reset */
+		aggr->gen++;
+		perf_aggr_stack_expire(aggr);
+	}
+
+	raw_spin_unlock_irq(&aggr->lock);
+
+	if (copy_to_user(u64_to_user_ptr(req.entries), buf,
+			 n * sizeof(*buf)))
+		ret = -EFAULT;
+ out:
+	req.nr = n;
+	if (copy_to_user(arg, &req, sizeof(req)))
+		ret = -EFAULT;
+
+	kvfree(buf);
+
+	return ret;
+}
+
+int perf_aggr_stack(struct perf_event *event, void __user *arg)
+{
+	struct perf_aggr *aggr = event->aggr;
+	struct perf_aggr_stack_rec *rec;
+	struct perf_aggr_stack req;
+	unsigned int i, nr = 0;
+	u64 *ips;
+	int ret = 0;
+
+	if (!aggr)
+		return -EINVAL;
+
+	if (copy_from_user(&req, arg, sizeof(req)))
+		return -EFAULT;
+
+	if (!req.stack_id)
+		return -ENOENT;
+
+	ips = kmalloc_array(PERF_AGGR_STACK_MAX, sizeof(*ips), GFP_KERNEL);
+	if (!ips)
+		return -ENOMEM;
+
+	/* the record may be freed by a reset as soon as the lock is dropped */
+	raw_spin_lock_irq(&aggr->lock);
+	rec = perf_aggr_stack_by_id(aggr, req.stack_id);
+	if (rec) {
+		nr = rec->nr;
+		for (i = 0; i < nr; i++)
+			ips[i] = rec->ips[i];
+	}
+	raw_spin_unlock_irq(&aggr->lock);
+
+	if (!rec) {
+		ret = -ENOENT;
+		goto out;
+	}
+
+	if (copy_to_user(u64_to_user_ptr(req.ips), ips,
+			 min(req.nr, nr) * sizeof(*ips))) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	req.nr = nr;
+	if (copy_to_user(arg, &req, sizeof(req)))
+		ret = -EFAULT;
+ out:
+	kfree(ips);
+
+	return ret;
+}
+
+/*
+ * Called when the event is freed: it's out of its context and its
+ * inherited events are gone, so only already queued irq_work can still
+ * touch the table.
+ */
+void perf_aggr_free(struct perf_event *event)
+{
+	struct perf_aggr *aggr = event->aggr;
+	int cpu;
+
+	if (!aggr)
+		return;
+
+	event->aggr = NULL;
+
+	for_each_possible_cpu(cpu)
+		irq_work_sync(&per_cpu_ptr(aggr->cpu, cpu)->work);
+
+	perf_aggr_destroy(aggr);
+}
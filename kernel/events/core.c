@@ -4398,6 +4398,7 @@ static void _free_event(struct perf_event *event)
 	}
 
 	perf_event_free_bpf_prog(event);
+	perf_aggr_free(event);
 	perf_addr_filters_splice(event, NULL);
 	kfree(event->addr_filter_ranges);
 
@@ -5095,6 +5096,16 @@ static long _perf_ioctl(struct perf_event *event, unsigned int cmd, unsigned lon
 		rcu_read_unlock();
 		return 0;
 	}
+
+	case PERF_EVENT_IOC_SET_AGGREGATE:
+		return perf_aggr_set(event, arg);
+
+	case PERF_EVENT_IOC_AGGREGATE_READ:
+		return perf_aggr_read(event, (void __user *)arg);
+
+	case PERF_EVENT_IOC_AGGREGATE_STACK:
+		return perf_aggr_stack(event, (void __user *)arg);
+
 	default:
 		return -ENOTTY;
 	}
@@ -249,4 +249,28 @@ static inline bool arch_perf_have_user_stack_dump(void)
 #define perf_user_stack_pointer(regs) 0
 #endif /* CONFIG_HAVE_PERF_USER_STACK_DUMP */
 
+#ifdef CONFIG_PERF_EVENTS_AGGREGATE
+extern int perf_aggr_set(struct perf_event *event, u32 bits);
+extern int perf_aggr_read(struct perf_event *event, void __user *arg);
+extern int perf_aggr_stack(struct perf_event *event, void __user *arg);
+extern void perf_aggr_free(struct perf_event *event);
+#else
+static inline int perf_aggr_set(struct perf_event *event, u32 bits)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline int perf_aggr_read(struct perf_event *event, void __user *arg)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline int perf_aggr_stack(struct perf_event *event, void __user *arg)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline void perf_aggr_free(struct perf_event *event) { }
+#endif /* CONFIG_PERF_EVENTS_AGGREGATE */
+
 #endif /* _KERNEL_EVENTS_INTERNAL_H */
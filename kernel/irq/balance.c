@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * linux/kernel/irq/balance.c
+ *
+ * In-kernel interrupt affinity balancing.
+ *
+ * Left alone, every device interrupt is routed to the first CPU of its
+ * affinity mask, so on systems without a user space irqbalance all the
+ * busy storage, network and WLAN interrupts pile up on CPU0 and compete
+ * with whatever runs there.
+ *
+ * Every interval the time spent in the hard interrupt handlers of each
+ * interrupt (see irq_balance_account()) and its rate are sampled.  An
+ * interrupt that fires often enough is moved away from a CPU that runs
+ * RT, deadline or boosted (top-app) work, or whose interrupt load is
+ * well above that of another CPU, to the least loaded CPU that runs no
+ * such work.  An interrupt that was moved is left where it is for a
+ * while, and a move has to improve the balance by a margin, so that
+ * interrupts do not bounce between CPUs.
+ *
+ * Only interrupts whose affinity nobody has narrowed, or that were last
+ * placed by the balancer itself, are considered.  Writing a mask to
+ * /proc/irq/N/smp_affinity takes an interrupt out of the balancer's
+ * hands, as do managed, per-CPU and IRQF_NOBALANCING interrupts.
+ */
+
+#include <linux/irq.h>
+#include <linux/interrupt.h>
+#include <linux/jiffies.h>
+#include <linux/moduleparam.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/workqueue.h>
+
+#include "internals.h"
+
+#ifdef MODULE_PARAM_PREFIX
+#undef MODULE_PARAM_PREFIX
+#endif
+#define MODULE_PARAM_PREFIX "irqbalance."
+
+static bool enable = true;
+module_param(enable, bool, 0644);
+MODULE_PARM_DESC(enable, "Balance interrupt affinity");
+
+static unsigned int interval_ms = 1000;
+module_param(interval_ms, uint, 0644);
+MODULE_PARM_DESC(interval_ms, "Sampling interval");
+
+static unsigned int min_rate = 200;
+module_param(min_rate, uint, 0644);
+MODULE_PARM_DESC(min_rate, "Interrupts per second below which an interrupt is left alone");
+
+static unsigned int hold_ms = 5000;
+module_param(hold_ms, uint, 0644);
+MODULE_PARM_DESC(hold_ms, "Minimum time an interrupt stays on a CPU it was moved to");
+
+static unsigned int margin_pct = 5;
+module_param(margin_pct, uint, 0644);
+MODULE_PARM_DESC(margin_pct, "Load difference, in percent of the interval, a move must gain");
+
+static DEFINE_PER_CPU(u64, irq_balance_load);	/* handler ns this interval */
+static DEFINE_PER_CPU(bool, irq_balance_busy);	/* runs RT or boosted work */
+
+static void irq_balance_workfn(struct work_struct *work);
+static DECLARE_DEFERRABLE_WORK(irq_balance_work, irq_balance_workfn);
+static struct cpumask irq_balance_cpus;
+
+/* The CPU an interrupt is currently delivered to */
+static int irq_balance_cur_cpu(struct irq_desc *desc)
+{
+	struct irq_data *d = irq_desc_get_irq_data(desc);
+
+	return cpumask_first_and(irq_data_get_effective_affinity_mask(d),
+				 cpu_online_mask);
+}
+
+/* May the balancer move this interrupt? */
+static bool irq_balance_eligible(struct irq_desc *desc)
+{
+	struct irq_data *d = irq_desc_get_irq_data(desc);
+	const struct cpumask *mask = irq_data_get_affinity_mask(d);
+
+	if (!desc->action || !irqd_can_balance(d) ||
+	    irqd_affinity_is_managed(d) || !d->chip ||
+	    !d->chip->irq_set_affinity)
+		return false;
+
+	if (desc->balance_cpu >= 0 &&
+	    cpumask_equal(mask, cpumask_of(desc->balance_cpu)))
+		return true;
+
+	return cpumask_subset(irq_default_affinity, mask);
+}
+
+/*
+ * Sample the handler time and rate of every interrupt since the last
+ * pass and charge the time to the CPU the interrupt runs on.
+ */
+static void irq_balance_sample(void)
+{
+	struct irq_desc *desc;
+	unsigned int irq;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		per_cpu(irq_balance_load, cpu) = 0;
+
+	for_each_irq_desc(irq, desc) {
+		u64 time = READ_ONCE(desc->handle_time);
+		unsigned int count = READ_ONCE(desc->tot_count);
+
+		desc->balance_load = time - desc->balance_time;
+		desc->balance_rate = count - desc->balance_count;
+		desc->balance_time = time;
+		desc->balance_count = count;
+
+		if (!desc->balance_load)
+			continue;
+		cpu = irq_balance_cur_cpu(desc);
+		if (cpu < nr_cpu_ids)
+			per_cpu(irq_balance_load, cpu) += desc->balance_load;
+	}
+
+	/*
+	 * Not only the CPUs interrupts may be moved to: an interrupt can
+	 * still sit on a CPU that has left irq_default_affinity, and
+	 * irq_balance_one() looks at the flag of the source CPU too.
+	 */
+	for_each_online_cpu(cpu)
+		per_cpu(irq_balance_busy, cpu) = cpu_latency_sensitive(cpu);
+}
+
+/* The least loaded CPU not running latency sensitive work, if any */
+static int irq_balance_find_cpu(void)
+{
+	int cpu, best = nr_cpu_ids;
+	u64 load, best_load = U64_MAX;
+
+	for_each_cpu(cpu, &irq_balance_cpus) {
+		if (per_cpu(irq_balance_busy, cpu))
+			continue;
+		load = per_cpu(irq_balance_load, cpu);
+		if (load < best_load) {
+			best = cpu;
+			best_load = load;
+		}
+	}
+	return best;
+}
+
+static void irq_balance_one(struct irq_desc *desc, unsigned int rate,
+			    u64 margin)
+{
+	unsigned int irq = irq_desc_get_irq(desc);
+	u64 load = desc->balance_load;
+	int src, dst;
+
+	if (desc->balance_rate < rate || !irq_balance_eligible(desc))
+		return;
+	if (desc->balance_cpu >= 0 &&
+	    time_before(jiffies, desc->balance_moved +
+				 msecs_to_jiffies(hold_ms)))
+		return;
+
+	src = irq_balance_cur_cpu(desc);
+	dst = irq_balance_find_cpu();
+	if (src >= nr_cpu_ids || dst >= nr_cpu_ids || src == dst)
+		return;
+
+	/*
+	 * Leave a CPU running latency sensitive work, otherwise only move
+	 * if the destination stays clearly below the source.
+	 */
+	if (!per_cpu(irq_balance_busy, src) &&
+	    per_cpu(irq_balance_load, dst) + load + margin >=
+	    per_cpu(irq_balance_load, src))
+		return;
+
+	if (irq_set_affinity(irq, cpumask_of(dst)))
+		return;
+
+	desc->balance_cpu = dst;
+	desc->balance_moved = jiffies;
+	per_cpu(irq_balance_load, src) -= load;
+	per_cpu(irq_balance_load, dst) += load;
+}
+
+static void irq_balance_workfn(struct work_struct *work)
+{
+	unsigned int interval = max(interval_ms, 10U);
+	unsigned int rate = max_t(unsigned int, 1,
+				  mult_frac(min_rate, interval, MSEC_PER_SEC));
+	u64 margin = (u64)interval * NSEC_PER_MSEC * margin_pct / 100;
+	struct irq_desc *desc;
+	unsigned int irq;
+
+	get_online_cpus();
+	cpumask_and(&irq_balance_cpus, irq_default_affinity, cpu_online_mask);
+
+	irq_lock_sparse();
+	irq_balance_sample();
+	if (READ_ONCE(enable) && cpumask_weight(&irq_balance_cpus) > 1) {
+		for_each_irq_desc(irq, desc)
+			irq_balance_one(desc, rate, margin);
+	}
+	irq_unlock_sparse();
+	put_online_cpus();
+
+	queue_delayed_work(system_power_efficient_wq, &irq_balance_work,
+			   msecs_to_jiffies(interval));
+}
+
+static int __init irq_balance_init(void)
+{
+	queue_delayed_work(system_power_efficient_wq, &irq_balance_work,
+			   msecs_to_jiffies(interval_ms));
+	return 0;
+}
+late_initcall(irq_balance_init);
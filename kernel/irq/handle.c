@@ -196,12 +196,15 @@ irqreturn_t handle_irq_event_percpu(struct irq_desc *desc)
 irqreturn_t handle_irq_event(struct irq_desc *desc)
 {
 	irqreturn_t ret;
+	u64 start;
 
 	desc->istate &= ~IRQS_PENDING;
 	irqd_set(&desc->irq_data, IRQD_IRQ_INPROGRESS);
 	raw_spin_unlock(&desc->lock);
 
+	start = irq_balance_clock();
 	ret = handle_irq_event_percpu(desc);
+	irq_balance_account(desc, start);
 
 	raw_spin_lock(&desc->lock);
 	irqd_clear(&desc->irq_data, IRQD_IRQ_INPROGRESS);
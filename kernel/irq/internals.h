@@ -378,6 +378,26 @@ static inline void irq_setup_timings(struct irq_desc *desc,
 static inline void record_irq_time(struct irq_desc *desc) {}
 #endif /* CONFIG_IRQ_TIMINGS */
 
+#ifdef CONFIG_IRQ_BALANCE
+static inline u64 irq_balance_clock(void)
+{
+	return local_clock();
+}
+
+/*
+ * Charge the time spent in the handlers to the interrupt.  Serialized
+ * by IRQD_IRQ_INPROGRESS, sampled locklessly by the balancer.
+ */
+static inline void irq_balance_account(struct irq_desc *desc, u64 start)
+{
+	WRITE_ONCE(desc->handle_time,
+		   desc->handle_time + local_clock() - start);
+}
+#else
+static inline u64 irq_balance_clock(void) { return 0; }
+static inline void irq_balance_account(struct irq_desc *desc, u64 start) {}
+#endif /* CONFIG_IRQ_BALANCE */
+
 
 #ifdef CONFIG_GENERIC_IRQ_CHIP
 void irq_init_generic_chip(struct irq_chip_generic *gc, const char *name,
@@ -0,0 +1,354 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Sampling lock contention profiler
+ *
+ * lock_stat needs lockdep and is far too heavy for production kernels.
+ * This profiler instead samples one in sample_period acquisitions that
+ * take the slow path of a mutex, rwsem or queued spinlock, and records
+ * the waiter's call stack and how long it waited for the lock.
+ *
+ * A lock slow path may run with arbitrary locks held, including those of
+ * the page allocator and of the stack depot, so a sample is only copied
+ * into a small per-cpu buffer there, with interrupts disabled and without
+ * taking locks or allocating memory. A lazy irq_work later moves the
+ * buffered samples into the stack depot and a table of call sites. Samples
+ * taken while the buffer is full or being drained are dropped.
+ *
+ * The following debugfs files are created:
+ *
+ * <debugfs>/lock_profile/
+ *   enable		- 1 to sample, 0 to stop
+ *   sample_period	- sample one in this many slow path acquisitions
+ *   top		- call sites sorted by total wait time
+ *   reset		- writing anything clears the call site table
+ */
+#include <linux/debugfs.h>
+#include <linux/hash.h>
+#include <linux/irq_work.h>
+#include <linux/math64.h>
+#include <linux/percpu.h>
+#include <linux/sched/clock.h>
+#include <linux/sched/debug.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/spinlock.h>
+#include <linux/stackdepot.h>
+#include <linux/stacktrace.h>
+#include <linux/vmalloc.h>
+
+#include "lock_profile.h"
+
+#define LOCK_PROFILE_DEPTH	8	/* stack entries kept per sample */
+#define LOCK_PROFILE_SKIP	4	/* max profiler and slow path frames */
+#define LOCK_PROFILE_SAMPLES	16	/* per-cpu buffer, power of 2 */
+#define LOCK_PROFILE_SITES	1024	/* call site table, power of 2 */
+#define LOCK_PROFILE_TOP	50	/* call sites shown in "top" */
+
+static const char * const lock_profile_names[LOCK_PROFILE_NR_TYPES] = {
+	[LOCK_PROFILE_MUTEX]		= "mutex",
+	[LOCK_PROFILE_RWSEM_READ]	= "rwsem_read",
+	[LOCK_PROFILE_RWSEM_WRITE]	= "rwsem_write",
+	[LOCK_PROFILE_SPIN]		= "spinlock",
+};
+
+struct lock_profile_sample {
+	unsigned int type;
+	unsigned int nr_entries;
+	u64 wait_ns;
+	unsigned long entries[LOCK_PROFILE_DEPTH];
+};
+
+struct lock_profile_cpu {
+	struct lock_profile_sample samples[LOCK_PROFILE_SAMPLES];
+	unsigned int head;	/* next sample to fill */
+	unsigned int tail;	/* next sample to drain */
+	unsigned int busy;	/* recursion guard */
+	int countdown;		/* slow paths until the next sample */
+	unsigned long dropped;
+	struct irq_work work;
+};
+
+struct lock_profile_site {
+	depot_stack_handle_t handle;
+	unsigned int type;
+	u64 count;
+	u64 total_ns;
+	u64 max_ns;
+};
+
+DEFINE_STATIC_KEY_FALSE(lock_profile_key);
+
+static DEFINE_PER_CPU(struct lock_profile_cpu, lock_profile_cpu);
+static struct lock_profile_site lock_profile_sites[LOCK_PROFILE_SITES];
+static unsigned long lock_profile_overflow;
+static DEFINE_RAW_SPINLOCK(lock_profile_lock);
+static u32 sample_period = 64;
+
+u64 __lock_profile_start(void)
+{
+	if (this_cpu_dec_return(lock_profile_cpu.countdown) > 0)
+		return 0;
+
+	this_cpu_write(lock_profile_cpu.countdown,
+		       max_t(u32, READ_ONCE(sample_period), 1));
+	return local_clock() ?: 1;
+}
+
+static bool lock_profile_internal(unsigned long ip)
+{
+	return in_lock_functions(ip) || in_sched_functions(ip);
+}
+
+/*
+ * Drop the frames of the profiler and of the lock functions so that the
+ * trace starts at the code that asked for the lock.
+ */
+static void lock_profile_save_stack(struct lock_profile_sample *s)
+{
+	unsigned long entries[LOCK_PROFILE_DEPTH + LOCK_PROFILE_SKIP + 2];
+	struct stack_trace trace = {
+		.entries	= entries,
+		.max_entries	= ARRAY_SIZE(entries),
+	};
+	unsigned int i = 0, j;
+
+	save_stack_trace(&trace);
+
+	while (i < LOCK_PROFILE_SKIP && i < trace.nr_entries &&
+	       !lock_profile_internal(entries[i]))
+		i++;
+	if (i == LOCK_PROFILE_SKIP || i == trace.nr_entries)
+		i = 0;
+	while (i < trace.nr_entries && lock_profile_internal(entries[i]))
+		i++;
+
+	for (j = 0; j < LOCK_PROFILE_DEPTH && i < trace.nr_entries &&
+		    entries[i] != ULONG_MAX; i++, j++)
+		s->entries[j] = entries[i];
+	s->nr_entries = j;
+}
+
+void __lock_profile_record(enum lock_profile_type type, u64 start)
+{
+	u64 wait_ns = local_clock() - start;
+	struct lock_profile_sample *s;
+	struct lock_profile_cpu *pc;
+	unsigned long flags;
+
+	if (in_nmi())
+		return;
+
+	local_irq_save(flags);
+	pc = this_cpu_ptr(&lock_profile_cpu);
+	if (pc->busy || pc->head - pc->tail >= LOCK_PROFILE_SAMPLES) {
+		pc->dropped++;
+		goto out;
+	}
+
+	pc->busy++;
+	s = &pc->samples[pc->head & (LOCK_PROFILE_SAMPLES - 1)];
+	s->type = type;
+	s->wait_ns = wait_ns;
+	lock_profile_save_stack(s);
+	pc->head++;
+	irq_work_queue(&pc->work);
+	pc->busy--;
+out:
+	local_irq_restore(flags);
+}
+
+static void lock_profile_account(struct lock_profile_sample *s,
+				 depot_stack_handle_t handle)
+{
+	struct lock_profile_site *site;
+	unsigned int i, n;
+
+	i = hash_32(handle ^ s->type, ilog2(LOCK_PROFILE_SITES));
+
+	raw_spin_lock(&lock_profile_lock);
+	for (n = 0; n < LOCK_PROFILE_SITES; n++) {
+		site = &lock_profile_sites[(i + n) & (LOCK_PROFILE_SITES - 1)];
+		if (!site->handle) {
+			site->handle = handle;
+			site->type = s->type;
+			break;
+		}
+		if (site->handle == handle && site->type == s->type)
+			break;
+	}
+
+	if (n < LOCK_PROFILE_SITES) {
+		site->count++;
+		site->total_ns += s->wait_ns;
+		site->max_ns = max(site->max_ns, s->wait_ns);
+	} else {
+		lock_profile_overflow++;
+	}
+	raw_spin_unlock(&lock_profile_lock);
+}
+
+/*
+ * Runs from the tick with interrupts disabled, on the CPU that buffered
+ * the samples, and outside of the slow path that took them.
+ */
+static void lock_profile_drain(struct irq_work *work)
+{
+	struct lock_profile_cpu *pc = this_cpu_ptr(&lock_profile_cpu);
+
+	pc->busy++;
+	while (pc->tail != pc->head) {
+		struct lock_profile_sample *s =
+			&pc->samples[pc->tail & (LOCK_PROFILE_SAMPLES - 1)];
+		struct stack_trace trace = {
+			.nr_entries	= s->nr_entries,
+			.entries	= s->entries,
+		};
+		depot_stack_handle_t handle;
+
+		handle = depot_save_stack(&trace, GFP_NOWAIT);
+		if (handle)
+			lock_profile_account(s, handle);
+		pc->tail++;
+	}
+	pc->busy--;
+}
+
+static int lock_profile_cmp(const void *a, const void *b)
+{
+	const struct lock_profile_site *sa = a, *sb = b;
+
+	if (sa->total_ns == sb->total_ns)
+		return 0;
+	return sa->total_ns < sb->total_ns ? 1 : -1;
+}
+
+static int lock_profile_top_show(struct seq_file *m, void *v)
+{
+	struct lock_profile_site *sites;
+	unsigned long dropped = 0, overflow;
+	unsigned int i, j, nr = 0;
+	int cpu;
+
+	sites = vmalloc(sizeof(lock_profile_sites));
+	if (!sites)
+		return -ENOMEM;
+
+	raw_spin_lock_irq(&lock_profile_lock);
+	for (i = 0; i < LOCK_PROFILE_SITES; i++) {
+		if (lock_profile_sites[i].handle)
+			sites[nr++] = lock_profile_sites[i];
+	}
+	overflow = lock_profile_overflow;
+	raw_spin_unlock_irq(&lock_profile_lock);
+
+	for_each_possible_cpu(cpu)
+		dropped += per_cpu(lock_profile_cpu, cpu).dropped;
+
+	sort(sites, nr, sizeof(*sites), lock_profile_cmp, NULL);
+
+	seq_printf(m, "sites %u dropped %lu overflow %lu\n",
+		   nr, dropped, overflow);
+	for (i = 0; i < nr && i < LOCK_PROFILE_TOP; i++) {
+		struct stack_trace trace;
+
+		seq_printf(m, "\n%s count %llu wait_total_ns %llu wait_avg_ns %llu wait_max_ns %llu\n",
+			   lock_profile_names[sites[i].type], sites[i].count,
+			   sites[i].total_ns,
+			   div64_u64(sites[i].total_ns, sites[i].count),
+			   sites[i].max_ns);
+		depot_fetch_stack(sites[i].handle, &trace);
+		for (j = 0; j < trace.nr_entries; j++)
+			seq_printf(m, "  %pS\n", (void *)trace.entries[j]);
+	}
+
+	vfree(sites);
+	return 0;
+}
+
+static int lock_profile_top_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lock_profile_top_show, NULL);
+}
+
+static const struct file_operations lock_profile_top_fops = {
+	.open		= lock_profile_top_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static ssize_t lock_profile_reset_write(struct file *file,
+					const char __user *user_buf,
+					size_t count, loff_t *ppos)
+{
+	int cpu;
+
+	raw_spin_lock_irq(&lock_profile_lock);
+	memset(lock_profile_sites, 0, sizeof(lock_profile_sites));
+	lock_profile_overflow = 0;
+	raw_spin_unlock_irq(&lock_profile_lock);
+
+	for_each_possible_cpu(cpu)
+		per_cpu(lock_profile_cpu, cpu).dropped = 0;
+
+	return count;
+}
+
+static const struct file_operations lock_profile_reset_fops = {
+	.write		= lock_profile_reset_write,
+	.llseek		= default_llseek,
+};
+
+static int lock_profile_enable_get(void *data, u64 *val)
+{
+	*val = static_key_enabled(&lock_profile_key);
+	return 0;
+}
+
+static int lock_profile_enable_set(void *data, u64 val)
+{
+	if (val)
+		static_branch_enable(&lock_profile_key);
+	else
+		static_branch_disable(&lock_profile_key);
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(lock_profile_enable_fops, lock_profile_enable_get,
+			lock_profile_enable_set, "%llu\n");
+
+static int __init lock_profile_init(void)
+{
+	struct dentry *dir;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct lock_profile_cpu *pc = per_cpu_ptr(&lock_profile_cpu, cpu);
+
+		init_irq_work(&pc->work, lock_profile_drain);
+		pc->work.flags = IRQ_WORK_LAZY;
+		pc->countdown = sample_period;
+	}
+
+	dir = debugfs_create_dir("lock_profile", NULL);
+	if (!dir)
+		goto out;
+
+	if (!debugfs_create_file("enable", 0600, dir, NULL,
+				 &lock_profile_enable_fops) ||
+	    !debugfs_create_u32("sample_period", 0600, dir, &sample_period) ||
+	    !debugfs_create_file("top", 0400, dir, NULL,
+				 &lock_profile_top_fops) ||
+	    !debugfs_create_file("reset", 0200, dir, NULL,
+				 &lock_profile_reset_fops))
+		goto fail_undo;
+
+	return 0;
+fail_undo:
+	debugfs_remove_recursive(dir);
+out:
+	pr_warn("Could not create 'lock_profile' debugfs entries\n");
+	return -ENOMEM;
+}
+fs_initcall(lock_profile_init);
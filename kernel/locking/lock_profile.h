@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Sampling lock contention profiler, see lock_profile.c.
+ *
+ * The hooks only sit in the slow paths of mutexes, rwsems and queued
+ * spinlocks; the uncontended fast paths are not touched. While the
+ * profiler is disabled a slow path costs one static branch.
+ */
+#ifndef __LOCKING_LOCK_PROFILE_H
+#define __LOCKING_LOCK_PROFILE_H
+
+#include <linux/types.h>
+#include <linux/jump_label.h>
+
+enum lock_profile_type {
+	LOCK_PROFILE_MUTEX,
+	LOCK_PROFILE_RWSEM_READ,
+	LOCK_PROFILE_RWSEM_WRITE,
+	LOCK_PROFILE_SPIN,
+	LOCK_PROFILE_NR_TYPES,
+};
+
+#ifdef CONFIG_LOCK_PROFILE
+DECLARE_STATIC_KEY_FALSE(lock_profile_key);
+
+extern u64 __lock_profile_start(void);
+extern void __lock_profile_record(enum lock_profile_type type, u64 start);
+
+/*
+ * Called on entry to a slow path. Returns the start time if this
+ * acquisition is sampled, 0 otherwise.
+ */
+static __always_inline u64 lock_profile_start(void)
+{
+	if (static_branch_unlikely(&lock_profile_key))
+		return __lock_profile_start();
+	return 0;
+}
+
+/* Called once the lock has been acquired */
+static __always_inline void lock_profile_end(enum lock_profile_type type,
+					     u64 start)
+{
+	if (unlikely(start))
+		__lock_profile_record(type, start);
+}
+#else
+static inline u64 lock_profile_start(void)	{ return 0; }
+static inline void lock_profile_end(enum lock_profile_type type,
+				    u64 start)	{ }
+#endif /* CONFIG_LOCK_PROFILE */
+
+#endif /* __LOCKING_LOCK_PROFILE_H */
@@ -596,6 +596,47 @@ static struct lock_torture_ops rwsem_lock_ops = {
 	.name		= "rwsem_lock"
 };
 
+/*
+ * The same rwsem with mmap_sem-like hold times: writers hold it for about
+ * as long as an mprotect() and readers for about as long as a page fault,
+ * so readers mostly contend with a writer that is running.  This is the
+ * case that CONFIG_RWSEM_READER_SPIN is meant for.
+ */
+static void torture_rwsem_mmap_write_delay(struct torture_random_state *trsp)
+{
+	const unsigned long longdelay_us = 2000;
+
+	/* An occasional long hold, such as an munmap() of a large area.  */
+	if (!(torture_random(trsp) % (cxt.nrealwriters_stress * 1000)))
+		udelay(longdelay_us);
+	else
+		udelay(10);
+#ifdef CONFIG_PREEMPT
+	if (!(torture_random(trsp) % (cxt.nrealwriters_stress * 20000)))
+		preempt_schedule();  /* Allow test to be preempted. */
+#endif
+}
+
+static void torture_rwsem_mmap_read_delay(struct torture_random_state *trsp)
+{
+	udelay(2);
+#ifdef CONFIG_PREEMPT
+	if (!(torture_random(trsp) % (cxt.nrealreaders_stress * 20000)))
+		preempt_schedule();  /* Allow test to be preempted. */
+#endif
+}
+
+static struct lock_torture_ops rwsem_mmap_lock_ops = {
+	.writelock	= torture_rwsem_down_write,
+	.write_delay	= torture_rwsem_mmap_write_delay,
+	.task_boost     = torture_boost_dummy,
+	.writeunlock	= torture_rwsem_up_write,
+	.readlock       = torture_rwsem_down_read,
+	.read_delay     = torture_rwsem_mmap_read_delay,
+	.readunlock     = torture_rwsem_up_read,
+	.name		= "rwsem_mmap_lock"
+};
+
 #include <linux/percpu-rwsem.h>
 static struct percpu_rw_semaphore pcpu_rwsem;
 
@@ -875,6 +916,7 @@ static int __init lock_torture_init(void)
 		&rtmutex_lock_ops,
 #endif
 		&rwsem_lock_ops,
+		&rwsem_mmap_lock_ops,
 		&percpu_rwsem_lock_ops,
 	};
 
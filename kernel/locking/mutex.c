@@ -35,6 +35,7 @@
 #else
 # include "mutex.h"
 #endif
+#include "lock_profile.h"
 
 void
 __mutex_init(struct mutex *lock, const char *name, struct lock_class_key *key)
@@ -754,6 +755,7 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 	struct mutex_waiter waiter;
 	bool first = false;
 	struct ww_mutex *ww;
+	u64 profile_start;
 	int ret;
 
 	might_sleep();
@@ -764,6 +766,7 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 			return -EALREADY;
 	}
 
+	profile_start = lock_profile_start();
 	preempt_disable();
 	mutex_acquire_nest(&lock->dep_map, subclass, 0, nest_lock, ip);
 
@@ -774,6 +777,7 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 		if (use_ww_ctx && ww_ctx)
 			ww_mutex_set_context_fastpath(ww, ww_ctx);
 		preempt_enable();
+		lock_profile_end(LOCK_PROFILE_MUTEX, profile_start);
 		return 0;
 	}
 
@@ -885,6 +889,7 @@ skip_wait:
 
 	spin_unlock(&lock->wait_lock);
 	preempt_enable();
+	lock_profile_end(LOCK_PROFILE_MUTEX, profile_start);
 	return 0;
 
 err:
@@ -69,6 +69,7 @@
  */
 
 #include "mcs_spinlock.h"
+#include "lock_profile.h"
 
 #ifdef CONFIG_PARAVIRT_SPINLOCKS
 #define MAX_NODES	8
@@ -302,6 +303,7 @@ static __always_inline u32  __pv_wait_head_or_lock(struct qspinlock *lock,
 void queued_spin_lock_slowpath(struct qspinlock *lock, u32 val)
 {
 	struct mcs_spinlock *prev, *next, *node;
+	u64 profile_start;
 	u32 old, tail;
 	int idx;
 
@@ -375,6 +377,7 @@ void queued_spin_lock_slowpath(struct qspinlock *lock, u32 val)
 	 * queuing.
 	 */
 queue:
+	profile_start = lock_profile_start();
 	node = this_cpu_ptr(&mcs_nodes[0]);
 	idx = node->count++;
 	tail = encode_tail(smp_processor_id(), idx);
@@ -509,6 +512,7 @@ release:
 	 * release the node
 	 */
 	__this_cpu_dec(mcs_nodes[0].count);
+	lock_profile_end(LOCK_PROFILE_SPIN, profile_start);
 }
 EXPORT_SYMBOL(queued_spin_lock_slowpath);
 
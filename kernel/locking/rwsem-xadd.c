@@ -20,6 +20,8 @@
 #include <linux/osq_lock.h>
 
 #include "rwsem.h"
+#include "rwsem_stat.h"
+#include "lock_profile.h"
 
 /*
  * Guide to the rw_semaphore's count field for common values.
@@ -90,6 +92,9 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	sem->owner = NULL;
 	osq_lock_init(&sem->osq);
 #endif
+#ifdef CONFIG_RWSEM_READER_SPIN
+	sem->handoff = 0;
+#endif
 #ifdef CONFIG_RWSEM_PRIO_AWARE
 	sem->m_count = 0;
 #endif
@@ -103,6 +108,21 @@ enum rwsem_wake_type {
 	RWSEM_WAKE_READ_OWNED	/* Waker thread holds the read lock */
 };
 
+/*
+ * The head of the queue, @waiter, found the lock taken from under it once
+ * more. If it has been waiting for too long, stop all lock stealing until
+ * the lock has been granted to the queue.
+ * - the wait_lock must be held by the caller
+ */
+static inline void rwsem_check_handoff(struct rw_semaphore *sem,
+				       struct rwsem_waiter *waiter)
+{
+	if (!rwsem_handoff_pending(sem) && rwsem_waiter_timed_out(waiter)) {
+		rwsem_set_handoff(sem);
+		rwstat_inc(rwstat_handoff, true);
+	}
+}
+
 /*
  * handle the lock release when processes blocked on it that can now run
  * - if we come here from up_xxxx(), then:
@@ -162,8 +182,10 @@ static void __rwsem_mark_wake(struct rw_semaphore *sem,
 			 * reader grant.
 			 */
 			if (atomic_long_add_return(-adjustment, &sem->count) <
-			    RWSEM_WAITING_BIAS)
+			    RWSEM_WAITING_BIAS) {
+				rwsem_check_handoff(sem, waiter);
 				return;
+			}
 
 			/* Last active locker left. Retry waking readers. */
 			goto try_reader_grant;
@@ -175,6 +197,7 @@ static void __rwsem_mark_wake(struct rw_semaphore *sem,
 		 */
 		rwsem_set_reader_owned(sem);
 	}
+	rwsem_clear_handoff(sem);
 
 	/*
 	 * Grant an infinite number of read locks to the readers at the front
@@ -234,6 +257,10 @@ static void __rwsem_mark_wake(struct rw_semaphore *sem,
 	}
 }
 
+static bool rwsem_reader_can_spin(struct rw_semaphore *sem);
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem,
+				  enum rwsem_waiter_type type);
+
 /*
  * Wait for the read lock to be granted
  */
@@ -241,16 +268,36 @@ static inline struct rw_semaphore __sched *
 __rwsem_down_read_failed_common(struct rw_semaphore *sem, int state)
 {
 	long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
+	bool waiting = true; /* any queued threads before us */
 	struct rwsem_waiter waiter;
 	DEFINE_WAKE_Q(wake_q);
 	bool is_first_waiter = false;
+	u64 profile_start = lock_profile_start();
+	u64 wait_start;
+
+	/*
+	 * If a running writer holds the lock, undo the read bias and spin
+	 * until it goes away rather than queueing behind it.
+	 */
+	if (rwsem_reader_can_spin(sem)) {
+		atomic_long_add(-RWSEM_ACTIVE_READ_BIAS, &sem->count);
+		adjustment = 0;
+		if (rwsem_optimistic_spin(sem, RWSEM_WAITING_FOR_READ)) {
+			lock_profile_end(LOCK_PROFILE_RWSEM_READ, profile_start);
+			return sem;
+		}
+	}
 
 	waiter.task = current;
 	waiter.type = RWSEM_WAITING_FOR_READ;
+	rwsem_waiter_start(&waiter);
+	wait_start = rwstat_clock();
 
 	raw_spin_lock_irq(&sem->wait_lock);
-	if (list_empty(&sem->wait_list))
+	if (list_empty(&sem->wait_list)) {
 		adjustment += RWSEM_WAITING_BIAS;
+		waiting = false;
+	}
 
 	/* is_first_waiter == true means we are first in the queue */
 	is_first_waiter = rwsem_list_add_per_prio(&waiter, sem);
@@ -265,9 +312,7 @@ __rwsem_down_read_failed_common(struct rw_semaphore *sem, int state)
 	 * wake our own waiter to join the existing active readers !
 	 */
 	if (count == RWSEM_WAITING_BIAS ||
-	    (count > RWSEM_WAITING_BIAS &&
-	     (adjustment != -RWSEM_ACTIVE_READ_BIAS ||
-	     is_first_waiter)))
+	    (count > RWSEM_WAITING_BIAS && (!waiting || is_first_waiter)))
 		__rwsem_mark_wake(sem, RWSEM_WAKE_ANY, &wake_q);
 
 	raw_spin_unlock_irq(&sem->wait_lock);
@@ -289,11 +334,16 @@ __rwsem_down_read_failed_common(struct rw_semaphore *sem, int state)
 	}
 
 	__set_current_state(TASK_RUNNING);
+	rwstat_inc(rwstat_rlock_sleep, true);
+	rwstat_wait(rwstat_rlock_wait, wait_start);
+	lock_profile_end(LOCK_PROFILE_RWSEM_READ, profile_start);
 	return sem;
 out_nolock:
 	list_del(&waiter.list);
-	if (list_empty(&sem->wait_list))
+	if (list_empty(&sem->wait_list)) {
 		atomic_long_add(-RWSEM_WAITING_BIAS, &sem->count);
+		rwsem_clear_handoff(sem);
+	}
 	raw_spin_unlock_irq(&sem->wait_lock);
 	__set_current_state(TASK_RUNNING);
 	return ERR_PTR(-EINTR);
@@ -318,7 +368,8 @@ EXPORT_SYMBOL(rwsem_down_read_failed_killable);
  * race conditions between checking the rwsem wait list and setting the
  * sem->count accordingly.
  */
-static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
+static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem,
+					struct rwsem_waiter *waiter)
 {
 	/*
 	 * Avoid trying to acquire write lock if count isn't RWSEM_WAITING_BIAS.
@@ -326,6 +377,13 @@ static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
 	if (count != RWSEM_WAITING_BIAS)
 		return false;
 
+	/*
+	 * A lock that has been handed off belongs to the head of the queue.
+	 */
+	if (rwsem_handoff_pending(sem) &&
+	    list_first_entry(&sem->wait_list, struct rwsem_waiter, list) != waiter)
+		return false;
+
 	/*
 	 * Acquire the lock by trying to set it to ACTIVE_WRITE_BIAS. If there
 	 * are other tasks on the wait list, we need to add on WAITING_BIAS.
@@ -337,6 +395,7 @@ static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
 	if (atomic_long_cmpxchg_acquire(&sem->count, RWSEM_WAITING_BIAS, count)
 							== RWSEM_WAITING_BIAS) {
 		rwsem_set_owner(sem);
+		rwsem_clear_handoff(sem);
 		return true;
 	}
 
@@ -355,6 +414,9 @@ static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
 		if (!(count == 0 || count == RWSEM_WAITING_BIAS))
 			return false;
 
+		if (count && rwsem_handoff_pending(sem))
+			return false;
+
 		old = atomic_long_cmpxchg_acquire(&sem->count, count,
 				      count + RWSEM_ACTIVE_WRITE_BIAS);
 		if (old == count) {
@@ -366,6 +428,49 @@ static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
 	}
 }
 
+#ifdef CONFIG_RWSEM_READER_SPIN
+/*
+ * Try to acquire read lock before the reader has been put on wait queue.
+ * Only join when no writer is active: either readers own the lock and
+ * nobody waits, or the lock is free and the queue may be passed over.
+ */
+static inline bool rwsem_try_read_lock_unqueued(struct rw_semaphore *sem)
+{
+	long old, count = atomic_long_read(&sem->count);
+
+	while (true) {
+		if (count < 0 && count != RWSEM_WAITING_BIAS)
+			return false;
+
+		if (count < 0 && rwsem_handoff_pending(sem))
+			return false;
+
+		old = atomic_long_cmpxchg_acquire(&sem->count, count,
+				      count + RWSEM_ACTIVE_READ_BIAS);
+		if (old == count) {
+			rwsem_set_reader_owned(sem);
+			return true;
+		}
+
+		count = old;
+	}
+}
+#else
+static inline bool rwsem_try_read_lock_unqueued(struct rw_semaphore *sem)
+{
+	return false;
+}
+#endif
+
+static inline bool rwsem_try_lock_unqueued(struct rw_semaphore *sem,
+					   enum rwsem_waiter_type type)
+{
+	if (type == RWSEM_WAITING_FOR_WRITE)
+		return rwsem_try_write_lock_unqueued(sem);
+
+	return rwsem_try_read_lock_unqueued(sem);
+}
+
 static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
 {
 	struct task_struct *owner;
@@ -373,7 +478,7 @@ static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
 
 	BUILD_BUG_ON(!rwsem_has_anonymous_owner(RWSEM_OWNER_UNKNOWN));
 
-	if (need_resched())
+	if (need_resched() || rwsem_handoff_pending(sem))
 		return false;
 
 	rcu_read_lock();
@@ -434,7 +539,8 @@ static noinline bool rwsem_spin_on_owner(struct rw_semaphore *sem)
 	return is_rwsem_owner_spinnable(READ_ONCE(sem->owner));
 }
 
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem,
+				  enum rwsem_waiter_type type)
 {
 	bool taken = false;
 
@@ -452,13 +558,17 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 	 * lock whenever the owner changes. Spinning will be stopped when:
 	 *  1) the owning writer isn't running; or
 	 *  2) readers own the lock as we can't determine if they are
-	 *     actively running or not.
+	 *     actively running or not; or
+	 *  3) a starved waiter asked for the lock to be handed off.
 	 */
 	while (rwsem_spin_on_owner(sem)) {
+		if (rwsem_handoff_pending(sem))
+			break;
+
 		/*
 		 * Try to acquire the lock
 		 */
-		if (rwsem_try_write_lock_unqueued(sem)) {
+		if (rwsem_try_lock_unqueued(sem, type)) {
 			taken = true;
 			break;
 		}
@@ -480,12 +590,36 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 		 */
 		cpu_relax();
 	}
+
+	/*
+	 * A writer that passed the lock on to readers stops the spin above,
+	 * but a spinning reader can still join them.
+	 */
+	if (!taken && type == RWSEM_WAITING_FOR_READ)
+		taken = rwsem_try_read_lock_unqueued(sem);
 	osq_unlock(&sem->osq);
+
+	if (type == RWSEM_WAITING_FOR_READ)
+		rwstat_inc(taken ? rwstat_rlock_spin : rwstat_rlock_spin_fail,
+			   true);
+	else
+		rwstat_inc(taken ? rwstat_wlock_spin : rwstat_wlock_spin_fail,
+			   true);
 done:
 	preempt_enable();
 	return taken;
 }
 
+/*
+ * Return true if a reader that failed the fast path should spin, i.e. the
+ * lock is write owned by a running task.
+ */
+static bool rwsem_reader_can_spin(struct rw_semaphore *sem)
+{
+	return IS_ENABLED(CONFIG_RWSEM_READER_SPIN) &&
+	       rwsem_can_spin_on_owner(sem);
+}
+
 /*
  * Return true if the rwsem has active spinner
  */
@@ -495,7 +629,13 @@ static inline bool rwsem_has_spinner(struct rw_semaphore *sem)
 }
 
 #else
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem,
+				  enum rwsem_waiter_type type)
+{
+	return false;
+}
+
+static bool rwsem_reader_can_spin(struct rw_semaphore *sem)
 {
 	return false;
 }
@@ -518,13 +658,17 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	struct rw_semaphore *ret = sem;
 	DEFINE_WAKE_Q(wake_q);
 	bool is_first_waiter = false;
+	u64 profile_start = lock_profile_start();
+	u64 wait_start;
 
 	/* undo write bias from down_write operation, stop active locking */
 	count = atomic_long_sub_return(RWSEM_ACTIVE_WRITE_BIAS, &sem->count);
 
 	/* do optimistic spinning and steal lock if possible */
-	if (rwsem_optimistic_spin(sem))
+	if (rwsem_optimistic_spin(sem, RWSEM_WAITING_FOR_WRITE)) {
+		lock_profile_end(LOCK_PROFILE_RWSEM_WRITE, profile_start);
 		return sem;
+	}
 
 	/*
 	 * Optimistic spinning failed, proceed to the slowpath
@@ -532,6 +676,8 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	 */
 	waiter.task = current;
 	waiter.type = RWSEM_WAITING_FOR_WRITE;
+	rwsem_waiter_start(&waiter);
+	wait_start = rwstat_clock();
 
 	raw_spin_lock_irq(&sem->wait_lock);
 
@@ -577,8 +723,23 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	/* wait until we successfully acquire the lock */
 	set_current_state(state);
 	while (true) {
-		if (rwsem_try_write_lock(count, sem))
+		if (rwsem_try_write_lock(count, sem, &waiter))
 			break;
+
+		if (list_first_entry(&sem->wait_list, struct rwsem_waiter,
+				     list) == &waiter) {
+			rwsem_check_handoff(sem, &waiter);
+		} else if (count == RWSEM_WAITING_BIAS &&
+			   rwsem_handoff_pending(sem)) {
+			/*
+			 * The lock is free but reserved for the head of the
+			 * queue, which may not have been woken if the release
+			 * raced with a spinner. Make sure it gets to run.
+			 */
+			__rwsem_mark_wake(sem, RWSEM_WAKE_ANY, &wake_q);
+			wake_up_q(&wake_q);
+			wake_q_init(&wake_q);
+		}
 		raw_spin_unlock_irq(&sem->wait_lock);
 
 		/* Block until there are no active lockers. */
@@ -595,6 +756,9 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	__set_current_state(TASK_RUNNING);
 	list_del(&waiter.list);
 	raw_spin_unlock_irq(&sem->wait_lock);
+	rwstat_inc(rwstat_wlock_sleep, true);
+	rwstat_wait(rwstat_wlock_wait, wait_start);
+	lock_profile_end(LOCK_PROFILE_RWSEM_WRITE, profile_start);
 
 	return ret;
 
@@ -602,10 +766,12 @@ out_nolock:
 	__set_current_state(TASK_RUNNING);
 	raw_spin_lock_irq(&sem->wait_lock);
 	list_del(&waiter.list);
-	if (list_empty(&sem->wait_list))
+	if (list_empty(&sem->wait_list)) {
 		atomic_long_add(-RWSEM_WAITING_BIAS, &sem->count);
-	else
+		rwsem_clear_handoff(sem);
+	} else {
 		__rwsem_mark_wake(sem, RWSEM_WAKE_ANY, &wake_q);
+	}
 	raw_spin_unlock_irq(&sem->wait_lock);
 	wake_up_q(&wake_q);
 
@@ -681,7 +847,9 @@ struct rw_semaphore *rwsem_wake(struct rw_semaphore *sem)
 	 * is just going to break out of the waiting loop, it will still do
 	 * a trylock in rwsem_down_write_failed() before sleeping. IOW, if
 	 * rwsem_has_spinner() is true, it will guarantee at least one
-	 * trylock attempt on the rwsem later on.
+	 * trylock attempt on the rwsem later on. A spinning reader that gives
+	 * up re-checks the count under the wait_lock as it queues itself in
+	 * rwsem_down_read_failed(), which has the same effect.
 	 */
 	if (rwsem_has_spinner(sem)) {
 		/*
@@ -29,6 +29,9 @@ struct rwsem_waiter {
 	struct list_head list;
 	struct task_struct *task;
 	enum rwsem_waiter_type type;
+#ifdef CONFIG_RWSEM_READER_SPIN
+	unsigned long timeout;
+#endif
 };
 
 #ifdef CONFIG_RWSEM_SPIN_ON_OWNER
@@ -91,6 +94,68 @@ static inline void rwsem_set_reader_owned(struct rw_semaphore *sem)
 }
 #endif
 
+#ifdef CONFIG_RWSEM_READER_SPIN
+/*
+ * A waiter that has been queued for longer than this and finds the lock
+ * stolen from under it again sets sem->handoff. While it is set nobody may
+ * take the lock except through the wait queue: optimistic spinners and
+ * writers that are not at the head of the queue back off, and the lock
+ * goes to the head of the queue on the next release.
+ */
+#define RWSEM_WAIT_TIMEOUT	DIV_ROUND_UP(HZ, 250)
+
+static inline void rwsem_waiter_start(struct rwsem_waiter *waiter)
+{
+	waiter->timeout = jiffies + RWSEM_WAIT_TIMEOUT;
+}
+
+static inline bool rwsem_waiter_timed_out(struct rwsem_waiter *waiter)
+{
+	return time_after(jiffies, waiter->timeout);
+}
+
+static inline bool rwsem_handoff_pending(struct rw_semaphore *sem)
+{
+	return READ_ONCE(sem->handoff);
+}
+
+/*
+ * The handoff flag is only changed with the wait_lock held.
+ */
+static inline void rwsem_set_handoff(struct rw_semaphore *sem)
+{
+	WRITE_ONCE(sem->handoff, 1);
+}
+
+static inline void rwsem_clear_handoff(struct rw_semaphore *sem)
+{
+	if (sem->handoff)
+		WRITE_ONCE(sem->handoff, 0);
+}
+#else
+static inline void rwsem_waiter_start(struct rwsem_waiter *waiter)
+{
+}
+
+static inline bool rwsem_waiter_timed_out(struct rwsem_waiter *waiter)
+{
+	return false;
+}
+
+static inline bool rwsem_handoff_pending(struct rw_semaphore *sem)
+{
+	return false;
+}
+
+static inline void rwsem_set_handoff(struct rw_semaphore *sem)
+{
+}
+
+static inline void rwsem_clear_handoff(struct rw_semaphore *sem)
+{
+}
+#endif
+
 #ifdef CONFIG_RWSEM_PRIO_AWARE
 
 #define RWSEM_MAX_PREEMPT_ALLOWED 3000
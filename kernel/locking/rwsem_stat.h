@@ -0,0 +1,174 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * When rwsem statistical counters are enabled, the following debugfs files
+ * will be created for reporting the counter values:
+ *
+ * <debugfs>/rwsem_stat/
+ *   rlock_spin		- # of read locks taken by optimistic spinning
+ *   rlock_spin_fail	- # of reader spins that ended in the wait queue
+ *   rlock_sleep	- # of readers that were queued
+ *   rlock_wait		- average time (ns) a queued reader waited
+ *   wlock_spin		- # of write locks taken by optimistic spinning
+ *   wlock_spin_fail	- # of writer spins that ended in the wait queue
+ *   wlock_sleep	- # of writers that were queued
+ *   wlock_wait		- average time (ns) a queued writer waited
+ *   handoff		- # of times a starved waiter set the handoff flag
+ *
+ * Writing to the "reset_counters" file will reset all the above counter
+ * values.
+ *
+ * The counters are per-cpu and shared by all rwsems; they are summed
+ * whenever the corresponding debugfs files are read. Use lock_stat to
+ * find out which lock class the contention comes from.
+ */
+enum rwsem_stats {
+	rwstat_rlock_spin,
+	rwstat_rlock_spin_fail,
+	rwstat_rlock_sleep,
+	rwstat_rlock_wait,
+	rwstat_wlock_spin,
+	rwstat_wlock_spin_fail,
+	rwstat_wlock_sleep,
+	rwstat_wlock_wait,
+	rwstat_handoff,
+	rwstat_num,	/* Total number of statistical counters */
+	rwstat_reset_cnts = rwstat_num,
+};
+
+#ifdef CONFIG_RWSEM_STAT
+#include <linux/debugfs.h>
+#include <linux/sched.h>
+#include <linux/sched/clock.h>
+#include <linux/fs.h>
+
+static const char * const rwstat_names[rwstat_num + 1] = {
+	[rwstat_rlock_spin]	 = "rlock_spin",
+	[rwstat_rlock_spin_fail] = "rlock_spin_fail",
+	[rwstat_rlock_sleep]	 = "rlock_sleep",
+	[rwstat_rlock_wait]	 = "rlock_wait",
+	[rwstat_wlock_spin]	 = "wlock_spin",
+	[rwstat_wlock_spin_fail] = "wlock_spin_fail",
+	[rwstat_wlock_sleep]	 = "wlock_sleep",
+	[rwstat_wlock_wait]	 = "wlock_wait",
+	[rwstat_handoff]	 = "handoff",
+	[rwstat_reset_cnts]	 = "reset_counters",
+};
+
+/*
+ * Per-cpu counters
+ */
+static DEFINE_PER_CPU(u64, rwstats[rwstat_num]);
+
+/*
+ * Function to read and return the rwsem statistical counter values
+ *
+ * The wait counters hold the total time spent queued and are reported as
+ * the average over the matching sleep counter.
+ */
+static ssize_t rwstat_read(struct file *file, char __user *user_buf,
+			   size_t count, loff_t *ppos)
+{
+	char buf[64];
+	int cpu, counter, len;
+	u64 stat = 0, sleeps = 0;
+
+	counter = (long)file_inode(file)->i_private;
+
+	if (counter >= rwstat_num)
+		return -EBADF;
+
+	for_each_possible_cpu(cpu) {
+		stat += per_cpu(rwstats[counter], cpu);
+		if (counter == rwstat_rlock_wait)
+			sleeps += per_cpu(rwstats[rwstat_rlock_sleep], cpu);
+		else if (counter == rwstat_wlock_wait)
+			sleeps += per_cpu(rwstats[rwstat_wlock_sleep], cpu);
+	}
+
+	if (sleeps)
+		stat = DIV_ROUND_CLOSEST_ULL(stat, sleeps);
+	len = snprintf(buf, sizeof(buf) - 1, "%llu\n", stat);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+/*
+ * When counter = reset_cnts, reset all the counter values.
+ */
+static ssize_t rwstat_write(struct file *file, const char __user *user_buf,
+			    size_t count, loff_t *ppos)
+{
+	int cpu;
+
+	if ((long)file_inode(file)->i_private != rwstat_reset_cnts)
+		return count;
+
+	for_each_possible_cpu(cpu) {
+		int i;
+		u64 *ptr = per_cpu_ptr(rwstats, cpu);
+
+		for (i = 0 ; i < rwstat_num; i++)
+			WRITE_ONCE(ptr[i], 0);
+	}
+	return count;
+}
+
+static const struct file_operations fops_rwstat = {
+	.read = rwstat_read,
+	.write = rwstat_write,
+	.llseek = default_llseek,
+};
+
+static int __init init_rwsem_stat(void)
+{
+	struct dentry *d_rwstat = debugfs_create_dir("rwsem_stat", NULL);
+	int i;
+
+	if (!d_rwstat)
+		goto out;
+
+	for (i = 0; i < rwstat_num; i++)
+		if (!debugfs_create_file(rwstat_names[i], 0400, d_rwstat,
+					 (void *)(long)i, &fops_rwstat))
+			goto fail_undo;
+
+	if (!debugfs_create_file(rwstat_names[rwstat_reset_cnts], 0200,
+				 d_rwstat, (void *)(long)rwstat_reset_cnts,
+				 &fops_rwstat))
+		goto fail_undo;
+
+	return 0;
+fail_undo:
+	debugfs_remove_recursive(d_rwstat);
+out:
+	pr_warn("Could not create 'rwsem_stat' debugfs entries\n");
+	return -ENOMEM;
+}
+fs_initcall(init_rwsem_stat);
+
+static inline void rwstat_inc(enum rwsem_stats stat, bool cond)
+{
+	if (cond)
+		this_cpu_inc(rwstats[stat]);
+}
+
+static inline u64 rwstat_clock(void)
+{
+	return sched_clock();
+}
+
+/*
+ * Account the time since @start to one of the wait counters
+ */
+static inline void rwstat_wait(enum rwsem_stats stat, u64 start)
+{
+	this_cpu_add(rwstats[stat], sched_clock() - start);
+}
+
+#else /* CONFIG_RWSEM_STAT */
+
+static inline void rwstat_inc(enum rwsem_stats stat, bool cond)	{ }
+static inline u64 rwstat_clock(void)				{ return 0; }
+static inline void rwstat_wait(enum rwsem_stats stat, u64 start)	{ }
+
+#endif /* CONFIG_RWSEM_STAT */
@@ -42,12 +42,14 @@
 #include <linux/rculist.h>
 #include <linux/poll.h>
 #include <linux/irq_work.h>
+#include <linux/kthread.h>
 #include <linux/utsname.h>
 #include <linux/ctype.h>
 #include <linux/uio.h>
 #include <linux/sched/clock.h>
 #include <linux/sched/debug.h>
 #include <linux/sched/task_stack.h>
+#include <uapi/linux/sched/types.h>
 
 #include <linux/uaccess.h>
 #include <asm/sections.h>
@@ -2035,21 +2037,12 @@ static size_t log_output(int facility, int level, enum log_flags lflags, const c
 }
 
 /* Must be called under logbuf_lock. */
-int vprintk_store(int facility, int level,
-		  const char *dict, size_t dictlen,
-		  const char *fmt, va_list args)
+static int printk_store_text(int facility, int level,
+			     const char *dict, size_t dictlen,
+			     char *text, size_t text_len)
 {
-	static char textbuf[LOG_LINE_MAX];
-	char *text = textbuf;
-	size_t text_len;
 	enum log_flags lflags = 0;
 
-	/*
-	 * The printf needs to come first; we need the syslog
-	 * prefix which might be passed-in as a parameter.
-	 */
-	text_len = vscnprintf(text, sizeof(textbuf), fmt, args);
-
 	/* mark and strip a trailing newline */
 	if (text_len && text[text_len-1] == '\n') {
 		text_len--;
@@ -2089,6 +2082,136 @@ int vprintk_store(int facility, int level,
 			  dict, dictlen, text, text_len);
 }
 
+/* Must be called under logbuf_lock. */
+int vprintk_store(int facility, int level,
+		  const char *dict, size_t dictlen,
+		  const char *fmt, va_list args)
+{
+	static char textbuf[LOG_LINE_MAX];
+	size_t text_len;
+
+	/*
+	 * The printf needs to come first; we need the syslog
+	 * prefix which might be passed-in as a parameter.
+	 */
+	text_len = vscnprintf(textbuf, sizeof(textbuf), fmt, args);
+
+	return printk_store_text(facility, level, dict, dictlen,
+				 textbuf, text_len);
+}
+
+/*
+ * Per-CPU buffers used to format messages before logbuf_lock is taken,
+ * so that the lock only covers copying the finished text into the log
+ * and concurrent printk() callers on other CPUs are not serialized
+ * behind each other's vsnprintf().  One buffer per nesting level lets
+ * an interrupt (or a WARN from inside vsnprintf) printk while the
+ * interrupted context is still formatting.
+ */
+#define PRINTK_TEXTBUF_NESTING	4
+
+static DEFINE_PER_CPU(char [PRINTK_TEXTBUF_NESTING][LOG_LINE_MAX],
+		      printk_textbuf);
+static DEFINE_PER_CPU(int, printk_textbuf_nesting);
+
+/* Called with preemption disabled; returns NULL if nested too deep. */
+static char *printk_get_textbuf(void)
+{
+	int nesting = this_cpu_inc_return(printk_textbuf_nesting);
+
+	if (nesting > PRINTK_TEXTBUF_NESTING) {
+		this_cpu_dec(printk_textbuf_nesting);
+		return NULL;
+	}
+	return this_cpu_ptr(printk_textbuf)[nesting - 1];
+}
+
+static void printk_put_textbuf(void)
+{
+	this_cpu_dec(printk_textbuf_nesting);
+}
+
+#ifdef CONFIG_PRINTK_CONSOLE_KTHREAD
+static struct task_struct *printk_kthread;
+static unsigned long printk_kthread_pending;
+static bool printk_kthread_disabled;
+module_param_named(console_sync, printk_kthread_disabled, bool,
+		   S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(console_sync, "print to consoles synchronously from printk()");
+
+/*
+ * Console output is handed off to printk_kthread in normal operation, so
+ * that the caller of printk() never ends up pushing the whole backlog to
+ * slow consoles itself.  Anything that suggests the kthread may never
+ * get to run again (early boot, shutdown, oops or panic) falls back to
+ * printing synchronously.
+ */
+static bool printk_offload_console(void)
+{
+	if (!printk_kthread || READ_ONCE(printk_kthread_disabled))
+		return false;
+	if (oops_in_progress ||
+	    atomic_read(&panic_cpu) != PANIC_CPU_INVALID)
+		return false;
+	return system_state == SYSTEM_RUNNING;
+}
+
+static void printk_kthread_wake(void)
+{
+	set_bit(0, &printk_kthread_pending);
+	wake_up_process(printk_kthread);
+}
+
+static int printk_kthread_func(void *data)
+{
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!test_and_clear_bit(0, &printk_kthread_pending)) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		console_lock();
+		console_unlock();
+	}
+	return 0;
+}
+
+static int __init printk_kthread_init(void)
+{
+	/*
+	 * Run at the lowest RT priority: at SCHED_NORMAL a busy system can
+	 * delay console output by whole timeslices, and with it the last
+	 * messages before a hang.  The kthread only runs while there is a
+	 * backlog, so it can't take more CPU time than the callers of
+	 * printk() used to spend printing synchronously.
+	 */
+	struct sched_param param = { .sched_priority = 1 };
+	struct task_struct *tsk;
+
+	tsk = kthread_run(printk_kthread_func, NULL, "printk");
+	if (IS_ERR(tsk)) {
+		pr_err("printk: unable to create console kthread: %ld\n",
+		       PTR_ERR(tsk));
+		return PTR_ERR(tsk);
+	}
+	sched_setscheduler_nocheck(tsk, SCHED_FIFO, &param);
+	printk_kthread = tsk;
+	return 0;
+}
+late_initcall(printk_kthread_init);
+#else
+static inline bool printk_offload_console(void)
+{
+	return false;
+}
+
+static inline void printk_kthread_wake(void)
+{
+}
+#endif /* CONFIG_PRINTK_CONSOLE_KTHREAD */
+
 asmlinkage int vprintk_emit(int facility, int level,
 			    const char *dict, size_t dictlen,
 			    const char *fmt, va_list args)
@@ -2096,6 +2219,8 @@ asmlinkage int vprintk_emit(int facility, int level,
 	int printed_len;
 	bool in_sched = false;
 	unsigned long flags;
+	size_t text_len;
+	char *text;
 
 	if (level == LOGLEVEL_SCHED) {
 		level = LOGLEVEL_DEFAULT;
@@ -2105,13 +2230,29 @@ asmlinkage int vprintk_emit(int facility, int level,
 	boot_delay_msec(level);
 	printk_delay();
 
-	/* This stops the holder of console_sem just where we want him */
-	logbuf_lock_irqsave(flags);
-	printed_len = vprintk_store(facility, level, dict, dictlen, fmt, args);
-	logbuf_unlock_irqrestore(flags);
+	preempt_disable();
+	text = printk_get_textbuf();
+	if (text) {
+		text_len = vscnprintf(text, LOG_LINE_MAX, fmt, args);
+
+		/* This stops the holder of console_sem just where we want him */
+		logbuf_lock_irqsave(flags);
+		printed_len = printk_store_text(facility, level, dict, dictlen,
+						text, text_len);
+		logbuf_unlock_irqrestore(flags);
+		printk_put_textbuf();
+	} else {
+		logbuf_lock_irqsave(flags);
+		printed_len = vprintk_store(facility, level, dict, dictlen,
+					    fmt, args);
+		logbuf_unlock_irqrestore(flags);
+	}
+	preempt_enable();
 
 	/* If called from the scheduler, we can not call up(). */
-	if (!in_sched) {
+	if (!in_sched && printk_offload_console()) {
+		printk_kthread_wake();
+	} else if (!in_sched) {
 		/*
 		 * Disable preemption to avoid being preempted while holding
 		 * console_sem which would prevent anyone from printing to
@@ -3087,8 +3228,10 @@ static void wake_up_klogd_work_func(struct irq_work *irq_work)
 	int pending = __this_cpu_xchg(printk_pending, 0);
 
 	if (pending & PRINTK_PENDING_OUTPUT) {
+		if (printk_offload_console())
+			printk_kthread_wake();
 		/* If trylock fails, someone else is doing the printing */
-		if (console_trylock())
+		else if (console_trylock())
 			console_unlock();
 	}
 
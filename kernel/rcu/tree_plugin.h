@@ -28,6 +28,7 @@
 #include <linux/gfp.h>
 #include <linux/oom.h>
 #include <linux/sched/debug.h>
+#include <linux/sched/stat.h>
 #include <linux/smpboot.h>
 #include <uapi/linux/sched/types.h>
 #include "../time/tick-internal.h"
@@ -61,6 +62,8 @@ DEFINE_PER_CPU(char, rcu_cpu_has_work);
 static cpumask_var_t rcu_nocb_mask; /* CPUs to have callbacks offloaded. */
 static bool have_rcu_nocb_mask;	    /* Was rcu_nocb_mask allocated? */
 static bool __read_mostly rcu_nocb_poll;    /* Offload kthread are to poll. */
+static cpumask_var_t rcu_nocb_affinity_mask; /* CPUs to run rcuo kthreads. */
+static bool have_rcu_nocb_affinity_mask;
 #endif /* #ifdef CONFIG_RCU_NOCB_CPU */
 
 /*
@@ -1772,6 +1775,75 @@ static int __init parse_rcu_nocb_poll(char *arg)
 }
 early_param("rcu_nocb_poll", parse_rcu_nocb_poll);
 
+/*
+ * Parse the boot-time CPU list that the rcuo kthreads are confined to,
+ * typically the energy-efficient CPUs of an asymmetric system.
+ */
+static int __init rcu_nocb_affinity_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_affinity_mask);
+	have_rcu_nocb_affinity_mask = true;
+	cpulist_parse(str, rcu_nocb_affinity_mask);
+	return 1;
+}
+__setup("rcu_nocb_affinity=", rcu_nocb_affinity_setup);
+
+#ifdef CONFIG_RCU_NOCB_LAZY
+
+/*
+ * Callbacks that only free memory (kfree_rcu()) are not in a hurry, so
+ * an rcuo kthread whose queue holds nothing else is woken by a timer
+ * rcu_nocb_lazy_delay jiffies later rather than right away.  Anything
+ * else queued in the meantime, or the queue growing past qhimark, cuts
+ * the wait short.  This lets a burst of frees share one wakeup and one
+ * grace period.
+ */
+static int rcu_nocb_lazy_delay = HZ;
+module_param(rcu_nocb_lazy_delay, int, 0644);
+
+/*
+ * Number of callbacks an rcuo kthread invokes with bottom halves disabled
+ * before offering to reschedule: rcu_nocb_batch_idle when it has its CPU
+ * to itself, rcu_nocb_batch_busy when other tasks are waiting to run.
+ */
+static int rcu_nocb_batch_idle = 256;
+module_param(rcu_nocb_batch_idle, int, 0644);
+static int rcu_nocb_batch_busy = 16;
+module_param(rcu_nocb_batch_busy, int, 0644);
+
+/* Can the wakeup for this enqueue onto an empty list be put off? */
+static bool rcu_nocb_lazy_enqueue(int rhcount, int rhcount_lazy)
+{
+	return READ_ONCE(rcu_nocb_lazy_delay) > 0 && rhcount == rhcount_lazy;
+}
+
+static int rcu_nocb_batch_limit(void)
+{
+	int batch;
+
+	if (single_task_running())
+		batch = READ_ONCE(rcu_nocb_batch_idle);
+	else
+		batch = READ_ONCE(rcu_nocb_batch_busy);
+	return max(batch, 1);
+}
+
+#else /* #ifdef CONFIG_RCU_NOCB_LAZY */
+
+#define rcu_nocb_lazy_delay 1
+
+static bool rcu_nocb_lazy_enqueue(int rhcount, int rhcount_lazy)
+{
+	return false;
+}
+
+static int rcu_nocb_batch_limit(void)
+{
+	return 1;
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_LAZY */
+
 /*
  * Wake up any no-CBs CPUs' kthreads that were waiting on the just-ended
  * grace period.
@@ -1831,6 +1903,7 @@ static void __wake_nocb_leader(struct rcu_data *rdp, bool force,
 	if (rdp_leader->nocb_leader_sleep || force) {
 		/* Prior smp_mb__after_atomic() orders against prior enqueue. */
 		WRITE_ONCE(rdp_leader->nocb_leader_sleep, false);
+		WRITE_ONCE(rdp->nocb_defer_wakeup, RCU_NOCB_WAKE_NOT);
 		del_timer(&rdp->nocb_timer);
 		raw_spin_unlock_irqrestore(&rdp->nocb_lock, flags);
 		smp_mb(); /* ->nocb_leader_sleep before swake_up(). */
@@ -1854,7 +1927,8 @@ static void wake_nocb_leader(struct rcu_data *rdp, bool force)
 
 /*
  * Arrange to wake the leader kthread for this NOCB group at some
- * future time when it is safe to do so.
+ * future time when it is safe to do so, or, for RCU_NOCB_WAKE_LAZY,
+ * when the lazy callbacks have waited long enough.
  */
 static void wake_nocb_leader_defer(struct rcu_data *rdp, int waketype,
 				   const char *reason)
@@ -1862,9 +1936,15 @@ static void wake_nocb_leader_defer(struct rcu_data *rdp, int waketype,
 	unsigned long flags;
 
 	raw_spin_lock_irqsave(&rdp->nocb_lock, flags);
-	if (rdp->nocb_defer_wakeup == RCU_NOCB_WAKE_NOT)
+	if (waketype == RCU_NOCB_WAKE_LAZY) {
+		if (rdp->nocb_defer_wakeup == RCU_NOCB_WAKE_NOT)
+			mod_timer(&rdp->nocb_timer,
+				  jiffies + rcu_nocb_lazy_delay);
+	} else if (rdp->nocb_defer_wakeup <= RCU_NOCB_WAKE_LAZY) {
 		mod_timer(&rdp->nocb_timer, jiffies + 1);
-	WRITE_ONCE(rdp->nocb_defer_wakeup, waketype);
+	}
+	if (rdp->nocb_defer_wakeup < waketype)
+		WRITE_ONCE(rdp->nocb_defer_wakeup, waketype);
 	trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu, reason);
 	raw_spin_unlock_irqrestore(&rdp->nocb_lock, flags);
 }
@@ -1950,7 +2030,11 @@ static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
 	}
 	len = atomic_long_read(&rdp->nocb_q_count);
 	if (old_rhpp == &rdp->nocb_head) {
-		if (!irqs_disabled_flags(flags)) {
+		if (rcu_nocb_lazy_enqueue(rhcount, rhcount_lazy)) {
+			/* ... later if it only has memory to free ... */
+			wake_nocb_leader_defer(rdp, RCU_NOCB_WAKE_LAZY,
+					       TPS("WakeLazy"));
+		} else if (!irqs_disabled_flags(flags)) {
 			/* ... if queue was empty ... */
 			wake_nocb_leader(rdp, false);
 			trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
@@ -1971,6 +2055,17 @@ static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
 					       TPS("WakeOvfIsDeferred"));
 		}
 		rdp->qlen_last_fqs_check = LONG_MAX / 2;
+	} else if (rhcount != rhcount_lazy &&
+		   READ_ONCE(rdp->nocb_defer_wakeup) == RCU_NOCB_WAKE_LAZY) {
+		/* ... or if something more urgent joins lazy callbacks. */
+		if (!irqs_disabled_flags(flags)) {
+			wake_nocb_leader(rdp, false);
+			trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
+					    TPS("WakeNotLazy"));
+		} else {
+			wake_nocb_leader_defer(rdp, RCU_NOCB_WAKE,
+					       TPS("WakeNotLazyIsDeferred"));
+		}
 	} else {
 		trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu, TPS("WakeNot"));
 	}
@@ -2117,6 +2212,17 @@ wait_again:
 		WRITE_ONCE(rdp->nocb_head, NULL);
 		rdp->nocb_gp_tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
 		gotcbs = true;
+
+		/* A pending lazy wakeup for these callbacks is now moot. */
+		if (READ_ONCE(rdp->nocb_defer_wakeup) == RCU_NOCB_WAKE_LAZY) {
+			raw_spin_lock_irqsave(&rdp->nocb_lock, flags);
+			if (rdp->nocb_defer_wakeup == RCU_NOCB_WAKE_LAZY) {
+				WRITE_ONCE(rdp->nocb_defer_wakeup,
+					   RCU_NOCB_WAKE_NOT);
+				del_timer(&rdp->nocb_timer);
+			}
+			raw_spin_unlock_irqrestore(&rdp->nocb_lock, flags);
+		}
 	}
 
 	/* No callbacks?  Sleep a bit if polling, and go retry.  */
@@ -2190,7 +2296,7 @@ static void nocb_follower_wait(struct rcu_data *rdp)
  */
 static int rcu_nocb_kthread(void *arg)
 {
-	int c, cl;
+	int batch, c, cl;
 	unsigned long flags;
 	struct rcu_head *list;
 	struct rcu_head *next;
@@ -2219,7 +2325,7 @@ static int rcu_nocb_kthread(void *arg)
 		trace_rcu_batch_start(rdp->rsp->name,
 				      atomic_long_read(&rdp->nocb_q_count_lazy),
 				      atomic_long_read(&rdp->nocb_q_count), -1);
-		c = cl = 0;
+		batch = c = cl = 0;
 		while (list) {
 			next = list->next;
 			/* Wait for enqueuing to complete, if needed. */
@@ -2232,12 +2338,19 @@ static int rcu_nocb_kthread(void *arg)
 				next = list->next;
 			}
 			debug_rcu_head_unqueue(list);
-			local_bh_disable();
+			if (!batch) {
+				local_bh_disable();
+				batch = rcu_nocb_batch_limit();
+			}
 			if (__rcu_reclaim(rdp->rsp->name, list))
 				cl++;
 			c++;
-			local_bh_enable();
-			cond_resched_rcu_qs();
+			/* End the batch before waiting or if others need the CPU. */
+			if (!--batch || !next || need_resched()) {
+				local_bh_enable();
+				cond_resched_rcu_qs();
+				batch = 0;
+			}
 			list = next;
 		}
 		trace_rcu_batch_end(rdp->rsp->name, c, !!list, 0, 0, 1);
@@ -2249,10 +2362,13 @@ static int rcu_nocb_kthread(void *arg)
 	return 0;
 }
 
-/* Is a deferred wakeup of rcu_nocb_kthread() required? */
+/*
+ * Is a deferred wakeup of rcu_nocb_kthread() required?  Lazy wakeups
+ * are left to ->nocb_timer.
+ */
 static int rcu_nocb_need_deferred_wakeup(struct rcu_data *rdp)
 {
-	return READ_ONCE(rdp->nocb_defer_wakeup);
+	return READ_ONCE(rdp->nocb_defer_wakeup) > RCU_NOCB_WAKE_LAZY;
 }
 
 /* Do a deferred wakeup of rcu_nocb_kthread(). */
@@ -2262,7 +2378,7 @@ static void do_nocb_deferred_wakeup_common(struct rcu_data *rdp)
 	int ndw;
 
 	raw_spin_lock_irqsave(&rdp->nocb_lock, flags);
-	if (!rcu_nocb_need_deferred_wakeup(rdp)) {
+	if (rdp->nocb_defer_wakeup == RCU_NOCB_WAKE_NOT) {
 		raw_spin_unlock_irqrestore(&rdp->nocb_lock, flags);
 		return;
 	}
@@ -2324,6 +2440,17 @@ void __init rcu_init_nohz(void)
 		cpumask_pr_args(rcu_nocb_mask));
 	if (rcu_nocb_poll)
 		pr_info("\tPoll for callbacks from no-CBs CPUs.\n");
+	if (have_rcu_nocb_affinity_mask) {
+		cpumask_and(rcu_nocb_affinity_mask, rcu_nocb_affinity_mask,
+			    cpu_possible_mask);
+		if (cpumask_empty(rcu_nocb_affinity_mask)) {
+			pr_info("\tNote: kernel parameter 'rcu_nocb_affinity=' has no possible CPUs, ignored.\n");
+			have_rcu_nocb_affinity_mask = false;
+		} else {
+			pr_info("\tRun RCU callback kthreads on CPUs: %*pbl.\n",
+				cpumask_pr_args(rcu_nocb_affinity_mask));
+		}
+	}
 
 	for_each_rcu_flavor(rsp) {
 		for_each_cpu(cpu, rcu_nocb_mask)
@@ -2385,9 +2512,12 @@ static void rcu_spawn_one_nocb_kthread(struct rcu_state *rsp, int cpu)
 	}
 
 	/* Spawn the kthread for this CPU and RCU flavor. */
-	t = kthread_run(rcu_nocb_kthread, rdp_spawn,
-			"rcuo%c/%d", rsp->abbr, cpu);
+	t = kthread_create(rcu_nocb_kthread, rdp_spawn,
+			   "rcuo%c/%d", rsp->abbr, cpu);
 	BUG_ON(IS_ERR(t));
+	if (have_rcu_nocb_affinity_mask)
+		set_cpus_allowed_ptr(t, rcu_nocb_affinity_mask);
+	wake_up_process(t);
 	WRITE_ONCE(rdp_spawn->nocb_kthread, t);
 }
 
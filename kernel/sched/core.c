@@ -42,6 +42,7 @@
 
 #include "sched.h"
 #include "walt.h"
+#include "tune.h"
 #include "../workqueue_internal.h"
 #include "../smpboot.h"
 
@@ -766,6 +767,123 @@ static void set_load_weight(struct task_struct *p)
 	load->inv_weight = sched_prio_to_wmult[prio];
 }
 
+#ifdef CONFIG_UCLAMP_TASK
+static inline unsigned int uclamp_none(enum uclamp_id clamp_id)
+{
+	return clamp_id == UCLAMP_MIN ? 0 : SCHED_CAPACITY_SCALE;
+}
+
+static inline unsigned int uclamp_bucket_id(unsigned int value)
+{
+	return min_t(unsigned int, value / UCLAMP_BUCKET_DELTA,
+		     UCLAMP_BUCKETS - 1);
+}
+
+/* The rq clamp after the highest bucket has been emptied */
+static unsigned int uclamp_rq_max_value(struct rq *rq, enum uclamp_id clamp_id)
+{
+	struct uclamp_bucket *bucket = rq->uclamp[clamp_id].bucket;
+	int id;
+
+	for (id = UCLAMP_BUCKETS - 1; id >= 0; id--) {
+		if (bucket[id].tasks)
+			return bucket[id].value;
+	}
+
+	return uclamp_none(clamp_id);
+}
+
+/*
+ * Account a task becoming runnable on @rq. The rq clamp only ever moves
+ * up here; it is recomputed when the bucket holding it drains.
+ */
+static inline void uclamp_rq_inc(struct rq *rq, struct task_struct *p)
+{
+	enum uclamp_id clamp_id;
+
+	for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++) {
+		struct uclamp_se *uc_se = &p->uclamp[clamp_id];
+		struct uclamp_rq *uc_rq = &rq->uclamp[clamp_id];
+		struct uclamp_bucket *bucket;
+
+		uc_se->bucket_id = uclamp_bucket_id(uc_se->value);
+		uc_se->active = true;
+
+		bucket = &uc_rq->bucket[uc_se->bucket_id];
+		if (!bucket->tasks++ || uc_se->value > bucket->value)
+			bucket->value = uc_se->value;
+
+		if (!uc_rq->tasks++ || uc_se->value > uc_rq->value)
+			WRITE_ONCE(uc_rq->value, uc_se->value);
+	}
+}
+
+static inline void uclamp_rq_dec(struct rq *rq, struct task_struct *p)
+{
+	enum uclamp_id clamp_id;
+
+	for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++) {
+		struct uclamp_se *uc_se = &p->uclamp[clamp_id];
+		struct uclamp_rq *uc_rq = &rq->uclamp[clamp_id];
+		struct uclamp_bucket *bucket;
+
+		if (!uc_se->active)
+			continue;
+		uc_se->active = false;
+
+		bucket = &uc_rq->bucket[uc_se->bucket_id];
+		if (SCHED_WARN_ON(!bucket->tasks || !uc_rq->tasks))
+			continue;
+		uc_rq->tasks--;
+
+		/*
+		 * A bucket keeps the highest value seen until it drains, so
+		 * the rq clamp can only need a refresh once it does.
+		 */
+		if (--bucket->tasks)
+			continue;
+		if (bucket->value >= uc_rq->value)
+			WRITE_ONCE(uc_rq->value,
+				   uclamp_rq_max_value(rq, clamp_id));
+	}
+}
+
+static void __init init_uclamp(void)
+{
+	enum uclamp_id clamp_id;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+
+		memset(rq->uclamp, 0, sizeof(rq->uclamp));
+		for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++)
+			rq->uclamp[clamp_id].value = uclamp_none(clamp_id);
+	}
+
+	for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++) {
+		init_task.uclamp[clamp_id].value = uclamp_none(clamp_id);
+		init_task.uclamp[clamp_id].active = false;
+	}
+}
+
+static void uclamp_fork(struct task_struct *p)
+{
+	enum uclamp_id clamp_id;
+
+	for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++) {
+		p->uclamp[clamp_id].active = false;
+		if (unlikely(p->sched_reset_on_fork))
+			p->uclamp[clamp_id].value = uclamp_none(clamp_id);
+	}
+}
+#else
+static inline void uclamp_rq_inc(struct rq *rq, struct task_struct *p) { }
+static inline void uclamp_rq_dec(struct rq *rq, struct task_struct *p) { }
+static inline void init_uclamp(void) { }
+static inline void uclamp_fork(struct task_struct *p) { }
+#endif /* CONFIG_UCLAMP_TASK */
+
 static inline void enqueue_task(struct rq *rq, struct task_struct *p, int flags)
 {
 	if (!(flags & ENQUEUE_NOCLOCK))
@@ -776,6 +894,7 @@ static inline void enqueue_task(struct rq *rq, struct task_struct *p, int flags)
 		psi_enqueue(p, flags & ENQUEUE_WAKEUP);
 	}
 
+	uclamp_rq_inc(rq, p);
 	p->sched_class->enqueue_task(rq, p, flags);
 	walt_update_last_enqueue(p);
 	trace_sched_enq_deq_task(p, 1, cpumask_bits(&p->cpus_allowed)[0]);
@@ -791,6 +910,7 @@ static inline void dequeue_task(struct rq *rq, struct task_struct *p, int flags)
 		psi_dequeue(p, flags & DEQUEUE_SLEEP);
 	}
 
+	uclamp_rq_dec(rq, p);
 	p->sched_class->dequeue_task(rq, p, flags);
 #ifdef CONFIG_SCHED_WALT
 	if (p == rq->ed_task)
@@ -2490,6 +2610,8 @@ int sched_fork(unsigned long clone_flags, struct task_struct *p)
 	 */
 	p->prio = current->normal_prio;
 
+	uclamp_fork(p);
+
 	/*
 	 * Revert to default priority/policy on fork if requested.
 	 */
@@ -4120,6 +4242,25 @@ int idle_cpu(int cpu)
 	return 1;
 }
 
+/**
+ * cpu_latency_sensitive - is a given CPU running latency sensitive work?
+ * @cpu: the processor in question.
+ *
+ * Used to keep interrupts away from CPUs with runnable RT or deadline
+ * tasks, or a runnable task of a boosted (e.g. top-app) schedtune group.
+ *
+ * Return: true if @cpu runs such work.
+ */
+bool cpu_latency_sensitive(int cpu)
+{
+	struct rq *rq = cpu_rq(cpu);
+
+	if (READ_ONCE(rq->rt.rt_nr_running) || READ_ONCE(rq->dl.dl_nr_running))
+		return true;
+
+	return schedtune_cpu_boost(cpu) > 0;
+}
+
 /**
  * idle_task - return the idle task for a given CPU.
  * @cpu: the processor in question.
@@ -4496,6 +4637,45 @@ int sched_setattr(struct task_struct *p, const struct sched_attr *attr)
 }
 EXPORT_SYMBOL_GPL(sched_setattr);
 
+#ifdef CONFIG_UCLAMP_TASK
+/**
+ * sched_set_util_clamp - set the utilization floor and cap of a task
+ * @p: the task in question.
+ * @min: utilization floor, in SCHED_CAPACITY_SCALE units.
+ * @max: utilization cap, in SCHED_CAPACITY_SCALE units.
+ *
+ * schedutil selects frequencies for at least the highest floor and at
+ * most the highest cap of the tasks runnable on a CPU, and task placement
+ * sizes @p by its clamped utilization. The new clamps take effect on the
+ * next frequency update of the CPU @p runs on.
+ *
+ * Return: 0 on success. -EINVAL for out of range values.
+ */
+int sched_set_util_clamp(struct task_struct *p, unsigned int min,
+			 unsigned int max)
+{
+	struct rq_flags rf;
+	struct rq *rq;
+	bool queued;
+
+	if (min > max || max > SCHED_CAPACITY_SCALE)
+		return -EINVAL;
+
+	rq = task_rq_lock(p, &rf);
+	queued = task_on_rq_queued(p);
+	if (queued)
+		uclamp_rq_dec(rq, p);
+	p->uclamp[UCLAMP_MIN].value = min;
+	p->uclamp[UCLAMP_MAX].value = max;
+	if (queued)
+		uclamp_rq_inc(rq, p);
+	task_rq_unlock(rq, p, &rf);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(sched_set_util_clamp);
+#endif /* CONFIG_UCLAMP_TASK */
+
 /**
  * sched_setscheduler_nocheck - change the scheduling policy and/or RT priority of a thread from kernelspace.
  * @p: the task in question.
@@ -6538,6 +6718,7 @@ void __init sched_init(void)
 	BUG_ON(alloc_related_thread_groups());
 
 	set_load_weight(&init_task);
+	init_uclamp();
 
 	/*
 	 * The boot idle thread does lazy MMU switching as well:
@@ -6764,6 +6945,10 @@ struct task_group *sched_create_group(struct task_group *parent)
 	if (!alloc_rt_sched_group(tg, parent))
 		goto err;
 
+#ifdef CONFIG_CGROUP_TIMER_SLACK
+	tg->timer_slack_ns = parent->timer_slack_ns;
+#endif
+
 	return tg;
 
 err:
@@ -7421,6 +7606,43 @@ static u64 cpu_rt_period_read_uint(struct cgroup_subsys_state *css,
 }
 #endif /* CONFIG_RT_GROUP_SCHED */
 
+#ifdef CONFIG_CGROUP_TIMER_SLACK
+/*
+ * The timer slack of a task is the larger of its own (prctl) value and
+ * the one of its cpu cgroup, so a background group can have the timers
+ * of all its tasks batched without touching each of them.  Realtime and
+ * deadline tasks only get the slack they asked for.
+ */
+u64 task_timer_slack_ns(struct task_struct *p)
+{
+	u64 slack;
+
+	if (rt_task(p) || dl_task(p))
+		return p->timer_slack_ns;
+
+	rcu_read_lock();
+	slack = max(p->timer_slack_ns, READ_ONCE(task_group(p)->timer_slack_ns));
+	rcu_read_unlock();
+
+	return slack;
+}
+
+static u64 cpu_timer_slack_read_u64(struct cgroup_subsys_state *css,
+				    struct cftype *cft)
+{
+	return READ_ONCE(css_tg(css)->timer_slack_ns);
+}
+
+static int cpu_timer_slack_write_u64(struct cgroup_subsys_state *css,
+				     struct cftype *cftype, u64 slack)
+{
+	if (slack > NSEC_PER_SEC)
+		return -EINVAL;
+	WRITE_ONCE(css_tg(css)->timer_slack_ns, slack);
+	return 0;
+}
+#endif /* CONFIG_CGROUP_TIMER_SLACK */
+
 static struct cftype cpu_files[] = {
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	{
@@ -7456,6 +7678,13 @@ static struct cftype cpu_files[] = {
 		.read_u64 = cpu_rt_period_read_uint,
 		.write_u64 = cpu_rt_period_write_uint,
 	},
+#endif
+#ifdef CONFIG_CGROUP_TIMER_SLACK
+	{
+		.name = "timer_slack_ns",
+		.read_u64 = cpu_timer_slack_read_u64,
+		.write_u64 = cpu_timer_slack_write_u64,
+	},
 #endif
 	{ }	/* Terminate */
 };
@@ -403,6 +403,11 @@ struct task_group {
 	struct autogroup *autogroup;
 #endif
 
+#ifdef CONFIG_CGROUP_TIMER_SLACK
+	/* minimum timer slack of the tasks in this group */
+	u64 timer_slack_ns;
+#endif
+
 	struct cfs_bandwidth cfs_bandwidth;
 };
 
@@ -768,6 +773,29 @@ extern void rto_push_irq_work_func(struct irq_work *work);
 #endif
 #endif /* CONFIG_SMP */
 
+#ifdef CONFIG_UCLAMP_TASK
+/*
+ * Runnable tasks are accounted in UCLAMP_BUCKETS buckets per clamp index,
+ * each covering UCLAMP_BUCKET_DELTA of the capacity range and tracking the
+ * highest value requested by its tasks. The rq clamp is the value of the
+ * highest non-empty bucket.
+ */
+#define UCLAMP_BUCKETS		20
+#define UCLAMP_BUCKET_DELTA	DIV_ROUND_CLOSEST(SCHED_CAPACITY_SCALE, \
+						  UCLAMP_BUCKETS)
+
+struct uclamp_bucket {
+	unsigned int value;
+	unsigned int tasks;
+};
+
+struct uclamp_rq {
+	unsigned int value;
+	unsigned int tasks;
+	struct uclamp_bucket bucket[UCLAMP_BUCKETS];
+};
+#endif /* CONFIG_UCLAMP_TASK */
+
 /*
  * This is the main, per-CPU runqueue data structure.
  *
@@ -809,6 +837,11 @@ struct rq {
 	struct rt_rq rt;
 	struct dl_rq dl;
 
+#ifdef CONFIG_UCLAMP_TASK
+	/* utilization clamps aggregated over the runnable tasks */
+	struct uclamp_rq uclamp[UCLAMP_CNT];
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	/* list of leaf cfs_rq on this cpu: */
 	struct list_head leaf_cfs_rq_list;
@@ -2155,6 +2188,47 @@ cpu_util_freq(int cpu, struct sched_walt_cpu_load *walt_load)
 
 #endif /* CONFIG_SCHED_WALT */
 
+#ifdef CONFIG_UCLAMP_TASK
+/*
+ * Clamp @util by the floor and cap of the tasks runnable on @rq. A floor
+ * above the cap wins, so a task asking for performance is never starved
+ * by another task capped on the same CPU.
+ */
+static inline unsigned long uclamp_rq_util(struct rq *rq, unsigned long util)
+{
+	unsigned long min = READ_ONCE(rq->uclamp[UCLAMP_MIN].value);
+	unsigned long max = READ_ONCE(rq->uclamp[UCLAMP_MAX].value);
+
+	if (unlikely(min >= max))
+		return min;
+
+	return clamp(util, min, max);
+}
+
+static inline unsigned long uclamp_task_util(struct task_struct *p,
+					     unsigned long util)
+{
+	unsigned long min = p->uclamp[UCLAMP_MIN].value;
+	unsigned long max = p->uclamp[UCLAMP_MAX].value;
+
+	if (unlikely(min >= max))
+		return min;
+
+	return clamp(util, min, max);
+}
+#else
+static inline unsigned long uclamp_rq_util(struct rq *rq, unsigned long util)
+{
+	return util;
+}
+
+static inline unsigned long uclamp_task_util(struct task_struct *p,
+					     unsigned long util)
+{
+	return util;
+}
+#endif /* CONFIG_UCLAMP_TASK */
+
 extern unsigned long
 boosted_cpu_util(int cpu, struct sched_walt_cpu_load *walt_load);
 extern unsigned int capacity_margin_freq;
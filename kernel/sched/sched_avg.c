@@ -28,6 +28,8 @@ static DEFINE_PER_CPU(u64, last_time);
 static DEFINE_PER_CPU(u64, nr_big_prod_sum);
 static DEFINE_PER_CPU(u64, nr);
 static DEFINE_PER_CPU(u64, nr_max);
+static DEFINE_PER_CPU(u64, nr_sum);
+static DEFINE_PER_CPU(u64, nr_big_sum);
 
 static DEFINE_PER_CPU(unsigned long, iowait_prod_sum);
 static DEFINE_PER_CPU(spinlock_t, nr_lock) = __SPIN_LOCK_UNLOCKED(nr_lock);
@@ -88,6 +90,14 @@ void sched_get_nr_running_avg(struct sched_avg_stats *stats)
 		trace_sched_get_nr_running_avg(cpu, stats[cpu].nr,
 				stats[cpu].nr_misfit, stats[cpu].nr_max);
 
+		/*
+		 * last_time is moved forward below, so account the time
+		 * since the last update in the running totals first, as
+		 * sched_update_nr_prod() does.
+		 */
+		per_cpu(nr_sum, cpu) += per_cpu(nr, cpu) * diff;
+		per_cpu(nr_big_sum, cpu) += walt_big_tasks(cpu) * diff;
+
 		per_cpu(last_time, cpu) = curr_time;
 		per_cpu(nr_prod_sum, cpu) = 0;
 		per_cpu(nr_big_prod_sum, cpu) = 0;
@@ -156,10 +166,35 @@ void sched_update_nr_prod(int cpu, long delta, bool inc)
 	per_cpu(nr_prod_sum, cpu) += nr_running * diff;
 	per_cpu(nr_big_prod_sum, cpu) += walt_big_tasks(cpu) * diff;
 	per_cpu(iowait_prod_sum, cpu) += nr_iowait_cpu(cpu) * diff;
+	per_cpu(nr_sum, cpu) += nr_running * diff;
+	per_cpu(nr_big_sum, cpu) += walt_big_tasks(cpu) * diff;
 	spin_unlock_irqrestore(&per_cpu(nr_lock, cpu), flags);
 }
 EXPORT_SYMBOL(sched_update_nr_prod);
 
+/**
+ * sched_get_nr_running_sum
+ * @cpu: The core id of the nr running driver.
+ * @sum: Filled with the running totals of @cpu up to now.
+ *
+ * Unlike sched_get_nr_running_avg() nothing is reset, so any number of
+ * readers can sample the totals and average over their own period.
+ */
+void sched_get_nr_running_sum(int cpu, struct sched_nr_sum *sum)
+{
+	unsigned long flags;
+	u64 diff;
+
+	spin_lock_irqsave(&per_cpu(nr_lock, cpu), flags);
+	sum->time = sched_clock();
+	diff = sum->time - per_cpu(last_time, cpu);
+	sum->nr_running = per_cpu(nr, cpu);
+	sum->nr = per_cpu(nr_sum, cpu) + sum->nr_running * diff;
+	sum->nr_big = per_cpu(nr_big_sum, cpu) + walt_big_tasks(cpu) * diff;
+	spin_unlock_irqrestore(&per_cpu(nr_lock, cpu), flags);
+}
+EXPORT_SYMBOL(sched_get_nr_running_sum);
+
 /*
  * Returns the CPU utilization % in the last window.
  *
@@ -2954,7 +2954,7 @@ static int do_sigtimedwait(const sigset_t *which, siginfo_t *info,
 		spin_unlock_irq(&tsk->sighand->siglock);
 
 		__set_current_state(TASK_INTERRUPTIBLE);
-		ret = freezable_schedule_hrtimeout_range(to, tsk->timer_slack_ns,
+		ret = freezable_schedule_hrtimeout_range(to, task_timer_slack_ns(tsk),
 							 HRTIMER_MODE_REL);
 		spin_lock_irq(&tsk->sighand->siglock);
 		__set_task_blocked(tsk, &tsk->real_blocked);
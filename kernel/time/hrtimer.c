@@ -967,6 +967,37 @@ static inline ktime_t hrtimer_update_lowres(struct hrtimer *timer, ktime_t tim,
 	return tim;
 }
 
+#ifdef CONFIG_CGROUP_TIMER_SLACK
+/*
+ * Timers allowed at least this much slack are batched into aligned slots.
+ */
+#define HRTIMER_SLOT_MIN_SLACK	NSEC_PER_MSEC
+
+/*
+ * Move the hard expiry of a timer with generous slack to the value inside
+ * [softexpires, expires] with the most trailing zero bits.  Such slots
+ * nest, so timers of unrelated tasks in a background cgroup land on the
+ * same instant and are expired from a single interrupt, rather than each
+ * of them waking the CPU at its own exact expiry.
+ */
+static inline void hrtimer_align_expires(struct hrtimer *timer, u64 delta_ns)
+{
+	s64 soft = hrtimer_get_softexpires_tv64(timer);
+	s64 hard = hrtimer_get_expires_tv64(timer);
+
+	if (delta_ns < HRTIMER_SLOT_MIN_SLACK || soft <= 0 || hard <= soft)
+		return;
+
+	/* Keep the bits above the highest one that differs from soft - 1 */
+	hard &= ~((1ULL << (fls64((soft - 1) ^ hard) - 1)) - 1);
+	timer->node.expires = hard;
+}
+#else
+static inline void hrtimer_align_expires(struct hrtimer *timer, u64 delta_ns)
+{
+}
+#endif
+
 /**
  * hrtimer_start_range_ns - (re)start an hrtimer on the current CPU
  * @timer:	the timer to be added
@@ -993,6 +1024,7 @@ void hrtimer_start_range_ns(struct hrtimer *timer, ktime_t tim,
 	tim = hrtimer_update_lowres(timer, tim, mode);
 
 	hrtimer_set_expires_range_ns(timer, tim, delta_ns);
+	hrtimer_align_expires(timer, delta_ns);
 
 	/* Switch the timer base, if necessary: */
 	new_base = switch_hrtimer_base(timer, base, mode & HRTIMER_MODE_PINNED);
@@ -1586,7 +1618,7 @@ long hrtimer_nanosleep(const struct timespec64 *rqtp,
 	int ret = 0;
 	u64 slack;
 
-	slack = current->timer_slack_ns;
+	slack = task_timer_slack_ns(current);
 	if (dl_task(current) || rt_task(current))
 		slack = 0;
 
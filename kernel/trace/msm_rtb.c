@@ -67,26 +67,127 @@ struct msm_rtb_state {
 	int initialized;
 	uint32_t filter;
 	int step_size;
+	unsigned int sample_rate;
+	unsigned int panic_dump;
 };
 
 #if defined(CONFIG_QCOM_RTB_SEPARATE_CPUS)
 DEFINE_PER_CPU(atomic_t, msm_rtb_idx_cpu);
+#elif defined(CONFIG_QCOM_RTB_PERCPU_SEGMENTS)
+/*
+ * Each cpu owns a contiguous, power of 2 sized slice of the buffer and
+ * a private index into it, so logging never touches a cache line that
+ * another cpu writes to.  @dump_pos is only used by the panic dump.
+ */
+struct msm_rtb_cpu_seg {
+	struct msm_rtb_layout *rtb;
+	uint32_t idx;
+	uint32_t dump_pos;
+	int cpu;
+};
+
+static DEFINE_PER_CPU(struct msm_rtb_cpu_seg, msm_rtb_seg);
 #else
 static atomic_t msm_rtb_idx;
 #endif
 
+static DEFINE_PER_CPU(unsigned int, msm_rtb_sample_cnt);
+
 static struct msm_rtb_state msm_rtb = {
 	.filter = 1 << LOGK_LOGBUF,
 	.enabled = 1,
+	.sample_rate = 1,
 };
 
 module_param_named(filter, msm_rtb.filter, uint, 0644);
 module_param_named(enable, msm_rtb.enabled, int, 0644);
+/* Log only one out of every sample_rate events that pass the filter */
+module_param_named(sample_rate, msm_rtb.sample_rate, uint, 0644);
+/* Number of most recent entries to print, merged across cpus, on panic */
+module_param_named(panic_dump, msm_rtb.panic_dump, uint, 0644);
+
+#if defined(CONFIG_QCOM_RTB_PERCPU_SEGMENTS)
+static bool msm_rtb_entry_valid(struct msm_rtb_layout *e)
+{
+	return e->sentinel[0] == SENTINEL_BYTE_1 &&
+	       e->sentinel[1] == SENTINEL_BYTE_2 &&
+	       e->sentinel[2] == SENTINEL_BYTE_3;
+}
+
+/*
+ * Print the last @count entries of all cpu segments as one stream ordered
+ * by timestamp.  The first pass walks backwards from each cpu's head,
+ * always stepping the segment with the newest remaining entry, which
+ * leaves every dump_pos at the oldest entry to print; the second pass
+ * merges forwards from there.
+ */
+static void msm_rtb_dump_merged(unsigned int count)
+{
+	struct msm_rtb_cpu_seg *seg, *best;
+	struct msm_rtb_layout *e, *best_e;
+	uint32_t mask = msm_rtb.nentries - 1;
+	unsigned int n, cpu;
+
+	for_each_possible_cpu(cpu) {
+		seg = &per_cpu(msm_rtb_seg, cpu);
+		seg->dump_pos = READ_ONCE(seg->idx);
+	}
+
+	for (n = 0; n < count; n++) {
+		best = NULL;
+		best_e = NULL;
+		for_each_possible_cpu(cpu) {
+			seg = &per_cpu(msm_rtb_seg, cpu);
+			if (seg->idx - seg->dump_pos > mask)
+				continue;
+			e = &seg->rtb[(seg->dump_pos - 1) & mask];
+			if (!msm_rtb_entry_valid(e))
+				continue;
+			if (!best_e || e->timestamp > best_e->timestamp) {
+				best = seg;
+				best_e = e;
+			}
+		}
+		if (!best)
+			break;
+		best->dump_pos--;
+	}
+
+	pr_emerg("msm_rtb: last %u entries\n", n);
+	while (n--) {
+		best = NULL;
+		best_e = NULL;
+		for_each_possible_cpu(cpu) {
+			seg = &per_cpu(msm_rtb_seg, cpu);
+			if (seg->dump_pos == seg->idx)
+				continue;
+			e = &seg->rtb[seg->dump_pos & mask];
+			if (!best_e || e->timestamp < best_e->timestamp) {
+				best = seg;
+				best_e = e;
+			}
+		}
+		if (!best)
+			break;
+		pr_emerg("msm_rtb: cpu%d idx %u type %u caller %pS data %llx ts %llu\n",
+			 best->cpu, best_e->idx, best_e->log_type,
+			 (void *)(unsigned long)best_e->caller,
+			 best_e->data, best_e->timestamp);
+		best->dump_pos++;
+	}
+}
+#else
+static inline void msm_rtb_dump_merged(unsigned int count)
+{
+}
+#endif
 
 static int msm_rtb_panic_notifier(struct notifier_block *this,
 					unsigned long event, void *ptr)
 {
 	msm_rtb.enabled = 0;
+	if (msm_rtb.initialized && msm_rtb.panic_dump)
+		msm_rtb_dump_merged(msm_rtb.panic_dump);
 	return NOTIFY_DONE;
 }
 
@@ -141,13 +242,10 @@ static void msm_rtb_write_cyclecount(struct msm_rtb_layout *start)
 	start->cycle_count = get_cycles();
 }
 
-static void uncached_logk_pc_idx(enum logk_event_type log_type, uint64_t caller,
-				 uint64_t data, int idx)
+static void msm_rtb_write_entry(struct msm_rtb_layout *start,
+				enum logk_event_type log_type, uint64_t caller,
+				uint64_t data, int idx)
 {
-	struct msm_rtb_layout *start;
-
-	start = &msm_rtb.rtb[idx & (msm_rtb.nentries - 1)];
-
 	msm_rtb_emit_sentinel(start);
 	msm_rtb_write_type(log_type, start);
 	msm_rtb_write_caller(caller, start);
@@ -159,6 +257,14 @@ static void uncached_logk_pc_idx(enum logk_event_type log_type, uint64_t caller,
 
 }
 
+#if !defined(CONFIG_QCOM_RTB_PERCPU_SEGMENTS)
+static void uncached_logk_pc_idx(enum logk_event_type log_type, uint64_t caller,
+				 uint64_t data, int idx)
+{
+	msm_rtb_write_entry(&msm_rtb.rtb[idx & (msm_rtb.nentries - 1)],
+			    log_type, caller, data, idx);
+}
+
 static void uncached_logk_timestamp(int idx)
 {
 	unsigned long long timestamp;
@@ -168,6 +274,7 @@ static void uncached_logk_timestamp(int idx)
 			(uint64_t)lower_32_bits(timestamp),
 			(uint64_t)upper_32_bits(timestamp), idx);
 }
+#endif
 
 #if defined(CONFIG_QCOM_RTB_SEPARATE_CPUS)
 static int msm_rtb_get_idx(void)
@@ -197,6 +304,25 @@ static int msm_rtb_get_idx(void)
 
 	return i;
 }
+#elif defined(CONFIG_QCOM_RTB_PERCPU_SEGMENTS)
+/*
+ * Every entry carries its own sched_clock() timestamp, which is what the
+ * panic dump and the ramdump parser merge the segments by, so no wrap
+ * marker is needed here.
+ */
+static void notrace msm_rtb_log_seg(enum logk_event_type log_type,
+				    uint64_t caller, uint64_t data)
+{
+	struct msm_rtb_cpu_seg *seg;
+	uint32_t i;
+
+	preempt_disable_notrace();
+	seg = this_cpu_ptr(&msm_rtb_seg);
+	i = this_cpu_inc_return(msm_rtb_seg.idx) - 1;
+	msm_rtb_write_entry(&seg->rtb[i & (msm_rtb.nentries - 1)],
+			    log_type, caller, data, i);
+	preempt_enable_notrace();
+}
 #else
 static int msm_rtb_get_idx(void)
 {
@@ -218,17 +344,41 @@ static int msm_rtb_get_idx(void)
 }
 #endif
 
+/*
+ * Per-cpu countdown so that sampling doesn't add a shared cache line of
+ * its own to the logging path.
+ */
+static bool notrace msm_rtb_sample(void)
+{
+	unsigned int rate = READ_ONCE(msm_rtb.sample_rate);
+
+	if (rate <= 1)
+		return true;
+
+	return this_cpu_inc_return(msm_rtb_sample_cnt) % rate == 0;
+}
+
 int notrace uncached_logk_pc(enum logk_event_type log_type, void *caller,
 				void *data)
 {
+#if !defined(CONFIG_QCOM_RTB_PERCPU_SEGMENTS)
 	int i;
+#endif
 
 	if (!msm_rtb_event_should_log(log_type))
 		return 0;
 
+	if (!msm_rtb_sample())
+		return 0;
+
+#if defined(CONFIG_QCOM_RTB_PERCPU_SEGMENTS)
+	msm_rtb_log_seg(log_type, (uint64_t)((unsigned long) caller),
+			(uint64_t)((unsigned long) data));
+#else
 	i = msm_rtb_get_idx();
 	uncached_logk_pc_idx(log_type, (uint64_t)((unsigned long) caller),
 				(uint64_t)((unsigned long) data), i);
+#endif
 
 	return 1;
 }
@@ -246,6 +396,8 @@ static int msm_rtb_probe(struct platform_device *pdev)
 	struct md_region md_entry;
 #if defined(CONFIG_QCOM_RTB_SEPARATE_CPUS)
 	unsigned int cpu;
+#elif defined(CONFIG_QCOM_RTB_PERCPU_SEGMENTS)
+	unsigned int cpu, nsegs;
 #endif
 	int ret;
 
@@ -309,6 +461,27 @@ static int msm_rtb_probe(struct platform_device *pdev)
 		atomic_set(a, cpu);
 	}
 	msm_rtb.step_size = num_possible_cpus();
+#elif defined(CONFIG_QCOM_RTB_PERCPU_SEGMENTS)
+	/*
+	 * Carve the buffer into one power of 2 sized segment per cpu;
+	 * from here on nentries is the size of a single segment.
+	 */
+	if (msm_rtb.nentries < num_possible_cpus()) {
+		dma_free_coherent(&pdev->dev, msm_rtb.size, msm_rtb.rtb,
+				  msm_rtb.phys);
+		return -EINVAL;
+	}
+	msm_rtb.nentries = __rounddown_pow_of_two(msm_rtb.nentries /
+						  num_possible_cpus());
+	nsegs = 0;
+	for_each_possible_cpu(cpu) {
+		struct msm_rtb_cpu_seg *seg = &per_cpu(msm_rtb_seg, cpu);
+
+		seg->rtb = &msm_rtb.rtb[nsegs++ * msm_rtb.nentries];
+		seg->idx = 0;
+		seg->cpu = cpu;
+	}
+	msm_rtb.step_size = 1;
 #else
 	atomic_set(&msm_rtb_idx, 0);
 	msm_rtb.step_size = 1;
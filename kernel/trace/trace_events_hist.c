@@ -15,18 +15,54 @@
  */
 
 #include <linux/module.h>
+#include <linux/ctype.h>
 #include <linux/kallsyms.h>
 #include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/stacktrace.h>
 #include <linux/rculist.h>
+#include <linux/tracefs.h>
+#include <linux/trace_clock.h>
 
 #include "tracing_map.h"
 #include "trace.h"
 
+#define SYNTH_SYSTEM		"synthetic"
+#define SYNTH_FIELDS_MAX	16
+
+#define HIST_FIELD_OPERANDS_MAX	2
+
+enum hist_field_flags {
+	HIST_FIELD_FL_HITCOUNT		= 1,
+	HIST_FIELD_FL_KEY		= 2,
+	HIST_FIELD_FL_STRING		= 4,
+	HIST_FIELD_FL_HEX		= 8,
+	HIST_FIELD_FL_SYM		= 16,
+	HIST_FIELD_FL_SYM_OFFSET	= 32,
+	HIST_FIELD_FL_EXECNAME		= 64,
+	HIST_FIELD_FL_SYSCALL		= 128,
+	HIST_FIELD_FL_STACKTRACE	= 256,
+	HIST_FIELD_FL_LOG2		= 512,
+	HIST_FIELD_FL_TIMESTAMP		= 1024,
+	HIST_FIELD_FL_TIMESTAMP_USECS	= 2048,
+	HIST_FIELD_FL_VAR		= 4096,
+	HIST_FIELD_FL_EXPR		= 8192,
+	HIST_FIELD_FL_VAR_REF		= 16384,
+	HIST_FIELD_FL_VAR_READ		= 32768,
+};
+
 struct hist_field;
+struct hist_trigger_data;
+
+typedef u64 (*hist_field_fn_t) (struct hist_field *field,
+				struct tracing_map_elt *elt,
+				void *event, u64 *var_ref_vals);
 
-typedef u64 (*hist_field_fn_t) (struct hist_field *field, void *event);
+enum field_op_id {
+	FIELD_OP_NONE,
+	FIELD_OP_PLUS,
+	FIELD_OP_MINUS,
+};
 
 struct hist_field {
 	struct ftrace_event_field	*field;
@@ -34,26 +70,92 @@ struct hist_field {
 	hist_field_fn_t			fn;
 	unsigned int			size;
 	unsigned int			offset;
+	enum field_op_id		operator;
+	struct hist_field		*operands[HIST_FIELD_OPERANDS_MAX];
+	/* variable name, for HIST_FIELD_FL_VAR */
+	char				*name;
+	/* index of the variable in the tracing_map, for HIST_FIELD_FL_VAR */
+	unsigned int			var_idx;
+	/* slot in the resolved var_ref_vals[], for HIST_FIELD_FL_VAR_REF */
+	unsigned int			var_ref_idx;
+	/* variable of the same trigger read by HIST_FIELD_FL_VAR_READ */
+	struct hist_field		*var;
 };
 
-static u64 hist_field_none(struct hist_field *field, void *event)
+static u64 hist_field_none(struct hist_field *field,
+			   struct tracing_map_elt *elt,
+			   void *event, u64 *var_ref_vals)
 {
 	return 0;
 }
 
-static u64 hist_field_counter(struct hist_field *field, void *event)
+static u64 hist_field_counter(struct hist_field *field,
+			      struct tracing_map_elt *elt,
+			      void *event, u64 *var_ref_vals)
 {
 	return 1;
 }
 
-static u64 hist_field_string(struct hist_field *hist_field, void *event)
+static u64 hist_field_timestamp(struct hist_field *hist_field,
+				struct tracing_map_elt *elt,
+				void *event, u64 *var_ref_vals)
+{
+	u64 ts = trace_clock_local();
+
+	if (hist_field->flags & HIST_FIELD_FL_TIMESTAMP_USECS)
+		ts = ns2usecs(ts);
+
+	return ts;
+}
+
+static u64 hist_field_var_ref(struct hist_field *hist_field,
+			      struct tracing_map_elt *elt,
+			      void *event, u64 *var_ref_vals)
+{
+	return var_ref_vals[hist_field->var_ref_idx];
+}
+
+static u64 hist_field_var_read(struct hist_field *hist_field,
+			       struct tracing_map_elt *elt,
+			       void *event, u64 *var_ref_vals)
+{
+	return tracing_map_read_var(elt, hist_field->var->var_idx);
+}
+
+static u64 hist_field_plus(struct hist_field *hist_field,
+			   struct tracing_map_elt *elt,
+			   void *event, u64 *var_ref_vals)
+{
+	struct hist_field *operand1 = hist_field->operands[0];
+	struct hist_field *operand2 = hist_field->operands[1];
+
+	return operand1->fn(operand1, elt, event, var_ref_vals) +
+		operand2->fn(operand2, elt, event, var_ref_vals);
+}
+
+static u64 hist_field_minus(struct hist_field *hist_field,
+			    struct tracing_map_elt *elt,
+			    void *event, u64 *var_ref_vals)
+{
+	struct hist_field *operand1 = hist_field->operands[0];
+	struct hist_field *operand2 = hist_field->operands[1];
+
+	return operand1->fn(operand1, elt, event, var_ref_vals) -
+		operand2->fn(operand2, elt, event, var_ref_vals);
+}
+
+static u64 hist_field_string(struct hist_field *hist_field,
+			     struct tracing_map_elt *elt,
+			     void *event, u64 *var_ref_vals)
 {
 	char *addr = (char *)(event + hist_field->field->offset);
 
 	return (u64)(unsigned long)addr;
 }
 
-static u64 hist_field_dynstring(struct hist_field *hist_field, void *event)
+static u64 hist_field_dynstring(struct hist_field *hist_field,
+				struct tracing_map_elt *elt,
+				void *event, u64 *var_ref_vals)
 {
 	u32 str_item = *(u32 *)(event + hist_field->field->offset);
 	int str_loc = str_item & 0xffff;
@@ -62,14 +164,18 @@ static u64 hist_field_dynstring(struct hist_field *hist_field, void *event)
 	return (u64)(unsigned long)addr;
 }
 
-static u64 hist_field_pstring(struct hist_field *hist_field, void *event)
+static u64 hist_field_pstring(struct hist_field *hist_field,
+			      struct tracing_map_elt *elt,
+			      void *event, u64 *var_ref_vals)
 {
 	char **addr = (char **)(event + hist_field->field->offset);
 
 	return (u64)(unsigned long)*addr;
 }
 
-static u64 hist_field_log2(struct hist_field *hist_field, void *event)
+static u64 hist_field_log2(struct hist_field *hist_field,
+			   struct tracing_map_elt *elt,
+			   void *event, u64 *var_ref_vals)
 {
 	u64 val = *(u64 *)(event + hist_field->field->offset);
 
@@ -77,7 +183,9 @@ static u64 hist_field_log2(struct hist_field *hist_field, void *event)
 }
 
 #define DEFINE_HIST_FIELD_FN(type)					\
-static u64 hist_field_##type(struct hist_field *hist_field, void *event)\
+static u64 hist_field_##type(struct hist_field *hist_field,		\
+			     struct tracing_map_elt *elt,		\
+			     void *event, u64 *var_ref_vals)		\
 {									\
 	type *addr = (type *)(event + hist_field->field->offset);	\
 									\
@@ -109,19 +217,6 @@ DEFINE_HIST_FIELD_FN(u8);
 #define HITCOUNT_IDX		0
 #define HIST_KEY_SIZE_MAX	(MAX_FILTER_STR_VAL + HIST_STACKTRACE_SIZE)
 
-enum hist_field_flags {
-	HIST_FIELD_FL_HITCOUNT		= 1,
-	HIST_FIELD_FL_KEY		= 2,
-	HIST_FIELD_FL_STRING		= 4,
-	HIST_FIELD_FL_HEX		= 8,
-	HIST_FIELD_FL_SYM		= 16,
-	HIST_FIELD_FL_SYM_OFFSET	= 32,
-	HIST_FIELD_FL_EXECNAME		= 64,
-	HIST_FIELD_FL_SYSCALL		= 128,
-	HIST_FIELD_FL_STACKTRACE	= 256,
-	HIST_FIELD_FL_LOG2		= 512,
-};
-
 struct hist_trigger_attrs {
 	char		*keys_str;
 	char		*vals_str;
@@ -131,6 +226,49 @@ struct hist_trigger_attrs {
 	bool		cont;
 	bool		clear;
 	unsigned int	map_bits;
+	char		*assignment_str[TRACING_MAP_VARS_MAX];
+	unsigned int	n_assignments;
+	char		*action_str;
+};
+
+struct synth_field {
+	char		*type;
+	char		*name;
+	unsigned int	size;
+	bool		is_signed;
+};
+
+struct synth_event {
+	struct list_head		list;
+	int				ref;
+	char				*name;
+	struct synth_field		**fields;
+	unsigned int			n_fields;
+	struct trace_event_class	class;
+	struct trace_event_call		call;
+	struct tracepoint		*tp;
+};
+
+/*
+ * A variable of another hist trigger referenced by this one.  It is
+ * looked up with this trigger's key when an event hits, and the value
+ * is consumed so that it is matched at most once.
+ */
+struct hist_var_ref {
+	struct hist_trigger_data	*hist_data;
+	unsigned int			var_idx;
+	char				*name;
+};
+
+/*
+ * onmatch(system.event).synth(params): generate the synthetic event
+ * whenever all variable references could be resolved.
+ */
+struct hist_action {
+	struct trace_event_file		*match_file;
+	struct synth_event		*synth_event;
+	struct hist_field		*params[SYNTH_FIELDS_MAX];
+	unsigned int			n_params;
 };
 
 struct hist_trigger_data {
@@ -144,6 +282,13 @@ struct hist_trigger_data {
 	struct trace_event_file		*event_file;
 	struct hist_trigger_attrs	*attrs;
 	struct tracing_map		*map;
+	struct hist_field		*vars[TRACING_MAP_VARS_MAX];
+	unsigned int			n_vars;
+	struct hist_var_ref		var_refs[TRACING_MAP_VARS_MAX];
+	unsigned int			n_var_refs;
+	struct hist_action		*action;
+	/* number of other hist triggers referencing our variables */
+	int				n_referrers;
 };
 
 static hist_field_fn_t select_value_fn(int field_size, int field_is_signed)
@@ -207,9 +352,15 @@ static int parse_map_size(char *str)
 
 static void destroy_hist_trigger_attrs(struct hist_trigger_attrs *attrs)
 {
+	unsigned int i;
+
 	if (!attrs)
 		return;
 
+	for (i = 0; i < attrs->n_assignments; i++)
+		kfree(attrs->assignment_str[i]);
+
+	kfree(attrs->action_str);
 	kfree(attrs->name);
 	kfree(attrs->sort_key_str);
 	kfree(attrs->keys_str);
@@ -217,6 +368,26 @@ static void destroy_hist_trigger_attrs(struct hist_trigger_attrs *attrs)
 	kfree(attrs);
 }
 
+static int parse_assignment(char *str, struct hist_trigger_attrs *attrs)
+{
+	char *eq = strchr(str, '=');
+
+	/* var=expr, where var is a plain identifier */
+	if (!eq || eq == str || !(isalpha(str[0]) || str[0] == '_'))
+		return -EINVAL;
+
+	if (attrs->n_assignments == TRACING_MAP_VARS_MAX)
+		return -EINVAL;
+
+	attrs->assignment_str[attrs->n_assignments] = kstrdup(str, GFP_KERNEL);
+	if (!attrs->assignment_str[attrs->n_assignments])
+		return -ENOMEM;
+
+	attrs->n_assignments++;
+
+	return 0;
+}
+
 static struct hist_trigger_attrs *parse_hist_trigger_attrs(char *trigger_str)
 {
 	struct hist_trigger_attrs *attrs;
@@ -255,9 +426,20 @@ static struct hist_trigger_attrs *parse_hist_trigger_attrs(char *trigger_str)
 				goto free;
 			}
 			attrs->map_bits = map_bits;
+		} else if (strncmp(str, "onmatch(", strlen("onmatch(")) == 0) {
+			if (attrs->action_str) {
+				ret = -EINVAL;
+				goto free;
+			}
+			attrs->action_str = kstrdup(str, GFP_KERNEL);
+			if (!attrs->action_str) {
+				ret = -ENOMEM;
+				goto free;
+			}
 		} else {
-			ret = -EINVAL;
-			goto free;
+			ret = parse_assignment(str, attrs);
+			if (ret)
+				goto free;
 		}
 	}
 
@@ -273,173 +455,841 @@ static struct hist_trigger_attrs *parse_hist_trigger_attrs(char *trigger_str)
 	return ERR_PTR(ret);
 }
 
-static inline void save_comm(char *comm, struct task_struct *task)
+/*
+ * Synthetic events.
+ *
+ * A synthetic event is a trace event defined at runtime through the
+ * 'synthetic_events' tracefs file and generated by the onmatch() action
+ * of a hist trigger, typically from values (such as latencies) computed
+ * out of variables saved by other hist triggers.  Every field occupies a
+ * u64 slot in the record but is stored and described with its declared
+ * size.
+ */
+struct synth_trace_event {
+	struct trace_entry	ent;
+	u64			fields[];
+};
+
+struct synth_field_type {
+	const char	*name;
+	unsigned int	size;
+	bool		is_signed;
+	const char	*fmt;
+};
+
+static const struct synth_field_type synth_field_types[] = {
+	{ "s64",	sizeof(s64),	true,	"%lld" },
+	{ "u64",	sizeof(u64),	false,	"%llu" },
+	{ "s32",	sizeof(s32),	true,	"%d" },
+	{ "u32",	sizeof(u32),	false,	"%u" },
+	{ "s16",	sizeof(s16),	true,	"%d" },
+	{ "u16",	sizeof(u16),	false,	"%u" },
+	{ "s8",		sizeof(s8),	true,	"%d" },
+	{ "u8",		sizeof(u8),	false,	"%u" },
+	{ "int",	sizeof(int),	true,	"%d" },
+	{ "long",	sizeof(long),	true,	"%ld" },
+	{ "pid_t",	sizeof(pid_t),	true,	"%d" },
+	{ "gfp_t",	sizeof(gfp_t),	false,	"%x" },
+	{ "bool",	sizeof(bool),	false,	"%u" },
+};
+
+static LIST_HEAD(synth_event_list);
+/*
+ * synth_event_mutex serializes creation and removal of synthetic events.
+ * The list itself is only modified with event_mutex held as well, so
+ * that hist triggers, which are parsed under event_mutex, can look up
+ * synthetic events and take references on them.
+ */
+static DEFINE_MUTEX(synth_event_mutex);
+
+static const struct synth_field_type *synth_field_type(const char *type)
 {
-	if (!task->pid) {
-		strcpy(comm, "<idle>");
-		return;
-	}
+	unsigned int i;
 
-	if (WARN_ON_ONCE(task->pid < 0)) {
-		strcpy(comm, "<XXX>");
-		return;
-	}
+	for (i = 0; i < ARRAY_SIZE(synth_field_types); i++)
+		if (strcmp(type, synth_field_types[i].name) == 0)
+			return &synth_field_types[i];
 
-	memcpy(comm, task->comm, TASK_COMM_LEN);
+	return NULL;
 }
 
-static void hist_trigger_elt_comm_free(struct tracing_map_elt *elt)
+static void synth_field_store(struct synth_field *field, u64 *slot, u64 val)
 {
-	kfree((char *)elt->private_data);
+	switch (field->size) {
+	case 1:
+		*(u8 *)slot = val;
+		break;
+	case 2:
+		*(u16 *)slot = val;
+		break;
+	case 4:
+		*(u32 *)slot = val;
+		break;
+	default:
+		*slot = val;
+		break;
+	}
 }
 
-static int hist_trigger_elt_comm_alloc(struct tracing_map_elt *elt)
+static u64 synth_field_read(struct synth_field *field, u64 *slot)
 {
-	struct hist_trigger_data *hist_data = elt->map->private_data;
-	struct hist_field *key_field;
-	unsigned int i;
-
-	for_each_hist_key_field(i, hist_data) {
-		key_field = hist_data->fields[i];
+	switch (field->size) {
+	case 1:
+		return field->is_signed ? (u64)*(s8 *)slot : *(u8 *)slot;
+	case 2:
+		return field->is_signed ? (u64)*(s16 *)slot : *(u16 *)slot;
+	case 4:
+		return field->is_signed ? (u64)*(s32 *)slot : *(u32 *)slot;
+	default:
+		return *slot;
+	}
+}
 
-		if (key_field->flags & HIST_FIELD_FL_EXECNAME) {
-			unsigned int size = TASK_COMM_LEN + 1;
+static int synth_event_define_fields(struct trace_event_call *call)
+{
+	unsigned int offset = offsetof(struct synth_trace_event, fields);
+	struct synth_event *event = call->data;
+	struct synth_field *field;
+	unsigned int i;
+	int ret = 0;
 
-			elt->private_data = kzalloc(size, GFP_KERNEL);
-			if (!elt->private_data)
-				return -ENOMEM;
+	for (i = 0; i < event->n_fields; i++) {
+		field = event->fields[i];
+		ret = trace_define_field(call, field->type, field->name,
+					 offset, field->size,
+					 field->is_signed, FILTER_OTHER);
+		if (ret)
 			break;
-		}
+		offset += sizeof(u64);
 	}
 
-	return 0;
+	return ret;
 }
 
-static void hist_trigger_elt_comm_copy(struct tracing_map_elt *to,
-				       struct tracing_map_elt *from)
+static enum print_line_t print_synth_event(struct trace_iterator *iter,
+					   int flags,
+					   struct trace_event *event)
 {
-	char *comm_from = from->private_data;
-	char *comm_to = to->private_data;
+	struct trace_seq *s = &iter->seq;
+	struct synth_trace_event *entry;
+	struct synth_field *field;
+	struct synth_event *se;
+	unsigned int i;
+	u64 val;
 
-	if (comm_from)
-		memcpy(comm_to, comm_from, TASK_COMM_LEN + 1);
-}
+	entry = (struct synth_trace_event *)iter->ent;
+	se = container_of(event, struct synth_event, call.event);
 
-static void hist_trigger_elt_comm_init(struct tracing_map_elt *elt)
-{
-	char *comm = elt->private_data;
+	trace_seq_printf(s, "%s:", se->name);
 
-	if (comm)
-		save_comm(comm, current);
+	for (i = 0; i < se->n_fields; i++) {
+		if (trace_seq_has_overflowed(s))
+			break;
+
+		field = se->fields[i];
+		val = synth_field_read(field, &entry->fields[i]);
+		if (field->is_signed)
+			trace_seq_printf(s, " %s=%lld", field->name, (s64)val);
+		else
+			trace_seq_printf(s, " %s=%llu", field->name, val);
+	}
+
+	trace_seq_putc(s, '\n');
+
+	return trace_handle_return(s);
 }
 
-static const struct tracing_map_ops hist_trigger_elt_comm_ops = {
-	.elt_alloc	= hist_trigger_elt_comm_alloc,
-	.elt_copy	= hist_trigger_elt_comm_copy,
-	.elt_free	= hist_trigger_elt_comm_free,
-	.elt_init	= hist_trigger_elt_comm_init,
+static struct trace_event_functions synth_event_funcs = {
+	.trace		= print_synth_event
 };
 
-static void destroy_hist_field(struct hist_field *hist_field)
+static notrace void trace_event_raw_event_synth(void *__data, u64 *var_vals)
 {
-	kfree(hist_field);
-}
+	struct trace_event_file *trace_file = __data;
+	struct synth_trace_event *entry;
+	struct trace_event_buffer fbuffer;
+	struct synth_event *event;
+	unsigned int i, len;
 
-static struct hist_field *create_hist_field(struct ftrace_event_field *field,
-					    unsigned long flags)
-{
-	struct hist_field *hist_field;
+	event = trace_file->event_call->data;
 
-	if (field && is_function_field(field))
-		return NULL;
+	if (trace_trigger_soft_disabled(trace_file))
+		return;
 
-	hist_field = kzalloc(sizeof(struct hist_field), GFP_KERNEL);
-	if (!hist_field)
-		return NULL;
+	len = sizeof(*entry) + event->n_fields * sizeof(u64);
+	entry = trace_event_buffer_reserve(&fbuffer, trace_file, len);
+	if (!entry)
+		return;
 
-	if (flags & HIST_FIELD_FL_HITCOUNT) {
-		hist_field->fn = hist_field_counter;
-		goto out;
-	}
+	for (i = 0; i < event->n_fields; i++)
+		synth_field_store(event->fields[i], &entry->fields[i],
+				  var_vals[i]);
 
-	if (flags & HIST_FIELD_FL_STACKTRACE) {
-		hist_field->fn = hist_field_none;
-		goto out;
-	}
+	trace_event_buffer_commit(&fbuffer, len);
+}
 
-	if (flags & HIST_FIELD_FL_LOG2) {
-		hist_field->fn = hist_field_log2;
-		goto out;
-	}
+typedef void (*synth_probe_func_t) (void *__data, u64 *var_vals);
 
-	if (WARN_ON_ONCE(!field))
-		goto out;
+/*
+ * The tracepoint backing a synthetic event is allocated at runtime, so
+ * it can't go through the usual __DO_TRACE() and its probes are called
+ * by hand here instead.  Called from hist trigger context, i.e. with
+ * preemption disabled by the tracepoint of the triggering event.
+ */
+static notrace void trace_synth(struct synth_event *event, u64 *var_vals)
+{
+	struct tracepoint *tp = event->tp;
+	struct tracepoint_func *probe_func_ptr;
+	synth_probe_func_t probe_func;
+	void *__data;
 
-	/* Pointers to strings are just pointers and dangerous to dereference */
-	if (is_string_field(field) &&
-	    (field->filter_type != FILTER_PTR_STRING)) {
-		flags |= HIST_FIELD_FL_STRING;
+	if (!static_key_enabled(&tp->key))
+		return;
 
-		if (field->filter_type == FILTER_STATIC_STRING)
-			hist_field->fn = hist_field_string;
-		else if (field->filter_type == FILTER_DYN_STRING)
-			hist_field->fn = hist_field_dynstring;
-		else
-			hist_field->fn = hist_field_pstring;
-	} else {
-		hist_field->fn = select_value_fn(field->size,
-						 field->is_signed);
-		if (!hist_field->fn) {
-			destroy_hist_field(hist_field);
-			return NULL;
-		}
-	}
- out:
-	hist_field->field = field;
-	hist_field->flags = flags;
+	if (!cpu_online(raw_smp_processor_id()))
+		return;
 
-	return hist_field;
+	probe_func_ptr = rcu_dereference_sched(tp->funcs);
+	if (probe_func_ptr) {
+		do {
+			probe_func = probe_func_ptr->func;
+			__data = probe_func_ptr->data;
+			probe_func(__data, var_vals);
+		} while ((++probe_func_ptr)->func);
+	}
 }
 
-static void destroy_hist_fields(struct hist_trigger_data *hist_data)
+static int __set_synth_event_print_fmt(struct synth_event *event,
+				       char *buf, int len)
 {
+	const struct synth_field_type *type;
+	int pos = 0;
 	unsigned int i;
 
-	for (i = 0; i < TRACING_MAP_FIELDS_MAX; i++) {
-		if (hist_data->fields[i]) {
-			destroy_hist_field(hist_data->fields[i]);
-			hist_data->fields[i] = NULL;
-		}
+	/* When len=0, we just calculate the needed length */
+#define LEN_OR_ZERO (len ? len - pos : 0)
+
+	pos += snprintf(buf + pos, LEN_OR_ZERO, "\"");
+	for (i = 0; i < event->n_fields; i++) {
+		type = synth_field_type(event->fields[i]->type);
+		pos += snprintf(buf + pos, LEN_OR_ZERO, "%s%s=%s",
+				i ? " " : "", event->fields[i]->name,
+				type->fmt);
 	}
+	pos += snprintf(buf + pos, LEN_OR_ZERO, "\"");
+
+	for (i = 0; i < event->n_fields; i++)
+		pos += snprintf(buf + pos, LEN_OR_ZERO, ", REC->%s",
+				event->fields[i]->name);
+
+#undef LEN_OR_ZERO
+
+	/* return the length of print_fmt */
+	return pos;
 }
 
-static int create_hitcount_val(struct hist_trigger_data *hist_data)
+static int set_synth_event_print_fmt(struct synth_event *event)
 {
-	hist_data->fields[HITCOUNT_IDX] =
-		create_hist_field(NULL, HIST_FIELD_FL_HITCOUNT);
-	if (!hist_data->fields[HITCOUNT_IDX])
-		return -ENOMEM;
+	char *print_fmt;
+	int len;
 
-	hist_data->n_vals++;
+	/* First: called with 0 length to calculate the needed length */
+	len = __set_synth_event_print_fmt(event, NULL, 0);
 
-	if (WARN_ON(hist_data->n_vals > TRACING_MAP_VALS_MAX))
-		return -EINVAL;
+	print_fmt = kmalloc(len + 1, GFP_KERNEL);
+	if (!print_fmt)
+		return -ENOMEM;
+
+	/* Second: actually write the @print_fmt */
+	__set_synth_event_print_fmt(event, print_fmt, len + 1);
+	event->call.print_fmt = print_fmt;
 
 	return 0;
 }
 
-static int create_val_field(struct hist_trigger_data *hist_data,
-			    unsigned int val_idx,
-			    struct trace_event_file *file,
-			    char *field_str)
+static int synth_event_reg(struct trace_event_call *call,
+			   enum trace_reg type, void *data)
 {
-	struct ftrace_event_field *field = NULL;
-	unsigned long flags = 0;
-	char *field_name;
-	int ret = 0;
-
-	if (WARN_ON(val_idx >= TRACING_MAP_VALS_MAX))
-		return -EINVAL;
+	switch (type) {
+	case TRACE_REG_REGISTER:
+	case TRACE_REG_UNREGISTER:
+		return trace_event_reg(call, type, data);
+	default:
+		/* perf can't attach to synthetic events */
+		return -EOPNOTSUPP;
+	}
+}
+
+static void free_synth_field(struct synth_field *field)
+{
+	kfree(field->type);
+	kfree(field->name);
+	kfree(field);
+}
+
+static struct synth_field *parse_synth_field(char *type, char *name)
+{
+	const struct synth_field_type *field_type;
+	struct synth_field *field;
+	int len;
+
+	len = strlen(name);
+	if (len && name[len - 1] == ';')
+		name[--len] = '\0';
+	if (!len)
+		return ERR_PTR(-EINVAL);
+
+	field_type = synth_field_type(type);
+	if (!field_type)
+		return ERR_PTR(-EINVAL);
+
+	field = kzalloc(sizeof(*field), GFP_KERNEL);
+	if (!field)
+		return ERR_PTR(-ENOMEM);
+
+	field->type = kstrdup(type, GFP_KERNEL);
+	field->name = kstrdup(name, GFP_KERNEL);
+	if (!field->type || !field->name) {
+		free_synth_field(field);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	field->size = field_type->size;
+	field->is_signed = field_type->is_signed;
+
+	return field;
+}
+
+static void free_synth_event(struct synth_event *event)
+{
+	unsigned int i;
+
+	if (!event)
+		return;
+
+	for (i = 0; i < event->n_fields; i++)
+		free_synth_field(event->fields[i]);
+
+	if (event->tp) {
+		kfree(event->tp->name);
+		kfree(event->tp);
+	}
+
+	kfree(event->call.print_fmt);
+	kfree(event->fields);
+	kfree(event->name);
+	kfree(event);
+}
+
+static struct synth_event *alloc_synth_event(char *name, int n_fields,
+					     struct synth_field **fields)
+{
+	struct synth_event *event;
+	unsigned int i;
+
+	event = kzalloc(sizeof(*event), GFP_KERNEL);
+	if (!event)
+		return ERR_PTR(-ENOMEM);
+
+	event->name = kstrdup(name, GFP_KERNEL);
+	event->fields = kcalloc(n_fields ? n_fields : 1,
+				sizeof(*event->fields), GFP_KERNEL);
+	event->tp = kzalloc(sizeof(*event->tp), GFP_KERNEL);
+	if (!event->name || !event->fields || !event->tp)
+		goto free;
+
+	event->tp->name = kstrdup(name, GFP_KERNEL);
+	if (!event->tp->name)
+		goto free;
+
+	for (i = 0; i < n_fields; i++)
+		event->fields[i] = fields[i];
+	event->n_fields = n_fields;
+
+	return event;
+ free:
+	free_synth_event(event);
+
+	return ERR_PTR(-ENOMEM);
+}
+
+static int register_synth_event(struct synth_event *event)
+{
+	struct trace_event_call *call = &event->call;
+	int ret;
+
+	call->class = &event->class;
+	event->class.system = SYNTH_SYSTEM;
+	INIT_LIST_HEAD(&call->class->fields);
+	call->class->define_fields = synth_event_define_fields;
+	call->class->reg = synth_event_reg;
+	call->class->probe = trace_event_raw_event_synth;
+	call->event.funcs = &synth_event_funcs;
+
+	ret = register_trace_event(&call->event);
+	if (!ret)
+		return -ENODEV;
+
+	call->flags = TRACE_EVENT_FL_TRACEPOINT;
+	call->tp = event->tp;
+	call->data = event;
+
+	ret = set_synth_event_print_fmt(event);
+	if (ret)
+		goto err;
+
+	ret = trace_add_event_call(call);
+	if (ret) {
+		pr_warn("Failed to register synthetic event: %s\n",
+			event->name);
+		goto err;
+	}
+
+	return 0;
+ err:
+	unregister_trace_event(&call->event);
+
+	return ret;
+}
+
+/* Must be called with event_mutex or synth_event_mutex held */
+static struct synth_event *find_synth_event(const char *name)
+{
+	struct synth_event *event;
+
+	list_for_each_entry(event, &synth_event_list, list) {
+		if (strcmp(event->name, name) == 0)
+			return event;
+	}
+
+	return NULL;
+}
+
+/* Must be called with synth_event_mutex held */
+static int remove_synth_event(struct synth_event *event)
+{
+	int ret;
+
+	mutex_lock(&event_mutex);
+	if (event->ref) {
+		mutex_unlock(&event_mutex);
+		return -EBUSY;
+	}
+	list_del(&event->list);
+	mutex_unlock(&event_mutex);
+
+	ret = trace_remove_event_call(&event->call);
+	if (ret) {
+		mutex_lock(&event_mutex);
+		list_add(&event->list, &synth_event_list);
+		mutex_unlock(&event_mutex);
+		return ret;
+	}
+
+	unregister_trace_event(&event->call.event);
+	free_synth_event(event);
+
+	return 0;
+}
+
+static int create_synth_event(int argc, char **argv)
+{
+	struct synth_field *field, *fields[SYNTH_FIELDS_MAX];
+	struct synth_event *event;
+	bool delete_event = false;
+	int i, n_fields = 0, ret = 0;
+	char *name;
+
+	/*
+	 * Argument syntax:
+	 *  - Add synthetic event: <event_name> field[;field] ...
+	 *  - Remove synthetic event: !<event_name>
+	 *      where 'field' = type field_name
+	 */
+	if (argc < 1)
+		return -EINVAL;
+
+	mutex_lock(&synth_event_mutex);
+
+	name = argv[0];
+	if (name[0] == '!') {
+		delete_event = true;
+		name++;
+	}
+
+	event = find_synth_event(name);
+	if (delete_event) {
+		ret = event ? remove_synth_event(event) : -ENOENT;
+		goto out;
+	}
+	if (event) {
+		ret = -EEXIST;
+		goto out;
+	}
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], ";") == 0)
+			continue;
+		if (i + 1 >= argc || n_fields == SYNTH_FIELDS_MAX) {
+			ret = -EINVAL;
+			goto err;
+		}
+
+		field = parse_synth_field(argv[i], argv[i + 1]);
+		if (IS_ERR(field)) {
+			ret = PTR_ERR(field);
+			goto err;
+		}
+		fields[n_fields++] = field;
+		i++;
+	}
+
+	event = alloc_synth_event(name, n_fields, fields);
+	if (IS_ERR(event)) {
+		ret = PTR_ERR(event);
+		goto err;
+	}
+
+	ret = register_synth_event(event);
+	if (ret) {
+		free_synth_event(event);
+		goto out;
+	}
+
+	mutex_lock(&event_mutex);
+	list_add(&event->list, &synth_event_list);
+	mutex_unlock(&event_mutex);
+ out:
+	mutex_unlock(&synth_event_mutex);
+
+	return ret;
+ err:
+	for (i = 0; i < n_fields; i++)
+		free_synth_field(fields[i]);
+
+	goto out;
+}
+
+static int release_all_synth_events(void)
+{
+	struct synth_event *event, *e;
+	int ret = 0;
+
+	mutex_lock(&synth_event_mutex);
+
+	list_for_each_entry_safe(event, e, &synth_event_list, list) {
+		ret = remove_synth_event(event);
+		if (ret)
+			break;
+	}
+
+	mutex_unlock(&synth_event_mutex);
+
+	return ret;
+}
+
+static void *synth_events_seq_start(struct seq_file *m, loff_t *pos)
+{
+	mutex_lock(&synth_event_mutex);
+
+	return seq_list_start(&synth_event_list, *pos);
+}
+
+static void *synth_events_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	return seq_list_next(v, &synth_event_list, pos);
+}
+
+static void synth_events_seq_stop(struct seq_file *m, void *v)
+{
+	mutex_unlock(&synth_event_mutex);
+}
+
+static int synth_events_seq_show(struct seq_file *m, void *v)
+{
+	struct synth_event *event = v;
+	struct synth_field *field;
+	unsigned int i;
+
+	seq_printf(m, "%s\t", event->name);
+
+	for (i = 0; i < event->n_fields; i++) {
+		field = event->fields[i];
+
+		/* parameter values */
+		seq_printf(m, "%s %s%s", field->type, field->name,
+			   i == event->n_fields - 1 ? "" : "; ");
+	}
+
+	seq_putc(m, '\n');
+
+	return 0;
+}
+
+static const struct seq_operations synth_events_seq_op = {
+	.start  = synth_events_seq_start,
+	.next   = synth_events_seq_next,
+	.stop   = synth_events_seq_stop,
+	.show   = synth_events_seq_show
+};
+
+static int synth_events_open(struct inode *inode, struct file *file)
+{
+	int ret;
+
+	if ((file->f_mode & FMODE_WRITE) && (file->f_flags & O_TRUNC)) {
+		ret = release_all_synth_events();
+		if (ret < 0)
+			return ret;
+	}
+
+	return seq_open(file, &synth_events_seq_op);
+}
+
+static ssize_t synth_events_write(struct file *file,
+				  const char __user *buffer,
+				  size_t count, loff_t *ppos)
+{
+	char *kbuf, *buf, *line, *comment;
+	char **argv;
+	int argc;
+	ssize_t ret = 0;
+
+	if (count >= PAGE_SIZE)
+		return -E2BIG;
+
+	kbuf = memdup_user_nul(buffer, count);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	buf = kbuf;
+	while ((line = strsep(&buf, "\n")) != NULL) {
+		comment = strchr(line, '#');
+		if (comment)
+			*comment = '\0';
+
+		argv = argv_split(GFP_KERNEL, line, &argc);
+		if (!argv) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		if (argc)
+			ret = create_synth_event(argc, argv);
+
+		argv_free(argv);
+		if (ret < 0)
+			break;
+	}
+
+	kfree(kbuf);
+
+	return ret < 0 ? ret : count;
+}
+
+static const struct file_operations synth_events_fops = {
+	.open           = synth_events_open,
+	.write		= synth_events_write,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release        = seq_release,
+};
+
+static inline void save_comm(char *comm, struct task_struct *task)
+{
+	if (!task->pid) {
+		strcpy(comm, "<idle>");
+		return;
+	}
+
+	if (WARN_ON_ONCE(task->pid < 0)) {
+		strcpy(comm, "<XXX>");
+		return;
+	}
+
+	memcpy(comm, task->comm, TASK_COMM_LEN);
+}
+
+static void hist_trigger_elt_comm_free(struct tracing_map_elt *elt)
+{
+	kfree((char *)elt->private_data);
+}
+
+static int hist_trigger_elt_comm_alloc(struct tracing_map_elt *elt)
+{
+	struct hist_trigger_data *hist_data = elt->map->private_data;
+	struct hist_field *key_field;
+	unsigned int i;
+
+	for_each_hist_key_field(i, hist_data) {
+		key_field = hist_data->fields[i];
+
+		if (key_field->flags & HIST_FIELD_FL_EXECNAME) {
+			unsigned int size = TASK_COMM_LEN + 1;
+
+			elt->private_data = kzalloc(size, GFP_KERNEL);
+			if (!elt->private_data)
+				return -ENOMEM;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static void hist_trigger_elt_comm_copy(struct tracing_map_elt *to,
+				       struct tracing_map_elt *from)
+{
+	char *comm_from = from->private_data;
+	char *comm_to = to->private_data;
+
+	if (comm_from)
+		memcpy(comm_to, comm_from, TASK_COMM_LEN + 1);
+}
+
+static void hist_trigger_elt_comm_init(struct tracing_map_elt *elt)
+{
+	char *comm = elt->private_data;
+
+	if (comm)
+		save_comm(comm, current);
+}
+
+static const struct tracing_map_ops hist_trigger_elt_comm_ops = {
+	.elt_alloc	= hist_trigger_elt_comm_alloc,
+	.elt_copy	= hist_trigger_elt_comm_copy,
+	.elt_free	= hist_trigger_elt_comm_free,
+	.elt_init	= hist_trigger_elt_comm_init,
+};
+
+static void destroy_hist_field(struct hist_field *hist_field)
+{
+	unsigned int i;
+
+	if (!hist_field)
+		return;
+
+	for (i = 0; i < HIST_FIELD_OPERANDS_MAX; i++)
+		destroy_hist_field(hist_field->operands[i]);
+
+	kfree(hist_field->name);
+	kfree(hist_field);
+}
+
+static struct hist_field *create_hist_field(struct ftrace_event_field *field,
+					    unsigned long flags)
+{
+	struct hist_field *hist_field;
+
+	if (field && is_function_field(field))
+		return NULL;
+
+	hist_field = kzalloc(sizeof(struct hist_field), GFP_KERNEL);
+	if (!hist_field)
+		return NULL;
+
+	if (flags & HIST_FIELD_FL_HITCOUNT) {
+		hist_field->fn = hist_field_counter;
+		goto out;
+	}
+
+	if (flags & HIST_FIELD_FL_STACKTRACE) {
+		hist_field->fn = hist_field_none;
+		goto out;
+	}
+
+	if (flags & HIST_FIELD_FL_LOG2) {
+		hist_field->fn = hist_field_log2;
+		goto out;
+	}
+
+	if (flags & HIST_FIELD_FL_TIMESTAMP) {
+		hist_field->fn = hist_field_timestamp;
+		goto out;
+	}
+
+	if (flags & HIST_FIELD_FL_VAR_REF) {
+		hist_field->fn = hist_field_var_ref;
+		goto out;
+	}
+
+	if (flags & HIST_FIELD_FL_VAR_READ) {
+		hist_field->fn = hist_field_var_read;
+		goto out;
+	}
+
+	/* operands and fn are filled in by the caller */
+	if (flags & HIST_FIELD_FL_EXPR)
+		goto out;
+
+	if (WARN_ON_ONCE(!field))
+		goto out;
+
+	/* Pointers to strings are just pointers and dangerous to dereference */
+	if (is_string_field(field) &&
+	    (field->filter_type != FILTER_PTR_STRING)) {
+		flags |= HIST_FIELD_FL_STRING;
+
+		if (field->filter_type == FILTER_STATIC_STRING)
+			hist_field->fn = hist_field_string;
+		else if (field->filter_type == FILTER_DYN_STRING)
+			hist_field->fn = hist_field_dynstring;
+		else
+			hist_field->fn = hist_field_pstring;
+	} else {
+		hist_field->fn = select_value_fn(field->size,
+						 field->is_signed);
+		if (!hist_field->fn) {
+			destroy_hist_field(hist_field);
+			return NULL;
+		}
+	}
+ out:
+	hist_field->field = field;
+	hist_field->flags = flags;
+
+	return hist_field;
+}
+
+static void destroy_hist_fields(struct hist_trigger_data *hist_data)
+{
+	unsigned int i;
+
+	for (i = 0; i < TRACING_MAP_FIELDS_MAX; i++) {
+		if (hist_data->fields[i]) {
+			destroy_hist_field(hist_data->fields[i]);
+			hist_data->fields[i] = NULL;
+		}
+	}
+}
+
+static int create_hitcount_val(struct hist_trigger_data *hist_data)
+{
+	hist_data->fields[HITCOUNT_IDX] =
+		create_hist_field(NULL, HIST_FIELD_FL_HITCOUNT);
+	if (!hist_data->fields[HITCOUNT_IDX])
+		return -ENOMEM;
+
+	hist_data->n_vals++;
+
+	if (WARN_ON(hist_data->n_vals > TRACING_MAP_VALS_MAX))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int create_val_field(struct hist_trigger_data *hist_data,
+			    unsigned int val_idx,
+			    struct trace_event_file *file,
+			    char *field_str)
+{
+	struct ftrace_event_field *field = NULL;
+	unsigned long flags = 0;
+	char *field_name;
+	int ret = 0;
+
+	if (WARN_ON(val_idx >= TRACING_MAP_VALS_MAX))
+		return -EINVAL;
 
 	field_name = strsep(&field_str, ".");
 	if (field_str) {
@@ -501,140 +1351,545 @@ static int create_val_fields(struct hist_trigger_data *hist_data,
 		if (ret)
 			goto out;
 	}
-	if (fields_str && (strcmp(fields_str, "hitcount") != 0))
-		ret = -EINVAL;
- out:
-	return ret;
+	if (fields_str && (strcmp(fields_str, "hitcount") != 0))
+		ret = -EINVAL;
+ out:
+	return ret;
+}
+
+static int create_key_field(struct hist_trigger_data *hist_data,
+			    unsigned int key_idx,
+			    unsigned int key_offset,
+			    struct trace_event_file *file,
+			    char *field_str)
+{
+	struct ftrace_event_field *field = NULL;
+	unsigned long flags = 0;
+	unsigned int key_size;
+	int ret = 0;
+
+	if (WARN_ON(key_idx >= TRACING_MAP_FIELDS_MAX))
+		return -EINVAL;
+
+	flags |= HIST_FIELD_FL_KEY;
+
+	if (strcmp(field_str, "stacktrace") == 0) {
+		flags |= HIST_FIELD_FL_STACKTRACE;
+		key_size = sizeof(unsigned long) * HIST_STACKTRACE_DEPTH;
+	} else {
+		char *field_name = strsep(&field_str, ".");
+
+		if (field_str) {
+			if (strcmp(field_str, "hex") == 0)
+				flags |= HIST_FIELD_FL_HEX;
+			else if (strcmp(field_str, "sym") == 0)
+				flags |= HIST_FIELD_FL_SYM;
+			else if (strcmp(field_str, "sym-offset") == 0)
+				flags |= HIST_FIELD_FL_SYM_OFFSET;
+			else if ((strcmp(field_str, "execname") == 0) &&
+				 (strcmp(field_name, "common_pid") == 0))
+				flags |= HIST_FIELD_FL_EXECNAME;
+			else if (strcmp(field_str, "syscall") == 0)
+				flags |= HIST_FIELD_FL_SYSCALL;
+			else if (strcmp(field_str, "log2") == 0)
+				flags |= HIST_FIELD_FL_LOG2;
+			else {
+				ret = -EINVAL;
+				goto out;
+			}
+		}
+
+		field = trace_find_event_field(file->event_call, field_name);
+		if (!field || !field->size) {
+			ret = -EINVAL;
+			goto out;
+		}
+
+		if (is_string_field(field))
+			key_size = MAX_FILTER_STR_VAL;
+		else
+			key_size = field->size;
+	}
+
+	hist_data->fields[key_idx] = create_hist_field(field, flags);
+	if (!hist_data->fields[key_idx]) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	key_size = ALIGN(key_size, sizeof(u64));
+	hist_data->fields[key_idx]->size = key_size;
+	hist_data->fields[key_idx]->offset = key_offset;
+	hist_data->key_size += key_size;
+	if (hist_data->key_size > HIST_KEY_SIZE_MAX) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	hist_data->n_keys++;
+
+	if (WARN_ON(hist_data->n_keys > TRACING_MAP_KEYS_MAX))
+		return -EINVAL;
+
+	ret = key_size;
+ out:
+	return ret;
+}
+
+static int create_key_fields(struct hist_trigger_data *hist_data,
+			     struct trace_event_file *file)
+{
+	unsigned int i, key_offset = 0, n_vals = hist_data->n_vals;
+	char *fields_str, *field_str;
+	int ret = -EINVAL;
+
+	fields_str = hist_data->attrs->keys_str;
+	if (!fields_str)
+		goto out;
+
+	strsep(&fields_str, "=");
+	if (!fields_str)
+		goto out;
+
+	for (i = n_vals; i < n_vals + TRACING_MAP_KEYS_MAX; i++) {
+		field_str = strsep(&fields_str, ",");
+		if (!field_str)
+			break;
+		ret = create_key_field(hist_data, i, key_offset,
+				       file, field_str);
+		if (ret < 0)
+			goto out;
+		key_offset += ret;
+	}
+	if (fields_str) {
+		ret = -EINVAL;
+		goto out;
+	}
+	ret = 0;
+ out:
+	return ret;
+}
+
+static int create_hist_fields(struct hist_trigger_data *hist_data,
+			      struct trace_event_file *file)
+{
+	int ret;
+
+	ret = create_val_fields(hist_data, file);
+	if (ret)
+		goto out;
+
+	ret = create_key_fields(hist_data, file);
+	if (ret)
+		goto out;
+
+	hist_data->n_fields = hist_data->n_vals + hist_data->n_keys;
+ out:
+	return ret;
+}
+
+static struct hist_field *find_var_field(struct hist_trigger_data *hist_data,
+					 const char *var_name)
+{
+	unsigned int i;
+
+	for (i = 0; i < hist_data->n_vars; i++) {
+		if (strcmp(hist_data->vars[i]->name, var_name) == 0)
+			return hist_data->vars[i];
+	}
+
+	return NULL;
+}
+
+/* Must be called with event_mutex held */
+static struct hist_trigger_data *find_file_var(struct trace_event_file *file,
+					       const char *var_name,
+					       struct hist_field **var)
+{
+	struct hist_trigger_data *hist_data;
+	struct event_trigger_data *test;
+
+	list_for_each_entry(test, &file->triggers, list) {
+		if (test->cmd_ops->trigger_type != ETT_EVENT_HIST)
+			continue;
+
+		hist_data = test->private_data;
+		*var = find_var_field(hist_data, var_name);
+		if (*var)
+			return hist_data;
+	}
+
+	return NULL;
+}
+
+/* Must be called with event_mutex held */
+static struct hist_trigger_data *find_any_var(struct trace_array *tr,
+					      const char *var_name,
+					      struct hist_field **var)
+{
+	struct hist_trigger_data *hist_data;
+	struct trace_event_file *file;
+
+	list_for_each_entry(file, &tr->events, list) {
+		hist_data = find_file_var(file, var_name, var);
+		if (hist_data)
+			return hist_data;
+	}
+
+	return NULL;
+}
+
+/*
+ * Create a field for a '$var_name' reference.  A variable assigned by
+ * this same trigger is simply read back from the current tracing_map_elt;
+ * otherwise the variable is looked up in the hist triggers of the onmatch()
+ * event first and then in those of any other event of the same instance.
+ * The value of a variable of another trigger is fetched once per event
+ * into a var_ref_vals[] slot, see resolve_var_refs().
+ */
+static struct hist_field *create_var_ref(struct hist_trigger_data *hist_data,
+					 struct trace_event_file *file,
+					 char *var_name)
+{
+	struct hist_trigger_data *var_hist_data = NULL;
+	struct hist_field *var = NULL, *ref;
+	struct hist_var_ref *var_ref;
+	unsigned int i;
+
+	var = find_var_field(hist_data, var_name);
+	if (var) {
+		ref = create_hist_field(NULL, HIST_FIELD_FL_VAR_READ);
+		if (!ref)
+			return ERR_PTR(-ENOMEM);
+		ref->var = var;
+		ref->flags |= var->flags & HIST_FIELD_FL_VAR_REF;
+		return ref;
+	}
+
+	if (hist_data->action)
+		var_hist_data = find_file_var(hist_data->action->match_file,
+					      var_name, &var);
+	if (!var_hist_data)
+		var_hist_data = find_any_var(file->tr, var_name, &var);
+	if (!var_hist_data)
+		return ERR_PTR(-EINVAL);
+
+	/* the variable is looked up using our own key */
+	if (var_hist_data->key_size != hist_data->key_size)
+		return ERR_PTR(-EINVAL);
+
+	for (i = 0; i < hist_data->n_var_refs; i++) {
+		var_ref = &hist_data->var_refs[i];
+		if (var_ref->hist_data == var_hist_data &&
+		    var_ref->var_idx == var->var_idx)
+			break;
+	}
+
+	if (i == hist_data->n_var_refs) {
+		if (i == TRACING_MAP_VARS_MAX)
+			return ERR_PTR(-EINVAL);
+
+		var_ref = &hist_data->var_refs[i];
+		var_ref->name = kstrdup(var_name, GFP_KERNEL);
+		if (!var_ref->name)
+			return ERR_PTR(-ENOMEM);
+		var_ref->hist_data = var_hist_data;
+		var_ref->var_idx = var->var_idx;
+		var_hist_data->n_referrers++;
+		hist_data->n_var_refs++;
+	}
+
+	ref = create_hist_field(NULL, HIST_FIELD_FL_VAR_REF);
+	if (!ref)
+		return ERR_PTR(-ENOMEM);
+	ref->var_ref_idx = i;
+
+	return ref;
+}
+
+static struct hist_field *parse_atom(struct hist_trigger_data *hist_data,
+				     struct trace_event_file *file,
+				     char *str)
+{
+	struct ftrace_event_field *field = NULL;
+	struct hist_field *hist_field;
+	unsigned long flags = 0;
+	char *field_name;
+
+	if (str[0] == '$')
+		return create_var_ref(hist_data, file, str + 1);
+
+	field_name = strsep(&str, ".");
+	if (strcmp(field_name, "common_timestamp") == 0) {
+		flags |= HIST_FIELD_FL_TIMESTAMP;
+		if (str) {
+			if (strcmp(str, "usecs") == 0)
+				flags |= HIST_FIELD_FL_TIMESTAMP_USECS;
+			else
+				return ERR_PTR(-EINVAL);
+		}
+	} else {
+		if (str) {
+			if (strcmp(str, "hex") == 0)
+				flags |= HIST_FIELD_FL_HEX;
+			else
+				return ERR_PTR(-EINVAL);
+		}
+
+		field = trace_find_event_field(file->event_call, field_name);
+		if (!field || !field->size || is_string_field(field))
+			return ERR_PTR(-EINVAL);
+	}
+
+	hist_field = create_hist_field(field, flags);
+	if (!hist_field)
+		return ERR_PTR(-ENOMEM);
+
+	return hist_field;
+}
+
+/*
+ * Expressions are either a single operand or two operands combined by
+ * '+' or '-', where an operand is an event field, common_timestamp or a
+ * $variable reference.
+ */
+static struct hist_field *parse_expr(struct hist_trigger_data *hist_data,
+				     struct trace_event_file *file,
+				     char *str)
+{
+	struct hist_field *expr, *operand1, *operand2;
+	enum field_op_id op;
+	char *sep;
+
+	str = strstrip(str);
+
+	sep = strpbrk(str, "+-");
+	if (!sep)
+		return parse_atom(hist_data, file, str);
+
+	op = *sep == '+' ? FIELD_OP_PLUS : FIELD_OP_MINUS;
+	*sep++ = '\0';
+	if (strpbrk(sep, "+-"))
+		return ERR_PTR(-EINVAL);
+
+	operand1 = parse_atom(hist_data, file, strstrip(str));
+	if (IS_ERR(operand1))
+		return operand1;
+
+	operand2 = parse_atom(hist_data, file, strstrip(sep));
+	if (IS_ERR(operand2)) {
+		destroy_hist_field(operand1);
+		return operand2;
+	}
+
+	expr = create_hist_field(NULL, HIST_FIELD_FL_EXPR);
+	if (!expr) {
+		destroy_hist_field(operand1);
+		destroy_hist_field(operand2);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	expr->operator = op;
+	expr->operands[0] = operand1;
+	expr->operands[1] = operand2;
+	expr->fn = op == FIELD_OP_PLUS ? hist_field_plus : hist_field_minus;
+	expr->flags |= (operand1->flags | operand2->flags) &
+		HIST_FIELD_FL_VAR_REF;
+
+	return expr;
 }
 
-static int create_key_field(struct hist_trigger_data *hist_data,
-			    unsigned int key_idx,
-			    unsigned int key_offset,
+static int create_var_field(struct hist_trigger_data *hist_data,
 			    struct trace_event_file *file,
-			    char *field_str)
+			    char *var_name, char *expr_str)
 {
-	struct ftrace_event_field *field = NULL;
-	unsigned long flags = 0;
-	unsigned int key_size;
-	int ret = 0;
+	struct hist_field *var;
 
-	if (WARN_ON(key_idx >= TRACING_MAP_FIELDS_MAX))
+	if (!*var_name || find_var_field(hist_data, var_name))
 		return -EINVAL;
 
-	flags |= HIST_FIELD_FL_KEY;
+	if (WARN_ON(hist_data->n_vars >= TRACING_MAP_VARS_MAX))
+		return -EINVAL;
 
-	if (strcmp(field_str, "stacktrace") == 0) {
-		flags |= HIST_FIELD_FL_STACKTRACE;
-		key_size = sizeof(unsigned long) * HIST_STACKTRACE_DEPTH;
-	} else {
-		char *field_name = strsep(&field_str, ".");
+	var = parse_expr(hist_data, file, expr_str);
+	if (IS_ERR(var))
+		return PTR_ERR(var);
 
-		if (field_str) {
-			if (strcmp(field_str, "hex") == 0)
-				flags |= HIST_FIELD_FL_HEX;
-			else if (strcmp(field_str, "sym") == 0)
-				flags |= HIST_FIELD_FL_SYM;
-			else if (strcmp(field_str, "sym-offset") == 0)
-				flags |= HIST_FIELD_FL_SYM_OFFSET;
-			else if ((strcmp(field_str, "execname") == 0) &&
-				 (strcmp(field_name, "common_pid") == 0))
-				flags |= HIST_FIELD_FL_EXECNAME;
-			else if (strcmp(field_str, "syscall") == 0)
-				flags |= HIST_FIELD_FL_SYSCALL;
-			else if (strcmp(field_str, "log2") == 0)
-				flags |= HIST_FIELD_FL_LOG2;
-			else {
-				ret = -EINVAL;
-				goto out;
-			}
-		}
+	var->flags |= HIST_FIELD_FL_VAR;
+	var->name = kstrdup(var_name, GFP_KERNEL);
+	if (!var->name) {
+		destroy_hist_field(var);
+		return -ENOMEM;
+	}
 
-		field = trace_find_event_field(file->event_call, field_name);
-		if (!field || !field->size) {
-			ret = -EINVAL;
-			goto out;
-		}
+	hist_data->vars[hist_data->n_vars++] = var;
 
-		if (is_string_field(field))
-			key_size = MAX_FILTER_STR_VAL;
-		else
-			key_size = field->size;
-	}
+	return 0;
+}
 
-	hist_data->fields[key_idx] = create_hist_field(field, flags);
-	if (!hist_data->fields[key_idx]) {
-		ret = -ENOMEM;
-		goto out;
+static int create_var_fields(struct hist_trigger_data *hist_data,
+			     struct trace_event_file *file)
+{
+	struct hist_trigger_attrs *attrs = hist_data->attrs;
+	char *assignment, *var_name;
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < attrs->n_assignments; i++) {
+		assignment = kstrdup(attrs->assignment_str[i], GFP_KERNEL);
+		if (!assignment)
+			return -ENOMEM;
+
+		var_name = strsep(&assignment, "=");
+		ret = create_var_field(hist_data, file, var_name, assignment);
+		kfree(var_name);
+		if (ret)
+			break;
 	}
 
-	key_size = ALIGN(key_size, sizeof(u64));
-	hist_data->fields[key_idx]->size = key_size;
-	hist_data->fields[key_idx]->offset = key_offset;
-	hist_data->key_size += key_size;
-	if (hist_data->key_size > HIST_KEY_SIZE_MAX) {
-		ret = -EINVAL;
-		goto out;
+	return ret;
+}
+
+static int create_tracing_map_vars(struct hist_trigger_data *hist_data)
+{
+	unsigned int i;
+	int idx;
+
+	for (i = 0; i < hist_data->n_vars; i++) {
+		idx = tracing_map_add_var(hist_data->map);
+		if (idx < 0)
+			return idx;
+		hist_data->vars[i]->var_idx = idx;
 	}
 
-	hist_data->n_keys++;
+	return 0;
+}
 
-	if (WARN_ON(hist_data->n_keys > TRACING_MAP_KEYS_MAX))
-		return -EINVAL;
+static void destroy_hist_action(struct hist_action *action)
+{
+	unsigned int i;
 
-	ret = key_size;
- out:
-	return ret;
+	if (!action)
+		return;
+
+	for (i = 0; i < action->n_params; i++)
+		destroy_hist_field(action->params[i]);
+
+	if (action->synth_event)
+		action->synth_event->ref--;
+
+	kfree(action);
 }
 
-static int create_key_fields(struct hist_trigger_data *hist_data,
-			     struct trace_event_file *file)
+/*
+ * First half of onmatch(system.event).synth(params) parsing: the match
+ * event has to be known before the variables are created, since it's
+ * where $variable references are looked up first.
+ */
+static int parse_action_match(struct hist_trigger_data *hist_data,
+			      struct trace_event_file *file)
 {
-	unsigned int i, key_offset = 0, n_vals = hist_data->n_vals;
-	char *fields_str, *field_str;
+	char *action_str, *str, *match, *system, *event;
+	struct hist_action *action;
 	int ret = -EINVAL;
 
-	fields_str = hist_data->attrs->keys_str;
-	if (!fields_str)
+	if (!hist_data->attrs->action_str)
+		return 0;
+
+	action_str = kstrdup(hist_data->attrs->action_str, GFP_KERNEL);
+	if (!action_str)
+		return -ENOMEM;
+
+	str = action_str + strlen("onmatch(");
+	match = strsep(&str, ")");
+	if (!str)
 		goto out;
 
-	strsep(&fields_str, "=");
-	if (!fields_str)
+	system = strsep(&match, ".");
+	event = match;
+	if (!event || !*system || !*event)
 		goto out;
 
-	for (i = n_vals; i < n_vals + TRACING_MAP_KEYS_MAX; i++) {
-		field_str = strsep(&fields_str, ",");
-		if (!field_str)
-			break;
-		ret = create_key_field(hist_data, i, key_offset,
-				       file, field_str);
-		if (ret < 0)
-			goto out;
-		key_offset += ret;
+	action = kzalloc(sizeof(*action), GFP_KERNEL);
+	if (!action) {
+		ret = -ENOMEM;
+		goto out;
 	}
-	if (fields_str) {
-		ret = -EINVAL;
+
+	action->match_file = find_event_file(file->tr, system, event);
+	if (!action->match_file) {
+		kfree(action);
 		goto out;
 	}
+
+	hist_data->action = action;
 	ret = 0;
  out:
+	kfree(action_str);
+
 	return ret;
 }
 
-static int create_hist_fields(struct hist_trigger_data *hist_data,
-			      struct trace_event_file *file)
+static int create_action(struct hist_trigger_data *hist_data,
+			 struct trace_event_file *file)
 {
-	int ret;
+	struct hist_action *action = hist_data->action;
+	char *action_str, *str, *synth_name, *params, *param;
+	struct synth_event *synth_event;
+	struct hist_field *hist_field;
+	int ret = -EINVAL;
 
-	ret = create_val_fields(hist_data, file);
-	if (ret)
+	if (!action)
+		return 0;
+
+	action_str = kstrdup(hist_data->attrs->action_str, GFP_KERNEL);
+	if (!action_str)
+		return -ENOMEM;
+
+	/* skip onmatch(system.event), already handled */
+	str = action_str;
+	strsep(&str, ")");
+	if (!str || *str++ != '.')
 		goto out;
 
-	ret = create_key_fields(hist_data, file);
-	if (ret)
+	synth_name = strsep(&str, "(");
+	params = strsep(&str, ")");
+	if (!str || *str)
 		goto out;
 
-	hist_data->n_fields = hist_data->n_vals + hist_data->n_keys;
+	if (strcmp(synth_name, "trace") == 0)
+		synth_name = strsep(&params, ",");
+
+	synth_event = find_synth_event(synth_name);
+	if (!synth_event)
+		goto out;
+
+	/* generating the event we're attached to would recurse forever */
+	if (&synth_event->call == file->event_call)
+		goto out;
+
+	while (params && *params) {
+		param = strsep(&params, ",");
+		if (action->n_params == SYNTH_FIELDS_MAX)
+			goto out;
+
+		hist_field = parse_expr(hist_data, file, param);
+		if (IS_ERR(hist_field)) {
+			ret = PTR_ERR(hist_field);
+			goto out;
+		}
+		action->params[action->n_params++] = hist_field;
+	}
+
+	if (action->n_params != synth_event->n_fields)
+		goto out;
+
+	synth_event->ref++;
+	action->synth_event = synth_event;
+	ret = 0;
  out:
+	kfree(action_str);
+
 	return ret;
 }
 
@@ -727,9 +1982,26 @@ static int create_sort_keys(struct hist_trigger_data *hist_data)
 	return ret;
 }
 
+static void destroy_hist_vars(struct hist_trigger_data *hist_data)
+{
+	struct hist_var_ref *var_ref;
+	unsigned int i;
+
+	for (i = 0; i < hist_data->n_vars; i++)
+		destroy_hist_field(hist_data->vars[i]);
+
+	for (i = 0; i < hist_data->n_var_refs; i++) {
+		var_ref = &hist_data->var_refs[i];
+		var_ref->hist_data->n_referrers--;
+		kfree(var_ref->name);
+	}
+}
+
 static void destroy_hist_data(struct hist_trigger_data *hist_data)
 {
 	destroy_hist_trigger_attrs(hist_data->attrs);
+	destroy_hist_action(hist_data->action);
+	destroy_hist_vars(hist_data);
 	destroy_hist_fields(hist_data);
 	tracing_map_destroy(hist_data->map);
 	kfree(hist_data);
@@ -804,6 +2076,18 @@ create_hist_data(unsigned int map_bits,
 	if (ret)
 		goto free;
 
+	ret = parse_action_match(hist_data, file);
+	if (ret)
+		goto free;
+
+	ret = create_var_fields(hist_data, file);
+	if (ret)
+		goto free;
+
+	ret = create_action(hist_data, file);
+	if (ret)
+		goto free;
+
 	ret = create_sort_keys(hist_data);
 	if (ret)
 		goto free;
@@ -823,6 +2107,10 @@ create_hist_data(unsigned int map_bits,
 	if (ret)
 		goto free;
 
+	ret = create_tracing_map_vars(hist_data);
+	if (ret)
+		goto free;
+
 	ret = tracing_map_init(hist_data->map);
 	if (ret)
 		goto free;
@@ -842,7 +2130,8 @@ create_hist_data(unsigned int map_bits,
 
 static void hist_trigger_elt_update(struct hist_trigger_data *hist_data,
 				    struct tracing_map_elt *elt,
-				    void *rec)
+				    void *rec, u64 *var_ref_vals,
+				    bool refs_ok)
 {
 	struct hist_field *hist_field;
 	unsigned int i;
@@ -850,9 +2139,68 @@ static void hist_trigger_elt_update(struct hist_trigger_data *hist_data,
 
 	for_each_hist_val_field(i, hist_data) {
 		hist_field = hist_data->fields[i];
-		hist_val = hist_field->fn(hist_field, rec);
+		hist_val = hist_field->fn(hist_field, elt, rec, var_ref_vals);
 		tracing_map_update_sum(elt, i, hist_val);
 	}
+
+	for (i = 0; i < hist_data->n_vars; i++) {
+		hist_field = hist_data->vars[i];
+
+		/* leave the previous value alone if a reference is missing */
+		if (!refs_ok && (hist_field->flags & HIST_FIELD_FL_VAR_REF))
+			continue;
+
+		hist_val = hist_field->fn(hist_field, elt, rec, var_ref_vals);
+		tracing_map_set_var(elt, hist_field->var_idx, hist_val);
+	}
+}
+
+/*
+ * Fetch the values of the variables of other hist triggers referenced by
+ * this one, using this event's key.  Values are only consumed if all of
+ * them were set, so that e.g. a wakeup timestamp isn't thrown away by an
+ * unrelated event that happens to share the key.
+ */
+static bool resolve_var_refs(struct hist_trigger_data *hist_data, void *key,
+			     u64 *var_ref_vals)
+{
+	struct tracing_map_elt *var_elts[TRACING_MAP_VARS_MAX];
+	struct hist_var_ref *var_ref;
+	unsigned int i;
+
+	for (i = 0; i < hist_data->n_var_refs; i++) {
+		var_ref = &hist_data->var_refs[i];
+
+		var_elts[i] = tracing_map_lookup(var_ref->hist_data->map, key);
+		if (!var_elts[i] ||
+		    !tracing_map_var_set(var_elts[i], var_ref->var_idx))
+			return false;
+	}
+
+	for (i = 0; i < hist_data->n_var_refs; i++) {
+		var_ref = &hist_data->var_refs[i];
+		var_ref_vals[i] = tracing_map_read_var_once(var_elts[i],
+							    var_ref->var_idx);
+	}
+
+	return true;
+}
+
+static void hist_trigger_action(struct hist_trigger_data *hist_data,
+				struct tracing_map_elt *elt, void *rec,
+				u64 *var_ref_vals)
+{
+	struct hist_action *action = hist_data->action;
+	u64 param_vals[SYNTH_FIELDS_MAX];
+	struct hist_field *param;
+	unsigned int i;
+
+	for (i = 0; i < action->n_params; i++) {
+		param = action->params[i];
+		param_vals[i] = param->fn(param, elt, rec, var_ref_vals);
+	}
+
+	trace_synth(action->synth_event, param_vals);
 }
 
 static inline void add_to_key(char *compound_key, void *key,
@@ -886,7 +2234,9 @@ static void event_hist_trigger(struct event_trigger_data *data, void *rec)
 	char compound_key[HIST_KEY_SIZE_MAX];
 	struct stack_trace stacktrace;
 	struct hist_field *key_field;
+	u64 var_ref_vals[TRACING_MAP_VARS_MAX];
 	struct tracing_map_elt *elt;
+	bool refs_ok = true;
 	u64 field_contents;
 	void *key = NULL;
 	unsigned int i;
@@ -907,7 +2257,7 @@ static void event_hist_trigger(struct event_trigger_data *data, void *rec)
 
 			key = entries;
 		} else {
-			field_contents = key_field->fn(key_field, rec);
+			field_contents = key_field->fn(key_field, NULL, rec, NULL);
 			if (key_field->flags & HIST_FIELD_FL_STRING) {
 				key = (void *)(unsigned long)field_contents;
 				use_compound_key = true;
@@ -922,9 +2272,17 @@ static void event_hist_trigger(struct event_trigger_data *data, void *rec)
 	if (use_compound_key)
 		key = compound_key;
 
+	if (hist_data->n_var_refs)
+		refs_ok = resolve_var_refs(hist_data, key, var_ref_vals);
+
 	elt = tracing_map_insert(hist_data->map, key);
-	if (elt)
-		hist_trigger_elt_update(hist_data, elt, rec);
+	if (!elt)
+		return;
+
+	hist_trigger_elt_update(hist_data, elt, rec, var_ref_vals, refs_ok);
+
+	if (hist_data->action && refs_ok)
+		hist_trigger_action(hist_data, elt, rec, var_ref_vals);
 }
 
 static void hist_trigger_stacktrace_print(struct seq_file *m,
@@ -1179,6 +2537,9 @@ static int event_hist_trigger_print(struct seq_file *m,
 			hist_field_print(m, key_field);
 	}
 
+	for (i = 0; i < hist_data->attrs->n_assignments; i++)
+		seq_printf(m, ":%s", hist_data->attrs->assignment_str[i]);
+
 	seq_puts(m, ":vals=");
 
 	for_each_hist_val_field(i, hist_data) {
@@ -1217,6 +2578,9 @@ static int event_hist_trigger_print(struct seq_file *m,
 
 	seq_printf(m, ":size=%u", (1 << hist_data->map->map_bits));
 
+	if (hist_data->attrs->action_str)
+		seq_printf(m, ":%s", hist_data->attrs->action_str);
+
 	if (data->filter_str)
 		seq_printf(m, " if %s", data->filter_str);
 
@@ -1397,6 +2761,27 @@ static bool hist_trigger_match(struct event_trigger_data *data,
 	    (strcmp(data->filter_str, data_test->filter_str) != 0))
 		return false;
 
+	if (hist_data->attrs->n_assignments !=
+	    hist_data_test->attrs->n_assignments)
+		return false;
+
+	for (i = 0; i < hist_data->attrs->n_assignments; i++) {
+		if (strcmp(hist_data->attrs->assignment_str[i],
+			   hist_data_test->attrs->assignment_str[i]) != 0)
+			return false;
+	}
+
+	if ((hist_data->attrs->action_str &&
+	     !hist_data_test->attrs->action_str) ||
+	    (!hist_data->attrs->action_str &&
+	     hist_data_test->attrs->action_str))
+		return false;
+
+	if (hist_data->attrs->action_str &&
+	    (strcmp(hist_data->attrs->action_str,
+		    hist_data_test->attrs->action_str) != 0))
+		return false;
+
 	return true;
 }
 
@@ -1500,12 +2885,42 @@ static void hist_unregister_trigger(char *glob, struct event_trigger_ops *ops,
 		test->ops->free(test->ops, test);
 }
 
+/*
+ * A hist trigger whose variables are referenced by other hist triggers
+ * can't go away before them.
+ */
+static bool hist_trigger_referenced(struct event_trigger_data *data,
+				    struct trace_event_file *file)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	struct event_trigger_data *test, *named_data = NULL;
+
+	if (hist_data->attrs->name)
+		named_data = find_named_trigger(hist_data->attrs->name);
+
+	list_for_each_entry(test, &file->triggers, list) {
+		if (test->cmd_ops->trigger_type != ETT_EVENT_HIST)
+			continue;
+		if (!hist_trigger_match(data, test, named_data, false))
+			continue;
+
+		hist_data = test->private_data;
+		return hist_data->n_referrers > 0;
+	}
+
+	return false;
+}
+
 static void hist_unreg_all(struct trace_event_file *file)
 {
+	struct hist_trigger_data *hist_data;
 	struct event_trigger_data *test, *n;
 
 	list_for_each_entry_safe(test, n, &file->triggers, list) {
 		if (test->cmd_ops->trigger_type == ETT_EVENT_HIST) {
+			hist_data = test->private_data;
+			if (hist_data->n_referrers)
+				continue;
 			list_del_rcu(&test->list);
 			trace_event_trigger_enable_disable(file, 0);
 			update_cond_flag(file);
@@ -1572,6 +2987,10 @@ static int event_hist_trigger_func(struct event_command *cmd_ops,
 	}
 
 	if (glob[0] == '!') {
+		if (hist_trigger_referenced(trigger_data, file)) {
+			ret = -EBUSY;
+			goto out_free;
+		}
 		cmd_ops->unreg(glob+1, trigger_ops, trigger_data, file);
 		ret = 0;
 		goto out_free;
@@ -1755,3 +3174,31 @@ __init int register_trigger_hist_enable_disable_cmds(void)
 
 	return ret;
 }
+
+static __init int trace_events_hist_init(void)
+{
+	struct dentry *entry = NULL;
+	struct dentry *d_tracer;
+	int err = 0;
+
+	d_tracer = tracing_init_dentry();
+	if (IS_ERR(d_tracer)) {
+		err = PTR_ERR(d_tracer);
+		goto err;
+	}
+
+	entry = tracefs_create_file("synthetic_events", 0644, d_tracer,
+				    NULL, &synth_events_fops);
+	if (!entry) {
+		err = -ENODEV;
+		goto err;
+	}
+
+	return err;
+ err:
+	pr_warn("Could not create tracefs 'synthetic_events' entry\n");
+
+	return err;
+}
+
+fs_initcall(trace_events_hist_init);
@@ -27,6 +27,7 @@
 #include <linux/export.h>
 #include <linux/kernel.h>
 #include <linux/sched.h>
+#include <linux/sched/topology.h>
 #include <linux/init.h>
 #include <linux/signal.h>
 #include <linux/completion.h>
@@ -52,6 +53,7 @@
 #include <linux/delay.h>
 #include <linux/nmi.h>
 #include <linux/kvm_para.h>
+#include <linux/topology.h>
 
 #include "workqueue_internal.h"
 
@@ -279,9 +281,19 @@ struct workqueue_struct {
 	/* hot fields used during command issue, aligned to cacheline */
 	unsigned int		flags ____cacheline_aligned; /* WQ: WQ_* flags */
 	struct pool_workqueue __percpu *cpu_pwqs; /* I: per-cpu pwqs */
+	struct wq_cluster_pwqs __rcu *cluster_pwqs; /* PWR: latency critical only */
 	struct pool_workqueue __rcu *numa_pwq_tbl[]; /* PWR: unbound pwqs indexed by node */
 };
 
+/*
+ * The unbound pwqs of a latency critical workqueue indexed by CPU cluster.
+ * Replaced as a whole and freed after a sched RCU grace period.
+ */
+struct wq_cluster_pwqs {
+	struct rcu_head		rcu;
+	struct pool_workqueue	*pwqs[];
+};
+
 static struct kmem_cache *pwq_cache;
 
 static cpumask_var_t *wq_numa_possible_cpumask;
@@ -298,9 +310,24 @@ static bool wq_online;			/* can kworkers be created yet? */
 
 static bool wq_numa_enabled;		/* unbound NUMA affinity enabled */
 
+static int wq_nr_clusters;		/* CPU clusters, see wq_cluster_init() */
+static DEFINE_PER_CPU(int, wq_cpu_cluster);
+static cpumask_var_t *wq_cluster_possible_cpumask;
+					/* possible CPUs of each cluster */
+
+/* attributes given to WQ_LATENCY_CRITICAL workqueues, see enum wq_capacity */
+static int wq_critical_capacity = WQ_CAPACITY_BIG;
+module_param_named(critical_capacity, wq_critical_capacity, int, 0444);
+
+static int wq_critical_min_idle = 2;
+module_param_named(critical_min_idle, wq_critical_min_idle, int, 0444);
+
 /* buf for wq_update_unbound_numa_attrs(), protected by CPU hotplug exclusion */
 static struct workqueue_attrs *wq_update_unbound_numa_attrs_buf;
 
+/* same for wq_update_unbound_cluster() */
+static struct workqueue_attrs *wq_update_unbound_cluster_attrs_buf;
+
 static DEFINE_MUTEX(wq_pool_mutex);	/* protects pools and workqueues list */
 static DEFINE_SPINLOCK(wq_mayday_lock);	/* protects wq->maydays list */
 static DECLARE_WAIT_QUEUE_HEAD(wq_manager_wait); /* wait for manager to go away */
@@ -579,6 +606,32 @@ static struct pool_workqueue *unbound_pwq_by_node(struct workqueue_struct *wq,
 	return rcu_dereference_raw(wq->numa_pwq_tbl[node]);
 }
 
+/**
+ * unbound_pwq_by_cpu - return the unbound pool_workqueue to use on a CPU
+ * @wq: the target workqueue
+ * @cpu: the CPU work is being queued on
+ *
+ * Latency critical workqueues have a pwq per CPU cluster and use the one
+ * of @cpu's cluster, all others go by @cpu's NUMA node.  Same locking
+ * rules as unbound_pwq_by_node().
+ *
+ * Return: The unbound pool_workqueue for @cpu.
+ */
+static struct pool_workqueue *unbound_pwq_by_cpu(struct workqueue_struct *wq,
+						 int cpu)
+{
+	struct wq_cluster_pwqs *cpwqs;
+
+	assert_rcu_or_wq_mutex_or_pool_mutex(wq);
+
+	cpwqs = rcu_dereference_raw(wq->cluster_pwqs);
+	if (cpwqs)
+		return rcu_dereference_raw(cpwqs->pwqs[per_cpu(wq_cpu_cluster,
+							       cpu)]);
+
+	return unbound_pwq_by_node(wq, cpu_to_node(cpu));
+}
+
 static unsigned int work_color_to_flags(int color)
 {
 	return color << WORK_STRUCT_COLOR_SHIFT;
@@ -813,6 +866,9 @@ static bool too_many_workers(struct worker_pool *pool)
 	int nr_idle = pool->nr_idle + managing; /* manager is considered idle */
 	int nr_busy = pool->nr_workers - nr_idle;
 
+	if (nr_idle <= pool->attrs->min_idle)
+		return false;
+
 	return nr_idle > 2 && (nr_idle - 2) * MAX_IDLE_WORKERS_RATIO >= nr_busy;
 }
 
@@ -1421,7 +1477,7 @@ retry:
 	if (wq->flags & WQ_UNBOUND) {
 		if (req_cpu == WORK_CPU_UNBOUND)
 			cpu = wq_select_unbound_cpu(raw_smp_processor_id());
-		pwq = unbound_pwq_by_node(wq, cpu_to_node(cpu));
+		pwq = unbound_pwq_by_cpu(wq, cpu);
 	} else {
 		if (req_cpu == WORK_CPU_UNBOUND)
 			cpu = raw_smp_processor_id();
@@ -3230,12 +3286,16 @@ static void copy_workqueue_attrs(struct workqueue_attrs *to,
 {
 	to->nice = from->nice;
 	cpumask_copy(to->cpumask, from->cpumask);
+	to->min_idle = from->min_idle;
 	/*
 	 * Unlike hash and equality test, this function doesn't ignore
-	 * ->no_numa as it is used for both pool and wq attrs.  Instead,
-	 * get_unbound_pool() explicitly clears ->no_numa after copying.
+	 * ->no_numa, ->capacity and ->latency as it is used for both pool
+	 * and wq attrs.  Instead, get_unbound_pool() explicitly clears them
+	 * after copying.
 	 */
 	to->no_numa = from->no_numa;
+	to->capacity = from->capacity;
+	to->latency = from->latency;
 }
 
 /* hash value of the content of @attr */
@@ -3244,6 +3304,7 @@ static u32 wqattrs_hash(const struct workqueue_attrs *attrs)
 	u32 hash = 0;
 
 	hash = jhash_1word(attrs->nice, hash);
+	hash = jhash_1word(attrs->min_idle, hash);
 	hash = jhash(cpumask_bits(attrs->cpumask),
 		     BITS_TO_LONGS(nr_cpumask_bits) * sizeof(long), hash);
 	return hash;
@@ -3255,6 +3316,8 @@ static bool wqattrs_equal(const struct workqueue_attrs *a,
 {
 	if (a->nice != b->nice)
 		return false;
+	if (a->min_idle != b->min_idle)
+		return false;
 	if (!cpumask_equal(a->cpumask, b->cpumask))
 		return false;
 	return true;
@@ -3439,17 +3502,26 @@ static struct worker_pool *get_unbound_pool(const struct workqueue_attrs *attrs)
 	pool->node = target_node;
 
 	/*
-	 * no_numa isn't a worker_pool attribute, always clear it.  See
-	 * 'struct workqueue_attrs' comments for detail.
+	 * no_numa, capacity and latency aren't worker_pool attributes,
+	 * always clear them.  See 'struct workqueue_attrs' comments for
+	 * detail.
 	 */
 	pool->attrs->no_numa = false;
+	pool->attrs->capacity = WQ_CAPACITY_ANY;
+	pool->attrs->latency = WQ_LATENCY_CLASS_NORMAL;
 
 	if (worker_pool_assign_id(pool) < 0)
 		goto fail;
 
-	/* create and start the initial worker */
-	if (wq_online && !create_worker(pool))
-		goto fail;
+	/* create and start the initial workers */
+	if (wq_online) {
+		int i = 0;
+
+		do {
+			if (!create_worker(pool))
+				goto fail;
+		} while (++i < pool->attrs->min_idle);
+	}
 
 	/* install */
 	hash_add(unbound_pool_hash, &pool->hash_node, hash);
@@ -3676,6 +3748,115 @@ use_dfl:
 	return false;
 }
 
+#ifdef arch_scale_cpu_capacity
+#define wq_cpu_capacity(cpu)	arch_scale_cpu_capacity(NULL, cpu)
+#else
+#define wq_cpu_capacity(cpu)	SCHED_CAPACITY_SCALE
+#endif
+
+/**
+ * wq_capacity_cpumask - narrow down a cpumask to a CPU capacity class
+ * @capacity: the requested capacity class
+ * @cpumask: the cpumask to restrict, modified in place
+ *
+ * Little CPUs are the ones with the lowest capacity in @cpumask, big CPUs
+ * all the others.  On systems without capacity differences there are no
+ * big CPUs and the result is empty, the caller has to fall back.
+ */
+static void wq_capacity_cpumask(enum wq_capacity capacity,
+				struct cpumask *cpumask)
+{
+	unsigned long min_cap = ULONG_MAX;
+	int cpu;
+
+	if (capacity == WQ_CAPACITY_ANY)
+		return;
+
+	for_each_cpu(cpu, cpumask)
+		min_cap = min_t(unsigned long, min_cap, wq_cpu_capacity(cpu));
+
+	for_each_cpu(cpu, cpumask) {
+		bool little = wq_cpu_capacity(cpu) == min_cap;
+
+		if (little != (capacity == WQ_CAPACITY_LITTLE))
+			cpumask_clear_cpu(cpu, cpumask);
+	}
+}
+
+/**
+ * wq_calc_cluster_cpumask - calculate a wq_attrs' cpumask for a CPU cluster
+ * @attrs: the wq_attrs of the default pwq of the target workqueue
+ * @cluster: the target cluster
+ * @cpu_going_down: if >= 0, the CPU to consider as offline
+ * @cpumask: outarg, the resulting cpumask
+ *
+ * The cluster counterpart of wq_calc_node_cpumask().  If @cluster has
+ * online CPUs requested by @attrs, the result is the intersection of its
+ * possible CPUs with @attrs->cpumask, otherwise it is @attrs->cpumask.
+ *
+ * Return: %true if the resulting @cpumask is different from @attrs->cpumask,
+ * %false if equal.
+ */
+static bool wq_calc_cluster_cpumask(const struct workqueue_attrs *attrs,
+				    int cluster, int cpu_going_down,
+				    cpumask_t *cpumask)
+{
+	/* does @cluster have any online CPUs @attrs wants? */
+	cpumask_and(cpumask, attrs->cpumask,
+		    wq_cluster_possible_cpumask[cluster]);
+	cpumask_and(cpumask, cpumask, cpu_online_mask);
+	if (cpu_going_down >= 0)
+		cpumask_clear_cpu(cpu_going_down, cpumask);
+
+	if (cpumask_empty(cpumask)) {
+		cpumask_copy(cpumask, attrs->cpumask);
+		return false;
+	}
+
+	/* yeap, return possible CPUs in @cluster that @attrs wants */
+	cpumask_and(cpumask, attrs->cpumask,
+		    wq_cluster_possible_cpumask[cluster]);
+
+	return !cpumask_equal(cpumask, attrs->cpumask);
+}
+
+static void rcu_free_cluster_pwqs(struct rcu_head *rcu)
+{
+	kfree(container_of(rcu, struct wq_cluster_pwqs, rcu));
+}
+
+/* put the pwqs of @cpwqs and free it once sched RCU readers are done */
+static void put_cluster_pwqs_unlocked(struct wq_cluster_pwqs *cpwqs)
+{
+	int cluster;
+
+	if (!cpwqs)
+		return;
+
+	for (cluster = 0; cluster < wq_nr_clusters; cluster++)
+		put_pwq_unlocked(cpwqs->pwqs[cluster]);
+	call_rcu_sched(&cpwqs->rcu, rcu_free_cluster_pwqs);
+}
+
+/* install @pwq into @cpwqs of @wq for @cluster and return the old pwq */
+static struct pool_workqueue *
+cluster_pwq_tbl_install(struct workqueue_struct *wq,
+			struct wq_cluster_pwqs *cpwqs, int cluster,
+			struct pool_workqueue *pwq)
+{
+	struct pool_workqueue *old_pwq;
+
+	lockdep_assert_held(&wq_pool_mutex);
+	lockdep_assert_held(&wq->mutex);
+
+	/* link_pwq() can handle duplicate calls */
+	link_pwq(pwq);
+
+	old_pwq = cpwqs->pwqs[cluster];
+	rcu_assign_pointer(cpwqs->pwqs[cluster], pwq);
+	return old_pwq;
+}
+
 /* install @pwq into @wq's numa_pwq_tbl[] for @node and return the old pwq */
 static struct pool_workqueue *numa_pwq_tbl_install(struct workqueue_struct *wq,
 						   int node,
@@ -3700,6 +3881,7 @@ struct apply_wqattrs_ctx {
 	struct workqueue_attrs	*attrs;		/* attrs to apply */
 	struct list_head	list;		/* queued for batching commit */
 	struct pool_workqueue	*dfl_pwq;
+	struct wq_cluster_pwqs	*cluster_pwqs;
 	struct pool_workqueue	*pwq_tbl[];
 };
 
@@ -3711,6 +3893,7 @@ static void apply_wqattrs_cleanup(struct apply_wqattrs_ctx *ctx)
 
 		for_each_node(node)
 			put_pwq_unlocked(ctx->pwq_tbl[node]);
+		put_cluster_pwqs_unlocked(ctx->cluster_pwqs);
 		put_pwq_unlocked(ctx->dfl_pwq);
 
 		free_workqueue_attrs(ctx->attrs);
@@ -3726,7 +3909,7 @@ apply_wqattrs_prepare(struct workqueue_struct *wq,
 {
 	struct apply_wqattrs_ctx *ctx;
 	struct workqueue_attrs *new_attrs, *tmp_attrs;
-	int node;
+	int node, cluster;
 
 	lockdep_assert_held(&wq_pool_mutex);
 
@@ -3748,6 +3931,15 @@ apply_wqattrs_prepare(struct workqueue_struct *wq,
 	if (unlikely(cpumask_empty(new_attrs->cpumask)))
 		cpumask_copy(new_attrs->cpumask, wq_unbound_cpumask);
 
+	/*
+	 * Narrow it down to the requested CPU capacity class, unless there
+	 * are no such CPUs in the mask.
+	 */
+	cpumask_copy(tmp_attrs->cpumask, new_attrs->cpumask);
+	wq_capacity_cpumask(new_attrs->capacity, tmp_attrs->cpumask);
+	if (!cpumask_empty(tmp_attrs->cpumask))
+		cpumask_copy(new_attrs->cpumask, tmp_attrs->cpumask);
+
 	/*
 	 * We may create multiple pwqs with differing cpumasks.  Make a
 	 * copy of @new_attrs which will be modified and used to obtain
@@ -3775,6 +3967,32 @@ apply_wqattrs_prepare(struct workqueue_struct *wq,
 		}
 	}
 
+	/* latency critical workqueues get a pwq per CPU cluster on top */
+	if (new_attrs->latency == WQ_LATENCY_CLASS_CRITICAL &&
+	    wq_nr_clusters > 1) {
+		ctx->cluster_pwqs = kzalloc(sizeof(*ctx->cluster_pwqs) +
+					    wq_nr_clusters *
+					    sizeof(ctx->cluster_pwqs->pwqs[0]),
+					    GFP_KERNEL);
+		if (!ctx->cluster_pwqs)
+			goto out_free;
+
+		for (cluster = 0; cluster < wq_nr_clusters; cluster++) {
+			struct pool_workqueue **pwqp =
+				&ctx->cluster_pwqs->pwqs[cluster];
+
+			if (wq_calc_cluster_cpumask(new_attrs, cluster, -1,
+						    tmp_attrs->cpumask)) {
+				*pwqp = alloc_unbound_pwq(wq, tmp_attrs);
+				if (!*pwqp)
+					goto out_free;
+			} else {
+				ctx->dfl_pwq->refcnt++;
+				*pwqp = ctx->dfl_pwq;
+			}
+		}
+	}
+
 	/* save the user configured attrs and sanitize it. */
 	copy_workqueue_attrs(new_attrs, attrs);
 	cpumask_and(new_attrs->cpumask, new_attrs->cpumask, cpu_possible_mask);
@@ -3794,7 +4012,8 @@ out_free:
 /* set attrs and install prepared pwqs, @ctx points to old pwqs on return */
 static void apply_wqattrs_commit(struct apply_wqattrs_ctx *ctx)
 {
-	int node;
+	struct wq_cluster_pwqs *cpwqs;
+	int node, cluster;
 
 	/* all pwqs have been created successfully, let's install'em */
 	mutex_lock(&ctx->wq->mutex);
@@ -3806,6 +4025,14 @@ static void apply_wqattrs_commit(struct apply_wqattrs_ctx *ctx)
 		ctx->pwq_tbl[node] = numa_pwq_tbl_install(ctx->wq, node,
 							  ctx->pwq_tbl[node]);
 
+	/* same for the per-cluster pwqs, which are swapped as a whole */
+	if (ctx->cluster_pwqs)
+		for (cluster = 0; cluster < wq_nr_clusters; cluster++)
+			link_pwq(ctx->cluster_pwqs->pwqs[cluster]);
+	cpwqs = rcu_access_pointer(ctx->wq->cluster_pwqs);
+	rcu_assign_pointer(ctx->wq->cluster_pwqs, ctx->cluster_pwqs);
+	ctx->cluster_pwqs = cpwqs;
+
 	/* @dfl_pwq might not have been used, ensure it's linked */
 	link_pwq(ctx->dfl_pwq);
 	swap(ctx->wq->dfl_pwq, ctx->dfl_pwq);
@@ -3967,6 +4194,76 @@ out_unlock:
 	put_pwq_unlocked(old_pwq);
 }
 
+/**
+ * wq_update_unbound_cluster - update cluster affinity of a wq for CPU hot[un]plug
+ * @wq: the target workqueue
+ * @cpu: the CPU coming up or going down
+ * @online: whether @cpu is coming up or going down
+ *
+ * The cluster counterpart of wq_update_unbound_numa() for latency critical
+ * workqueues: the pwq of @cpu's cluster is recomputed so that it doesn't
+ * keep a cpumask without online CPUs, and falls back to @wq->dfl_pwq
+ * while the cluster is offline or if allocation fails.  The per-cluster
+ * table isn't replaced, only its entry for @cpu's cluster.
+ */
+static void wq_update_unbound_cluster(struct workqueue_struct *wq, int cpu,
+				      bool online)
+{
+	int cluster = per_cpu(wq_cpu_cluster, cpu);
+	int cpu_off = online ? -1 : cpu;
+	struct pool_workqueue *old_pwq = NULL, *pwq;
+	struct workqueue_attrs *target_attrs;
+	struct wq_cluster_pwqs *cpwqs;
+	cpumask_t *cpumask;
+
+	lockdep_assert_held(&wq_pool_mutex);
+
+	if (!(wq->flags & WQ_UNBOUND))
+		return;
+
+	cpwqs = rcu_dereference_protected(wq->cluster_pwqs,
+					  lockdep_is_held(&wq_pool_mutex));
+	if (!cpwqs)
+		return;
+
+	target_attrs = wq_update_unbound_cluster_attrs_buf;
+	cpumask = target_attrs->cpumask;
+
+	copy_workqueue_attrs(target_attrs, wq->unbound_attrs);
+	pwq = cpwqs->pwqs[cluster];
+
+	if (wq_calc_cluster_cpumask(wq->dfl_pwq->pool->attrs, cluster, cpu_off,
+				    cpumask)) {
+		if (cpumask_equal(cpumask, pwq->pool->attrs->cpumask))
+			return;
+	} else {
+		goto use_dfl_pwq;
+	}
+
+	/* create a new pwq */
+	pwq = alloc_unbound_pwq(wq, target_attrs);
+	if (!pwq) {
+		pr_warn("workqueue: allocation failed while updating cluster affinity of \"%s\"\n",
+			wq->name);
+		goto use_dfl_pwq;
+	}
+
+	/* Install the new pwq. */
+	mutex_lock(&wq->mutex);
+	old_pwq = cluster_pwq_tbl_install(wq, cpwqs, cluster, pwq);
+	goto out_unlock;
+
+use_dfl_pwq:
+	mutex_lock(&wq->mutex);
+	spin_lock_irq(&wq->dfl_pwq->pool->lock);
+	get_pwq(wq->dfl_pwq);
+	spin_unlock_irq(&wq->dfl_pwq->pool->lock);
+	old_pwq = cluster_pwq_tbl_install(wq, cpwqs, cluster, wq->dfl_pwq);
+out_unlock:
+	mutex_unlock(&wq->mutex);
+	put_pwq_unlocked(old_pwq);
+}
+
 static int alloc_and_link_pwqs(struct workqueue_struct *wq)
 {
 	bool highpri = wq->flags & WQ_HIGHPRI;
@@ -3997,6 +4294,21 @@ static int alloc_and_link_pwqs(struct workqueue_struct *wq)
 			      wq->pwqs.prev != &wq->dfl_pwq->pwqs_node),
 		     "ordering guarantee broken for workqueue %s\n", wq->name);
 		return ret;
+	} else if (wq->flags & WQ_LATENCY_CRITICAL) {
+		struct workqueue_attrs *attrs;
+
+		attrs = alloc_workqueue_attrs(GFP_KERNEL);
+		if (!attrs)
+			return -ENOMEM;
+
+		copy_workqueue_attrs(attrs, unbound_std_wq_attrs[highpri]);
+		attrs->capacity = clamp(wq_critical_capacity, WQ_CAPACITY_ANY,
+					WQ_CAPACITY_BIG);
+		attrs->latency = WQ_LATENCY_CLASS_CRITICAL;
+		attrs->min_idle = clamp(wq_critical_min_idle, 0, WQ_MAX_ACTIVE);
+		ret = apply_workqueue_attrs(wq, attrs);
+		free_workqueue_attrs(attrs);
+		return ret;
 	} else {
 		return apply_workqueue_attrs(wq, unbound_std_wq_attrs[highpri]);
 	}
@@ -4149,6 +4461,7 @@ EXPORT_SYMBOL_GPL(__alloc_workqueue_key);
  */
 void destroy_workqueue(struct workqueue_struct *wq)
 {
+	struct wq_cluster_pwqs *cpwqs;
 	struct pool_workqueue *pwq;
 	int node;
 
@@ -4224,6 +4537,10 @@ void destroy_workqueue(struct workqueue_struct *wq)
 			put_pwq_unlocked(pwq);
 		}
 
+		cpwqs = rcu_access_pointer(wq->cluster_pwqs);
+		RCU_INIT_POINTER(wq->cluster_pwqs, NULL);
+		put_cluster_pwqs_unlocked(cpwqs);
+
 		/*
 		 * Put dfl_pwq.  @wq may be freed any time after dfl_pwq is
 		 * put.  Don't access it afterwards.
@@ -4329,7 +4646,7 @@ bool workqueue_congested(int cpu, struct workqueue_struct *wq)
 	if (!(wq->flags & WQ_UNBOUND))
 		pwq = per_cpu_ptr(wq->cpu_pwqs, cpu);
 	else
-		pwq = unbound_pwq_by_node(wq, cpu_to_node(cpu));
+		pwq = unbound_pwq_by_cpu(wq, cpu);
 
 	ret = !list_empty(&pwq->delayed_works);
 	rcu_read_unlock_sched();
@@ -4827,9 +5144,11 @@ int workqueue_online_cpu(unsigned int cpu)
 		mutex_unlock(&pool->attach_mutex);
 	}
 
-	/* update NUMA affinity of unbound workqueues */
-	list_for_each_entry(wq, &workqueues, list)
+	/* update NUMA and cluster affinity of unbound workqueues */
+	list_for_each_entry(wq, &workqueues, list) {
 		wq_update_unbound_numa(wq, cpu, true);
+		wq_update_unbound_cluster(wq, cpu, true);
+	}
 
 	mutex_unlock(&wq_pool_mutex);
 	return 0;
@@ -4845,10 +5164,12 @@ int workqueue_offline_cpu(unsigned int cpu)
 
 	unbind_workers(cpu);
 
-	/* update NUMA affinity of unbound workqueues */
+	/* update NUMA and cluster affinity of unbound workqueues */
 	mutex_lock(&wq_pool_mutex);
-	list_for_each_entry(wq, &workqueues, list)
+	list_for_each_entry(wq, &workqueues, list) {
 		wq_update_unbound_numa(wq, cpu, false);
+		wq_update_unbound_cluster(wq, cpu, false);
+	}
 	mutex_unlock(&wq_pool_mutex);
 
 	return 0;
@@ -5324,11 +5645,143 @@ out_unlock:
 	return ret ?: count;
 }
 
+static const char * const wq_capacity_names[] = {
+	[WQ_CAPACITY_ANY]	= "any",
+	[WQ_CAPACITY_LITTLE]	= "little",
+	[WQ_CAPACITY_BIG]	= "big",
+};
+
+static ssize_t wq_capacity_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int written;
+
+	mutex_lock(&wq->mutex);
+	written = scnprintf(buf, PAGE_SIZE, "%s\n",
+			    wq_capacity_names[wq->unbound_attrs->capacity]);
+	mutex_unlock(&wq->mutex);
+
+	return written;
+}
+
+static ssize_t wq_capacity_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int v, ret = -ENOMEM;
+
+	apply_wqattrs_lock();
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		goto out_unlock;
+
+	v = sysfs_match_string(wq_capacity_names, buf);
+	if (v >= 0) {
+		attrs->capacity = v;
+		ret = apply_workqueue_attrs_locked(wq, attrs);
+	} else {
+		ret = v;
+	}
+
+out_unlock:
+	apply_wqattrs_unlock();
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
+static ssize_t wq_latency_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int written;
+
+	mutex_lock(&wq->mutex);
+	written = scnprintf(buf, PAGE_SIZE, "%d\n",
+			    wq->unbound_attrs->latency == WQ_LATENCY_CLASS_CRITICAL);
+	mutex_unlock(&wq->mutex);
+
+	return written;
+}
+
+static ssize_t wq_latency_store(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int v, ret = -ENOMEM;
+
+	apply_wqattrs_lock();
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		goto out_unlock;
+
+	ret = -EINVAL;
+	if (sscanf(buf, "%d", &v) == 1) {
+		attrs->latency = v ? WQ_LATENCY_CLASS_CRITICAL :
+				     WQ_LATENCY_CLASS_NORMAL;
+		ret = apply_workqueue_attrs_locked(wq, attrs);
+	}
+
+out_unlock:
+	apply_wqattrs_unlock();
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
+static ssize_t wq_min_idle_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int written;
+
+	mutex_lock(&wq->mutex);
+	written = scnprintf(buf, PAGE_SIZE, "%d\n",
+			    wq->unbound_attrs->min_idle);
+	mutex_unlock(&wq->mutex);
+
+	return written;
+}
+
+static ssize_t wq_min_idle_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int ret = -ENOMEM;
+
+	apply_wqattrs_lock();
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		goto out_unlock;
+
+	if (sscanf(buf, "%d", &attrs->min_idle) == 1 &&
+	    attrs->min_idle >= 0 && attrs->min_idle <= WQ_MAX_ACTIVE)
+		ret = apply_workqueue_attrs_locked(wq, attrs);
+	else
+		ret = -EINVAL;
+
+out_unlock:
+	apply_wqattrs_unlock();
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
 static struct device_attribute wq_sysfs_unbound_attrs[] = {
 	__ATTR(pool_ids, 0444, wq_pool_ids_show, NULL),
 	__ATTR(nice, 0644, wq_nice_show, wq_nice_store),
 	__ATTR(cpumask, 0644, wq_cpumask_show, wq_cpumask_store),
 	__ATTR(numa, 0644, wq_numa_show, wq_numa_store),
+	__ATTR(capacity, 0644, wq_capacity_show, wq_capacity_store),
+	__ATTR(latency_critical, 0644, wq_latency_show, wq_latency_store),
+	__ATTR(min_idle, 0644, wq_min_idle_show, wq_min_idle_store),
 	__ATTR_NULL,
 };
 
@@ -5677,6 +6130,48 @@ static void __init wq_numa_init(void)
 	wq_numa_enabled = true;
 }
 
+/*
+ * Group the possible CPUs into clusters by physical package id, which is
+ * the cluster on arm64.  Like NUMA init this has to wait for the topology
+ * to be parsed.  Latency critical workqueues created before this point
+ * only get per-cluster pwqs once their attributes are applied again.
+ */
+static void __init wq_cluster_init(void)
+{
+	cpumask_var_t *tbl;
+	int *ids, cpu, cluster;
+
+	tbl = kcalloc(nr_cpu_ids, sizeof(tbl[0]), GFP_KERNEL);
+	ids = kcalloc(nr_cpu_ids, sizeof(ids[0]), GFP_KERNEL);
+	BUG_ON(!tbl || !ids);
+
+	for_each_possible_cpu(cpu) {
+		int id = topology_physical_package_id(cpu);
+
+		for (cluster = 0; cluster < wq_nr_clusters; cluster++)
+			if (ids[cluster] == id)
+				break;
+
+		if (cluster == wq_nr_clusters) {
+			BUG_ON(!zalloc_cpumask_var(&tbl[cluster], GFP_KERNEL));
+			ids[cluster] = id;
+			wq_nr_clusters++;
+		}
+
+		cpumask_set_cpu(cpu, tbl[cluster]);
+		per_cpu(wq_cpu_cluster, cpu) = cluster;
+	}
+
+	kfree(ids);
+	wq_cluster_possible_cpumask = tbl;
+
+	if (wq_nr_clusters > 1) {
+		wq_update_unbound_cluster_attrs_buf =
+			alloc_workqueue_attrs(GFP_KERNEL);
+		BUG_ON(!wq_update_unbound_cluster_attrs_buf);
+	}
+}
+
 /**
  * workqueue_init_early - early init for workqueue subsystem
  *
@@ -5782,6 +6277,7 @@ int __init workqueue_init(void)
 	 * Also, while iterating workqueues, create rescuers if requested.
 	 */
 	wq_numa_init();
+	wq_cluster_init();
 
 	mutex_lock(&wq_pool_mutex);
 
@@ -5808,8 +6304,13 @@ int __init workqueue_init(void)
 		}
 	}
 
-	hash_for_each(unbound_pool_hash, bkt, pool, hash_node)
-		BUG_ON(!create_worker(pool));
+	hash_for_each(unbound_pool_hash, bkt, pool, hash_node) {
+		int i = 0;
+
+		do {
+			BUG_ON(!create_worker(pool));
+		} while (++i < pool->attrs->min_idle);
+	}
 
 	wq_online = true;
 	wq_watchdog_init();
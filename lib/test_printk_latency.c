@@ -0,0 +1,211 @@
+/*
+ * Kernel module measuring printk() and console output latency.
+ *
+ * A kthread on every online CPU logs nr_msgs messages, and a dummy
+ * console notes when each of them arrives.  With hogs=1 a busy SCHED_NORMAL
+ * kthread runs on every CPU at the same time.  The module reports the time
+ * spent in printk() by the callers and the time from printk() to console
+ * output, then fails to load so that it can be run again right away.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/console.h>
+#include <linux/cpu.h>
+#include <linux/delay.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/sort.h>
+#include <linux/vmalloc.h>
+
+static unsigned int nr_msgs = 200;
+module_param(nr_msgs, uint, 0444);
+MODULE_PARM_DESC(nr_msgs, "messages logged per CPU");
+
+static bool hogs;
+module_param(hogs, bool, 0444);
+MODULE_PARM_DESC(hogs, "keep every CPU busy while logging");
+
+#define MARKER	"printk_lat seq="
+
+static unsigned int nr_total;
+static atomic_t next_seq;
+static atomic_t nr_delivered;
+static atomic_t nr_loggers_done;
+static u64 *sent_ns;
+static u64 *call_ns;
+static u64 *deliver_ns;
+static bool hogs_stop;
+
+/* Called with the console lock held, so the updates are serialized. */
+static void lat_console_write(struct console *con, const char *text,
+			      unsigned int len)
+{
+	char buf[64];
+	const char *p;
+	unsigned int seq;
+
+	len = min_t(unsigned int, len, sizeof(buf) - 1);
+	memcpy(buf, text, len);
+	buf[len] = '\0';
+
+	p = strstr(buf, MARKER);
+	if (!p || kstrtouint(p + strlen(MARKER), 10, &seq) || seq >= nr_total)
+		return;
+	if (READ_ONCE(sent_ns[seq]) && !deliver_ns[seq]) {
+		deliver_ns[seq] = ktime_get_ns() - READ_ONCE(sent_ns[seq]);
+		atomic_inc(&nr_delivered);
+	}
+}
+
+static struct console lat_console = {
+	.name	= "printklat",
+	.write	= lat_console_write,
+	.flags	= CON_ENABLED,
+	.index	= -1,
+};
+
+static int lat_logger(void *data)
+{
+	unsigned int i, seq;
+	u64 start;
+
+	for (i = 0; i < nr_msgs; i++) {
+		seq = atomic_inc_return(&next_seq) - 1;
+		start = ktime_get_ns();
+		WRITE_ONCE(sent_ns[seq], start);
+		pr_err(MARKER "%u\n", seq);
+		call_ns[seq] = ktime_get_ns() - start;
+		usleep_range(500, 1500);
+	}
+	atomic_inc(&nr_loggers_done);
+
+	/* kthread_stop() must find us still running */
+	while (!kthread_should_stop())
+		schedule_timeout_interruptible(1);
+	return 0;
+}
+
+static int lat_hog(void *data)
+{
+	while (!READ_ONCE(hogs_stop)) {
+		cpu_relax();
+		cond_resched();
+	}
+	while (!kthread_should_stop())
+		schedule_timeout_interruptible(1);
+	return 0;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void lat_report(const char *what, u64 *ns, unsigned int nr)
+{
+	u64 total = 0;
+	unsigned int i;
+
+	if (!nr) {
+		pr_info("%s: no samples\n", what);
+		return;
+	}
+	sort(ns, nr, sizeof(*ns), cmp_u64, NULL);
+	for (i = 0; i < nr; i++)
+		total += ns[i];
+	pr_info("%s: %u samples, avg %llu us, p50 %llu us, p99 %llu us, max %llu us\n",
+		what, nr, div_u64(total, nr) / 1000, ns[nr / 2] / 1000,
+		ns[nr * 99 / 100] / 1000, ns[nr - 1] / 1000);
+}
+
+static int __init test_printk_latency_init(void)
+{
+	struct task_struct **loggers, **hog_tasks;
+	unsigned int cpu, i, nr_cpus, nr_loggers = 0, delivered = 0;
+	int timeout;
+
+	get_online_cpus();
+	nr_cpus = num_online_cpus();
+	nr_total = nr_cpus * nr_msgs;
+
+	sent_ns = vzalloc(array_size(nr_total, sizeof(u64)));
+	call_ns = vzalloc(array_size(nr_total, sizeof(u64)));
+	deliver_ns = vzalloc(array_size(nr_total, sizeof(u64)));
+	loggers = kcalloc(nr_cpu_ids, sizeof(*loggers), GFP_KERNEL);
+	hog_tasks = kcalloc(nr_cpu_ids, sizeof(*hog_tasks), GFP_KERNEL);
+	if (!sent_ns || !call_ns || !deliver_ns || !loggers || !hog_tasks)
+		goto out;
+
+	register_console(&lat_console);
+
+	for_each_online_cpu(cpu) {
+		if (hogs) {
+			hog_tasks[cpu] = kthread_create(lat_hog, NULL,
+							"printk_hog/%u", cpu);
+			if (!IS_ERR(hog_tasks[cpu])) {
+				kthread_bind(hog_tasks[cpu], cpu);
+				wake_up_process(hog_tasks[cpu]);
+			}
+		}
+		loggers[cpu] = kthread_create(lat_logger, NULL,
+					      "printk_lat/%u", cpu);
+		if (!IS_ERR(loggers[cpu])) {
+			kthread_bind(loggers[cpu], cpu);
+			wake_up_process(loggers[cpu]);
+			nr_loggers++;
+		}
+	}
+
+	while (atomic_read(&nr_loggers_done) < nr_loggers)
+		msleep(10);
+	for_each_online_cpu(cpu) {
+		if (!IS_ERR_OR_NULL(loggers[cpu]))
+			kthread_stop(loggers[cpu]);
+	}
+
+	/* Give the consoles up to ten seconds to catch up. */
+	for (timeout = 1000; timeout > 0; timeout--) {
+		if (atomic_read(&nr_delivered) >= atomic_read(&next_seq))
+			break;
+		msleep(10);
+	}
+
+	WRITE_ONCE(hogs_stop, true);
+	for_each_online_cpu(cpu) {
+		if (!IS_ERR_OR_NULL(hog_tasks[cpu]))
+			kthread_stop(hog_tasks[cpu]);
+	}
+
+	unregister_console(&lat_console);
+
+	/* Compact the delivered samples to the front for sorting. */
+	for (i = 0; i < nr_total; i++)
+		if (deliver_ns[i])
+			deliver_ns[delivered++] = deliver_ns[i];
+
+	pr_info("%u CPUs, %s\n", nr_cpus, hogs ? "all CPUs busy" : "idle");
+	lat_report("printk() call", call_ns, atomic_read(&next_seq));
+	lat_report("printk() to console", deliver_ns, delivered);
+	if (delivered < atomic_read(&next_seq))
+		pr_info("%u messages not printed to the console in time\n",
+			atomic_read(&next_seq) - delivered);
+
+out:
+	put_online_cpus();
+	kfree(hog_tasks);
+	kfree(loggers);
+	vfree(deliver_ns);
+	vfree(call_ns);
+	vfree(sent_ns);
+	return -EAGAIN;
+}
+
+module_init(test_printk_latency_init);
+MODULE_LICENSE("GPL");
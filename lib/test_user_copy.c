@@ -18,9 +18,11 @@
 
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
+#include <linux/ktime.h>
 #include <linux/mman.h>
 #include <linux/module.h>
 #include <linux/sched.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
 #include <linux/vmalloc.h>
@@ -169,13 +171,124 @@ out_free:
 	return ret;
 }
 
+/* Size of the buffers for the large copy and throughput tests */
+#define TEST_LARGE_SIZE		SZ_1M
+
+static bool perf;
+module_param(perf, bool, 0444);
+MODULE_PARM_DESC(perf, "measure copy_{to,from}_user() throughput");
+
+/*
+ * Large copies may take a different path than small ones (non-temporal
+ * loads and stores on arm64), so check the data and the fault fixup at
+ * odd sizes and alignments around and well above the small sizes.
+ */
+static int test_large_copies(char *kmem, char __user *umem)
+{
+	static const size_t sizes[] = {
+		SZ_4K - 1, SZ_16K + 127, SZ_16K + 128, SZ_16K + 200,
+		SZ_64K + 63, SZ_256K + 17, TEST_LARGE_SIZE - 64,
+	};
+	char *kcopy = kmem + TEST_LARGE_SIZE;
+	size_t i, off, size;
+	int ret = 0;
+
+	for (i = 0; i < TEST_LARGE_SIZE; i++)
+		kmem[i] = i * 7 + i / 4096;
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		for (off = 0; off < 64; off += 13) {
+			size = sizes[i];
+			if (off + size > TEST_LARGE_SIZE)
+				size = TEST_LARGE_SIZE - off;
+
+			ret |= test(copy_to_user(umem + off, kmem, size),
+				    "legitimate large copy_to_user failed (size=%zu, off=%zu)",
+				    size, off);
+			memset(kcopy, 0, size);
+			ret |= test(copy_from_user(kcopy, umem + off, size),
+				    "legitimate large copy_from_user failed (size=%zu, off=%zu)",
+				    size, off);
+			ret |= test(memcmp(kmem, kcopy, size),
+				    "large usercopy failed to copy data (size=%zu, off=%zu)",
+				    size, off);
+		}
+	}
+
+	return ret;
+}
+
+/*
+ * Run into an unmapped page: whatever is reported as copied must have been
+ * copied, and no more than the mapped part can be.  Unmaps the last page of
+ * @umem.
+ */
+static int test_large_copy_fault(char *kmem, char __user *umem)
+{
+	char *kcopy = kmem + TEST_LARGE_SIZE;
+	unsigned long left;
+	size_t size;
+	int ret = 0;
+
+	size = TEST_LARGE_SIZE - 5;
+	ret |= test(copy_to_user(umem + 5, kmem, size - PAGE_SIZE),
+		    "legitimate large copy_to_user failed");
+	vm_munmap((unsigned long)umem + TEST_LARGE_SIZE - PAGE_SIZE, PAGE_SIZE);
+	memset(kcopy, 0, TEST_LARGE_SIZE);
+
+	left = copy_to_user(umem + 5, kmem, size);
+	ret |= test(left < PAGE_SIZE || left > size,
+		    "large copy_to_user into unmapped page returned %lu", left);
+
+	left = copy_from_user(kcopy, umem + 5, size);
+	ret |= test(left < PAGE_SIZE || left > size,
+		    "large copy_from_user from unmapped page returned %lu", left);
+	ret |= test(memcmp(kmem, kcopy, size - left),
+		    "large copy_from_user before unmapped page failed to copy data");
+	ret |= test(!is_zeroed(kcopy + size - left, left),
+		    "zeroing failure for large copy_from_user from unmapped page");
+
+	return ret;
+}
+
+static void test_copy_speed(char *kmem, char __user *umem)
+{
+	size_t size, i, loops;
+	u64 to_ns, from_ns, start;
+	unsigned long left = 0;
+
+	for (size = 64; size <= TEST_LARGE_SIZE; size *= 4) {
+		/* Move 256MB each way */
+		loops = SZ_256M / size;
+
+		start = ktime_get_ns();
+		for (i = 0; i < loops; i++)
+			left |= copy_to_user(umem, kmem, size);
+		to_ns = ktime_get_ns() - start;
+
+		start = ktime_get_ns();
+		for (i = 0; i < loops; i++)
+			left |= copy_from_user(kmem, umem, size);
+		from_ns = ktime_get_ns() - start;
+
+		if (left) {
+			pr_warn("copy of %zu bytes failed\n", size);
+			return;
+		}
+		pr_info("%7zu bytes: copy_to_user %llu MB/s, copy_from_user %llu MB/s\n",
+			size, div64_u64((u64)SZ_256M * 1000, to_ns ?: 1),
+			div64_u64((u64)SZ_256M * 1000, from_ns ?: 1));
+		cond_resched();
+	}
+}
+
 static int __init test_user_copy_init(void)
 {
 	int ret = 0;
-	char *kmem;
-	char __user *usermem;
+	char *kmem, *big_kmem;
+	char __user *usermem, *big_usermem;
 	char *bad_usermem;
-	unsigned long user_addr;
+	unsigned long user_addr, big_user_addr;
 	u8 val_u8;
 	u16 val_u16;
 	u32 val_u32;
@@ -199,6 +312,21 @@ static int __init test_user_copy_init(void)
 	usermem = (char __user *)user_addr;
 	bad_usermem = (char *)user_addr;
 
+	big_kmem = vmalloc(2 * TEST_LARGE_SIZE);
+	big_user_addr = vm_mmap(NULL, 0, TEST_LARGE_SIZE,
+				PROT_READ | PROT_WRITE,
+				MAP_ANONYMOUS | MAP_PRIVATE, 0);
+	if (!big_kmem || big_user_addr >= (unsigned long)(TASK_SIZE)) {
+		pr_warn("Failed to allocate large copy buffers\n");
+		if (big_user_addr < (unsigned long)(TASK_SIZE))
+			vm_munmap(big_user_addr, TEST_LARGE_SIZE);
+		vfree(big_kmem);
+		vm_munmap(user_addr, PAGE_SIZE * 2);
+		kfree(kmem);
+		return -ENOMEM;
+	}
+	big_usermem = (char __user *)big_user_addr;
+
 	/*
 	 * Legitimate usage: none of these copies should fail.
 	 */
@@ -240,6 +368,8 @@ static int __init test_user_copy_init(void)
 	ret |= test_check_nonzero_user(kmem, usermem, 2 * PAGE_SIZE);
 	/* Test usage of copy_struct_from_user(). */
 	ret |= test_copy_struct_from_user(kmem, usermem, 2 * PAGE_SIZE);
+	/* Test copies that take the large copy path. */
+	ret |= test_large_copies(big_kmem, big_usermem);
 
 	/*
 	 * Invalid usage: none of these copies should succeed.
@@ -299,8 +429,14 @@ static int __init test_user_copy_init(void)
 #endif
 #undef test_illegal
 
+	if (perf && !ret)
+		test_copy_speed(big_kmem, big_usermem);
+	ret |= test_large_copy_fault(big_kmem, big_usermem);
+
 	vm_munmap(user_addr, PAGE_SIZE * 2);
+	vm_munmap(big_user_addr, TEST_LARGE_SIZE);
 	kfree(kmem);
+	vfree(big_kmem);
 
 	if (ret == 0) {
 		pr_info("tests passed.\n");
@@ -396,6 +396,30 @@ static bool shmem_confirm_swap(struct address_space *mapping,
 #define SHMEM_HUGE_DENY		(-1)
 #define SHMEM_HUGE_FORCE	(-2)
 
+/*
+ * Files created by memfd_create(MFD_HUGE_PREFERRED) carry VM_HUGEPAGE in
+ * their info->flags and get huge pages within i_size unless shmem_huge is
+ * "deny".
+ */
+static inline bool shmem_huge_preferred(struct inode *inode)
+{
+	return SHMEM_I(inode)->flags & VM_HUGEPAGE;
+}
+
+/*
+ * The huge= policy for @inode: the mount's, or at least within_size for
+ * MFD_HUGE_PREFERRED files, so that a small memfd doesn't take a huge page
+ * on its first write.
+ */
+static inline int shmem_inode_huge(struct inode *inode)
+{
+	int huge = SHMEM_SB(inode->i_sb)->huge;
+
+	if (shmem_huge_preferred(inode) && huge != SHMEM_HUGE_ALWAYS)
+		huge = SHMEM_HUGE_WITHIN_SIZE;
+	return huge;
+}
+
 #ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
 /* ifdef here to avoid bloating shmem.o when not necessary */
 
@@ -1760,7 +1784,7 @@ repeat:
 			goto alloc_nohuge;
 		if (shmem_huge == SHMEM_HUGE_FORCE)
 			goto alloc_huge;
-		switch (sbinfo->huge) {
+		switch (shmem_inode_huge(inode)) {
 			loff_t i_size;
 			pgoff_t off;
 		case SHMEM_HUGE_NEVER:
@@ -1782,6 +1806,8 @@ repeat:
 alloc_huge:
 		page = shmem_alloc_and_acct_page(gfp, inode, index, true);
 		if (IS_ERR(page)) {
+			if (IS_ENABLED(CONFIG_TRANSPARENT_HUGE_PAGECACHE))
+				count_vm_event(THP_FILE_FALLBACK);
 alloc_nohuge:		page = shmem_alloc_and_acct_page(gfp, inode,
 					index, false);
 		}
@@ -2081,7 +2107,8 @@ unsigned long shmem_get_unmapped_area(struct file *file,
 				return addr;
 			sb = shm_mnt->mnt_sb;
 		}
-		if (SHMEM_SB(sb)->huge == SHMEM_HUGE_NEVER)
+		if (SHMEM_SB(sb)->huge == SHMEM_HUGE_NEVER &&
+		    !(file && shmem_huge_preferred(file_inode(file))))
 			return addr;
 	}
 
@@ -3743,7 +3770,8 @@ static int shmem_show_options(struct seq_file *seq, struct dentry *root)
 #define MFD_NAME_PREFIX_LEN (sizeof(MFD_NAME_PREFIX) - 1)
 #define MFD_NAME_MAX_LEN (NAME_MAX - MFD_NAME_PREFIX_LEN)
 
-#define MFD_ALL_FLAGS (MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_HUGETLB)
+#define MFD_ALL_FLAGS (MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_HUGETLB | \
+		       MFD_HUGE_PREFERRED)
 
 SYSCALL_DEFINE2(memfd_create,
 		const char __user *, uname,
@@ -3759,8 +3787,8 @@ SYSCALL_DEFINE2(memfd_create,
 		if (flags & ~(unsigned int)MFD_ALL_FLAGS)
 			return -EINVAL;
 	} else {
-		/* Sealing not supported in hugetlbfs (MFD_HUGETLB) */
-		if (flags & MFD_ALLOW_SEALING)
+		/* Sealing and THP not supported in hugetlbfs (MFD_HUGETLB) */
+		if (flags & (MFD_ALLOW_SEALING | MFD_HUGE_PREFERRED))
 			return -EINVAL;
 		/* Allow huge page size encoding in flags. */
 		if (flags & ~(unsigned int)(MFD_ALL_FLAGS |
@@ -3813,6 +3841,11 @@ SYSCALL_DEFINE2(memfd_create,
 	file->f_mode |= FMODE_LSEEK | FMODE_PREAD | FMODE_PWRITE;
 	file->f_flags |= O_RDWR | O_LARGEFILE;
 
+	if (flags & MFD_HUGE_PREFERRED) {
+		info = SHMEM_I(file_inode(file));
+		info->flags |= VM_HUGEPAGE;
+	}
+
 	if (flags & MFD_ALLOW_SEALING) {
 		/*
 		 * flags check at beginning of function ensures
@@ -4173,7 +4206,6 @@ struct kobj_attribute shmem_enabled_attr =
 bool shmem_huge_enabled(struct vm_area_struct *vma)
 {
 	struct inode *inode = file_inode(vma->vm_file);
-	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
 	loff_t i_size;
 	pgoff_t off;
 
@@ -4181,7 +4213,7 @@ bool shmem_huge_enabled(struct vm_area_struct *vma)
 		return true;
 	if (shmem_huge == SHMEM_HUGE_DENY)
 		return false;
-	switch (sbinfo->huge) {
+	switch (shmem_inode_huge(inode)) {
 		case SHMEM_HUGE_NEVER:
 			return false;
 		case SHMEM_HUGE_ALWAYS:
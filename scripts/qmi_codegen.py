@@ -0,0 +1,705 @@
+#!/usr/bin/env python
+# SPDX-License-Identifier: GPL-2.0
+#
+# Generate specialized QMI encoders/decoders from qmi_elem_info tables.
+#
+# The QMI helpers describe every message with a NULL-terminated array of
+# struct qmi_elem_info and interpret that array for each message that is
+# sent or received.  This script parses the static initializers of those
+# arrays out of the C sources at build time and emits one straight-line
+# encode and one decode function per message, with the element types,
+# array kinds and TLV grouping resolved at generation time and only the
+# sizes, offsets and TLV types left as C expressions for the compiler to
+# fold.
+#
+# The generated functions mirror qmi_encode()/qmi_decode() in
+# drivers/soc/qcom/qmi_encdec.c step for step, including their bounds
+# checks and error codes, so a registered codec and the interpreter are
+# interchangeable for every input.  Tables that the generator cannot prove
+# well-formed are left to the interpreter.
+#
+# Usage:
+#   qmi_codegen.py -n NAME -o OUTPUT PRIMARY.c [DEPENDENCY.c ...]
+#
+# Messages are the tables defined in PRIMARY.c that no other table in
+# PRIMARY.c refers to; nested tables may come from any of the inputs.  The
+# output defines "static struct qmi_codec NAME_codecs[]" for registration
+# with qmi_register_codecs().
+
+from __future__ import print_function
+
+import getopt
+import os
+import re
+import sys
+
+FIELDS = ('data_type', 'elem_len', 'elem_size', 'is_array', 'tlv_type',
+          'offset', 'ei_array')
+
+BASIC_TYPES = ('QMI_UNSIGNED_1_BYTE', 'QMI_UNSIGNED_2_BYTE',
+               'QMI_UNSIGNED_4_BYTE', 'QMI_UNSIGNED_8_BYTE',
+               'QMI_SIGNED_2_BYTE_ENUM', 'QMI_SIGNED_4_BYTE_ENUM')
+DATA_TYPES = ('QMI_EOTI', 'QMI_OPT_FLAG', 'QMI_DATA_LEN', 'QMI_STRUCT',
+              'QMI_STRING') + BASIC_TYPES
+ARRAY_TYPES = ('NO_ARRAY', 'STATIC_ARRAY', 'VAR_LEN_ARRAY')
+
+SIZEOF = {
+    'u8': 1, 's8': 1, 'char': 1, 'uint8_t': 1, 'int8_t': 1,
+    'u16': 2, 's16': 2, 'uint16_t': 2, 'int16_t': 2,
+    'u32': 4, 's32': 4, 'uint32_t': 4, 'int32_t': 4,
+    'u64': 8, 's64': 8, 'uint64_t': 8, 'int64_t': 8,
+}
+
+CONSTANTS = {
+    'QMI_COMMON_TLV_TYPE': 0,
+    'U8_MAX': 255,
+}
+
+TABLE_RE = re.compile(r'(?:\bstatic\s+)?(?:\bconst\s+)?struct\s+qmi_elem_info'
+                      r'\s+(\w+)\s*\[\s*\w*\s*\]\s*=\s*\{')
+
+
+class CodegenError(Exception):
+    pass
+
+
+def strip_comments(text):
+    text = re.sub(r'/\*.*?\*/', lambda m: ' ' * len(m.group(0)), text,
+                  flags=re.S)
+    return re.sub(r'//[^\n]*', '', text)
+
+
+def split_top(text, sep):
+    """Split @text at @sep characters that are not nested in brackets."""
+    parts, depth, cur = [], 0, []
+    for c in text:
+        if c in '([{':
+            depth += 1
+        elif c in ')]}':
+            depth -= 1
+        if c == sep and depth == 0:
+            parts.append(''.join(cur))
+            cur = []
+        else:
+            cur.append(c)
+    parts.append(''.join(cur))
+    return parts
+
+
+def match_brace(text, start):
+    """Return the index of the brace closing the one at @start."""
+    depth = 0
+    for i in range(start, len(text)):
+        if text[i] == '{':
+            depth += 1
+        elif text[i] == '}':
+            depth -= 1
+            if depth == 0:
+                return i
+    raise CodegenError('unbalanced braces')
+
+
+def normalize(expr):
+    return ' '.join(expr.split())
+
+
+def parse_entry(text, table):
+    elem = dict((f, '0') for f in FIELDS)
+    for init in split_top(text, ','):
+        init = init.strip()
+        if not init:
+            continue
+        m = re.match(r'\.(\w+)\s*=\s*(.*)$', init, re.S)
+        if not m or m.group(1) not in FIELDS:
+            raise CodegenError('%s: unsupported initializer "%s"' %
+                               (table, normalize(init)))
+        elem[m.group(1)] = normalize(m.group(2))
+    if elem['data_type'] not in DATA_TYPES:
+        raise CodegenError('%s: unknown data_type %s' %
+                           (table, elem['data_type']))
+    if elem['is_array'] == '0':
+        elem['is_array'] = 'NO_ARRAY'
+    if elem['is_array'] not in ARRAY_TYPES:
+        raise CodegenError('%s: unknown is_array %s' %
+                           (table, elem['is_array']))
+    ref = elem['ei_array'].lstrip('&').strip()
+    elem['ei_array'] = None if ref in ('0', 'NULL') else ref
+    return elem
+
+
+def parse_file(path):
+    """Return {name: [elements]} for every ei table defined in @path."""
+    with open(path) as f:
+        text = strip_comments(f.read())
+    tables = {}
+    for m in TABLE_RE.finditer(text):
+        name = m.group(1)
+        end = match_brace(text, m.end() - 1)
+        body = text[m.end():end]
+        elems, errors = [], None
+        try:
+            for entry in split_top(body, ','):
+                entry = entry.strip()
+                if not entry:
+                    continue
+                if entry[0] != '{' or entry[-1] != '}':
+                    raise CodegenError('%s: positional initializer' % name)
+                elems.append(parse_entry(entry[1:-1], name))
+            if not elems or elems[-1]['data_type'] != 'QMI_EOTI':
+                raise CodegenError('%s: not terminated by QMI_EOTI' % name)
+            if any(e['data_type'] == 'QMI_EOTI' for e in elems[:-1]):
+                raise CodegenError('%s: QMI_EOTI before the end' % name)
+        except CodegenError as e:
+            errors = str(e)
+        tables[name] = (elems, errors)
+    return tables
+
+
+def const_value(expr):
+    """Evaluate @expr if it is a trivially constant expression."""
+    e = expr.replace(' ', '')
+    while e.startswith('(') and e.endswith(')'):
+        e = e[1:-1]
+    if e in CONSTANTS:
+        return CONSTANTS[e]
+    m = re.match(r'^sizeof\((\w+)\)$', e)
+    if m and m.group(1) in SIZEOF:
+        return SIZEOF[m.group(1)]
+    try:
+        return int(e.rstrip('uUlL'), 0)
+    except ValueError:
+        return None
+
+
+class Table(object):
+    def __init__(self, name, elems):
+        self.name = name
+        self.elems = elems[:-1]
+        self.eoti = elems[-1]
+        self.asserts = []
+
+    def elem(self, i):
+        return self.elems[i] if i < len(self.elems) else self.eoti
+
+    @property
+    def n(self):
+        return len(self.elems)
+
+    def tlv_equal(self, i, j):
+        a, b = self.elem(i)['tlv_type'], self.elem(j)['tlv_type']
+        va, vb = const_value(a), const_value(b)
+        if va is not None and vb is not None:
+            return (va & 0xff) == (vb & 0xff)
+        if a.replace(' ', '') == b.replace(' ', ''):
+            return True
+        self.asserts.append('BUILD_BUG_ON((u8)(%s) == (u8)(%s));' % (a, b))
+        return False
+
+    def unique_asserts(self):
+        seen, out = set(), []
+        for a in self.asserts:
+            if a not in seen:
+                seen.add(a)
+                out.append(a)
+        del self.asserts[:]
+        return out
+
+    def skip(self, i, level):
+        """Mirror skip_to_next_elem() starting at element @i."""
+        if i > self.n:
+            raise CodegenError('%s: skip past QMI_EOTI' % self.name)
+        if level > 1:
+            if i + 1 > self.n:
+                raise CodegenError('%s: skip past QMI_EOTI' % self.name)
+            return i + 1
+        while True:
+            if i == self.n:
+                raise CodegenError('%s: skip past QMI_EOTI' % self.name)
+            i += 1
+            if not self.tlv_equal(i - 1, i):
+                return i
+
+
+def u32(expr):
+    return expr if const_value(expr) is not None else '(u32)(%s)' % expr
+
+
+def len_size(e):
+    """Wire size of the length prefix of a QMI_DATA_LEN element."""
+    v = const_value(e['elem_size'])
+    if v is not None:
+        if v > 4:
+            raise CodegenError('QMI_DATA_LEN wider than u32')
+        return 'sizeof(u8)' if v == 1 else 'sizeof(u16)'
+    return '(%s == sizeof(u8) ? sizeof(u8) : sizeof(u16))' % u32(
+        e['elem_size'])
+
+
+def string_len_size(e):
+    v = const_value(e['elem_len'])
+    if v is not None:
+        return 'sizeof(u8)' if v <= 255 else 'sizeof(u16)'
+    return '(%s <= U8_MAX ? sizeof(u8) : sizeof(u16))' % u32(e['elem_len'])
+
+
+def src(base, e):
+    off = e['offset']
+    if const_value(off) == 0:
+        return base
+    return '%s + %s' % (base, off)
+
+
+class Generator(object):
+    def __init__(self, tables):
+        self.tables = tables
+        self.nested_done = set()
+        self.out = []
+
+    def table(self, name):
+        if name not in self.tables:
+            raise CodegenError('nested table %s not found' % name)
+        elems, error = self.tables[name]
+        if error:
+            raise CodegenError(error)
+        return Table(name, elems)
+
+    def emit(self, lines):
+        self.out.extend(lines)
+        self.out.append('')
+
+    def nested_deps(self, t, stack=()):
+        """Generate the nested variants @t depends on, children first."""
+        for e in t.elems:
+            if e['data_type'] != 'QMI_STRUCT':
+                continue
+            ref = e['ei_array']
+            if ref is None:
+                continue
+            if ref in stack or ref == t.name:
+                raise CodegenError('%s: recursive nesting' % ref)
+            if ref in self.nested_done:
+                continue
+            child = self.table(ref)
+            self.nested_deps(child, stack + (t.name,))
+            self.emit(self.encoder(child, 2))
+            self.emit(self.decoder(child, 2))
+            self.nested_done.add(ref)
+
+    # Encoder -----------------------------------------------------------
+
+    def encoder(self, t, level):
+        nested = '_nested' if level > 1 else ''
+        targets = set()
+        for i, e in enumerate(t.elems):
+            if e['data_type'] == 'QMI_OPT_FLAG' and level == 1:
+                targets.add(t.skip(i, level))
+            elif e['data_type'] == 'QMI_DATA_LEN':
+                targets.add(t.skip(i + 1, level))
+        types = set(e['data_type'] for e in t.elems)
+
+        body = []
+        for i, e in enumerate(t.elems):
+            if i in targets:
+                body.append('L%d:' % i)
+            body += self.enc_array(e)
+            body += self.enc_elem(t, i, e, level)
+        if t.n in targets:
+            body.append('L%d:' % t.n)
+        body.append('\treturn encoded_bytes;')
+
+        if not t.elems:
+            return (['static int qmi_gen_enc%s_%s(void *out_buf, '
+                     'const void *in_c_struct,' % (nested, t.name),
+                     '\t\t\t\tu32 out_buf_len)', '{', '\treturn 0;', '}'])
+
+        decl = ['\tu8 *buf_dst = out_buf;',
+                '\tu32 data_len_value = 0;',
+                '\tu32 encoded_bytes = 0;']
+        if level == 1:
+            decl += ['\tu8 *tlv_pointer = buf_dst;', '\tu32 tlv_len = 0;']
+        if 'QMI_STRUCT' in types:
+            decl += ['\tu32 i, n;', '\tint rc;']
+        elif types & set(('QMI_STRING',) + BASIC_TYPES):
+            decl += ['\tu32 n;']
+        if 'QMI_STRING' in types:
+            decl += ['\tu32 string_len;']
+
+        pre = ['\t' + a for a in t.unique_asserts()]
+        pre += ['\tif (!in_c_struct)', '\t\treturn 0;', '']
+        if level == 1:
+            pre += ['\tbuf_dst += QMI_GEN_TLV_HDR_SIZE;', '']
+
+        return (['static int qmi_gen_enc%s_%s(void *out_buf, '
+                 'const void *in_c_struct,' % (nested, t.name),
+                 '\t\t\t\tu32 out_buf_len)', '{'] +
+                decl + [''] + pre + body + ['}'])
+
+    def enc_array(self, e):
+        if e['is_array'] == 'NO_ARRAY':
+            return ['\tdata_len_value = 1;']
+        if e['is_array'] == 'STATIC_ARRAY':
+            return ['\tdata_len_value = %s;' % u32(e['elem_len'])]
+        return ['\tif (!data_len_value || %s < data_len_value)' %
+                u32(e['elem_len']),
+                '\t\treturn -EINVAL;']
+
+    def enc_update(self, level, n, tlv):
+        lines = ['\tbuf_dst += %s;' % n, '\tencoded_bytes += %s;' % n]
+        if level == 1:
+            lines += ['\ttlv_len += %s;' % n] + self.enc_tlv(tlv)
+        return lines
+
+    def enc_tlv(self, tlv):
+        return ['\tqmi_gen_put_tlv(tlv_pointer, %s, tlv_len);' % tlv,
+                '\tencoded_bytes += QMI_GEN_TLV_HDR_SIZE;',
+                '\ttlv_pointer = buf_dst;',
+                '\ttlv_len = 0;',
+                '\tbuf_dst += QMI_GEN_TLV_HDR_SIZE;']
+
+    def enc_elem(self, t, i, e, level):
+        dt = e['data_type']
+        field = src('in_c_struct', e)
+        size = u32(e['elem_size'])
+        if dt == 'QMI_OPT_FLAG':
+            if level > 1:
+                return []
+            target = t.skip(i, level)
+            if target == i + 1:
+                return []
+            return ['\tif (!*(const u8 *)(%s))' % field,
+                    '\t\tgoto L%d;' % target]
+        if dt == 'QMI_DATA_LEN':
+            lsz = len_size(e)
+            lines = ['\tmemcpy(&data_len_value, %s, %s);' % (field, size),
+                     '\tif (%s + encoded_bytes + QMI_GEN_TLV_HDR_SIZE > '
+                     'out_buf_len)' % lsz,
+                     '\t\treturn -ETOOSMALL;',
+                     '\tmemcpy(buf_dst, &data_len_value, %s);' % lsz,
+                     '\tbuf_dst += %s;' % lsz,
+                     '\tencoded_bytes += %s;' % lsz]
+            if level == 1:
+                lines.append('\ttlv_len += %s;' % lsz)
+            lines.append('\tif (!data_len_value) {')
+            if level == 1:
+                lines += ['\t' + l for l in self.enc_tlv(e['tlv_type'])]
+            lines += ['\t\tgoto L%d;' % t.skip(i + 1, level), '\t}']
+            return lines
+        if dt in BASIC_TYPES:
+            return (['\tn = data_len_value * %s;' % size,
+                     '\tif (n + encoded_bytes + QMI_GEN_TLV_HDR_SIZE > '
+                     'out_buf_len)',
+                     '\t\treturn -ETOOSMALL;',
+                     '\tmemcpy(buf_dst, %s, n);' % field] +
+                    self.enc_update(level, 'n', e['tlv_type']))
+        if dt == 'QMI_STRUCT':
+            if e['ei_array'] is None:
+                lines = ['\tn = 0;']
+            else:
+                lines = ['\tfor (n = 0, i = 0; i < data_len_value; i++) {',
+                         '\t\trc = qmi_gen_enc_nested_%s(buf_dst + n,' %
+                         e['ei_array'],
+                         '\t\t\t\t%s + i * %s,' % (field, size),
+                         '\t\t\t\tout_buf_len - encoded_bytes - n);',
+                         '\t\tif (rc < 0)',
+                         '\t\t\treturn rc;',
+                         '\t\tn += rc;',
+                         '\t}']
+            return lines + self.enc_update(level, 'n', e['tlv_type'])
+        if dt == 'QMI_STRING':
+            lines = ['\tstring_len = strlen(%s);' % field,
+                     '\tif (string_len > %s)' % u32(e['elem_len']),
+                     '\t\treturn -EINVAL;']
+            if level == 1:
+                lines += ['\tif (string_len + QMI_GEN_TLV_HDR_SIZE > '
+                          'out_buf_len - encoded_bytes)',
+                          '\t\treturn -ETOOSMALL;',
+                          '\tn = 0;']
+            else:
+                lsz = string_len_size(e)
+                lines += ['\tif (string_len + %s + QMI_GEN_TLV_HDR_SIZE > '
+                          'out_buf_len - encoded_bytes)' % lsz,
+                          '\t\treturn -ETOOSMALL;',
+                          '\tmemcpy(buf_dst, &string_len, %s);' % lsz,
+                          '\tn = %s;' % lsz]
+            lines += ['\tmemcpy(buf_dst + n, %s, string_len * %s);' %
+                      (field, size),
+                      '\tn += string_len * %s;' % size]
+            return lines + self.enc_update(level, 'n', e['tlv_type'])
+        raise CodegenError('%s: cannot encode %s' % (t.name, dt))
+
+    # Decoder -----------------------------------------------------------
+
+    def decoder(self, t, level):
+        nested = '_nested' if level > 1 else ''
+        types = set(e['data_type'] for e in t.elems)
+        # nested elements only look at the remaining length for structs
+        # and strings
+        self.use_tlv_len = level == 1 or bool(
+            types & set(('QMI_STRUCT', 'QMI_STRING')))
+        decl = ['\tconst u8 *buf_src = in_buf;',
+                '\tu32 decoded_bytes = 0;']
+        if t.elems:
+            decl.insert(1, '\tu32 data_len_value = 0;')
+        if self.use_tlv_len:
+            decl.append('\tu32 tlv_len;')
+        if 'QMI_STRUCT' in types:
+            decl += ['\tu32 i, n;', '\tint rc;']
+        elif 'QMI_STRING' in types:
+            decl += ['\tu32 n;']
+        if 'QMI_STRING' in types:
+            decl += ['\tu32 string_len;']
+
+        body = []
+        if level == 1:
+            decl.append('\tu8 tlv_type;')
+            body += ['\twhile (decoded_bytes < in_buf_len) {',
+                     '\t\tif (decoded_bytes + QMI_GEN_TLV_HDR_SIZE > '
+                     'in_buf_len)',
+                     '\t\t\treturn -EINVAL;',
+                     '\t\ttlv_type = buf_src[0];',
+                     '\t\ttlv_len = buf_src[1] | buf_src[2] << 8;',
+                     '\t\tbuf_src += QMI_GEN_TLV_HDR_SIZE;',
+                     '\t\tdecoded_bytes += QMI_GEN_TLV_HDR_SIZE;',
+                     '',
+                     '\t\tswitch (tlv_type) {']
+            # find_ei() picks the first element carrying the TLV type
+            seen = []
+            for i, e in enumerate(t.elems):
+                if any(t.tlv_equal(j, i) for j in seen):
+                    continue
+                seen.append(i)
+                body.append('\t\tcase %s:' % e['tlv_type'])
+                lines, _ = self.dec_step(t, i, level)
+                body += ['\t\t' + l if l else l for l in lines]
+                body.append('\t\t\tbreak;')
+            body += ['\t\tdefault:',
+                     '\t\t\tif (tlv_type < QMI_GEN_OPTIONAL_TLV_START)',
+                     '\t\t\t\treturn -EINVAL;',
+                     '\t\t\tbuf_src += tlv_len;',
+                     '\t\t\tdecoded_bytes += tlv_len;',
+                     '\t\t\tbreak;',
+                     '\t\t}',
+                     '\t}',
+                     '\treturn decoded_bytes;']
+        else:
+            i = 0
+            while True:
+                if i == t.n:
+                    body.append('\treturn decoded_bytes;')
+                    break
+                body += ['\tif (decoded_bytes >= in_buf_len)',
+                         '\t\treturn decoded_bytes;']
+                if self.use_tlv_len:
+                    body.append('\ttlv_len = in_buf_len - decoded_bytes;')
+                lines, i = self.dec_step(t, i, level)
+                body += lines
+                if i is None:
+                    break
+
+        # distinct TLV types sharing a value fail as duplicate case labels
+        t.unique_asserts()
+        return (['static int qmi_gen_dec%s_%s(void *out_c_struct, '
+                 'const void *in_buf,' % (nested, t.name),
+                 '\t\t\t\tu32 in_buf_len)', '{'] +
+                decl + [''] + body + ['}'])
+
+    def dec_step(self, t, i, level):
+        """
+        Decode one loop iteration of qmi_decode() starting at element @i.
+        Returns the code and the index the next iteration starts at, or
+        None if the iteration always fails.
+        """
+        lines = []
+        e = t.elem(i)
+        if e['data_type'] == 'QMI_OPT_FLAG':
+            lines.append('\t*(u8 *)(%s) = 1;' % src('out_c_struct', e))
+            i += 1
+            e = t.elem(i)
+        if i < t.n and e['data_type'] == 'QMI_DATA_LEN':
+            lsz = len_size(e)
+            lines += ['\tif (%s > in_buf_len - decoded_bytes)' % lsz,
+                      '\t\treturn -EINVAL;',
+                      '\tmemcpy(&data_len_value, buf_src, %s);' % lsz,
+                      '\tmemcpy(%s, &data_len_value, sizeof(u32));' %
+                      src('out_c_struct', e)]
+            if self.use_tlv_len:
+                lines.append('\ttlv_len -= %s;' % lsz)
+            lines += ['\tbuf_src += %s;' % lsz,
+                      '\tdecoded_bytes += %s;' % lsz]
+            i += 1
+            e = t.elem(i)
+
+        if e['is_array'] == 'NO_ARRAY':
+            lines.append('\tdata_len_value = 1;')
+        elif e['is_array'] == 'STATIC_ARRAY':
+            lines.append('\tdata_len_value = %s;' % u32(e['elem_len']))
+        else:
+            lines += ['\tif (data_len_value > %s)' % u32(e['elem_len']),
+                      '\t\treturn -ETOOSMALL;']
+
+        dt = e['data_type']
+        field = src('out_c_struct', e)
+        size = u32(e['elem_size'])
+        if i == t.n or dt in ('QMI_OPT_FLAG', 'QMI_DATA_LEN'):
+            lines.append('\treturn -EINVAL;')
+            return lines, None
+        if dt in BASIC_TYPES:
+            lines += ['\tif (data_len_value * %s > '
+                      'in_buf_len - decoded_bytes)' % size,
+                      '\t\treturn -EINVAL;',
+                      '\tmemcpy(%s, buf_src, data_len_value * %s);' %
+                      (field, size),
+                      '\tbuf_src += data_len_value * %s;' % size,
+                      '\tdecoded_bytes += data_len_value * %s;' % size]
+        elif dt == 'QMI_STRUCT':
+            if e['ei_array'] is None:
+                raise CodegenError('%s: QMI_STRUCT without ei_array' %
+                                   t.name)
+            if level + 1 <= 2:
+                check = 'n != tlv_len'
+            else:
+                check = 'i < data_len_value || n > tlv_len'
+            lines += ['\tif (tlv_len > in_buf_len - decoded_bytes)',
+                      '\t\treturn -EINVAL;',
+                      '\tfor (n = 0, i = 0; i < data_len_value && '
+                      'n < tlv_len; i++) {',
+                      '\t\trc = qmi_gen_dec_nested_%s(%s + i * %s,' %
+                      (e['ei_array'], field, size),
+                      '\t\t\t\tbuf_src + n, tlv_len - n);',
+                      '\t\tif (rc < 0)',
+                      '\t\t\treturn rc;',
+                      '\t\tn += rc;',
+                      '\t}',
+                      '\tif (%s)' % check,
+                      '\t\treturn -EFAULT;',
+                      '\tbuf_src += n;',
+                      '\tdecoded_bytes += n;']
+        elif dt == 'QMI_STRING':
+            if level == 1:
+                lines += ['\tstring_len = tlv_len;', '\tn = 0;']
+            else:
+                lsz = string_len_size(e)
+                lines += ['\tif (%s > in_buf_len - decoded_bytes)' % lsz,
+                          '\t\treturn -EINVAL;',
+                          '\tstring_len = 0;',
+                          '\tmemcpy(&string_len, buf_src, %s);' % lsz,
+                          '\tn = %s;' % lsz]
+            lines += ['\tif (string_len >= %s)' % u32(e['elem_len']),
+                      '\t\treturn -ETOOSMALL;',
+                      '\tif (string_len > tlv_len)',
+                      '\t\treturn -EFAULT;',
+                      '\tif (string_len * %s > '
+                      'in_buf_len - decoded_bytes - n)' % size,
+                      '\t\treturn -EINVAL;',
+                      '\tmemcpy(%s, buf_src + n, string_len * %s);' %
+                      (field, size),
+                      '\t*((char *)(%s) + string_len) = \'\\0\';' % field,
+                      '\tn += string_len * %s;' % size,
+                      '\tbuf_src += n;',
+                      '\tdecoded_bytes += n;']
+        else:
+            raise CodegenError('%s: cannot decode %s' % (t.name, dt))
+        return lines, i + 1
+
+    def message(self, name):
+        t = self.table(name)
+        saved = (list(self.out), set(self.nested_done))
+        try:
+            self.nested_deps(t)
+            self.emit(self.encoder(t, 1))
+            self.emit(self.decoder(t, 1))
+        except CodegenError:
+            self.out, self.nested_done = saved
+            raise
+
+
+PROLOGUE = '''\
+/*
+ * Generated by scripts/qmi_codegen.py from %(sources)s.
+ * Do not edit.
+ */
+
+#include <linux/bug.h>
+#include <linux/string.h>
+#include <linux/soc/qcom/qmi.h>
+
+#ifndef QMI_GEN_TLV_HDR_SIZE
+#define QMI_GEN_TLV_HDR_SIZE		(sizeof(u8) + sizeof(u16))
+#define QMI_GEN_OPTIONAL_TLV_START	0x10
+
+static inline void qmi_gen_put_tlv(u8 *p, u8 type, u32 len)
+{
+	p[0] = type;
+	p[1] = len & 0xff;
+	p[2] = (len >> 8) & 0xff;
+}
+#endif
+'''
+
+
+def usage():
+    print('usage: %s -n NAME -o OUTPUT PRIMARY.c [DEPENDENCY.c ...]' %
+          sys.argv[0], file=sys.stderr)
+    sys.exit(2)
+
+
+def main():
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], 'n:o:')
+    except getopt.GetoptError:
+        usage()
+    opts = dict(opts)
+    if '-n' not in opts or '-o' not in opts or not args:
+        usage()
+
+    tables = {}
+    for path in reversed(args):
+        tables.update(parse_file(path))
+    primary = parse_file(args[0])
+
+    refs = set()
+    for elems, _ in primary.values():
+        for e in elems:
+            if e['ei_array']:
+                refs.add(e['ei_array'])
+    # keep the order of definition in the primary source
+    with open(args[0]) as f:
+        text = strip_comments(f.read())
+    messages = [m.group(1) for m in TABLE_RE.finditer(text)
+                if m.group(1) not in refs]
+
+    gen = Generator(tables)
+    codecs, skipped = [], []
+    for name in messages:
+        try:
+            gen.message(name)
+            codecs.append(name)
+        except CodegenError as e:
+            print('%s: %s: left to the interpreter: %s' %
+                  (sys.argv[0], name, e), file=sys.stderr)
+            skipped.append((name, str(e)))
+
+    out = [PROLOGUE % {'sources': ', '.join(os.path.basename(a)
+                                             for a in args)}]
+    out += gen.out
+    for name, why in skipped:
+        out.append('/* %s: not generated, %s */' % (name, why))
+    if skipped:
+        out.append('')
+    out.append('static struct qmi_codec %s_codecs[] = {' % opts['-n'])
+    for name in codecs:
+        out += ['\t{',
+                '\t\t.ei\t= %s,' % name,
+                '\t\t.encode\t= qmi_gen_enc_%s,' % name,
+                '\t\t.decode\t= qmi_gen_dec_%s,' % name,
+                '\t},']
+    out.append('};')
+
+    tmp = opts['-o'] + '.tmp'
+    with open(tmp, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+    os.rename(tmp, opts['-o'])
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,3 @@
+/* The C library includes this one too, so hand it the real one. */
+#include_next <linux/errno.h>
+#include "../shim.h"
@@ -0,0 +1 @@
+#include "../../../../../../include/linux/soc/qcom/qmi.h"
@@ -0,0 +1,371 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Compare the generated QMI codecs against the table interpreter.
+ *
+ * Every message is encoded from randomized C structs and decoded from
+ * valid, truncated, corrupted and random wire buffers through both
+ * qmi_encode_message()/qmi_decode_message() paths, with and without the
+ * generated codecs registered.  Return values, wire bytes and decoded
+ * structs must be identical.  A short benchmark of both paths follows.
+ */
+#include <time.h>
+#include <unistd.h>
+
+#include "shim.h"
+#include "msgs.h"
+
+enum { RES_OK, RES_EINVAL, RES_ETOOSMALL, RES_EFAULT, RES_OTHER, NR_RES };
+
+static const char * const res_names[NR_RES] = {
+	"ok", "-EINVAL", "-ETOOSMALL", "-EFAULT", "other",
+};
+
+struct test_msg {
+	const char *name;
+	struct qmi_elem_info *ei;
+	size_t size;
+	size_t max_len;
+	unsigned long enc_res[NR_RES];
+	unsigned long dec_res[NR_RES];
+};
+
+static struct test_msg msgs[] = {
+	{ "req", test_req_msg_ei, sizeof(struct test_req_msg), 4096 },
+	{ "resp", test_resp_msg_ei, sizeof(struct test_resp_msg), 1024 },
+	{ "empty", test_empty_msg_ei, sizeof(struct test_empty_msg), 16 },
+};
+
+static u64 rng_state = 0x9e3779b97f4a7c15ULL;
+static unsigned long failures;
+
+static u32 rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state >> 32;
+}
+
+static u32 rnd_below(u32 n)
+{
+	return n ? rnd() % n : 0;
+}
+
+static void rnd_fill(void *buf, size_t len)
+{
+	u8 *p = buf;
+
+	while (len--)
+		*p++ = rnd();
+}
+
+static void codecs_enable(bool on)
+{
+	static bool enabled;
+
+	if (on == enabled)
+		return;
+	if (on) {
+		if (qmi_register_codecs(test_msg_codecs, nr_test_msg_codecs)) {
+			fprintf(stderr, "codec registration failed\n");
+			exit(1);
+		}
+	} else {
+		qmi_unregister_codecs(test_msg_codecs, nr_test_msg_codecs);
+	}
+	enabled = on;
+}
+
+/*
+ * Turn random bytes into a mostly valid C struct for @ei: bounded array
+ * lengths, terminated strings and optional elements present about half of
+ * the time.  Now and then a length or string is left out of spec so the
+ * error paths get exercised as well.
+ */
+static void fixup(struct qmi_elem_info *ei, void *c_struct)
+{
+	u32 len = 0, n, i;
+
+	for (; ei->data_type != QMI_EOTI; ei++) {
+		void *p = c_struct + ei->offset;
+
+		switch (ei->data_type) {
+		case QMI_OPT_FLAG:
+			*(u8 *)p = rnd_below(3);
+			break;
+		case QMI_DATA_LEN:
+			len = rnd_below(ei[1].elem_len + 1);
+			if (!rnd_below(64))
+				len = ei[1].elem_len + 1;
+			memcpy(p, &len, ei->elem_size);
+			break;
+		case QMI_STRUCT:
+			n = ei->is_array == NO_ARRAY ? 1 : ei->elem_len;
+			for (i = 0; i < n; i++)
+				fixup(ei->ei_array, p + i * ei->elem_size);
+			break;
+		case QMI_STRING:
+			n = rnd_below(ei->elem_len);
+			for (i = 0; i < n; i++)
+				((char *)p)[i] = 'a' + rnd_below(26);
+			((char *)p)[n] = '\0';
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static void *encode(struct test_msg *msg, const void *c_struct,
+		    size_t buf_len, size_t *len, bool generated)
+{
+	codecs_enable(generated);
+	*len = buf_len;
+	return qmi_encode_message(QMI_REQUEST, 1, len, 7, msg->ei, c_struct);
+}
+
+static int decode(struct test_msg *msg, const void *buf, size_t len,
+		  void *c_struct, bool generated)
+{
+	codecs_enable(generated);
+	memset(c_struct, 0, msg->size);
+	return qmi_decode_message(buf, len, msg->ei, c_struct);
+}
+
+static int res_index(long ret)
+{
+	switch (ret) {
+	case -EINVAL:
+		return RES_EINVAL;
+	case -ETOOSMALL:
+		return RES_ETOOSMALL;
+	case -EFAULT:
+		return RES_EFAULT;
+	default:
+		return ret < 0 ? RES_OTHER : RES_OK;
+	}
+}
+
+static void fail(struct test_msg *msg, const char *what, long a, long b)
+{
+	if (failures++ < 20)
+		fprintf(stderr, "%s: %s mismatch: interpreter %ld, generated %ld\n",
+			msg->name, what, a, b);
+}
+
+static void check_encode(struct test_msg *msg, const void *c_struct,
+			 size_t buf_len)
+{
+	size_t len_i, len_g;
+	void *ei, *eg;
+
+	ei = encode(msg, c_struct, buf_len, &len_i, false);
+	eg = encode(msg, c_struct, buf_len, &len_g, true);
+
+	msg->enc_res[res_index(IS_ERR(ei) ? PTR_ERR(ei) : 0)]++;
+	if (IS_ERR(ei) || IS_ERR(eg)) {
+		if (PTR_ERR(ei) != PTR_ERR(eg))
+			fail(msg, "encode result", PTR_ERR(ei), PTR_ERR(eg));
+	} else if (len_i != len_g) {
+		fail(msg, "encode length", len_i, len_g);
+	} else if (memcmp(ei, eg, len_i)) {
+		fail(msg, "encode bytes", 0, 0);
+	}
+
+	if (!IS_ERR(ei))
+		free(ei);
+	if (!IS_ERR(eg))
+		free(eg);
+}
+
+static void check_decode(struct test_msg *msg, const void *wire, size_t len)
+{
+	void *ci = malloc(msg->size), *cg = malloc(msg->size);
+	void *buf = malloc(len ? len : 1);
+	int ri, rg;
+
+	/* exact sized copy so any over-read trips the sanitizer */
+	memcpy(buf, wire, len);
+	ri = decode(msg, buf, len, ci, false);
+	rg = decode(msg, buf, len, cg, true);
+	msg->dec_res[res_index(ri)]++;
+	if (ri != rg)
+		fail(msg, "decode result", ri, rg);
+	else if (memcmp(ci, cg, msg->size))
+		fail(msg, "decoded struct", ri, rg);
+
+	free(buf);
+	free(ci);
+	free(cg);
+}
+
+static void mutate(u8 *buf, size_t *len, size_t max)
+{
+	size_t hdr = sizeof(struct qmi_header);
+	u32 i, n;
+
+	switch (rnd_below(4)) {
+	case 0:		/* truncate */
+		*len = hdr + rnd_below(*len - hdr + 1);
+		break;
+	case 1:		/* flip bytes */
+		for (n = 1 + rnd_below(4), i = 0; i < n && *len > hdr; i++)
+			buf[hdr + rnd_below(*len - hdr)] = rnd();
+		break;
+	case 2:		/* append a random TLV */
+		if (*len + 3 + 8 > max)
+			break;
+		buf[*len] = rnd_below(0x20);
+		buf[*len + 1] = rnd_below(12);
+		buf[*len + 2] = rnd_below(8) ? 0 : rnd();
+		rnd_fill(buf + *len + 3, 8);
+		*len += 3 + rnd_below(9);
+		break;
+	default:	/* garbage */
+		*len = hdr + rnd_below(max - hdr);
+		rnd_fill(buf + hdr, *len - hdr);
+		break;
+	}
+}
+
+static void run_correctness(unsigned int iterations)
+{
+	unsigned int i, m;
+
+	for (m = 0; m < ARRAY_SIZE(msgs); m++) {
+		struct test_msg *msg = &msgs[m];
+		void *c_struct = malloc(msg->size);
+		u8 *buf = malloc(msg->max_len);
+
+		for (i = 0; i < iterations; i++) {
+			size_t len;
+			void *wire;
+
+			rnd_fill(c_struct, msg->size);
+			fixup(msg->ei, c_struct);
+
+			check_encode(msg, c_struct, msg->max_len);
+			check_encode(msg, c_struct, rnd_below(msg->max_len));
+
+			wire = encode(msg, c_struct, msg->max_len, &len, false);
+			if (IS_ERR(wire))
+				continue;
+			memcpy(buf, wire, len);
+			free(wire);
+
+			check_decode(msg, buf, len);
+			mutate(buf, &len, msg->max_len);
+			check_decode(msg, buf, len);
+		}
+
+		free(buf);
+		free(c_struct);
+	}
+}
+
+static void print_results(void)
+{
+	unsigned int m, r;
+
+	printf("%-6s %-7s", "msg", "");
+	for (r = 0; r < NR_RES; r++)
+		printf(" %10s", res_names[r]);
+	printf("\n");
+	for (m = 0; m < ARRAY_SIZE(msgs); m++) {
+		printf("%-6s %-7s", msgs[m].name, "encode");
+		for (r = 0; r < NR_RES; r++)
+			printf(" %10lu", msgs[m].enc_res[r]);
+		printf("\n%-6s %-7s", "", "decode");
+		for (r = 0; r < NR_RES; r++)
+			printf(" %10lu", msgs[m].dec_res[r]);
+		printf("\n");
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run_benchmark(unsigned int iterations)
+{
+	unsigned int i, m, pass;
+
+	printf("%-6s %14s %14s %14s %14s\n", "msg", "interp enc ns",
+	       "gen enc ns", "interp dec ns", "gen dec ns");
+
+	for (m = 0; m < ARRAY_SIZE(msgs); m++) {
+		struct test_msg *msg = &msgs[m];
+		void *c_struct = malloc(msg->size);
+		void *out = malloc(msg->size);
+		double t[4];
+		void *wire;
+		size_t len;
+
+		/* a fully populated, valid message */
+		do {
+			rnd_fill(c_struct, msg->size);
+			fixup(msg->ei, c_struct);
+			wire = encode(msg, c_struct, msg->max_len, &len, false);
+		} while (IS_ERR(wire));
+
+		for (pass = 0; pass < 2; pass++) {
+			double start = now();
+
+			for (i = 0; i < iterations; i++) {
+				size_t l;
+
+				free(encode(msg, c_struct, msg->max_len, &l,
+					    pass));
+			}
+			t[pass] = (now() - start) * 1e9 / iterations;
+
+			start = now();
+			for (i = 0; i < iterations; i++)
+				decode(msg, wire, len, out, pass);
+			t[2 + pass] = (now() - start) * 1e9 / iterations;
+		}
+
+		printf("%-6s %14.1f %14.1f %14.1f %14.1f\n", msg->name,
+		       t[0], t[1], t[2], t[3]);
+		free(wire);
+		free(out);
+		free(c_struct);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int iterations = 20000, bench = 200000;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:i:s:")) != -1) {
+		switch (opt) {
+		case 'b':
+			bench = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			rng_state = strtoull(optarg, NULL, 0) | 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-i iterations] [-b bench] [-s seed]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+
+	run_correctness(iterations);
+	print_results();
+	printf("%u iterations per message, %lu mismatches\n",
+	       iterations, failures);
+	if (bench)
+		run_benchmark(bench);
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _QMI_TEST_MSGS_H
+#define _QMI_TEST_MSGS_H
+
+#include <linux/soc/qcom/qmi.h>
+
+#define TEST_MAX_INNER		4
+#define TEST_MAX_OUTER		3
+#define TEST_MAX_BLOB		300
+#define TEST_NAME_LEN		32
+#define TEST_LONG_NAME_LEN	280
+
+#define TEST_TLV_ID		0x01
+#define TEST_TLV_NAME		0x12
+
+struct test_inner {
+	u8 a;
+	u16 b;
+	u32 vals_len;
+	u32 vals[TEST_MAX_INNER];
+	char name[TEST_NAME_LEN + 1];
+};
+
+struct test_outer {
+	u64 x;
+	struct test_inner inner[2];
+	u8 note_valid;
+	char note[TEST_LONG_NAME_LEN + 1];
+	s32 e;
+};
+
+struct test_req_msg {
+	u32 id;
+	struct qmi_response_type_v01 resp;
+	u8 flag_valid;
+	u8 flag;
+	u8 outer_valid;
+	u32 outer_len;
+	struct test_outer outer[TEST_MAX_OUTER];
+	u8 name_valid;
+	char name[TEST_NAME_LEN + 1];
+	u8 triple_valid;
+	u16 triple[3];
+	u8 mode_valid;
+	s16 mode;
+};
+
+struct test_resp_msg {
+	struct qmi_response_type_v01 resp;
+	u8 blob_valid;
+	u32 blob_len;
+	u8 blob[TEST_MAX_BLOB];
+	u8 inner_valid;
+	struct test_inner inner;
+};
+
+struct test_empty_msg {
+	char unused;
+};
+
+extern struct qmi_elem_info test_req_msg_ei[];
+extern struct qmi_elem_info test_resp_msg_ei[];
+extern struct qmi_elem_info test_empty_msg_ei[];
+
+extern struct qmi_codec *test_msg_codecs;
+extern const size_t nr_test_msg_codecs;
+
+#endif
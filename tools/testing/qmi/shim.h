@@ -0,0 +1,142 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Just enough of the kernel environment to build the QMI encoder/decoder
+ * and the code generated from ei tables as a host program.
+ */
+#ifndef _QMI_TEST_SHIM_H
+#define _QMI_TEST_SHIM_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+#define __packed		__attribute__((packed))
+#define __init
+#define U8_MAX			((u8)~0U)
+#define ETOOSMALL		525
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+#define BUILD_BUG_ON(cond)	((void)sizeof(char[1 - 2 * !!(cond)]))
+#define WARN_ON(cond)		(!!(cond))
+#define EXPORT_SYMBOL(sym)
+#define MODULE_DESCRIPTION(desc)
+#define MODULE_LICENSE(lic)
+
+/* The interpreter complains loudly about the malformed input we feed it */
+#define pr_err(fmt, ...)	do { } while (0)
+
+#define GFP_KERNEL		0
+#define kzalloc(size, gfp)	calloc(1, size)
+#define kfree(ptr)		free(ptr)
+
+static inline void *ERR_PTR(long error)
+{
+	return (void *)error;
+}
+
+static inline long PTR_ERR(const void *ptr)
+{
+	return (long)ptr;
+}
+
+static inline bool IS_ERR(const void *ptr)
+{
+	return (unsigned long)ptr >= (unsigned long)-4095;
+}
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+struct hlist_node {
+	struct hlist_node *next, **pprev;
+};
+
+struct hlist_head {
+	struct hlist_node *first;
+};
+
+/* Single threaded: RCU and spinlocks degenerate to plain list updates */
+#define DEFINE_SPINLOCK(x)	int x
+#define spin_lock(x)		((void)(x))
+#define spin_unlock(x)		((void)(x))
+#define rcu_read_lock()		do { } while (0)
+#define rcu_read_unlock()	do { } while (0)
+#define synchronize_rcu()	do { } while (0)
+
+#define DEFINE_HASHTABLE(name, bits)	struct hlist_head name[1 << (bits)]
+#define HASH_SIZE(name)			ARRAY_SIZE(name)
+#define hash_bucket(name, key)		(&(name)[(key) % HASH_SIZE(name)])
+
+static inline void hlist_add_head(struct hlist_node *n, struct hlist_head *h)
+{
+	n->next = h->first;
+	if (h->first)
+		h->first->pprev = &n->next;
+	h->first = n;
+	n->pprev = &h->first;
+}
+
+static inline void hlist_del(struct hlist_node *n)
+{
+	*n->pprev = n->next;
+	if (n->next)
+		n->next->pprev = n->pprev;
+}
+
+#define hash_add_rcu(name, node, key)	hlist_add_head(node, hash_bucket(name, key))
+#define hash_del_rcu(node)		hlist_del(node)
+
+#define hlist_entry_safe(ptr, type, member) \
+	({ struct hlist_node *__p = (ptr); \
+	   __p ? container_of(__p, type, member) : NULL; })
+
+#define hash_for_each_possible_rcu(name, obj, member, key) \
+	for (obj = hlist_entry_safe(hash_bucket(name, key)->first, \
+				    typeof(*(obj)), member); \
+	     obj; \
+	     obj = hlist_entry_safe((obj)->member.next, typeof(*(obj)), member))
+
+/* Types qmi.h embeds in struct qmi_handle and friends */
+struct completion {
+	int done;
+};
+
+struct idr {
+	int next;
+};
+
+struct mutex {
+	int locked;
+};
+
+struct work_struct {
+	int pending;
+};
+
+struct workqueue_struct;
+struct socket;
+
+struct sockaddr_qrtr {
+	unsigned short sq_family;
+	u32 sq_node;
+	u32 sq_port;
+};
+
+#endif
@@ -0,0 +1,253 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Multi-threaded ashmem pin/unpin throughput test.
+ *
+ * Every thread repeatedly unpins and pins a range of pages, either of its
+ * own area or of one area shared by all threads (-S), and reports the
+ * number of pin/unpin pairs per second. Optionally (-P) another thread
+ * keeps purging all unpinned ranges to put the shrinker path in the way.
+ *
+ * After every pin that reports ASHMEM_NOT_PURGED the contents written
+ * before the unpin must still be there; after ASHMEM_WAS_PURGED the pages
+ * must read back as zeroes.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#include "ashmem.h"
+
+#define KSFT_PASS	0
+#define KSFT_FAIL	1
+#define KSFT_SKIP	4
+
+static int nr_threads = 4;
+static int seconds = 5;
+static int nr_pages = 4;
+static bool shared;
+static bool purge;
+
+static volatile bool stop;
+static long page_size;
+
+struct worker {
+	pthread_t thread;
+	int fd;
+	char *map;
+	size_t offset;		/* of this worker's range in map */
+	unsigned long ops;
+	unsigned long purged;
+	unsigned long errors;
+};
+
+static int area_create(size_t size, char **map)
+{
+	int fd;
+
+	fd = open("/dev/ashmem", O_RDWR);
+	if (fd < 0)
+		return -1;
+
+	if (ioctl(fd, ASHMEM_SET_SIZE, size) < 0) {
+		perror("ASHMEM_SET_SIZE");
+		close(fd);
+		return -1;
+	}
+
+	*map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (*map == MAP_FAILED) {
+		perror("mmap");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static bool range_is(const char *p, size_t len, char c)
+{
+	size_t i;
+
+	for (i = 0; i < len; i += page_size)
+		if (p[i] != c)
+			return false;
+	return true;
+}
+
+static void *pin_thread(void *arg)
+{
+	struct worker *w = arg;
+	size_t len = nr_pages * page_size;
+	struct ashmem_pin pin = {
+		.offset = w->offset,
+		.len = len,
+	};
+	char *p = w->map + w->offset;
+	char c = 1;
+	int ret;
+
+	while (!stop) {
+		memset(p, c, len);
+
+		if (ioctl(w->fd, ASHMEM_UNPIN, &pin) < 0) {
+			w->errors++;
+			break;
+		}
+
+		ret = ioctl(w->fd, ASHMEM_PIN, &pin);
+		if (ret == ASHMEM_NOT_PURGED) {
+			if (!range_is(p, len, c))
+				w->errors++;
+		} else if (ret == ASHMEM_WAS_PURGED) {
+			if (!range_is(p, len, 0))
+				w->errors++;
+			w->purged++;
+		} else {
+			w->errors++;
+			break;
+		}
+
+		w->ops++;
+		c = c == 127 ? 1 : c + 1;
+	}
+	return NULL;
+}
+
+static void *purge_thread(void *arg)
+{
+	int fd = *(int *)arg;
+
+	while (!stop) {
+		if (ioctl(fd, ASHMEM_PURGE_ALL_CACHES) < 0)
+			break;
+		usleep(1000);
+	}
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-t threads] [-s seconds] [-p pages] [-S] [-P]\n"
+		"  -S  all threads use disjoint ranges of one area\n"
+		"  -P  purge unpinned ranges from another thread\n", prog);
+	exit(KSFT_FAIL);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long ops = 0, purged = 0, errors = 0;
+	struct timespec start, end;
+	struct worker *workers;
+	pthread_t purger;
+	char *shared_map = NULL;
+	int shared_fd = -1;
+	double elapsed;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "t:s:p:SP")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'p':
+			nr_pages = atoi(optarg);
+			break;
+		case 'S':
+			shared = true;
+			break;
+		case 'P':
+			purge = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nr_threads < 1 || seconds < 1 || nr_pages < 1)
+		usage(argv[0]);
+
+	if (access("/dev/ashmem", R_OK | W_OK)) {
+		printf("/dev/ashmem not available, skipping\n");
+		return KSFT_SKIP;
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers)
+		return KSFT_FAIL;
+
+	if (shared) {
+		shared_fd = area_create((size_t)nr_threads * nr_pages *
+					page_size, &shared_map);
+		if (shared_fd < 0)
+			return KSFT_FAIL;
+	}
+
+	for (i = 0; i < nr_threads; i++) {
+		struct worker *w = &workers[i];
+
+		if (shared) {
+			w->fd = shared_fd;
+			w->map = shared_map;
+			w->offset = (size_t)i * nr_pages * page_size;
+		} else {
+			w->fd = area_create(nr_pages * page_size, &w->map);
+			if (w->fd < 0)
+				return KSFT_FAIL;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&workers[i].thread, NULL, pin_thread,
+				   &workers[i])) {
+			perror("pthread_create");
+			return KSFT_FAIL;
+		}
+	}
+	if (purge && pthread_create(&purger, NULL, purge_thread,
+				    &workers[0].fd)) {
+		perror("pthread_create");
+		return KSFT_FAIL;
+	}
+
+	sleep(seconds);
+	stop = true;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		ops += workers[i].ops;
+		purged += workers[i].purged;
+		errors += workers[i].errors;
+	}
+	if (purge)
+		pthread_join(purger, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+		  (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("%d threads, %s areas, %d pages%s: %.0f pin/unpin per second, %lu purged\n",
+	       nr_threads, shared ? "shared" : "private", nr_pages,
+	       purge ? ", purging" : "", ops / elapsed, purged);
+
+	if (errors) {
+		printf("[FAIL]\t%lu errors\n", errors);
+		return KSFT_FAIL;
+	}
+	printf("[PASS]\n");
+	return KSFT_PASS;
+}
@@ -0,0 +1,93 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * fork+execve latency benchmark.
+ *
+ * Repeatedly forks and execs a binary (by default /bin/true, which is
+ * dynamically linked on most systems) and waits for it, then prints the
+ * average and percentile latencies of a fork+exec+exit round trip.  Run
+ * it with and without CONFIG_BINFMT_ELF_CACHE to compare exec costs.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n iterations] [binary [args...]]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	static char *def_argv[] = { "/bin/true", NULL };
+	unsigned long long *lat, total = 0, start;
+	char **exec_argv = def_argv;
+	int opt, i, status, iterations = 10000;
+	pid_t pid;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (iterations < 1)
+		usage(argv[0]);
+	if (optind < argc)
+		exec_argv = &argv[optind];
+
+	lat = calloc(iterations, sizeof(*lat));
+	if (!lat)
+		return 1;
+
+	for (i = 0; i < iterations; i++) {
+		start = now_ns();
+		pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			return 1;
+		}
+		if (!pid) {
+			execv(exec_argv[0], exec_argv);
+			_exit(127);
+		}
+		if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+		    WEXITSTATUS(status)) {
+			fprintf(stderr, "%s failed\n", exec_argv[0]);
+			return 1;
+		}
+		lat[i] = now_ns() - start;
+		total += lat[i];
+	}
+
+	qsort(lat, iterations, sizeof(*lat), cmp_ull);
+	printf("%s: %d fork+exec, avg %llu us p50 %llu us p99 %llu us\n",
+	       exec_argv[0], iterations, total / iterations / 1000,
+	       lat[iterations / 2] / 1000, lat[iterations * 99 / 100] / 1000);
+
+	free(lat);
+	return 0;
+}
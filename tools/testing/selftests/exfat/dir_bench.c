@@ -0,0 +1,187 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Big directory benchmark.
+ *
+ * Creates files named like a camera's DCIM folder in one directory and
+ * prints the create rate, then stats random existing and missing names for
+ * a few seconds and prints the lookup rates.  Every create and every
+ * missing name makes exFAT look for the name in the whole directory.
+ *
+ * With -R it instead unlinks every fourth of the files created before and
+ * creates as many with longer names, which need more directory entries
+ * than the holes left behind, and prints that create rate.  Each of these
+ * creates has to find free entries past all the holes.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static int nr_files = 50000;
+static int seconds = 5;
+static bool create = true, lookup = true, refill;
+static const char *dir;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void file_path(char *path, int i)
+{
+	snprintf(path, PATH_MAX, "%s/DSC%05d.JPG", dir, i);
+}
+
+/* A name two name entries long, one more than file_path() */
+static void long_file_path(char *path, int i)
+{
+	snprintf(path, PATH_MAX, "%s/IMG_20200101_%06d_HDR.jpg", dir, i);
+}
+
+static int create_files(void)
+{
+	char path[PATH_MAX];
+	double start, elapsed;
+	int i, fd;
+
+	start = now();
+	for (i = 0; i < nr_files; i++) {
+		file_path(path, i);
+		fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd < 0) {
+			perror(path);
+			return -1;
+		}
+		close(fd);
+	}
+	elapsed = now() - start;
+
+	printf("%d files: %.0f creates per second\n", nr_files,
+	       nr_files / elapsed);
+	return 0;
+}
+
+/* Unlink every fourth file, then create as many with longer names */
+static int refill_files(void)
+{
+	char path[PATH_MAX];
+	double start, elapsed;
+	int i, fd, nr = 0;
+
+	for (i = 0; i < nr_files; i += 4) {
+		file_path(path, i);
+		if (unlink(path)) {
+			perror(path);
+			return -1;
+		}
+		nr++;
+	}
+
+	start = now();
+	for (i = 0; i < nr; i++) {
+		long_file_path(path, i);
+		fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd < 0) {
+			perror(path);
+			return -1;
+		}
+		close(fd);
+	}
+	elapsed = now() - start;
+
+	printf("%d files, %d unlinked: %.0f creates per second\n", nr_files,
+	       nr, nr / elapsed);
+	return 0;
+}
+
+/* stat() random names that exist, or with @missing ones that do not */
+static int lookup_files(bool missing)
+{
+	unsigned long lookups = 0, errors = 0;
+	char path[PATH_MAX];
+	unsigned int seed = 1;
+	double start, end;
+	struct stat st;
+
+	start = now();
+	end = start + seconds;
+	while (now() < end) {
+		int i = rand_r(&seed) % nr_files;
+
+		file_path(path, missing ? i + nr_files : i);
+		if (stat(path, &st) != (missing ? -1 : 0) ||
+		    (missing && errno != ENOENT))
+			errors++;
+		lookups++;
+	}
+
+	printf("%d files: %.0f %s lookups per second\n", nr_files,
+	       lookups / (now() - start), missing ? "negative" : "positive");
+	if (errors) {
+		printf("%lu lookup errors\n", errors);
+		return -1;
+	}
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n files] [-s seconds] [-C | -L | -R] directory\n"
+		"  -C  only create the files\n"
+		"  -L  only look up files created before\n"
+		"  -R  only unlink some files created before and create others\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:s:CLR")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_files = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'C':
+			lookup = false;
+			break;
+		case 'L':
+			create = false;
+			break;
+		case 'R':
+			create = false;
+			lookup = false;
+			refill = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || nr_files < 1 || seconds < 1 ||
+	    (!create && !lookup && !refill))
+		usage(argv[0]);
+	dir = argv[optind];
+
+	if (create && create_files())
+		return 1;
+	if (lookup && (lookup_files(false) || lookup_files(true)))
+		return 1;
+	if (refill && refill_files())
+		return 1;
+	return 0;
+}
@@ -0,0 +1,435 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Consistency test for the exFAT directory index.
+ *
+ * Runs random creates, unlinks, renames within and between two big
+ * directories (with names of varying length, so that entry sets move and
+ * leave holes of different sizes behind) and lookups of present and
+ * missing names, and compares every result and, every so often, the
+ * listing of both directories with a model.  It then fills the file
+ * system and renames files to longer names until a rename fails with
+ * ENOSPC, after the index may already have been changed, and checks
+ * that both names still resolve as before.
+ *
+ * The expected listing is saved to STATE, and with -c it is compared
+ * with the directories after a remount, when the index is rebuilt.
+ *
+ * usage: dir_index_test [-c] [-n names] [-o ops] dir state
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_NAME_LEN	200
+#define NR_DIRS		2
+
+static int nr_ids = 3000;
+static int nr_ops = 30000;
+static const char *top;
+static unsigned int seed = 1;
+
+/* Each id has at most one name: in dir[id] with name_len[id] characters */
+static int *dir_of;		/* -1 if absent */
+static int *len_of;
+
+static void name_of(char *name, int id, int len)
+{
+	int n = snprintf(name, MAX_NAME_LEN + 1, "%05d", id);
+
+	for (; n < len; n++)
+		name[n] = 'a' + (id + n) % 26;
+	name[n] = '\0';
+}
+
+static void path_of(char *path, int dir, int id, int len)
+{
+	char name[MAX_NAME_LEN + 1];
+
+	name_of(name, id, len);
+	snprintf(path, PATH_MAX, "%s/%c/%s", top, 'a' + dir, name);
+}
+
+static int rand_len(void)
+{
+	/* mostly short names, some needing many name entries */
+	return rand_r(&seed) % 4 ? 8 + rand_r(&seed) % 24 :
+		32 + rand_r(&seed) % (MAX_NAME_LEN - 32);
+}
+
+static int fail(const char *what, const char *path, int err)
+{
+	printf("FAIL: %s %s: %s\n", what, path, err ? strerror(err) : "");
+	return -1;
+}
+
+static int check_lookup(int id)
+{
+	char path[PATH_MAX];
+	struct stat st;
+	int dir, len, ret;
+
+	/* the name it has, if any */
+	if (dir_of[id] >= 0) {
+		path_of(path, dir_of[id], id, len_of[id]);
+		if (stat(path, &st))
+			return fail("lookup of present", path, errno);
+	}
+	/* and some it does not have */
+	for (dir = 0; dir < NR_DIRS; dir++) {
+		len = rand_len();
+		if (dir == dir_of[id] && len == len_of[id])
+			continue;
+		path_of(path, dir, id, len);
+		ret = stat(path, &st);
+		if (!ret || errno != ENOENT)
+			return fail("lookup of missing", path, ret ? errno : 0);
+	}
+	return 0;
+}
+
+static int do_create(int id)
+{
+	char path[PATH_MAX];
+	int dir = rand_r(&seed) % NR_DIRS, len, fd;
+
+	if (dir_of[id] >= 0) {
+		/* O_EXCL must find the existing name */
+		path_of(path, dir_of[id], id, len_of[id]);
+		fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd >= 0 || errno != EEXIST)
+			return fail("create of existing", path,
+				    fd < 0 ? errno : 0);
+		return 0;
+	}
+
+	len = rand_len();
+	path_of(path, dir, id, len);
+	fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (fd < 0)
+		return fail("create", path, errno);
+	close(fd);
+	dir_of[id] = dir;
+	len_of[id] = len;
+	return 0;
+}
+
+static int do_unlink(int id)
+{
+	char path[PATH_MAX];
+
+	if (dir_of[id] < 0) {
+		path_of(path, rand_r(&seed) % NR_DIRS, id, rand_len());
+		if (!unlink(path) || errno != ENOENT)
+			return fail("unlink of missing", path, errno);
+		return 0;
+	}
+
+	path_of(path, dir_of[id], id, len_of[id]);
+	if (unlink(path))
+		return fail("unlink", path, errno);
+	dir_of[id] = -1;
+	return 0;
+}
+
+/*
+ * Rename @id to @new_id, over its current name if it has one.  Returns
+ * the errno of a rename the model allows to fail with @may_fail.
+ */
+static int do_rename(int id, int new_id, int may_fail)
+{
+	char from[PATH_MAX], to[PATH_MAX];
+	int dir, len;
+
+	if (dir_of[id] < 0 || id == new_id)
+		return 0;
+	if (dir_of[new_id] >= 0) {
+		dir = dir_of[new_id];
+		len = len_of[new_id];
+	} else {
+		dir = rand_r(&seed) % NR_DIRS;
+		len = may_fail ? MAX_NAME_LEN : rand_len();
+	}
+
+	path_of(from, dir_of[id], id, len_of[id]);
+	path_of(to, dir, new_id, len);
+	if (rename(from, to)) {
+		if (errno == may_fail)
+			return errno;
+		return fail("rename", from, errno);
+	}
+	dir_of[id] = -1;
+	dir_of[new_id] = dir;
+	len_of[new_id] = len;
+	return 0;
+}
+
+static int cmp_str(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* Compare the listing of @dir with the model */
+static int check_dir(int dir)
+{
+	char path[PATH_MAX], name[MAX_NAME_LEN + 1];
+	char **names = calloc(nr_ids, sizeof(*names));
+	int nr = 0, i, id, ret = -1;
+	struct dirent *d;
+	DIR *dp;
+
+	snprintf(path, sizeof(path), "%s/%c", top, 'a' + dir);
+	dp = opendir(path);
+	if (!names || !dp) {
+		perror(path);
+		goto out;
+	}
+	while ((d = readdir(dp))) {
+		if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, ".."))
+			continue;
+		id = atoi(d->d_name);
+		name_of(name, id, strlen(d->d_name));
+		if (id < 0 || id >= nr_ids || strcmp(name, d->d_name) ||
+		    dir_of[id] != dir || len_of[id] != (int)strlen(d->d_name)) {
+			printf("FAIL: %s/%s should not exist\n", path,
+			       d->d_name);
+			goto out;
+		}
+		if (nr == nr_ids) {
+			printf("FAIL: %s: too many entries\n", path);
+			goto out;
+		}
+		names[nr++] = strdup(d->d_name);
+	}
+	qsort(names, nr, sizeof(*names), cmp_str);
+	for (i = 1; i < nr; i++) {
+		if (!strcmp(names[i - 1], names[i])) {
+			printf("FAIL: %s/%s listed twice\n", path, names[i]);
+			goto out;
+		}
+	}
+	for (id = 0, i = 0; id < nr_ids; id++)
+		i += dir_of[id] == dir;
+	if (i != nr) {
+		printf("FAIL: %s: %d entries, expected %d\n", path, nr, i);
+		goto out;
+	}
+	ret = 0;
+out:
+	if (dp)
+		closedir(dp);
+	for (i = 0; i < nr; i++)
+		free(names[i]);
+	free(names);
+	return ret;
+}
+
+static int check_all(const char *step)
+{
+	int dir, id;
+
+	for (dir = 0; dir < NR_DIRS; dir++)
+		if (check_dir(dir))
+			goto fail;
+	for (id = 0; id < nr_ids; id++)
+		if (check_lookup(id))
+			goto fail;
+	printf("ok: %s\n", step);
+	return 0;
+fail:
+	printf("FAIL: %s\n", step);
+	return -1;
+}
+
+static int random_ops(int nr)
+{
+	int i, id, op;
+
+	for (i = 0; i < nr; i++) {
+		id = rand_r(&seed) % nr_ids;
+		op = rand_r(&seed) % 8;
+		if (op < 3 ? do_create(id) :
+		    op < 4 ? do_unlink(id) :
+		    op < 6 ? do_rename(id, rand_r(&seed) % nr_ids, 0) :
+		    check_lookup(id))
+			return -1;
+	}
+	return 0;
+}
+
+/* Fill the file system, returns the fd of the file that does it */
+static int fill_fs(void)
+{
+	char path[PATH_MAX], buf[65536];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/fill", top);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	memset(buf, 0, sizeof(buf));
+	while (write(fd, buf, sizeof(buf)) > 0)
+		;
+	while (write(fd, buf, 512) > 0)
+		;
+	return fd;
+}
+
+/* Renames to the longest names until one fails for want of space */
+static int failed_rename(void)
+{
+	char path[PATH_MAX];
+	int i, id, fd, ret;
+
+	fd = fill_fs();
+	if (fd < 0)
+		return -1;
+
+	for (i = 0; i < 10 * nr_ids; i++) {
+		id = rand_r(&seed) % nr_ids;
+		if (dir_of[id] < 0)
+			continue;
+		ret = do_rename(id, rand_r(&seed) % nr_ids, ENOSPC);
+		if (ret < 0)
+			return -1;
+		if (ret == ENOSPC)
+			break;
+	}
+	if (i == 10 * nr_ids)
+		printf("no rename failed with ENOSPC\n");
+	/* the directories are unchanged and the index must agree */
+	if (check_all("failed rename"))
+		return -1;
+
+	snprintf(path, sizeof(path), "%s/fill", top);
+	close(fd);
+	if (unlink(path)) {
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
+
+static int save_state(const char *state)
+{
+	FILE *f = fopen(state, "w");
+	int id;
+
+	if (!f) {
+		perror(state);
+		return -1;
+	}
+	for (id = 0; id < nr_ids; id++)
+		fprintf(f, "%d %d\n", dir_of[id], len_of[id]);
+	return fclose(f);
+}
+
+static int load_state(const char *state)
+{
+	FILE *f = fopen(state, "r");
+	int id;
+
+	if (!f) {
+		perror(state);
+		return -1;
+	}
+	for (id = 0; id < nr_ids; id++) {
+		if (fscanf(f, "%d %d", &dir_of[id], &len_of[id]) != 2) {
+			fprintf(stderr, "%s: bad state\n", state);
+			fclose(f);
+			return -1;
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+static int run(void)
+{
+	char path[PATH_MAX];
+	int dir, id;
+
+	for (dir = 0; dir < NR_DIRS; dir++) {
+		snprintf(path, sizeof(path), "%s/%c", top, 'a' + dir);
+		if (mkdir(path, 0755)) {
+			perror(path);
+			return -1;
+		}
+	}
+
+	/* big enough directories to get an index */
+	for (id = 0; id < nr_ids; id++)
+		if (do_create(id))
+			return -1;
+	if (check_all("create"))
+		return -1;
+
+	for (; nr_ops > 0; nr_ops -= nr_ids) {
+		if (random_ops(nr_ops < nr_ids ? nr_ops : nr_ids) ||
+		    check_all("random operations"))
+			return -1;
+	}
+
+	if (failed_rename())
+		return -1;
+	if (random_ops(nr_ids) || check_all("operations after the failure"))
+		return -1;
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-c] [-n names] [-o ops] dir state\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	bool check_only = false;
+	int opt, id, ret;
+
+	while ((opt = getopt(argc, argv, "cn:o:")) != -1) {
+		switch (opt) {
+		case 'c':
+			check_only = true;
+			break;
+		case 'n':
+			nr_ids = atoi(optarg);
+			break;
+		case 'o':
+			nr_ops = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 2 || nr_ids < 1 || nr_ids > 99999)
+		usage(argv[0]);
+	top = argv[optind];
+
+	dir_of = calloc(nr_ids, sizeof(*dir_of));
+	len_of = calloc(nr_ids, sizeof(*len_of));
+	if (!dir_of || !len_of)
+		return 1;
+	for (id = 0; id < nr_ids; id++)
+		dir_of[id] = -1;
+
+	if (check_only)
+		ret = load_state(argv[optind + 1]) ||
+		      check_all("after remount");
+	else
+		ret = run() || save_state(argv[optind + 1]);
+
+	printf("%s\n", ret ? "FAIL" : "PASS");
+	return ret ? 1 : 0;
+}
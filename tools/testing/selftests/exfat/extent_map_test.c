@@ -0,0 +1,286 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Check the data of a fragmented file on exFAT while its cluster map is
+ * being extended and dropped.
+ *
+ * The file is created with its clusters interleaved with those of a
+ * second, removed file, read back at random offsets (which builds the
+ * extent map of the FAT chain), and then appended to, both in small
+ * interleaved steps and in one big write, truncated and grown again, with
+ * the whole file checked after every step.  Every block holds a pattern
+ * derived from its offset and from the step that wrote it, so a block
+ * mapped to the wrong cluster is caught.
+ *
+ * With -c nothing is written and only the final contents are checked, so
+ * that the file can be checked again from a cold inode after a remount.
+ *
+ * usage: extent_map_test [-c] [-k cluster size] dir
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_BLOCKS	8192
+#define RANDOM_READS	4096
+
+static size_t blk_size = 4096;
+static bool check_only;
+static char path[PATH_MAX], frag_path[PATH_MAX];
+static int fd = -1, rfd = -1, frag_fd = -1;
+static void *buf;
+
+/* Expected contents: the step that wrote each block, 0 for zeroes */
+static unsigned char gen[MAX_BLOCKS];
+static off_t nr_blocks;
+
+static uint64_t word_at(off_t blk, size_t i, unsigned char g)
+{
+	if (!g)
+		return 0;
+	return (uint64_t)g << 56 ^ (blk * blk_size + i * sizeof(uint64_t));
+}
+
+static void fill(uint64_t *p, off_t blk, unsigned char g)
+{
+	size_t i;
+
+	for (i = 0; i < blk_size / sizeof(*p); i++)
+		p[i] = word_at(blk, i, g);
+}
+
+static int check_block(off_t blk)
+{
+	const uint64_t *p = buf;
+	ssize_t ret;
+	size_t i;
+
+	ret = pread(rfd, buf, blk_size, blk * blk_size);
+	if (ret != (ssize_t)blk_size) {
+		printf("FAIL: read of block %lld returned %zd: %s\n",
+		       (long long)blk, ret, ret < 0 ? strerror(errno) : "");
+		return -1;
+	}
+	for (i = 0; i < blk_size / sizeof(*p); i++) {
+		uint64_t want = word_at(blk, i, gen[blk]);
+
+		if (p[i] != want) {
+			printf("FAIL: block %lld word %zu: %#llx, expected %#llx\n",
+			       (long long)blk, i, (unsigned long long)p[i],
+			       (unsigned long long)want);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Random reads first, so that the map is used out of order, then all */
+static int check_file(const char *step)
+{
+	unsigned int seed = nr_blocks;
+	off_t blk;
+	int i;
+
+	if (!check_only && fsync(fd)) {
+		perror("fsync");
+		return -1;
+	}
+	if (lseek(rfd, 0, SEEK_END) != nr_blocks * (off_t)blk_size) {
+		printf("FAIL: %s: size %lld, expected %lld\n", step,
+		       (long long)lseek(rfd, 0, SEEK_END),
+		       (long long)(nr_blocks * blk_size));
+		return -1;
+	}
+	for (i = 0; i < RANDOM_READS && nr_blocks; i++)
+		if (check_block(rand_r(&seed) % nr_blocks))
+			goto fail;
+	for (blk = 0; blk < nr_blocks; blk++)
+		if (check_block(blk))
+			goto fail;
+	if (pread(rfd, buf, blk_size, nr_blocks * blk_size) != 0) {
+		printf("FAIL: %s: read past the end returned data\n", step);
+		return -1;
+	}
+	printf("ok: %s, %lld blocks\n", step, (long long)nr_blocks);
+	return 0;
+fail:
+	printf("FAIL: %s\n", step);
+	return -1;
+}
+
+/*
+ * Append @n blocks written by step @g, one block at a time with a block
+ * of the fragmentation file in between if @interleave, otherwise with a
+ * single write.
+ */
+static int append(int n, unsigned char g, bool interleave)
+{
+	char *p;
+	int i;
+
+	if (nr_blocks + n > MAX_BLOCKS)
+		return -1;
+	for (i = 0; i < n; i++)
+		gen[nr_blocks + i] = g;
+	if (check_only) {
+		nr_blocks += n;
+		return 0;
+	}
+
+	if (interleave) {
+		for (i = 0; i < n; i++, nr_blocks++) {
+			fill(buf, nr_blocks, g);
+			if (pwrite(fd, buf, blk_size, nr_blocks * blk_size) !=
+			    (ssize_t)blk_size ||
+			    write(frag_fd, buf, blk_size) != (ssize_t)blk_size) {
+				perror("pwrite");
+				return -1;
+			}
+		}
+		return 0;
+	}
+
+	p = malloc(n * blk_size);
+	if (!p)
+		return -1;
+	for (i = 0; i < n; i++)
+		fill((uint64_t *)(p + i * blk_size), nr_blocks + i, g);
+	if (pwrite(fd, p, n * blk_size, nr_blocks * blk_size) !=
+	    (ssize_t)(n * blk_size)) {
+		perror("pwrite");
+		free(p);
+		return -1;
+	}
+	free(p);
+	nr_blocks += n;
+	return 0;
+}
+
+static int truncate_to(off_t blocks)
+{
+	off_t blk;
+
+	for (blk = blocks; blk < nr_blocks; blk++)
+		gen[blk] = 0;
+	for (blk = nr_blocks; blk < blocks; blk++)
+		gen[blk] = 0;
+	nr_blocks = blocks;
+	if (!check_only && ftruncate(fd, blocks * blk_size)) {
+		perror("ftruncate");
+		return -1;
+	}
+	return 0;
+}
+
+/* Drop the fragmentation file, leaving holes between the file's runs */
+static int unfragment(void)
+{
+	if (check_only)
+		return 0;
+	if (ftruncate(frag_fd, 0) || lseek(frag_fd, 0, SEEK_SET)) {
+		perror(frag_path);
+		return -1;
+	}
+	return 0;
+}
+
+static int check_step(const char *step)
+{
+	return check_only ? 0 : check_file(step);
+}
+
+static int run_steps(void)
+{
+	/* A fragmented file, read back: this builds the map */
+	if (append(2048, 1, true) || unfragment() ||
+	    check_step("create"))
+		return -1;
+	/* Appends extending the map by one cluster at a time ... */
+	if (append(512, 2, true) || unfragment() ||
+	    check_step("interleaved append"))
+		return -1;
+	/* ... and by many at once */
+	if (append(1024, 3, false) || check_step("contiguous append"))
+		return -1;
+	/* Cut into runs in the middle and at the start of the file */
+	if (truncate_to(1500) || check_step("truncate") ||
+	    truncate_to(1) || check_step("truncate to one cluster"))
+		return -1;
+	/* Appends after the map was dropped, before and after a rebuild */
+	if (append(1023, 4, true) || unfragment() ||
+	    append(512, 5, true) || unfragment() ||
+	    check_step("append after truncate"))
+		return -1;
+	if (append(512, 6, true) || unfragment() ||
+	    check_step("append to the rebuilt map"))
+		return -1;
+	/* Growing with ftruncate() allocates zeroed clusters */
+	if (truncate_to(nr_blocks + 256) || check_step("extend"))
+		return -1;
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-c] [-k cluster size] dir\n", prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, ret = 1;
+
+	while ((opt = getopt(argc, argv, "ck:")) != -1) {
+		switch (opt) {
+		case 'c':
+			check_only = true;
+			break;
+		case 'k':
+			blk_size = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || blk_size < 512 ||
+	    blk_size % sizeof(uint64_t))
+		usage(argv[0]);
+
+	snprintf(path, sizeof(path), "%s/file", argv[optind]);
+	snprintf(frag_path, sizeof(frag_path), "%s/frag", argv[optind]);
+	if (posix_memalign(&buf, blk_size, blk_size))
+		return 1;
+
+	if (!check_only) {
+		fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		frag_fd = open(frag_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0 || frag_fd < 0) {
+			perror("open");
+			return 1;
+		}
+	}
+	rfd = open(path, O_RDONLY | O_DIRECT);
+	if (rfd < 0) {
+		perror(path);
+		return 1;
+	}
+
+	if (run_steps())
+		goto out;
+	if (check_only && check_file("after remount"))
+		goto out;
+	if (!check_only && unlink(frag_path)) {
+		perror(frag_path);
+		goto out;
+	}
+	ret = 0;
+out:
+	printf("%s\n", ret ? "FAIL" : "PASS");
+	return ret;
+}
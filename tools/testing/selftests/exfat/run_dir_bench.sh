@@ -0,0 +1,32 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Run dir_bench on an exFAT file system on a loop device: create 50000
+# files in one directory, then remount and look them up, then remount
+# and replace every fourth of them with a file with a longer name.
+#
+# usage: run_dir_bench.sh [number of files]
+
+readonly NR_FILES="${1:-50000}"
+readonly BIN="$(dirname "$0")/dir_bench"
+
+source "$(dirname "$0")/../lib/scratch_fs.sh"
+
+set -e
+
+loop_image_setup exfat 1G mkfs.exfat
+
+loop_image_mount
+mkdir "${MNT}/DCIM"
+"$BIN" -C -n "$NR_FILES" "${MNT}/DCIM"
+umount "$MNT"
+
+# Look the files up with cold dentry and inode caches
+loop_image_mount
+"$BIN" -L -n "$NR_FILES" "${MNT}/DCIM"
+umount "$MNT"
+
+# Creates past holes too small for them
+loop_image_mount
+"$BIN" -R -n "$NR_FILES" "${MNT}/DCIM"
+umount "$MNT"
@@ -0,0 +1,27 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Run dir_index_test on a small exFAT file system on a loop device, so
+# that it can be filled to make renames fail, then check the directories
+# again after a remount, with the index built from scratch.
+
+readonly BIN="$(dirname "$0")/dir_index_test"
+
+source "$(dirname "$0")/../lib/scratch_fs.sh"
+
+set -e
+
+loop_image_setup exfat 64M mkfs.exfat
+readonly STATE="${DIR}/state"
+
+if ! loop_image_mount; then
+	echo "SKIP: cannot mount exfat"
+	exit $ksft_skip
+fi
+
+set +e
+
+"$BIN" "$MNT" "$STATE" || exit 1
+umount "$MNT" || exit 1
+loop_image_mount || exit 1
+"$BIN" -c "$MNT" "$STATE"
@@ -0,0 +1,26 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Run extent_map_test on an exFAT file system with 4K clusters on a loop
+# device, then check the file again from a cold inode after a remount.
+
+readonly CLUSTER=4096
+readonly BIN="$(dirname "$0")/extent_map_test"
+
+source "$(dirname "$0")/../lib/scratch_fs.sh"
+
+set -e
+
+loop_image_setup exfat 256M mkfs.exfat -c $CLUSTER
+
+if ! loop_image_mount; then
+	echo "SKIP: cannot mount exfat"
+	exit $ksft_skip
+fi
+
+set +e
+
+"$BIN" -k $CLUSTER "$MNT" || exit 1
+umount "$MNT" || exit 1
+loop_image_mount || exit 1
+"$BIN" -c -k $CLUSTER "$MNT"
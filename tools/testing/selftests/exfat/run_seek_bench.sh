@@ -0,0 +1,29 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Run seek_bench against fragmented files of growing size on an exFAT file
+# system with 4K clusters on a loop device.
+#
+# usage: run_seek_bench.sh [seconds per run]
+
+readonly SECONDS_PER_RUN="${1:-5}"
+readonly CLUSTER=4096
+readonly BIN="$(dirname "$0")/seek_bench"
+
+source "$(dirname "$0")/../lib/scratch_fs.sh"
+
+set -e
+
+loop_image_setup exfat 4G mkfs.exfat -c $CLUSTER
+
+for mb in 64 256 1024; do
+	loop_image_mount
+	"$BIN" -s 1 -C $mb -k $CLUSTER "${MNT}/file" > /dev/null
+	umount "$MNT"
+
+	# Start from a cold inode, so that the first read walks the chain
+	loop_image_mount
+	"$BIN" -s "$SECONDS_PER_RUN" "${MNT}/file"
+	rm "${MNT}/file"
+	umount "$MNT"
+done
@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Random seek benchmark for big fragmented files.
+ *
+ * Issues block sized O_DIRECT preads at random offsets of one file and
+ * prints their latency.  On exFAT every read has to find the cluster at
+ * that offset in the file's FAT chain, so with a fragmented file this
+ * mostly measures how long the FAT chain lookups take.
+ *
+ * With -C the file is created first, by appending to it and to a second
+ * file in turns, one chunk at a time, and removing the second file, so
+ * that its clusters are interleaved with holes.  Every 64 bit word of the
+ * file holds its own offset, and the data of every read is checked.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LAT_BUCKETS	100000	/* 1 us each, up to 100 ms */
+
+static int seconds = 5;
+static size_t block_size = 4096;
+static size_t chunk_size = 4096;
+static unsigned long create_mb;
+static const char *path;
+
+static unsigned int lat[LAT_BUCKETS];
+
+static void fill(uint64_t *p, off_t off, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len / sizeof(*p); i++)
+		p[i] = off + i * sizeof(*p);
+}
+
+static bool check(const uint64_t *p, off_t off, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len / sizeof(*p); i++)
+		if (p[i] != (uint64_t)(off + i * sizeof(*p)))
+			return false;
+	return true;
+}
+
+static unsigned long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static int create_fragmented(void)
+{
+	char tmp[PATH_MAX];
+	off_t off, size = (off_t)create_mb << 20;
+	int fd, tmp_fd, ret = -1;
+	char *buf;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	buf = malloc(chunk_size);
+	if (!buf)
+		return -1;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	tmp_fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || tmp_fd < 0) {
+		perror("open");
+		goto out;
+	}
+
+	for (off = 0; off < size; off += chunk_size) {
+		fill((uint64_t *)buf, off, chunk_size);
+		if (pwrite(fd, buf, chunk_size, off) != (ssize_t)chunk_size ||
+		    pwrite(tmp_fd, buf, chunk_size, off) != (ssize_t)chunk_size) {
+			perror("pwrite");
+			goto out;
+		}
+	}
+	if (fsync(fd) || unlink(tmp)) {
+		perror(path);
+		goto out;
+	}
+	ret = 0;
+out:
+	if (fd >= 0)
+		close(fd);
+	if (tmp_fd >= 0)
+		close(tmp_fd);
+	free(buf);
+	return ret;
+}
+
+static unsigned long percentile(unsigned long total, double pct)
+{
+	unsigned long want = total * pct / 100, seen = 0;
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += lat[i];
+		if (seen > want)
+			break;
+	}
+	return i + 1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-s seconds] [-b block size] [-C MB [-k chunk size]] file\n"
+		"  -C  first create a fragmented file of this size\n"
+		"  -k  size of the fragments, usually the cluster size\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long start, end, us, total_us = 0, first_us = 0;
+	unsigned long reads = 0, errors = 0, corrupt = 0;
+	unsigned int seed = 1;
+	off_t nr_blocks;
+	struct stat st;
+	void *buf;
+	int opt, fd;
+
+	while ((opt = getopt(argc, argv, "s:b:C:k:")) != -1) {
+		switch (opt) {
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'b':
+			block_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'C':
+			create_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			chunk_size = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || seconds < 1 || !block_size || !chunk_size ||
+	    block_size % sizeof(uint64_t) || chunk_size % sizeof(uint64_t))
+		usage(argv[0]);
+	path = argv[optind];
+
+	if (create_mb && create_fragmented())
+		return 1;
+
+	fd = open(path, O_RDONLY | O_DIRECT);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(path);
+		return 1;
+	}
+	nr_blocks = st.st_size / block_size;
+	if (!nr_blocks) {
+		fprintf(stderr, "%s: smaller than one block\n", path);
+		return 1;
+	}
+	if (posix_memalign(&buf, block_size, block_size))
+		return 1;
+
+	start = now_us();
+	end = start + seconds * 1000000ULL;
+	while ((us = now_us()) < end) {
+		off_t blk = ((off_t)rand_r(&seed) << 16 ^
+			     rand_r(&seed)) % nr_blocks;
+
+		if (pread(fd, buf, block_size, blk * block_size) !=
+		    (ssize_t)block_size) {
+			errors++;
+			continue;
+		}
+		us = now_us() - us;
+		if (!check(buf, blk * block_size, block_size))
+			corrupt++;
+		if (!reads)
+			first_us = us;
+		reads++;
+		total_us += us;
+		lat[us < LAT_BUCKETS ? us : LAT_BUCKETS - 1]++;
+	}
+
+	printf("%llu MB file, %zu byte reads: %lu reads, first %llu us, avg %.1f us, p50 %lu us, p99 %lu us\n",
+	       (unsigned long long)st.st_size >> 20, block_size, reads,
+	       first_us, reads ? (double)total_us / reads : 0.0,
+	       percentile(reads, 50), percentile(reads, 99));
+
+	free(buf);
+	close(fd);
+
+	if (errors || corrupt) {
+		printf("%lu read errors, %lu reads with wrong data\n",
+		       errors, corrupt);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Parallel random read benchmark.
+ *
+ * N threads issue block sized O_DIRECT preads at random offsets of one
+ * file. Every read maps its block through ext4_map_blocks(), so with a
+ * fragmented file cached in the extent status tree this mostly measures
+ * how well extent status lookups scale with the number of readers.
+ *
+ * The file is made by -c: every even block is filled with its block
+ * number and every odd block is a hole, so that each read can check it
+ * got the data of the block it asked for.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static int nr_threads = 4;
+static int seconds = 5;
+static size_t block_size = 4096;
+static int open_flags = O_RDONLY | O_DIRECT;
+static const char *path;
+
+static off_t nr_blocks;
+static volatile bool stop;
+
+struct reader {
+	pthread_t thread;
+	unsigned int seed;
+	unsigned long reads;
+	unsigned long errors;
+	unsigned long bad;
+};
+
+/* even blocks hold their number in every word, odd blocks are holes */
+static bool block_ok(const uint64_t *buf, off_t blk)
+{
+	uint64_t expect = blk & 1 ? 0 : blk;
+	size_t i;
+
+	for (i = 0; i < block_size / sizeof(*buf); i++)
+		if (buf[i] != expect)
+			return false;
+	return true;
+}
+
+static int create_file(const char *name, long mb)
+{
+	uint64_t *buf;
+	off_t blk, n = mb * 1048576 / block_size;
+	size_t i;
+	int fd;
+
+	fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || posix_memalign((void **)&buf, block_size, block_size)) {
+		perror(name);
+		return 1;
+	}
+
+	for (blk = 0; blk < n; blk++) {
+		for (i = 0; i < block_size / sizeof(*buf); i++)
+			buf[i] = blk;
+		if (pwrite(fd, buf, block_size, blk * block_size) !=
+		    (ssize_t)block_size) {
+			perror("pwrite");
+			return 1;
+		}
+	}
+
+	/* one extent per block */
+	for (blk = 1; blk < n; blk += 2) {
+		if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+			      blk * block_size, block_size)) {
+			perror("fallocate");
+			return 1;
+		}
+	}
+
+	free(buf);
+	if (fsync(fd) || close(fd)) {
+		perror(name);
+		return 1;
+	}
+	return 0;
+}
+
+static void *read_thread(void *arg)
+{
+	struct reader *r = arg;
+	void *buf;
+	int fd;
+
+	fd = open(path, open_flags);
+	if (fd < 0) {
+		perror("open");
+		r->errors++;
+		return NULL;
+	}
+	if (posix_memalign(&buf, block_size, block_size)) {
+		r->errors++;
+		close(fd);
+		return NULL;
+	}
+
+	while (!stop) {
+		off_t blk = ((off_t)rand_r(&r->seed) << 16 ^
+			     rand_r(&r->seed)) % nr_blocks;
+
+		if (pread(fd, buf, block_size, blk * block_size) !=
+		    (ssize_t)block_size)
+			r->errors++;
+		else if (!block_ok(buf, blk))
+			r->bad++;
+		else
+			r->reads++;
+	}
+
+	free(buf);
+	close(fd);
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-t threads] [-s seconds] [-b block size] [-B] file\n"
+		"       %s [-b block size] -c MB file\n"
+		"  -B  buffered reads instead of O_DIRECT\n"
+		"  -c  create the test file, of MB megabytes\n", prog, prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long reads = 0, errors = 0, bad = 0;
+	struct timespec start, end;
+	struct reader *readers;
+	struct stat st;
+	double elapsed;
+	long create_mb = 0;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "t:s:b:Bc:")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'b':
+			block_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'B':
+			open_flags &= ~O_DIRECT;
+			break;
+		case 'c':
+			create_mb = atol(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || nr_threads < 1 || seconds < 1 ||
+	    !block_size || block_size % sizeof(uint64_t))
+		usage(argv[0]);
+	path = argv[optind];
+
+	if (create_mb > 0)
+		return create_file(path, create_mb);
+
+	if (stat(path, &st)) {
+		perror(path);
+		return 1;
+	}
+	nr_blocks = st.st_size / block_size;
+	if (!nr_blocks) {
+		fprintf(stderr, "%s: smaller than one block\n", path);
+		return 1;
+	}
+
+	readers = calloc(nr_threads, sizeof(*readers));
+	if (!readers)
+		return 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nr_threads; i++) {
+		readers[i].seed = i + 1;
+		if (pthread_create(&readers[i].thread, NULL, read_thread,
+				   &readers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	sleep(seconds);
+	stop = true;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(readers[i].thread, NULL);
+		reads += readers[i].reads;
+		errors += readers[i].errors;
+		bad += readers[i].bad;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+		  (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("%d threads, %zu byte %s reads: %.0f reads per second, %.2f us per read\n",
+	       nr_threads, block_size,
+	       open_flags & O_DIRECT ? "direct" : "buffered",
+	       reads / elapsed,
+	       reads ? elapsed * 1e6 * nr_threads / reads : 0.0);
+
+	if (errors || bad) {
+		printf("%lu read errors, %lu reads returned wrong data\n",
+		       errors, bad);
+		return 1;
+	}
+	return 0;
+}
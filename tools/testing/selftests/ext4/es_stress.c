@@ -0,0 +1,303 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Extent status tree stress test.
+ *
+ * Writer threads keep punching out blocks of one file and writing them
+ * back, which inserts, merges, splits and removes extent status entries
+ * all the time, while reader threads do O_DIRECT reads of random blocks,
+ * which look them up without i_es_lock. Optionally (-d) another thread
+ * keeps running the extent status shrinker through drop_caches.
+ *
+ * A block only ever holds its own block number in every word, or zeroes,
+ * so a read that returns anything else got the data of another block: a
+ * lookup returned a wrong or stale mapping.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BLOCK_SIZE	4096
+#define WORDS		(BLOCK_SIZE / sizeof(uint64_t))
+
+static int nr_readers = 4;
+static int nr_writers = 2;
+static int seconds = 10;
+static off_t nr_blocks = 16384;
+static bool drop_caches;
+static const char *path;
+
+static volatile bool stop;
+
+struct worker {
+	pthread_t thread;
+	unsigned int seed;
+	unsigned long ops;
+	unsigned long errors;
+	unsigned long bad;
+};
+
+static off_t random_block(unsigned int *seed)
+{
+	return ((off_t)rand_r(seed) << 16 ^ rand_r(seed)) % nr_blocks;
+}
+
+static void fill(uint64_t *buf, off_t blk)
+{
+	size_t i;
+
+	for (i = 0; i < WORDS; i++)
+		buf[i] = blk;
+}
+
+static bool block_ok(const uint64_t *buf, off_t blk)
+{
+	size_t i;
+
+	/* words, not the whole block: a read may race with the write */
+	for (i = 0; i < WORDS; i++)
+		if (buf[i] != (uint64_t)blk && buf[i] != 0)
+			return false;
+	return true;
+}
+
+static void *reader(void *arg)
+{
+	struct worker *w = arg;
+	uint64_t *buf;
+	off_t blk;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_DIRECT);
+	if (fd < 0 || posix_memalign((void **)&buf, BLOCK_SIZE, BLOCK_SIZE)) {
+		w->errors++;
+		return NULL;
+	}
+
+	while (!stop) {
+		blk = random_block(&w->seed);
+		if (pread(fd, buf, BLOCK_SIZE, blk * BLOCK_SIZE) != BLOCK_SIZE)
+			w->errors++;
+		else if (!block_ok(buf, blk))
+			w->bad++;
+		w->ops++;
+	}
+
+	free(buf);
+	close(fd);
+	return NULL;
+}
+
+static void *writer(void *arg)
+{
+	struct worker *w = arg;
+	uint64_t *buf;
+	off_t blk;
+	int fd, ret;
+
+	fd = open(path, O_WRONLY | O_DIRECT);
+	if (fd < 0 || posix_memalign((void **)&buf, BLOCK_SIZE, BLOCK_SIZE)) {
+		w->errors++;
+		return NULL;
+	}
+
+	while (!stop) {
+		blk = random_block(&w->seed);
+		if (rand_r(&w->seed) & 1) {
+			ret = fallocate(fd, FALLOC_FL_PUNCH_HOLE |
+					FALLOC_FL_KEEP_SIZE,
+					blk * BLOCK_SIZE, BLOCK_SIZE);
+		} else {
+			fill(buf, blk);
+			ret = pwrite(fd, buf, BLOCK_SIZE, blk * BLOCK_SIZE) ==
+			      BLOCK_SIZE ? 0 : -1;
+		}
+		if (ret)
+			w->errors++;
+		w->ops++;
+	}
+
+	free(buf);
+	close(fd);
+	return NULL;
+}
+
+static void *dropper(void *arg)
+{
+	struct worker *w = arg;
+	int fd;
+
+	while (!stop) {
+		fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+		if (fd < 0 || write(fd, "2", 1) != 1)
+			w->errors++;
+		if (fd >= 0)
+			close(fd);
+		w->ops++;
+		usleep(100000);
+	}
+	return NULL;
+}
+
+static int create_file(void)
+{
+	uint64_t *buf;
+	off_t blk;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || posix_memalign((void **)&buf, BLOCK_SIZE, BLOCK_SIZE)) {
+		perror(path);
+		return -1;
+	}
+
+	for (blk = 0; blk < nr_blocks; blk++) {
+		fill(buf, blk);
+		if (pwrite(fd, buf, BLOCK_SIZE, blk * BLOCK_SIZE) !=
+		    BLOCK_SIZE) {
+			perror("pwrite");
+			return -1;
+		}
+	}
+
+	free(buf);
+	if (fsync(fd) || close(fd)) {
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
+
+/* once everything settled, each block must be all zeroes or all its own */
+static unsigned long check_file(void)
+{
+	uint64_t *buf;
+	unsigned long bad = 0;
+	off_t blk;
+	size_t i;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_DIRECT);
+	if (fd < 0 || posix_memalign((void **)&buf, BLOCK_SIZE, BLOCK_SIZE)) {
+		perror(path);
+		return 1;
+	}
+
+	for (blk = 0; blk < nr_blocks; blk++) {
+		if (pread(fd, buf, BLOCK_SIZE, blk * BLOCK_SIZE) !=
+		    BLOCK_SIZE) {
+			bad++;
+			continue;
+		}
+		for (i = 1; i < WORDS; i++)
+			if (buf[i] != buf[0])
+				break;
+		if (i < WORDS || (buf[0] && buf[0] != (uint64_t)blk))
+			bad++;
+	}
+
+	free(buf);
+	close(fd);
+	return bad;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-r readers] [-w writers] [-s seconds] [-n blocks] [-d] file\n"
+		"  -d  run the shrinkers through drop_caches meanwhile\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long reads = 0, writes = 0, errors = 0, bad = 0, final;
+	struct worker *workers, dropw = { 0 };
+	pthread_t drop_thread;
+	int opt, i, n;
+
+	while ((opt = getopt(argc, argv, "r:w:s:n:d")) != -1) {
+		switch (opt) {
+		case 'r':
+			nr_readers = atoi(optarg);
+			break;
+		case 'w':
+			nr_writers = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'n':
+			nr_blocks = atol(optarg);
+			break;
+		case 'd':
+			drop_caches = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || nr_readers < 1 || nr_writers < 0 ||
+	    seconds < 1 || nr_blocks < 2)
+		usage(argv[0]);
+	path = argv[optind];
+
+	if (create_file())
+		return 1;
+
+	n = nr_readers + nr_writers;
+	workers = calloc(n, sizeof(*workers));
+	if (!workers)
+		return 1;
+
+	for (i = 0; i < n; i++) {
+		workers[i].seed = i + 1;
+		if (pthread_create(&workers[i].thread, NULL,
+				   i < nr_readers ? reader : writer,
+				   &workers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+	if (drop_caches &&
+	    pthread_create(&drop_thread, NULL, dropper, &dropw)) {
+		perror("pthread_create");
+		return 1;
+	}
+
+	sleep(seconds);
+	stop = true;
+
+	for (i = 0; i < n; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (i < nr_readers)
+			reads += workers[i].ops;
+		else
+			writes += workers[i].ops;
+		errors += workers[i].errors;
+		bad += workers[i].bad;
+	}
+	if (drop_caches) {
+		pthread_join(drop_thread, NULL);
+		errors += dropw.errors;
+	}
+
+	final = check_file();
+
+	printf("%lu reads, %lu writes and punches: %lu errors, %lu bad reads, %lu bad blocks at the end\n",
+	       reads, writes, errors, bad, final);
+
+	if (errors || bad || final) {
+		printf("FAIL\n");
+		return 1;
+	}
+	printf("PASS\n");
+	return 0;
+}
@@ -0,0 +1,289 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Fast commit crash/replay test, driven by run_fc_replay_test.sh.
+ *
+ *   fc_replay_test prepare FILE
+ *	Write PREP_SZ bytes and preallocate up to PREALLOC_SZ past i_size.
+ *	The caller syncs the file system afterwards.
+ *
+ *   fc_replay_test write [-i] [-j INFO] FILE STATE
+ *	Append WRITE_SZ bytes, fsync() and save i_size and mtime to STATE,
+ *	then shut the file system down without flushing the log.  The
+ *	append goes into the preallocated blocks, which a fast commit can
+ *	describe; with -i it goes past them, so that blocks are allocated
+ *	and fsync() has to fall back to a full commit.  With -j the jbd2
+ *	info file is used to check which of the two fsync() did.
+ *
+ *   fc_replay_test check FILE STATE
+ *	After the remount, compare i_size, mtime and the data with STATE.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef EXT4_IOC_SHUTDOWN
+#define EXT4_IOC_SHUTDOWN		_IOR('X', 125, uint32_t)
+#endif
+#define EXT4_GOING_FLAGS_NOLOGFLUSH	0x2
+
+#define PREP_SZ		(64 << 10)
+#define PREALLOC_SZ	(1 << 20)
+#define WRITE_SZ	(16 << 10)
+
+static uint64_t word_at(off_t off)
+{
+	return (uint64_t)off * 0x9e3779b97f4a7c15ULL;
+}
+
+static void fill(uint64_t *buf, off_t off, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len / sizeof(*buf); i++)
+		buf[i] = word_at(off + i * sizeof(*buf));
+}
+
+static int write_pattern(int fd, off_t off, size_t len)
+{
+	uint64_t *buf = malloc(len);
+	ssize_t ret;
+
+	if (!buf)
+		return -1;
+	fill(buf, off, len);
+	ret = pwrite(fd, buf, len, off);
+	free(buf);
+	if (ret != (ssize_t)len) {
+		perror("pwrite");
+		return -1;
+	}
+	return 0;
+}
+
+/* Committed transactions, from the first line of /proc/fs/jbd2/DEV/info */
+static long jbd2_transactions(const char *info)
+{
+	FILE *f = fopen(info, "r");
+	long nr = -1;
+
+	if (!f) {
+		perror(info);
+		return -1;
+	}
+	if (fscanf(f, "%ld transactions", &nr) != 1)
+		nr = -1;
+	fclose(f);
+	return nr;
+}
+
+static int do_prepare(const char *path)
+{
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0) {
+		perror(path);
+		return 1;
+	}
+	if (write_pattern(fd, 0, PREP_SZ))
+		return 1;
+	if (fallocate(fd, FALLOC_FL_KEEP_SIZE, PREP_SZ, PREALLOC_SZ)) {
+		perror("fallocate");
+		return 1;
+	}
+	if (fsync(fd)) {
+		perror("fsync");
+		return 1;
+	}
+	close(fd);
+	return 0;
+}
+
+static int do_write(const char *path, const char *state, bool ineligible,
+		    const char *info)
+{
+	off_t off = ineligible ? PREP_SZ + PREALLOC_SZ : PREP_SZ;
+	uint32_t flags = EXT4_GOING_FLAGS_NOLOGFLUSH;
+	long before = 0, after = 0;
+	struct stat st;
+	FILE *f;
+	int fd;
+
+	fd = open(path, O_RDWR);
+	if (fd < 0) {
+		perror(path);
+		return 1;
+	}
+	if (info && (before = jbd2_transactions(info)) < 0)
+		return 1;
+	if (write_pattern(fd, off, WRITE_SZ))
+		return 1;
+	if (fsync(fd)) {
+		perror("fsync");
+		return 1;
+	}
+	if (info && (after = jbd2_transactions(info)) < 0)
+		return 1;
+	if (fstat(fd, &st)) {
+		perror("fstat");
+		return 1;
+	}
+
+	f = fopen(state, "w");
+	if (!f) {
+		perror(state);
+		return 1;
+	}
+	fprintf(f, "%lld %lld %ld %lld\n", (long long)st.st_size,
+		(long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec,
+		(long long)off);
+	if (fclose(f)) {
+		perror(state);
+		return 1;
+	}
+
+	if (ioctl(fd, EXT4_IOC_SHUTDOWN, &flags)) {
+		perror("EXT4_IOC_SHUTDOWN");
+		return 1;
+	}
+	close(fd);
+
+	if (!info)
+		return 0;
+	if (!ineligible && after != before) {
+		printf("FAIL: fsync committed %ld transactions, expected a fast commit\n",
+		       after - before);
+		return 1;
+	}
+	if (ineligible && after == before) {
+		printf("FAIL: fsync of an ineligible inode did not commit\n");
+		return 1;
+	}
+	return 0;
+}
+
+static int check_range(const uint64_t *buf, off_t off, size_t len,
+		       off_t wstart, off_t wend)
+{
+	size_t i;
+
+	for (i = 0; i < len / sizeof(*buf); i++) {
+		off_t o = off + i * sizeof(*buf);
+		bool written = o < PREP_SZ || (o >= wstart && o < wend);
+		uint64_t want = written ? word_at(o) : 0;
+
+		if (buf[i] != want) {
+			printf("FAIL: offset %lld: %#llx, expected %#llx\n",
+			       (long long)o, (unsigned long long)buf[i],
+			       (unsigned long long)want);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int do_check(const char *path, const char *state)
+{
+	long long size, sec, woff;
+	uint64_t buf[4096 / sizeof(uint64_t)];
+	struct stat st;
+	long nsec;
+	off_t off;
+	FILE *f;
+	int fd;
+
+	f = fopen(state, "r");
+	if (!f) {
+		perror(state);
+		return 1;
+	}
+	if (fscanf(f, "%lld %lld %ld %lld", &size, &sec, &nsec, &woff) != 4) {
+		fprintf(stderr, "%s: bad state\n", state);
+		return 1;
+	}
+	fclose(f);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		printf("FAIL: %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+	if (fstat(fd, &st)) {
+		perror("fstat");
+		return 1;
+	}
+	if (st.st_size != size) {
+		printf("FAIL: i_size %lld, expected %lld\n",
+		       (long long)st.st_size, size);
+		return 1;
+	}
+	if (st.st_mtim.tv_sec != sec || st.st_mtim.tv_nsec != nsec) {
+		printf("FAIL: mtime %lld.%09ld, expected %lld.%09ld\n",
+		       (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec,
+		       sec, nsec);
+		return 1;
+	}
+
+	for (off = 0; off < size; off += sizeof(buf)) {
+		if (pread(fd, buf, sizeof(buf), off) != sizeof(buf)) {
+			printf("FAIL: read at %lld: %s\n", (long long)off,
+			       strerror(errno));
+			return 1;
+		}
+		if (check_range(buf, off, sizeof(buf), woff, woff + WRITE_SZ))
+			return 1;
+	}
+	close(fd);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s prepare FILE\n"
+		"       %s write [-i] [-j INFO] FILE STATE\n"
+		"       %s check FILE STATE\n", prog, prog, prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *info = NULL;
+	bool ineligible = false;
+	const char *cmd;
+	int opt;
+
+	if (argc < 2)
+		usage(argv[0]);
+	cmd = argv[1];
+	optind = 2;
+	while ((opt = getopt(argc, argv, "ij:")) != -1) {
+		switch (opt) {
+		case 'i':
+			ineligible = true;
+			break;
+		case 'j':
+			info = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!strcmp(cmd, "prepare") && argc - optind == 1)
+		return do_prepare(argv[optind]);
+	if (!strcmp(cmd, "write") && argc - optind == 2)
+		return do_write(argv[optind], argv[optind + 1], ineligible,
+				info);
+	if (!strcmp(cmd, "check") && argc - optind == 2)
+		return do_check(argv[optind], argv[optind + 1]);
+	usage(argv[0]);
+	return 2;
+}
@@ -0,0 +1,264 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Parallel fsync benchmark.
+ *
+ * Every thread runs a small SQLite-like workload in its own directory: a
+ * transaction writes a few pages to a write-ahead log and fdatasync()s it,
+ * and every few transactions the pages are checkpointed into the database
+ * file at random offsets, followed by an fsync().  As with SQLite and a
+ * journal_size_limit, both files are written in place once they have been
+ * created, so the metadata an fsync() has to make durable is mostly the
+ * inode's timestamps.  Prints the transaction rate and fsync() latencies.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PAGE_SZ		4096
+#define LAT_BUCKET_US	10
+#define LAT_BUCKETS	100000	/* up to one second */
+
+static int nr_threads = 4;
+static int seconds = 5;
+static int pages_per_txn = 2;
+static int checkpoint_every = 16;
+static off_t db_pages = 4096;
+static off_t wal_pages = 1024;
+static const char *dir;
+
+static volatile bool stop;
+
+struct worker {
+	pthread_t thread;
+	int id;
+	unsigned int seed;
+	unsigned long txns;
+	unsigned long syncs;
+	unsigned long errors;
+	unsigned long long sync_us;
+	unsigned int *lat;	/* fsync latency histogram */
+};
+
+static unsigned long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static int timed_sync(struct worker *w, int fd, bool datasync)
+{
+	unsigned long long start = now_us(), us;
+	int ret;
+
+	ret = datasync ? fdatasync(fd) : fsync(fd);
+	us = now_us() - start;
+
+	w->syncs++;
+	w->sync_us += us;
+	w->lat[us / LAT_BUCKET_US < LAT_BUCKETS ?
+	       us / LAT_BUCKET_US : LAT_BUCKETS - 1]++;
+	return ret;
+}
+
+/* Create a file of @pages pages and write it out once */
+static int create_file(const char *path, off_t pages, void *buf)
+{
+	off_t i;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	for (i = 0; i < pages; i++) {
+		if (pwrite(fd, buf, PAGE_SZ, i * PAGE_SZ) != PAGE_SZ) {
+			perror(path);
+			close(fd);
+			return -1;
+		}
+	}
+	if (fsync(fd)) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void *worker_thread(void *arg)
+{
+	struct worker *w = arg;
+	char path[PATH_MAX];
+	off_t wal_off = 0;
+	int db, wal, i;
+	char *buf;
+
+	buf = malloc(PAGE_SZ);
+	if (!buf) {
+		w->errors++;
+		return NULL;
+	}
+	memset(buf, w->id, PAGE_SZ);
+
+	snprintf(path, sizeof(path), "%s/db-%d", dir, w->id);
+	db = create_file(path, db_pages, buf);
+	snprintf(path, sizeof(path), "%s/db-%d-wal", dir, w->id);
+	wal = create_file(path, wal_pages, buf);
+	if (db < 0 || wal < 0) {
+		w->errors++;
+		goto out;
+	}
+
+	while (!stop) {
+		for (i = 0; i < pages_per_txn; i++) {
+			buf[0] = w->txns;
+			if (pwrite(wal, buf, PAGE_SZ, wal_off) != PAGE_SZ)
+				w->errors++;
+			wal_off = (wal_off + PAGE_SZ) % (wal_pages * PAGE_SZ);
+		}
+		if (timed_sync(w, wal, true))
+			w->errors++;
+
+		if (++w->txns % checkpoint_every)
+			continue;
+
+		for (i = 0; i < checkpoint_every * pages_per_txn; i++) {
+			off_t page = rand_r(&w->seed) % db_pages;
+
+			if (pwrite(db, buf, PAGE_SZ, page * PAGE_SZ) != PAGE_SZ)
+				w->errors++;
+		}
+		if (timed_sync(w, db, false))
+			w->errors++;
+	}
+
+out:
+	if (db >= 0)
+		close(db);
+	if (wal >= 0)
+		close(wal);
+	free(buf);
+	return NULL;
+}
+
+static unsigned long percentile(unsigned int *lat, unsigned long total,
+				double pct)
+{
+	unsigned long want = total * pct / 100, seen = 0;
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += lat[i];
+		if (seen > want)
+			break;
+	}
+	return (unsigned long)(i + 1) * LAT_BUCKET_US;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-t threads] [-s seconds] [-p pages per transaction]\n"
+		"          [-c transactions per checkpoint] directory\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long txns = 0, syncs = 0, errors = 0;
+	unsigned long long sync_us = 0;
+	struct timespec start, end;
+	struct worker *workers;
+	unsigned int *lat;
+	double elapsed;
+	int opt, i, j;
+
+	while ((opt = getopt(argc, argv, "t:s:p:c:")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'p':
+			pages_per_txn = atoi(optarg);
+			break;
+		case 'c':
+			checkpoint_every = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || nr_threads < 1 || seconds < 1 ||
+	    pages_per_txn < 1 || checkpoint_every < 1)
+		usage(argv[0]);
+	dir = argv[optind];
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	lat = calloc(LAT_BUCKETS, sizeof(*lat));
+	if (!workers || !lat)
+		return 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].id = i;
+		workers[i].seed = i + 1;
+		workers[i].lat = calloc(LAT_BUCKETS, sizeof(*lat));
+		if (!workers[i].lat)
+			return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&workers[i].thread, NULL, worker_thread,
+				   &workers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	sleep(seconds);
+	stop = true;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		txns += workers[i].txns;
+		syncs += workers[i].syncs;
+		errors += workers[i].errors;
+		sync_us += workers[i].sync_us;
+		for (j = 0; j < LAT_BUCKETS; j++)
+			lat[j] += workers[i].lat[j];
+		free(workers[i].lat);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+		  (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("%d threads: %.0f transactions per second, fsync avg %.0f us p50 %lu us p99 %lu us\n",
+	       nr_threads, txns / elapsed,
+	       syncs ? (double)sync_us / syncs : 0.0,
+	       percentile(lat, syncs, 50), percentile(lat, syncs, 99));
+
+	free(lat);
+	free(workers);
+
+	if (errors) {
+		printf("%lu errors\n", errors);
+		return 1;
+	}
+	return 0;
+}
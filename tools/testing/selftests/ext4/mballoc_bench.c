@@ -0,0 +1,288 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Parallel block allocation benchmark.
+ *
+ * Every thread appends fixed size chunks to files of its own, either with
+ * fallocate() or with O_DIRECT writes so that the blocks are allocated by
+ * the thread itself rather than by writeback.  Once a file is full the
+ * thread starts the next one, and when it holds more than a few files it
+ * unlinks a random one of them, so free space gets fragmented the longer
+ * the run goes on.  Prints the allocation rate and per-chunk latencies.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LAT_BUCKET_US	10
+#define LAT_BUCKETS	100000	/* up to one second */
+
+static int nr_threads = 4;
+static int seconds = 5;
+static size_t chunk_sz = 256 << 10;
+static off_t file_sz = 8 << 20;
+static int keep_files = 8;
+static bool use_write;
+static const char *dir;
+
+static volatile bool stop;
+
+struct worker {
+	pthread_t thread;
+	int id;
+	unsigned int seed;
+	unsigned long chunks;
+	unsigned long errors;
+	unsigned long long alloc_us;
+	unsigned long long max_us;
+	unsigned int *lat;	/* per-chunk latency histogram */
+};
+
+static unsigned long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static int timed_alloc(struct worker *w, int fd, off_t off, void *buf)
+{
+	unsigned long long start = now_us(), us;
+	int ret;
+
+	if (use_write)
+		ret = pwrite(fd, buf, chunk_sz, off) == (ssize_t)chunk_sz ?
+		      0 : -1;
+	else
+		ret = fallocate(fd, 0, off, chunk_sz);
+	us = now_us() - start;
+
+	w->chunks++;
+	w->alloc_us += us;
+	if (us > w->max_us)
+		w->max_us = us;
+	w->lat[us / LAT_BUCKET_US < LAT_BUCKETS ?
+	       us / LAT_BUCKET_US : LAT_BUCKETS - 1]++;
+	return ret;
+}
+
+static int open_file(struct worker *w, unsigned long nr)
+{
+	char path[PATH_MAX];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/f-%d-%lu", dir, w->id, nr);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC |
+		  (use_write ? O_DIRECT : 0), 0644);
+	if (fd < 0)
+		perror(path);
+	return fd;
+}
+
+static void unlink_file(struct worker *w, unsigned long nr)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/f-%d-%lu", dir, w->id, nr);
+	if (unlink(path) && errno != ENOENT) {
+		perror(path);
+		w->errors++;
+	}
+}
+
+static void *worker_thread(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long nr = 0, oldest = 0;
+	off_t off = 0;
+	void *buf;
+	int fd;
+
+	if (posix_memalign(&buf, 4096, chunk_sz)) {
+		w->errors++;
+		return NULL;
+	}
+	memset(buf, w->id, chunk_sz);
+
+	fd = open_file(w, nr);
+	if (fd < 0) {
+		w->errors++;
+		goto out;
+	}
+
+	while (!stop) {
+		if (timed_alloc(w, fd, off, buf)) {
+			perror(use_write ? "pwrite" : "fallocate");
+			w->errors++;
+			break;
+		}
+		off += chunk_sz;
+		if (off < file_sz)
+			continue;
+
+		close(fd);
+		off = 0;
+		fd = open_file(w, ++nr);
+		if (fd < 0) {
+			w->errors++;
+			goto out;
+		}
+
+		/* drop a random older file to leave holes in free space */
+		if (nr - oldest >= (unsigned long)keep_files) {
+			unsigned long victim = oldest +
+				rand_r(&w->seed) % (nr - oldest);
+
+			unlink_file(w, victim);
+			if (victim != oldest) {
+				char from[PATH_MAX], to[PATH_MAX];
+
+				snprintf(from, sizeof(from), "%s/f-%d-%lu",
+					 dir, w->id, oldest);
+				snprintf(to, sizeof(to), "%s/f-%d-%lu",
+					 dir, w->id, victim);
+				if (rename(from, to)) {
+					perror(from);
+					w->errors++;
+				}
+			}
+			oldest++;
+		}
+	}
+
+	close(fd);
+out:
+	free(buf);
+	return NULL;
+}
+
+static unsigned long percentile(unsigned int *lat, unsigned long total,
+				double pct)
+{
+	unsigned long want = total * pct / 100, seen = 0;
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += lat[i];
+		if (seen > want)
+			break;
+	}
+	return (unsigned long)(i + 1) * LAT_BUCKET_US;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-t threads] [-s seconds] [-w] [-c chunk kB]\n"
+		"          [-f file MB] [-k files kept per thread] directory\n"
+		"  -w  allocate with O_DIRECT writes instead of fallocate()\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long chunks = 0, errors = 0;
+	unsigned long long alloc_us = 0, max_us = 0;
+	struct timespec start, end;
+	struct worker *workers;
+	unsigned int *lat;
+	double elapsed;
+	int opt, i, j;
+
+	while ((opt = getopt(argc, argv, "t:s:wc:f:k:")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'w':
+			use_write = true;
+			break;
+		case 'c':
+			chunk_sz = (size_t)atoi(optarg) << 10;
+			break;
+		case 'f':
+			file_sz = (off_t)atoi(optarg) << 20;
+			break;
+		case 'k':
+			keep_files = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || nr_threads < 1 || seconds < 1 ||
+	    chunk_sz < 4096 || chunk_sz % 4096 || file_sz < (off_t)chunk_sz ||
+	    keep_files < 1)
+		usage(argv[0]);
+	dir = argv[optind];
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	lat = calloc(LAT_BUCKETS, sizeof(*lat));
+	if (!workers || !lat)
+		return 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].id = i;
+		workers[i].seed = i + 1;
+		workers[i].lat = calloc(LAT_BUCKETS, sizeof(*lat));
+		if (!workers[i].lat)
+			return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&workers[i].thread, NULL, worker_thread,
+				   &workers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	sleep(seconds);
+	stop = true;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		chunks += workers[i].chunks;
+		errors += workers[i].errors;
+		alloc_us += workers[i].alloc_us;
+		if (workers[i].max_us > max_us)
+			max_us = workers[i].max_us;
+		for (j = 0; j < LAT_BUCKETS; j++)
+			lat[j] += workers[i].lat[j];
+		free(workers[i].lat);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+		  (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("%d threads %s: %.0f MB/s, chunk avg %.0f us p50 %lu us p99 %lu us max %llu us\n",
+	       nr_threads, use_write ? "write" : "fallocate",
+	       chunks * (double)chunk_sz / elapsed / (1 << 20),
+	       chunks ? (double)alloc_us / chunks : 0.0,
+	       percentile(lat, chunks, 50), percentile(lat, chunks, 99),
+	       max_us);
+
+	free(lat);
+	free(workers);
+
+	if (errors) {
+		printf("%lu errors\n", errors);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,32 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Run es_read_bench with 1, 2, 4, ... threads up to the number of CPUs
+# against a fragmented file on an ext4 file system on a loop device.
+#
+# usage: run_es_read_bench.sh [seconds per run]
+
+readonly SECONDS_PER_RUN="${1:-5}"
+readonly FILE_MB=256
+readonly BIN="$(dirname "$0")/es_read_bench"
+
+source "$(dirname "$0")/../lib/scratch_fs.sh"
+
+set -e
+
+loop_image_setup ext4 $((FILE_MB * 4))M mkfs.ext4 -q -F
+loop_image_mount
+
+# One extent per block: every other block is punched out
+"$BIN" -c $FILE_MB "${MNT}/file"
+
+# Cache the whole extent tree, then drop the page cache
+"$BIN" -t 1 -s 1 "${MNT}/file" > /dev/null
+echo 1 > /proc/sys/vm/drop_caches
+
+nr_cpus="$(nproc)"
+for ((t = 1; t <= nr_cpus; t *= 2)); do
+	"$BIN" -t "$t" -s "$SECONDS_PER_RUN" "${MNT}/file"
+done
+
+cat /proc/fs/ext4/"$(basename "$LOOP")"/es_shrinker_info
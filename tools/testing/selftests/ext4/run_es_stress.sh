@@ -0,0 +1,22 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Run es_stress against a file on an ext4 file system on a loop device,
+# with the extent status shrinker running meanwhile.
+#
+# usage: run_es_stress.sh [seconds]
+
+readonly SECONDS_TO_RUN="${1:-20}"
+readonly BIN="$(dirname "$0")/es_stress"
+
+source "$(dirname "$0")/../lib/scratch_fs.sh"
+
+set -e
+
+loop_image_setup ext4 512M mkfs.ext4 -q -F
+loop_image_mount
+
+set +e
+
+nr_cpus="$(nproc)"
+"$BIN" -r "$nr_cpus" -w 2 -s "$SECONDS_TO_RUN" -n 65536 -d "${MNT}/file"
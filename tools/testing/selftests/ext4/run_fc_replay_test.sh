@@ -0,0 +1,63 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Crash/replay test for fast commits on an ext4 file system on a loop
+# device mounted with fast_commit: an fsync()ed append must survive a
+# shutdown without log flush and the remount, both when fsync() did a fast
+# commit and when the change was ineligible and fsync() fell back to a
+# full commit.
+
+readonly BIN="$(dirname "$0")/fc_replay_test"
+# No periodic commits, so that the jbd2 commit count only moves on fsync()
+readonly OPTS="fast_commit,commit=600,noatime"
+
+source "$(dirname "$0")/../lib/scratch_fs.sh"
+
+set -e
+
+loop_image_setup ext4 256M mkfs.ext4 -q -F
+readonly STATE="${DIR}/state"
+
+if ! loop_image_mount "$OPTS"; then
+	echo "SKIP: mount -o fast_commit failed"
+	exit $ksft_skip
+fi
+umount "$MNT"
+
+readonly INFO="/proc/fs/jbd2/$(basename "$LOOP")-8/info"
+
+set +e
+
+# run_case NAME [-i]
+run_case() {
+	local name="$1"
+	shift
+
+	loop_image_mount "$OPTS" || return 1
+	"$BIN" prepare "${MNT}/${name}" || return 1
+	sync -f "$MNT" || return 1
+	"$BIN" write "$@" -j "$INFO" "${MNT}/${name}" "$STATE" || return 1
+	umount "$MNT" || return 1
+
+	loop_image_mount "$OPTS" || return 1
+	"$BIN" check "${MNT}/${name}" "$STATE" || return 1
+	umount "$MNT"
+}
+
+ret=0
+if run_case fast; then
+	echo "PASS: fast commit replayed"
+else
+	echo "FAIL: fast commit replay"
+	ret=1
+fi
+umount "$MNT" 2> /dev/null
+
+if run_case full -i; then
+	echo "PASS: ineligible change fell back to a full commit"
+else
+	echo "FAIL: ineligible change"
+	ret=1
+fi
+
+exit $ret
@@ -0,0 +1,32 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Run fsync_bench with 1, 2, 4, ... threads up to the number of CPUs on an
+# ext4 file system on a loop device, first with full commits only and
+# then mounted with fast_commit.
+#
+# usage: run_fsync_bench.sh [seconds per run]
+
+readonly SECONDS_PER_RUN="${1:-5}"
+readonly BIN="$(dirname "$0")/fsync_bench"
+
+source "$(dirname "$0")/../lib/scratch_fs.sh"
+
+set -e
+
+loop_image_setup ext4 2G mkfs.ext4 -q -F
+
+nr_cpus="$(nproc)"
+for opts in defaults fast_commit; do
+	if ! loop_image_mount "$opts"; then
+		echo "SKIP: mount -o $opts failed"
+		continue
+	fi
+	echo "mount -o $opts"
+	for ((t = 1; t <= nr_cpus; t *= 2)); do
+		mkdir "${MNT}/run"
+		"$BIN" -t "$t" -s "$SECONDS_PER_RUN" "${MNT}/run"
+		rm -rf "${MNT}/run"
+	done
+	umount "$MNT"
+done
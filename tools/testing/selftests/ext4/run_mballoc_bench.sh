@@ -0,0 +1,55 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Run mballoc_bench with fallocate() and with O_DIRECT writes, with 1, 2,
+# 4, ... threads up to the number of CPUs, on a freshly made ext4 file
+# system on a loop device, first with mb_optimize_scan=1 and then with
+# the linear group scan.  The mb_stats summary that ext4 logs at unmount
+# is printed after each file system.
+#
+# usage: run_mballoc_bench.sh [seconds per run]
+
+readonly SECONDS_PER_RUN="${1:-5}"
+readonly BIN="$(dirname "$0")/mballoc_bench"
+
+source "$(dirname "$0")/../lib/scratch_fs.sh"
+
+if ! command -v dmesg > /dev/null; then
+	echo "SKIP: dmesg not found"
+	exit $ksft_skip
+fi
+
+set -e
+
+nr_cpus="$(nproc)"
+
+# every thread keeps up to 9 files of 8 MB, leave room for fragmentation
+size_mb=$((nr_cpus * 128))
+((size_mb < 2048)) && size_mb=2048
+loop_image_setup ext4 "${size_mb}M" mkfs.ext4 -q -F
+readonly SYSFS="/sys/fs/ext4/$(basename "$LOOP")"
+
+for scan in 1 0; do
+	[[ $scan -eq 1 ]] || loop_image_mkfs
+	loop_image_mount
+	if [[ ! -w "${SYSFS}/mb_optimize_scan" ]]; then
+		echo "SKIP: ${SYSFS}/mb_optimize_scan not found"
+		exit $ksft_skip
+	fi
+	echo "$scan" > "${SYSFS}/mb_optimize_scan"
+	echo 1 > "${SYSFS}/mb_stats"
+	echo "mb_optimize_scan=$scan"
+
+	for mode in "" -w; do
+		for ((t = 1; t <= nr_cpus; t *= 2)); do
+			mkdir "${MNT}/run"
+			"$BIN" $mode -t "$t" -s "$SECONDS_PER_RUN" "${MNT}/run"
+			rm -rf "${MNT}/run"
+		done
+	done
+
+	log_lines="$(dmesg | wc -l)"
+	umount "$MNT"
+	dmesg | tail -n "+$((log_lines + 1))" |
+		grep "($(basename "$LOOP")): mballoc:" || true
+done
@@ -0,0 +1,149 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Measure CPU0 interrupt load and timer wakeup latency under combined
+# storage and network load, with the in-kernel interrupt balancer off and
+# then on.
+#
+# The storage load is O_DIRECT writes and reads of a file in a directory
+# on the device under test, the network load an iperf3 client run against
+# a server on another machine, so that the interrupts come from real
+# hardware.  For the run with the balancer off every interrupt it may move
+# is put back on the default affinity, which routes it to the first CPU
+# of the mask; the affinities found at start are restored at exit.
+#
+# usage: run_irq_balance_bench.sh -d directory [-n iperf3 server]
+#                                 [-s seconds] [-c cpu]
+
+ksft_skip=4
+
+readonly BIN="$(dirname "$0")/wakeup_lat"
+readonly PARAMS="/sys/module/irqbalance/parameters"
+
+dir=""
+server=""
+seconds=30
+cpu=0
+
+while getopts "d:n:s:c:" opt; do
+	case "$opt" in
+	d) dir="$OPTARG" ;;
+	n) server="$OPTARG" ;;
+	s) seconds="$OPTARG" ;;
+	c) cpu="$OPTARG" ;;
+	*) echo "usage: $0 -d directory [-n iperf3 server] [-s seconds] [-c cpu]"
+	   exit 1 ;;
+	esac
+done
+
+if [[ -z "$dir" ]]; then
+	echo "usage: $0 -d directory [-n iperf3 server] [-s seconds] [-c cpu]"
+	exit 1
+fi
+
+if [[ "$(id -u)" -ne 0 ]]; then
+	echo "SKIP: must be run as root"
+	exit $ksft_skip
+fi
+
+if [[ ! -w "${PARAMS}/enable" ]]; then
+	echo "SKIP: ${PARAMS}/enable not found"
+	exit $ksft_skip
+fi
+
+if [[ -n "$server" ]] && ! command -v iperf3 > /dev/null; then
+	echo "SKIP: iperf3 not found"
+	exit $ksft_skip
+fi
+
+readonly FILE="${dir}/irq_balance_bench.$$"
+readonly SAVED="$(mktemp)"
+readonly ENABLE="$(cat "${PARAMS}/enable")"
+PIDS=""
+
+cleanup() {
+	[[ -n "$PIDS" ]] && kill $PIDS 2> /dev/null
+	wait 2> /dev/null
+	while read -r irq mask; do
+		echo "$mask" > "/proc/irq/${irq}/smp_affinity" 2> /dev/null
+	done < "$SAVED"
+	echo "$ENABLE" > "${PARAMS}/enable"
+	rm -f "$FILE" "$SAVED"
+}
+trap cleanup EXIT
+
+for f in /proc/irq/[0-9]*/smp_affinity; do
+	irq="${f#/proc/irq/}"
+	echo "${irq%%/*} $(cat "$f")" >> "$SAVED"
+done
+
+# irq and softirq time, and all time, of $cpu from /proc/stat
+cpu_times() {
+	awk -v cpu="cpu$cpu" '$1 == cpu {
+		total = 0
+		for (i = 2; i <= NF; i++)
+			total += $i
+		print $7 + $8, total
+	}' /proc/stat
+}
+
+# interrupts delivered to $cpu, summed over all lines of /proc/interrupts
+cpu_irqs() {
+	awk -v col="$((cpu + 2))" 'NR > 1 && $col ~ /^[0-9]+$/ {
+		sum += $col
+	} END { print sum }' /proc/interrupts
+}
+
+start_load() {
+	PIDS=""
+	(while :; do
+		dd if=/dev/zero of="$FILE" bs=64k count=4096 oflag=direct \
+			2> /dev/null
+		dd if="$FILE" of=/dev/null bs=64k iflag=direct 2> /dev/null
+	done) &
+	PIDS="$!"
+	if [[ -n "$server" ]]; then
+		iperf3 -c "$server" -t "$((seconds + 5))" -P 4 > /dev/null &
+		PIDS="$PIDS $!"
+	fi
+}
+
+stop_load() {
+	kill $PIDS 2> /dev/null
+	wait 2> /dev/null
+	PIDS=""
+}
+
+run() {
+	local t0 t1 irqs0 irqs1
+
+	start_load
+	sleep 2
+	read -r -a t0 <<< "$(cpu_times)"
+	irqs0="$(cpu_irqs)"
+	"$BIN" -c "$cpu" -s "$seconds"
+	read -r -a t1 <<< "$(cpu_times)"
+	irqs1="$(cpu_irqs)"
+	stop_load
+
+	echo "cpu $cpu: $(((irqs1 - irqs0) / seconds)) interrupts/s," \
+	     "$(((t1[0] - t0[0]) * 100 / (t1[1] - t0[1] + 1)))% in irq and softirq"
+}
+
+[[ -z "$server" ]] && echo "no iperf3 server given, storage load only"
+
+echo N > "${PARAMS}/enable"
+while read -r irq mask; do
+	cat /proc/irq/default_smp_affinity > "/proc/irq/${irq}/smp_affinity" \
+		2> /dev/null
+done < "$SAVED"
+echo "balancer off"
+run
+
+echo Y > "${PARAMS}/enable"
+# let the balancer place the interrupts under load first
+start_load
+sleep "$(( $(cat "${PARAMS}/interval_ms") * 5 / 1000 + 1 ))"
+stop_load
+echo "balancer on"
+run
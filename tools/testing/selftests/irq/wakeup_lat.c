@@ -0,0 +1,133 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Timer wakeup latency on one CPU.
+ *
+ * A SCHED_FIFO thread pinned to the CPU sleeps until an absolute time
+ * every interval and records how late it woke up.  Hard and soft
+ * interrupt handlers running on that CPU delay the wakeup, so this shows
+ * how much the interrupt load placed on the CPU gets in the way of the
+ * work that runs there.  Prints the latency percentiles and maximum.
+ */
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LAT_BUCKET_US	1
+#define LAT_BUCKETS	100000	/* up to 100 ms */
+
+static int cpu;
+static int seconds = 10;
+static int interval_us = 1000;
+static int prio = 80;
+
+static unsigned long long ts_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+static unsigned long percentile(unsigned int *lat, unsigned long total,
+				double pct)
+{
+	unsigned long want = total * pct / 100, seen = 0;
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += lat[i];
+		if (seen > want)
+			break;
+	}
+	return (unsigned long)(i + 1) * LAT_BUCKET_US;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-c cpu] [-s seconds] [-i interval us] [-p fifo priority]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long deadline, end, us, max_us = 0;
+	struct sched_param sp;
+	struct timespec next, now;
+	unsigned long wakeups = 0;
+	unsigned int *lat;
+	cpu_set_t set;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c:s:i:p:")) != -1) {
+		switch (opt) {
+		case 'c':
+			cpu = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'i':
+			interval_us = atoi(optarg);
+			break;
+		case 'p':
+			prio = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || cpu < 0 || seconds < 1 || interval_us < 1)
+		usage(argv[0]);
+
+	lat = calloc(LAT_BUCKETS, sizeof(*lat));
+	if (!lat)
+		return 1;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set)) {
+		perror("sched_setaffinity");
+		return 1;
+	}
+	memset(&sp, 0, sizeof(sp));
+	sp.sched_priority = prio;
+	if (sched_setscheduler(0, SCHED_FIFO, &sp))
+		perror("sched_setscheduler, running as SCHED_OTHER");
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	end = ts_ns(&next) + seconds * 1000000000ULL;
+
+	while (ts_ns(&next) < end) {
+		next.tv_nsec += interval_us * 1000L;
+		while (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		deadline = ts_ns(&next);
+
+		if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next,
+				    NULL)) {
+			perror("clock_nanosleep");
+			return 1;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		us = (ts_ns(&now) - deadline) / 1000;
+		if (us > max_us)
+			max_us = us;
+		lat[us / LAT_BUCKET_US < LAT_BUCKETS ?
+		    us / LAT_BUCKET_US : LAT_BUCKETS - 1]++;
+		wakeups++;
+	}
+
+	printf("cpu %d: %lu wakeups, latency p50 %lu us p99 %lu us p99.9 %lu us max %llu us\n",
+	       cpu, wakeups, percentile(lat, wakeups, 50),
+	       percentile(lat, wakeups, 99), percentile(lat, wakeups, 99.9),
+	       max_us);
+
+	free(lat);
+	return 0;
+}
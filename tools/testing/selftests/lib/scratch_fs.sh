@@ -0,0 +1,101 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Setup shared by the file system tests and benchmarks that run on a
+# scratch file system in a temporary directory.  Source this file, turn on
+# set -e if the setup should abort on errors, then call one of:
+#
+#   scratch_setup [TOOL...]
+#	Skip unless run as root with every TOOL installed, create the
+#	temporary directory DIR and the mount point MNT in it, and have
+#	everything torn down again at exit.
+#
+#   loop_image_setup FSTYPE SIZE MKFS [MKFS_ARG...]
+#	scratch_setup for MKFS and losetup, then create the sparse image
+#	IMG of SIZE in DIR, attach it to the loop device LOOP and run
+#	MKFS [MKFS_ARG...] on it.
+#
+# and afterwards
+#
+#   scratch_mount MOUNT_ARG... MOUNTPOINT
+#	mount(8), remembering MOUNTPOINT to unmount at exit
+#   loop_image_mount [OPTIONS]
+#	mount the image on MNT, with -o OPTIONS if given
+#   loop_image_mkfs
+#	make a fresh file system on the image, which must not be mounted
+#
+# At exit everything mounted with scratch_mount, or added to
+# SCRATCH_MOUNTS otherwise, is unmounted, last mounted first, the loop
+# device is detached and DIR is removed.
+
+ksft_skip=4
+
+DIR=""
+MNT=""
+IMG=""
+LOOP=""
+LOOP_FSTYPE=""
+LOOP_MKFS=()
+SCRATCH_MOUNTS=()
+
+scratch_cleanup() {
+	local i
+
+	for ((i = ${#SCRATCH_MOUNTS[@]} - 1; i >= 0; i--)); do
+		umount "${SCRATCH_MOUNTS[i]}" 2> /dev/null || true
+	done
+	[[ -n "$LOOP" ]] && losetup -d "$LOOP"
+	[[ -n "$DIR" ]] && rm -rf "$DIR"
+}
+
+scratch_setup() {
+	local tool
+
+	if [[ "$(id -u)" -ne 0 ]]; then
+		echo "SKIP: must be run as root"
+		exit $ksft_skip
+	fi
+
+	for tool in "$@"; do
+		if ! command -v "$tool" > /dev/null; then
+			echo "SKIP: $tool not found"
+			exit $ksft_skip
+		fi
+	done
+
+	DIR="$(mktemp -d)"
+	MNT="${DIR}/mnt"
+	trap scratch_cleanup EXIT
+	mkdir "$MNT"
+}
+
+scratch_mount() {
+	local mnt="${!#}" m
+
+	mount "$@" || return
+	for m in "${SCRATCH_MOUNTS[@]}"; do
+		[[ "$m" == "$mnt" ]] && return 0
+	done
+	SCRATCH_MOUNTS+=("$mnt")
+}
+
+loop_image_mkfs() {
+	"${LOOP_MKFS[@]}" "$LOOP" > /dev/null
+}
+
+loop_image_setup() {
+	LOOP_FSTYPE="$1"
+	local size="$2"
+	shift 2
+	LOOP_MKFS=("$@")
+
+	scratch_setup "$1" losetup
+	IMG="${DIR}/${LOOP_FSTYPE}.img"
+	truncate -s "$size" "$IMG" || return
+	LOOP="$(losetup -f --show "$IMG")" || return
+	loop_image_mkfs
+}
+
+loop_image_mount() {
+	scratch_mount -t "$LOOP_FSTYPE" ${1:+-o "$1"} "$LOOP" "$MNT"
+}
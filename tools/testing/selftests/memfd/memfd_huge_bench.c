@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Huge page backed memfd benchmark.
+ *
+ * Creates a shared buffer with memfd_create(), with and without
+ * MFD_HUGE_PREFERRED, maps it and touches every page of it the way a
+ * producer fills a camera or GPU buffer, then copies into and out of it.
+ * Prints the number of page faults taken, the memcpy() throughput and how
+ * much of the buffer ended up mapped with huge pages.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* newer glibc defines the MFD_ flags in sys/mman.h */
+#ifndef MFD_CLOEXEC
+#include <linux/memfd.h>
+#endif
+
+#ifndef MFD_HUGE_PREFERRED
+#define MFD_HUGE_PREFERRED	0x0020U
+#endif
+
+static size_t size = 64 << 20;
+static int loops = 20;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long minor_faults(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_minflt;
+}
+
+/* Returns the ShmemPmdMapped kB of the mapping at @addr, or -1 */
+static long pmd_mapped_kb(void *addr)
+{
+	unsigned long start = (unsigned long)addr, lo, hi;
+	char line[256];
+	bool found = false;
+	long kb = -1;
+	FILE *f;
+
+	f = fopen("/proc/self/smaps", "r");
+	if (!f)
+		return -1;
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2) {
+			found = lo <= start && start < hi;
+			continue;
+		}
+		if (found && sscanf(line, "ShmemPmdMapped: %ld kB", &kb) == 1)
+			break;
+	}
+	fclose(f);
+	return kb;
+}
+
+static int run(const char *name, unsigned int flags, char *src)
+{
+	double start, fault_time, copy_time;
+	long faults, huge_kb;
+	size_t off;
+	char *buf;
+	int fd, i;
+
+	fd = syscall(SYS_memfd_create, name, MFD_CLOEXEC | flags);
+	if (fd < 0) {
+		if (errno == EINVAL && flags) {
+			printf("%-10s MFD_HUGE_PREFERRED not supported\n", name);
+			return 4;	/* KSFT_SKIP */
+		}
+		perror("memfd_create");
+		return 1;
+	}
+	if (ftruncate(fd, size)) {
+		perror("ftruncate");
+		close(fd);
+		return 1;
+	}
+	buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (buf == MAP_FAILED) {
+		perror("mmap");
+		close(fd);
+		return 1;
+	}
+
+	faults = minor_faults();
+	start = now();
+	for (off = 0; off < size; off += getpagesize())
+		buf[off] = 1;
+	fault_time = now() - start;
+	faults = minor_faults() - faults;
+	huge_kb = pmd_mapped_kb(buf);
+
+	start = now();
+	for (i = 0; i < loops; i++) {
+		memcpy(buf, src, size);
+		memcpy(src, buf, size);
+	}
+	copy_time = now() - start;
+
+	printf("%-10s %ld faults in %.3f ms, memcpy %.0f MB/s, %ld of %zu kB pmd mapped\n",
+	       name, faults, fault_time * 1000,
+	       2.0 * loops * (size >> 20) / copy_time, huge_kb, size >> 10);
+
+	munmap(buf, size);
+	close(fd);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-s size in MB] [-l copy loops]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, ret;
+	char *src;
+
+	while ((opt = getopt(argc, argv, "s:l:")) != -1) {
+		switch (opt) {
+		case 's':
+			size = (size_t)atoi(optarg) << 20;
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || !size || loops < 1)
+		usage(argv[0]);
+
+	src = malloc(size);
+	if (!src)
+		return 1;
+	memset(src, 0x5a, size);
+
+	ret = run("small", 0, src);
+	if (!ret)
+		ret = run("huge", MFD_HUGE_PREFERRED, src);
+	free(src);
+	return ret;
+}
@@ -0,0 +1,338 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * memfd_create() tests: flags, names and seals of shmem backed memfds,
+ * and files created with MFD_HUGE_PREFERRED.
+ *
+ * Every check that fails prints what it expected and aborts.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* newer glibc defines the MFD_ flags in sys/mman.h */
+#ifndef MFD_CLOEXEC
+#include <linux/memfd.h>
+#endif
+
+#ifndef MFD_HUGE_PREFERRED
+#define MFD_HUGE_PREFERRED	0x0020U
+#endif
+
+#ifndef F_LINUX_SPECIFIC_BASE
+#define F_LINUX_SPECIFIC_BASE	1024
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS	(F_LINUX_SPECIFIC_BASE + 9)
+#define F_GET_SEALS	(F_LINUX_SPECIFIC_BASE + 10)
+#define F_SEAL_SEAL	0x0001
+#define F_SEAL_SHRINK	0x0002
+#define F_SEAL_GROW	0x0004
+#define F_SEAL_WRITE	0x0008
+#endif
+
+#define MFD_DEF_SIZE	8192
+#define HUGE_SIZE	(4 << 20)
+
+static int sys_memfd_create(const char *name, unsigned int flags)
+{
+	return syscall(__NR_memfd_create, name, flags);
+}
+
+static int mfd_assert_new(const char *name, loff_t sz, unsigned int flags)
+{
+	int fd;
+
+	fd = sys_memfd_create(name, flags);
+	if (fd < 0) {
+		printf("memfd_create(\"%s\", %#x) failed: %m\n", name, flags);
+		abort();
+	}
+	if (ftruncate(fd, sz) < 0) {
+		printf("ftruncate(%lld) failed: %m\n", (long long)sz);
+		abort();
+	}
+	return fd;
+}
+
+static void mfd_fail_new(const char *name, unsigned int flags)
+{
+	int fd;
+
+	fd = sys_memfd_create(name, flags);
+	if (fd >= 0 || errno != EINVAL) {
+		printf("memfd_create(\"%s\", %#x) did not fail with EINVAL\n",
+		       name, flags);
+		abort();
+	}
+}
+
+static unsigned int mfd_assert_get_seals(int fd)
+{
+	int r;
+
+	r = fcntl(fd, F_GET_SEALS);
+	if (r < 0) {
+		printf("GET_SEALS(%d) failed: %m\n", fd);
+		abort();
+	}
+	return (unsigned int)r;
+}
+
+static void mfd_assert_has_seals(int fd, unsigned int seals)
+{
+	unsigned int s = mfd_assert_get_seals(fd);
+
+	if (s != seals) {
+		printf("%u != %u = GET_SEALS(%d)\n", seals, s, fd);
+		abort();
+	}
+}
+
+static void mfd_assert_add_seals(int fd, unsigned int seals)
+{
+	unsigned int s = mfd_assert_get_seals(fd);
+
+	if (fcntl(fd, F_ADD_SEALS, seals) < 0) {
+		printf("ADD_SEALS(%d, %u -> %u) failed: %m\n", fd, s, seals);
+		abort();
+	}
+}
+
+static void mfd_fail_add_seals(int fd, unsigned int seals)
+{
+	if (fcntl(fd, F_ADD_SEALS, seals) >= 0 || errno != EPERM) {
+		printf("ADD_SEALS(%d, %u) did not fail with EPERM\n", fd,
+		       seals);
+		abort();
+	}
+}
+
+static void *mfd_assert_mmap(int fd, size_t sz, int prot)
+{
+	void *p;
+
+	p = mmap(NULL, sz, prot, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		printf("mmap(%zu, %#x) failed: %m\n", sz, prot);
+		abort();
+	}
+	return p;
+}
+
+static void mfd_fail_mmap_write(int fd, size_t sz)
+{
+	void *p;
+
+	p = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p != MAP_FAILED || errno != EPERM) {
+		printf("shared writable mmap of a sealed file did not fail\n");
+		abort();
+	}
+}
+
+static void mfd_fail_write(int fd)
+{
+	char c = 'x';
+
+	if (pwrite(fd, &c, 1, 0) >= 0 || errno != EPERM) {
+		printf("write to a sealed file did not fail with EPERM\n");
+		abort();
+	}
+}
+
+static void mfd_fail_ftruncate(int fd, off_t sz)
+{
+	if (ftruncate(fd, sz) >= 0 || errno != EPERM) {
+		printf("ftruncate(%lld) of a sealed file did not fail\n",
+		       (long long)sz);
+		abort();
+	}
+}
+
+static blkcnt_t mfd_blocks(int fd)
+{
+	struct stat st;
+
+	if (fstat(fd, &st) < 0) {
+		printf("fstat(%d) failed: %m\n", fd);
+		abort();
+	}
+	return st.st_blocks;
+}
+
+static void fill(unsigned char *p, size_t sz)
+{
+	size_t i;
+
+	for (i = 0; i < sz; i++)
+		p[i] = i * 7 + (i >> 12);
+}
+
+static void check(const unsigned char *p, size_t sz, const char *what)
+{
+	size_t i;
+
+	for (i = 0; i < sz; i++) {
+		if (p[i] != (unsigned char)(i * 7 + (i >> 12))) {
+			printf("%s: byte %zu is %#x\n", what, i, p[i]);
+			abort();
+		}
+	}
+}
+
+static void test_create(void)
+{
+	char buf[2048];
+	int fd;
+
+	printf("memfd: CREATE\n");
+
+	/* the name must fit in NAME_MAX with its "memfd:" prefix */
+	memset(buf, 0xff, sizeof(buf));
+	buf[sizeof(buf) - 1] = 0;
+	mfd_fail_new(buf, 0);
+
+	/* unknown flags */
+	mfd_fail_new("", 0x0100);
+	mfd_fail_new("", ~MFD_CLOEXEC);
+	mfd_fail_new("", ~MFD_ALLOW_SEALING);
+	mfd_fail_new("", ~0);
+
+	fd = mfd_assert_new("", 0, MFD_CLOEXEC);
+	if (!(fcntl(fd, F_GETFD) & FD_CLOEXEC)) {
+		printf("MFD_CLOEXEC did not set FD_CLOEXEC\n");
+		abort();
+	}
+	close(fd);
+}
+
+static void test_basic(void)
+{
+	int fd;
+
+	printf("memfd: BASIC\n");
+
+	/* without MFD_ALLOW_SEALING the file comes sealed against seals */
+	fd = mfd_assert_new("kern_memfd_basic", MFD_DEF_SIZE, MFD_CLOEXEC);
+	mfd_assert_has_seals(fd, F_SEAL_SEAL);
+	mfd_fail_add_seals(fd, F_SEAL_WRITE);
+	close(fd);
+
+	fd = mfd_assert_new("kern_memfd_basic", MFD_DEF_SIZE,
+			    MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	mfd_assert_has_seals(fd, 0);
+	mfd_assert_add_seals(fd, F_SEAL_SHRINK | F_SEAL_GROW);
+	mfd_assert_has_seals(fd, F_SEAL_SHRINK | F_SEAL_GROW);
+	mfd_fail_ftruncate(fd, MFD_DEF_SIZE / 2);
+	mfd_fail_ftruncate(fd, MFD_DEF_SIZE * 2);
+	mfd_assert_add_seals(fd, F_SEAL_WRITE | F_SEAL_SEAL);
+	mfd_fail_write(fd);
+	mfd_fail_mmap_write(fd, MFD_DEF_SIZE);
+	mfd_fail_add_seals(fd, F_SEAL_WRITE);
+	close(fd);
+}
+
+/* Returns 0 if MFD_HUGE_PREFERRED is not supported, the fd otherwise */
+static int huge_new(const char *name, loff_t sz, unsigned int flags)
+{
+	int fd;
+
+	fd = sys_memfd_create(name, MFD_HUGE_PREFERRED | flags);
+	if (fd < 0 && errno == EINVAL)
+		return 0;
+	if (fd < 0) {
+		printf("memfd_create(\"%s\", %#x) failed: %m\n", name,
+		       MFD_HUGE_PREFERRED | flags);
+		abort();
+	}
+	if (ftruncate(fd, sz) < 0) {
+		printf("ftruncate(%lld) failed: %m\n", (long long)sz);
+		abort();
+	}
+	return fd;
+}
+
+static void test_huge_preferred(void)
+{
+	unsigned char *p;
+	blkcnt_t blocks;
+	int fd;
+
+	printf("memfd: HUGE_PREFERRED\n");
+
+	fd = huge_new("kern_memfd_huge", HUGE_SIZE, MFD_CLOEXEC);
+	if (!fd) {
+		printf("memfd: MFD_HUGE_PREFERRED not supported, skipped\n");
+		return;
+	}
+	/* sealing stays off unless asked for */
+	mfd_assert_has_seals(fd, F_SEAL_SEAL);
+	close(fd);
+
+	/* hugetlbfs files can't have it, nor can they be sealed */
+	mfd_fail_new("kern_memfd_huge", MFD_HUGE_PREFERRED | MFD_HUGETLB);
+	mfd_fail_new("kern_memfd_huge",
+		     MFD_HUGE_PREFERRED | MFD_HUGETLB | MFD_ALLOW_SEALING);
+
+	/*
+	 * A file smaller than a huge page gets small pages: st_blocks
+	 * counts the whole huge page when one is allocated.
+	 */
+	fd = huge_new("kern_memfd_huge", 4096, MFD_CLOEXEC);
+	p = mfd_assert_mmap(fd, 4096, PROT_READ | PROT_WRITE);
+	fill(p, 4096);
+	munmap(p, 4096);
+	blocks = mfd_blocks(fd);
+	if (blocks != 4096 / 512) {
+		printf("4 kB file uses %lld blocks, expected %d\n",
+		       (long long)blocks, 4096 / 512);
+		abort();
+	}
+	close(fd);
+
+	/* seals work on a file that may have huge pages */
+	fd = huge_new("kern_memfd_huge", HUGE_SIZE,
+		      MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	mfd_assert_has_seals(fd, 0);
+	p = mfd_assert_mmap(fd, HUGE_SIZE, PROT_READ | PROT_WRITE);
+	fill(p, HUGE_SIZE);
+	munmap(p, HUGE_SIZE);
+	printf("memfd: %lld kB allocated for a %d kB file\n",
+	       (long long)mfd_blocks(fd) / 2, HUGE_SIZE >> 10);
+
+	mfd_assert_add_seals(fd, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE);
+	mfd_assert_has_seals(fd, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE);
+	mfd_fail_write(fd);
+	mfd_fail_mmap_write(fd, HUGE_SIZE);
+	mfd_fail_ftruncate(fd, HUGE_SIZE / 2);
+	mfd_fail_ftruncate(fd, HUGE_SIZE * 2);
+
+	p = mfd_assert_mmap(fd, HUGE_SIZE, PROT_READ);
+	check(p, HUGE_SIZE, "sealed file");
+	munmap(p, HUGE_SIZE);
+
+	mfd_assert_add_seals(fd, F_SEAL_SEAL);
+	mfd_fail_add_seals(fd, F_SEAL_WRITE);
+	close(fd);
+}
+
+int main(int argc, char **argv)
+{
+	/* keep the reason of a failed check when output goes to a pipe */
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	test_create();
+	test_basic();
+	test_huge_preferred();
+
+	printf("memfd: DONE\n");
+	return 0;
+}
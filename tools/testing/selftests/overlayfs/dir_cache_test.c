@@ -0,0 +1,414 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Check that overlayfs gives the same results with dir_cache=on as with
+ * dir_cache=off.
+ *
+ * Builds two identical sets of an upper and three lower layers under the
+ * given directory, with names spread over the layers, shadowed by upper
+ * layers, whited out and hidden by an opaque directory, mounts one with
+ * dir_cache=on and one with dir_cache=off, and applies the same random
+ * creates, mkdirs, unlinks, rmdirs, renames and copy-ups to both.  The
+ * result of every operation, of lookups of present and missing names and
+ * the listing of directories, with fstatat() of every entry, must be the
+ * same on both mounts.  Reads and lookups are done between changes, so
+ * that the caches are populated when the changes hit them.
+ *
+ * usage: dir_cache_test [-o ops] dir
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#define NR_LAYERS	4
+#define NR_DIRS		8
+#define NR_NAMES	64
+#define MAX_ENTRIES	(4 * NR_NAMES)
+
+static const char * const cache_opt[2] = { "off", "on" };
+static int nr_ops = 20000;
+static unsigned int seed = 1;
+static const char *top;
+static int root[2] = { -1, -1 };
+static bool mounted[2];
+
+static int write_file(const char *path, const char *data)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+
+	if (fd < 0 || write(fd, data, strlen(data)) < 0) {
+		perror(path);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+/*
+ * Name i of directory k is in layer l (0 being upper) if (i + k) % (l + 3)
+ * is 0, and a directory with an entry in each layer if i % 9 == 1; l1 has
+ * whiteouts for some names, and d1 is opaque in l1.
+ */
+static int build_layer(const char *base, int l)
+{
+	char path[PATH_MAX], data[64];
+	int k, i;
+
+	snprintf(path, sizeof(path), "%s/layer%d", base, l);
+	if (mkdir(path, 0755))
+		return -1;
+
+	for (k = 0; k < NR_DIRS; k++) {
+		snprintf(path, sizeof(path), "%s/layer%d/d%d", base, l, k);
+		if (mkdir(path, 0755))
+			return -1;
+		if (l == 1 && k == 1 &&
+		    setxattr(path, "trusted.overlay.opaque", "y", 1, 0)) {
+			perror("setxattr");
+			return -1;
+		}
+
+		for (i = 0; i < NR_NAMES; i++) {
+			snprintf(path, sizeof(path), "%s/layer%d/d%d/n%d",
+				 base, l, k, i);
+			if (i % 9 == 1) {
+				if (mkdir(path, 0755))
+					return -1;
+				snprintf(path, sizeof(path),
+					 "%s/layer%d/d%d/n%d/l%d", base, l, k,
+					 i, l);
+				snprintf(data, sizeof(data), "l%d", l);
+				if (write_file(path, data))
+					return -1;
+			} else if ((i + k) % (l + 3) == 0) {
+				/* a size telling which layer it came from */
+				snprintf(data, sizeof(data), "%*d", l + 1, l);
+				if (write_file(path, data))
+					return -1;
+			} else if (l == 1 && i % 5 == 0) {
+				if (mknod(path, S_IFCHR, makedev(0, 0))) {
+					perror("mknod");
+					return -1;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+static int setup(int on)
+{
+	char base[PATH_MAX / 2], opts[4 * PATH_MAX], mnt[PATH_MAX];
+	int l;
+
+	snprintf(base, sizeof(base), "%s/%s", top, cache_opt[on]);
+	snprintf(mnt, sizeof(mnt), "%s/mnt", base);
+	if (mkdir(base, 0755) || mkdir(mnt, 0755)) {
+		perror(base);
+		return -1;
+	}
+	snprintf(opts, sizeof(opts), "%s/work", base);
+	if (mkdir(opts, 0755)) {
+		perror(opts);
+		return -1;
+	}
+	for (l = 0; l < NR_LAYERS; l++) {
+		if (build_layer(base, l)) {
+			fprintf(stderr, "%s: cannot build layer %d\n", base, l);
+			return -1;
+		}
+	}
+
+	snprintf(opts, sizeof(opts),
+		 "lowerdir=%s/layer1:%s/layer2:%s/layer3,upperdir=%s/layer0,workdir=%s/work,dir_cache=%s",
+		 base, base, base, base, base, cache_opt[on]);
+	if (mount("overlay", mnt, "overlay", 0, opts)) {
+		printf("SKIP: mount -o dir_cache=%s: %s\n", cache_opt[on],
+		       strerror(errno));
+		exit(4);
+	}
+	mounted[on] = true;
+
+	root[on] = open(mnt, O_RDONLY | O_DIRECTORY);
+	if (root[on] < 0) {
+		perror(mnt);
+		return -1;
+	}
+	return 0;
+}
+
+static void cleanup(void)
+{
+	char mnt[PATH_MAX];
+	int on;
+
+	for (on = 0; on < 2; on++) {
+		if (root[on] >= 0)
+			close(root[on]);
+		snprintf(mnt, sizeof(mnt), "%s/%s/mnt", top, cache_opt[on]);
+		if (mounted[on])
+			umount(mnt);
+	}
+}
+
+static int fail(const char *what, const char *path)
+{
+	printf("FAIL: %s %s differs between dir_cache=off and on\n", what,
+	       path);
+	return -1;
+}
+
+/* Compare the results of the same call on both mounts */
+static int same_result(const char *what, const char *path, int ret[2],
+		       int err[2])
+{
+	if ((ret[0] < 0) != (ret[1] < 0) ||
+	    (ret[0] < 0 && err[0] != err[1])) {
+		printf("FAIL: %s %s: %s with dir_cache=off, %s with dir_cache=on\n",
+		       what, path, ret[0] < 0 ? strerror(err[0]) : "success",
+		       ret[1] < 0 ? strerror(err[1]) : "success");
+		return -1;
+	}
+	return 0;
+}
+
+static int check_stat(const char *path)
+{
+	struct stat st[2];
+	int ret[2], err[2], on;
+
+	for (on = 0; on < 2; on++) {
+		ret[on] = fstatat(root[on], path, &st[on], AT_SYMLINK_NOFOLLOW);
+		err[on] = errno;
+	}
+	if (same_result("stat", path, ret, err))
+		return -1;
+	if (ret[0] < 0)
+		return 0;
+
+	if (st[0].st_mode != st[1].st_mode ||
+	    st[0].st_nlink != st[1].st_nlink ||
+	    st[0].st_uid != st[1].st_uid ||
+	    (S_ISREG(st[0].st_mode) && st[0].st_size != st[1].st_size))
+		return fail("stat", path);
+	return 0;
+}
+
+struct entry {
+	char name[NAME_MAX + 1];
+	unsigned char type;
+};
+
+static int cmp_entry(const void *a, const void *b)
+{
+	return strcmp(((const struct entry *)a)->name,
+		      ((const struct entry *)b)->name);
+}
+
+static int list_dir(int on, const char *path, struct entry *ents)
+{
+	struct dirent *d;
+	int fd, nr = 0;
+	DIR *dp;
+
+	fd = openat(root[on], path, O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		return -errno;
+	dp = fdopendir(fd);
+	if (!dp) {
+		close(fd);
+		return -errno;
+	}
+	while ((d = readdir(dp)) && nr < MAX_ENTRIES) {
+		strcpy(ents[nr].name, d->d_name);
+		ents[nr++].type = d->d_type;
+	}
+	closedir(dp);
+	qsort(ents, nr, sizeof(*ents), cmp_entry);
+	return nr;
+}
+
+/* Compare the listing of @path and every entry in it */
+static int check_dir(const char *path)
+{
+	static struct entry ents[2][MAX_ENTRIES];
+	char name[PATH_MAX];
+	int nr[2], err[2], on, i;
+
+	for (on = 0; on < 2; on++) {
+		nr[on] = list_dir(on, path, ents[on]);
+		err[on] = -nr[on];
+	}
+	if (same_result("readdir", path, nr, err))
+		return -1;
+	if (nr[0] != nr[1])
+		return fail("number of entries of", path);
+
+	for (i = 0; i < nr[0]; i++) {
+		if (strcmp(ents[0][i].name, ents[1][i].name) ||
+		    ents[0][i].type != ents[1][i].type) {
+			snprintf(name, sizeof(name), "%s/%.*s", path,
+				 NAME_MAX, ents[0][i].name);
+			return fail("readdir entry", name);
+		}
+		if (!strcmp(ents[0][i].name, ".") ||
+		    !strcmp(ents[0][i].name, ".."))
+			continue;
+		snprintf(name, sizeof(name), "%s/%.*s", path, NAME_MAX,
+			 ents[0][i].name);
+		if (check_stat(name))
+			return -1;
+	}
+	return 0;
+}
+
+static int check_tree(void)
+{
+	char path[PATH_MAX];
+	int k, i;
+
+	if (check_dir("."))
+		return -1;
+	for (k = 0; k < NR_DIRS; k++) {
+		snprintf(path, sizeof(path), "d%d", k);
+		if (check_dir(path))
+			return -1;
+		for (i = 0; i < NR_NAMES + 8; i++) {
+			snprintf(path, sizeof(path), "d%d/n%d", k, i);
+			if (check_stat(path))
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/* A name that may or may not exist in any layer */
+static void rand_path(char *path)
+{
+	snprintf(path, PATH_MAX, "d%d/n%d", rand_r(&seed) % NR_DIRS,
+		 rand_r(&seed) % (NR_NAMES + 8));
+}
+
+enum { OP_CREATE, OP_MKDIR, OP_UNLINK, OP_RMDIR, OP_RENAME, OP_COPY_UP,
+       OP_CHMOD, OP_NR };
+
+static const char * const op_name[OP_NR] = {
+	"create", "mkdir", "unlink", "rmdir", "rename", "copy up", "chmod",
+};
+
+static int do_op(int on, int op, const char *path, const char *path2)
+{
+	int fd, ret = 0;
+
+	switch (op) {
+	case OP_CREATE:
+		fd = openat(root[on], path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd < 0)
+			return -1;
+		close(fd);
+		break;
+	case OP_MKDIR:
+		return mkdirat(root[on], path, 0755);
+	case OP_UNLINK:
+		return unlinkat(root[on], path, 0);
+	case OP_RMDIR:
+		return unlinkat(root[on], path, AT_REMOVEDIR);
+	case OP_RENAME:
+		return renameat(root[on], path, root[on], path2);
+	case OP_COPY_UP:
+		fd = openat(root[on], path, O_WRONLY | O_APPEND);
+		if (fd < 0)
+			return -1;
+		if (write(fd, "x", 1) != 1)
+			ret = -1;
+		close(fd);
+		break;
+	case OP_CHMOD:
+		return fchmodat(root[on], path, 0600, 0);
+	}
+	return ret;
+}
+
+static int random_op(void)
+{
+	char path[PATH_MAX], path2[PATH_MAX], dir[PATH_MAX], *p;
+	int op = rand_r(&seed) % OP_NR, ret[2], err[2], on;
+
+	rand_path(path);
+	rand_path(path2);
+	/* sometimes in a subdirectory that is merged from all layers */
+	if (op != OP_RENAME && rand_r(&seed) % 4 == 0)
+		snprintf(path, sizeof(path), "d%d/n%d/l%d",
+			 rand_r(&seed) % NR_DIRS, 9 * (rand_r(&seed) % 7) + 1,
+			 rand_r(&seed) % (NR_LAYERS + 1));
+
+	/* populate the caches before the change */
+	strcpy(dir, path);
+	p = strrchr(dir, '/');
+	*p = '\0';
+	if (check_stat(path) || check_stat(path2) || check_dir(dir))
+		return -1;
+
+	for (on = 0; on < 2; on++) {
+		ret[on] = do_op(on, op, path, path2);
+		err[on] = errno;
+	}
+	if (same_result(op_name[op], path, ret, err))
+		return -1;
+
+	if (check_stat(path) || check_stat(path2) || check_dir(dir))
+		return -1;
+	strcpy(dir, path2);
+	*strrchr(dir, '/') = '\0';
+	return check_dir(dir);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, i, ret = 1;
+
+	while ((opt = getopt(argc, argv, "o:")) != -1) {
+		switch (opt) {
+		case 'o':
+			nr_ops = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-o ops] dir\n", argv[0]);
+			return 2;
+		}
+	}
+	if (optind != argc - 1) {
+		fprintf(stderr, "usage: %s [-o ops] dir\n", argv[0]);
+		return 2;
+	}
+	top = argv[optind];
+
+	if (setup(0) || setup(1))
+		goto out;
+	if (check_tree())
+		goto out;
+	printf("ok: initial tree\n");
+
+	for (i = 0; i < nr_ops; i++) {
+		if (random_op())
+			goto out;
+		if ((i + 1) % 1000 == 0 && check_tree())
+			goto out;
+	}
+	printf("ok: %d operations\n", nr_ops);
+	ret = 0;
+out:
+	cleanup();
+	printf("%s\n", ret ? "FAIL" : "PASS");
+	return ret;
+}
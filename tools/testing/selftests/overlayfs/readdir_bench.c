@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Merged tree readdir+stat benchmark.
+ *
+ * With -C, creates the part of a tree of directories of files that belongs
+ * to one layer: file i of every directory is created in layer i % layers,
+ * so that most names are missing from most layers.  Otherwise walks the
+ * tree like "ls -lR" or a file indexer would, reading every directory and
+ * calling fstatat() on every entry, and prints the rate of each pass.  The
+ * first pass after mount is done with a cold overlay dentry cache.
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static int nr_dirs = 100;
+static int nr_files = 1000;
+static int nr_layers = 1;
+static int layer;
+static int passes = 3;
+static bool create;
+static const char *dir;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int create_tree(void)
+{
+	char path[PATH_MAX];
+	int d, i, fd;
+
+	for (d = 0; d < nr_dirs; d++) {
+		snprintf(path, sizeof(path), "%s/d%04d", dir, d);
+		if (mkdir(path, 0755) && errno != EEXIST) {
+			perror(path);
+			return -1;
+		}
+		for (i = layer; i < nr_files; i += nr_layers) {
+			snprintf(path, sizeof(path), "%s/d%04d/f%06d", dir, d, i);
+			fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (fd < 0) {
+				perror(path);
+				return -1;
+			}
+			close(fd);
+		}
+	}
+	return 0;
+}
+
+/* Read @name and stat every entry below it, returns the number of entries */
+static long scan_dir(int parent, const char *name, unsigned long *errors)
+{
+	struct dirent *de;
+	struct stat st;
+	long entries = 0;
+	DIR *d;
+	int fd;
+
+	fd = openat(parent, name, O_RDONLY | O_DIRECTORY);
+	if (fd < 0 || !(d = fdopendir(fd))) {
+		perror(name);
+		if (fd >= 0)
+			close(fd);
+		(*errors)++;
+		return 0;
+	}
+
+	while ((de = readdir(d))) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+		entries++;
+		if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW))
+			(*errors)++;
+		else if (S_ISDIR(st.st_mode))
+			entries += scan_dir(dirfd(d), de->d_name, errors);
+	}
+	closedir(d);
+
+	return entries;
+}
+
+static int scan_tree(void)
+{
+	unsigned long errors = 0;
+	double start, elapsed;
+	long entries;
+	int pass;
+
+	for (pass = 1; pass <= passes; pass++) {
+		start = now();
+		entries = scan_dir(AT_FDCWD, dir, &errors);
+		elapsed = now() - start;
+
+		printf("pass %d: %ld entries in %.3f s, %.0f entries per second\n",
+		       pass, entries, elapsed, entries / elapsed);
+	}
+
+	if (errors) {
+		printf("%lu errors\n", errors);
+		return -1;
+	}
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-p passes] directory\n"
+		"       %s -C [-d dirs] [-n files per dir] [-l layer -L layers] directory\n",
+		prog, prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "Cd:n:l:L:p:")) != -1) {
+		switch (opt) {
+		case 'C':
+			create = true;
+			break;
+		case 'd':
+			nr_dirs = atoi(optarg);
+			break;
+		case 'n':
+			nr_files = atoi(optarg);
+			break;
+		case 'l':
+			layer = atoi(optarg);
+			break;
+		case 'L':
+			nr_layers = atoi(optarg);
+			break;
+		case 'p':
+			passes = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || nr_dirs < 1 || nr_files < 1 ||
+	    nr_layers < 1 || layer < 0 || layer >= nr_layers || passes < 1)
+		usage(argv[0]);
+	dir = argv[optind];
+
+	if (create)
+		return create_tree() ? 1 : 0;
+	return scan_tree() ? 1 : 0;
+}
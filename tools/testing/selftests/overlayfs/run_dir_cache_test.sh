@@ -0,0 +1,21 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Run dir_cache_test on tmpfs layers, comparing an overlay mounted with
+# dir_cache=on with one mounted with dir_cache=off.
+
+readonly BIN="$(dirname "$0")/dir_cache_test"
+
+source "$(dirname "$0")/../lib/scratch_fs.sh"
+
+scratch_setup
+
+if ! grep -qw overlay /proc/filesystems && ! modprobe overlay 2> /dev/null; then
+	echo "SKIP: overlayfs not supported"
+	exit $ksft_skip
+fi
+
+scratch_mount -t tmpfs tmpfs "$DIR" || exit 1
+# dir_cache_test mounts the overlays itself
+SCRATCH_MOUNTS+=("${DIR}/off/mnt" "${DIR}/on/mnt")
+"$BIN" "$DIR"
@@ -0,0 +1,44 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Run readdir_bench on an overlay of an upper and three lower layers on
+# tmpfs, where every file is in one of the layers, first with dir_cache=off
+# and then with dir_cache=on.  The overlay is mounted again for each run,
+# so that the first pass starts with a cold overlay dentry cache.
+#
+# usage: run_readdir_bench.sh [dirs] [files per dir]
+
+readonly NR_DIRS="${1:-100}"
+readonly NR_FILES="${2:-1000}"
+readonly NR_LAYERS=4
+readonly BIN="$(dirname "$0")/readdir_bench"
+
+source "$(dirname "$0")/../lib/scratch_fs.sh"
+
+set -e
+
+scratch_setup
+
+if ! grep -qw overlay /proc/filesystems && ! modprobe overlay 2> /dev/null; then
+	echo "SKIP: overlayfs not supported"
+	exit $ksft_skip
+fi
+
+scratch_mount -t tmpfs tmpfs "$DIR"
+mkdir "$MNT" "${DIR}/work"
+for ((l = 0; l < NR_LAYERS; l++)); do
+	mkdir "${DIR}/layer${l}"
+	"$BIN" -C -d "$NR_DIRS" -n "$NR_FILES" -l "$l" -L "$NR_LAYERS" \
+		"${DIR}/layer${l}"
+done
+
+lowerdir="${DIR}/layer1:${DIR}/layer2:${DIR}/layer3"
+for opt in off on; do
+	if ! scratch_mount -t overlay overlay -o "lowerdir=${lowerdir},upperdir=${DIR}/layer0,workdir=${DIR}/work,dir_cache=${opt}" "$MNT"; then
+		echo "SKIP: mount -o dir_cache=$opt failed"
+		continue
+	fi
+	echo "dir_cache=$opt"
+	"$BIN" -p 3 "$MNT"
+	umount "$MNT"
+done
@@ -0,0 +1,236 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Checks the in-kernel stack aggregation ioctls of perf events:
+ * argument checking, the table read and its -ENOSPC protocol, stack
+ * fetches, and that stack ids stop being valid on the second reset
+ * after they were last counted.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define KSFT_SKIP	4
+#define STACK_MAX	64
+
+static int failed;
+
+#define check(cond, fmt, ...)						\
+do {									\
+	if (!(cond)) {							\
+		printf("FAIL: " fmt "\n", ##__VA_ARGS__);		\
+		failed = 1;						\
+	}								\
+} while (0)
+
+static int open_event(__u64 sample_type)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_SOFTWARE;
+	attr.config = PERF_COUNT_SW_TASK_CLOCK;
+	attr.sample_period = 100000;
+	attr.sample_type = sample_type;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static volatile unsigned long sink;
+
+static __attribute__((noinline)) void burn_a(void)
+{
+	unsigned long i;
+
+	for (i = 0; i < 1000000; i++)
+		sink += i;
+}
+
+static __attribute__((noinline)) void burn_b(void)
+{
+	unsigned long i;
+
+	for (i = 0; i < 1000000; i++)
+		sink ^= i;
+}
+
+static void burn(int ms)
+{
+	struct timespec start, now;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		burn_a();
+		burn_b();
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while ((now.tv_sec - start.tv_sec) * 1000 +
+		 (now.tv_nsec - start.tv_nsec) / 1000000 < ms);
+}
+
+static int read_table(int fd, struct perf_aggr_entry *entries, __u32 nr,
+		      __u32 flags, struct perf_aggr_read *req)
+{
+	memset(req, 0, sizeof(*req));
+	req->entries = (uintptr_t)entries;
+	req->nr = nr;
+	req->flags = flags;
+
+	return ioctl(fd, PERF_EVENT_IOC_AGGREGATE_READ, req);
+}
+
+static int fetch_stack(int fd, __u32 id, __u64 *ips, __u32 nr, __u32 *depth)
+{
+	struct perf_aggr_stack req = {
+		.ips = (uintptr_t)ips,
+		.stack_id = id,
+		.nr = nr,
+	};
+	int ret;
+
+	ret = ioctl(fd, PERF_EVENT_IOC_AGGREGATE_STACK, &req);
+	if (!ret)
+		*depth = req.nr;
+	return ret;
+}
+
+int main(void)
+{
+	__u64 ips[STACK_MAX + 1], other[STACK_MAX];
+	struct perf_aggr_entry *entries;
+	struct perf_aggr_read req;
+	__u32 i, j, nr, depth = 0, d2 = 0;
+	__u64 samples = 0;
+	int fd, ret;
+
+	fd = open_event(PERF_SAMPLE_CALLCHAIN);
+	if (fd < 0) {
+		printf("perf_event_open: %s, skipping\n", strerror(errno));
+		return KSFT_SKIP;
+	}
+
+	ret = ioctl(fd, PERF_EVENT_IOC_SET_AGGREGATE, 5);
+	if (ret && errno == ENOTTY) {
+		printf("stack aggregation not supported, skipping\n");
+		return KSFT_SKIP;
+	}
+	check(ret && errno == EINVAL, "table of 1 << 5 entries accepted");
+	ret = ioctl(fd, PERF_EVENT_IOC_SET_AGGREGATE, 15);
+	check(ret && errno == EINVAL, "table of 1 << 15 entries accepted");
+
+	/* aggregation needs the callchains */
+	ret = open_event(PERF_SAMPLE_IP);
+	if (ret >= 0) {
+		check(ioctl(ret, PERF_EVENT_IOC_SET_AGGREGATE, 8) &&
+		      errno == EINVAL, "event without callchains accepted");
+		close(ret);
+	}
+
+	check(!ioctl(fd, PERF_EVENT_IOC_SET_AGGREGATE, 8),
+	      "SET_AGGREGATE: %s", strerror(errno));
+	check(ioctl(fd, PERF_EVENT_IOC_SET_AGGREGATE, 8) && errno == EEXIST,
+	      "second SET_AGGREGATE accepted");
+
+	ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	burn(300);
+	ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+
+	/* a too small buffer tells how many entries there are */
+	ret = read_table(fd, NULL, 0, 0, &req);
+	check(ret && errno == ENOSPC && req.nr > 0,
+	      "empty read: ret %d errno %d nr %u", ret, errno, req.nr);
+	if (failed)
+		return 1;
+
+	nr = req.nr;
+	entries = calloc(nr, sizeof(*entries));
+	if (!entries)
+		return 1;
+
+	check(!read_table(fd, entries, nr, 0, &req) && req.nr == nr,
+	      "read of %u entries: %s, got %u", nr, strerror(errno), req.nr);
+
+	for (i = 0; i < nr; i++) {
+		check(entries[i].pid == (__u32)getpid(), "entry %u: pid %u", i,
+		      entries[i].pid);
+		check(entries[i].stack_id && entries[i].count,
+		      "entry %u: id %u count %llu", i, entries[i].stack_id,
+		      (unsigned long long)entries[i].count);
+		samples += entries[i].count;
+	}
+	check(samples > 0, "no samples counted");
+
+	/* only one entry per (pid, stack), and stacks are deduplicated */
+	for (i = 0; i < nr; i++) {
+		ret = fetch_stack(fd, entries[i].stack_id, ips, STACK_MAX,
+				  &depth);
+		check(!ret && depth > 0 && depth <= STACK_MAX,
+		      "stack %u: %s, depth %u", entries[i].stack_id,
+		      strerror(errno), depth);
+		if (ret)
+			continue;
+
+		for (j = i + 1; j < nr; j++) {
+			check(entries[j].stack_id != entries[i].stack_id,
+			      "stack %u counted twice", entries[i].stack_id);
+			if (fetch_stack(fd, entries[j].stack_id, other,
+					STACK_MAX, &d2))
+				continue;
+			check(d2 != depth ||
+			      memcmp(ips, other, depth * sizeof(*ips)),
+			      "stacks %u and %u are the same",
+			      entries[i].stack_id, entries[j].stack_id);
+		}
+	}
+
+	/* a short buffer gets the start of the stack and its full depth */
+	ret = fetch_stack(fd, entries[0].stack_id, other, STACK_MAX, &depth);
+	memset(ips, 0xa5, sizeof(ips));
+	ret |= fetch_stack(fd, entries[0].stack_id, ips, 1, &d2);
+	check(!ret && d2 == depth && ips[0] == other[0] &&
+	      ips[1] == 0xa5a5a5a5a5a5a5a5ULL, "short stack fetch");
+
+	check(fetch_stack(fd, 0, ips, STACK_MAX, &depth) && errno == ENOENT,
+	      "stack id 0 found");
+
+	/* the ids just read can be fetched until the next reset */
+	check(!read_table(fd, entries, nr, PERF_AGGR_READ_RESET, &req),
+	      "read and reset: %s", strerror(errno));
+	check(!read_table(fd, NULL, 0, 0, &req) && req.nr == 0 && !req.lost,
+	      "table not empty after reset: %u entries", req.nr);
+	for (i = 0; i < nr; i++)
+		check(!fetch_stack(fd, entries[i].stack_id, ips, STACK_MAX,
+				   &depth),
+		      "stack %u gone after one reset", entries[i].stack_id);
+
+	check(!read_table(fd, NULL, 0, PERF_AGGR_READ_RESET, &req),
+	      "second reset: %s", strerror(errno));
+	for (i = 0; i < nr; i++)
+		check(fetch_stack(fd, entries[i].stack_id, ips, STACK_MAX,
+				  &depth) && errno == ENOENT,
+		      "stack %u still there after two resets",
+		      entries[i].stack_id);
+
+	check(read_table(fd, NULL, 0, 1U << 31, &req) && errno == EINVAL,
+	      "unknown read flag accepted");
+
+	close(fd);
+	free(entries);
+
+	if (failed)
+		return 1;
+
+	printf("ok: %u stacks, %llu samples\n", nr,
+	       (unsigned long long)samples);
+	return 0;
+}
@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Directory scan benchmark for FS_IOC_READDIRPLUS.
+ *
+ * With -C, creates a tree of directories of files.  Otherwise walks the
+ * tree the way a media scanner does, once with getdents64() and an
+ * fstatat() per entry and once with FS_IOC_READDIRPLUS, and prints the
+ * time and number of system calls of each walk.  Entries that the ioctl
+ * could not stat are stat'ed with fstatat() as a scanner would.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/readdirplus.h>
+
+#define BUF_SIZE	(64 * 1024)
+
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+struct scan_stats {
+	unsigned long entries;
+	unsigned long syscalls;
+	unsigned long fallbacks;
+	unsigned long errors;
+};
+
+static int nr_dirs = 100;
+static int nr_files = 1000;
+static bool create;
+static const char *mode = "both";
+static const char *dir;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int create_tree(void)
+{
+	char path[PATH_MAX];
+	double start = now();
+	int d, i, fd;
+
+	for (d = 0; d < nr_dirs; d++) {
+		snprintf(path, sizeof(path), "%s/d%04d", dir, d);
+		if (mkdir(path, 0755) && errno != EEXIST) {
+			perror(path);
+			return -1;
+		}
+		for (i = 0; i < nr_files; i++) {
+			snprintf(path, sizeof(path), "%s/d%04d/IMG_%06d.jpg",
+				 dir, d, i);
+			fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (fd < 0) {
+				perror(path);
+				return -1;
+			}
+			close(fd);
+		}
+	}
+	printf("created %d files in %.3f s\n", nr_dirs * nr_files,
+	       now() - start);
+	return 0;
+}
+
+static bool dot_or_dotdot(const char *name)
+{
+	return !strcmp(name, ".") || !strcmp(name, "..");
+}
+
+static void scan_getdents(int fd, char *buf, struct scan_stats *s);
+static void scan_plus(int fd, char *buf, struct scan_stats *s);
+
+static void scan_subdir(int parent, const char *name, bool plus,
+			struct scan_stats *s)
+{
+	char *buf;
+	int fd;
+
+	buf = malloc(BUF_SIZE);
+	fd = openat(parent, name, O_RDONLY | O_DIRECTORY);
+	s->syscalls++;
+	if (!buf || fd < 0) {
+		perror(name);
+		s->errors++;
+		goto out;
+	}
+	if (plus)
+		scan_plus(fd, buf, s);
+	else
+		scan_getdents(fd, buf, s);
+	close(fd);
+	s->syscalls++;
+out:
+	free(buf);
+}
+
+static void scan_getdents(int fd, char *buf, struct scan_stats *s)
+{
+	struct linux_dirent64 *de;
+	struct stat st;
+	long n, pos;
+
+	for (;;) {
+		n = syscall(SYS_getdents64, fd, buf, BUF_SIZE);
+		s->syscalls++;
+		if (n <= 0) {
+			if (n < 0)
+				s->errors++;
+			return;
+		}
+		for (pos = 0; pos < n; pos += de->d_reclen) {
+			de = (void *)(buf + pos);
+			if (dot_or_dotdot(de->d_name))
+				continue;
+			s->entries++;
+			s->syscalls++;
+			if (fstatat(fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW)) {
+				s->errors++;
+				continue;
+			}
+			if (S_ISDIR(st.st_mode))
+				scan_subdir(fd, de->d_name, false, s);
+		}
+	}
+}
+
+static void scan_plus(int fd, char *buf, struct scan_stats *s)
+{
+	struct fs_readdirplus args = {
+		.buf = (uintptr_t)buf,
+		.size = BUF_SIZE,
+		.mask = STATX_BASIC_STATS,
+	};
+	struct fs_readdirplus_entry *de;
+	struct stat st;
+	long n, pos;
+	mode_t mode;
+
+	for (;;) {
+		n = ioctl(fd, FS_IOC_READDIRPLUS, &args);
+		s->syscalls++;
+		if (n <= 0) {
+			if (n < 0)
+				s->errors++;
+			return;
+		}
+		for (pos = 0; pos < n; pos += de->d_reclen) {
+			de = (void *)(buf + pos);
+			if (dot_or_dotdot(de->d_name))
+				continue;
+			s->entries++;
+			if (de->stx.stx_mask & STATX_TYPE) {
+				mode = de->stx.stx_mode;
+			} else {
+				s->fallbacks++;
+				s->syscalls++;
+				if (fstatat(fd, de->d_name, &st,
+					    AT_SYMLINK_NOFOLLOW)) {
+					s->errors++;
+					continue;
+				}
+				mode = st.st_mode;
+			}
+			if (S_ISDIR(mode))
+				scan_subdir(fd, de->d_name, true, s);
+		}
+	}
+}
+
+static bool readdirplus_supported(void)
+{
+	struct fs_readdirplus args = { 0 };
+	int fd, ret;
+
+	fd = open(dir, O_RDONLY | O_DIRECTORY);
+	if (fd < 0) {
+		perror(dir);
+		return false;
+	}
+	/* A too small buffer fails with EINVAL if the ioctl is supported */
+	ret = ioctl(fd, FS_IOC_READDIRPLUS, &args);
+	close(fd);
+	if (ret < 0 && errno == ENOTTY) {
+		printf("FS_IOC_READDIRPLUS not supported\n");
+		return false;
+	}
+	return true;
+}
+
+static int scan_tree(bool plus)
+{
+	struct scan_stats s = { 0 };
+	double start, elapsed;
+
+	start = now();
+	scan_subdir(AT_FDCWD, dir, plus, &s);
+	elapsed = now() - start;
+
+	printf("%-11s %lu entries in %.3f s, %lu syscalls",
+	       plus ? "readdirplus" : "getdents", s.entries, elapsed,
+	       s.syscalls);
+	if (plus)
+		printf(", %lu fstatat fallbacks", s.fallbacks);
+	printf("\n");
+
+	if (s.errors) {
+		printf("%lu errors\n", s.errors);
+		return -1;
+	}
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-m getdents|plus|both] directory\n"
+		"       %s -C [-d dirs] [-n files per dir] directory\n",
+		prog, prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "Cd:n:m:")) != -1) {
+		switch (opt) {
+		case 'C':
+			create = true;
+			break;
+		case 'd':
+			nr_dirs = atoi(optarg);
+			break;
+		case 'n':
+			nr_files = atoi(optarg);
+			break;
+		case 'm':
+			mode = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || nr_dirs < 1 || nr_files < 1)
+		usage(argv[0]);
+	dir = argv[optind];
+
+	if (create)
+		return create_tree() ? 1 : 0;
+
+	if (strcmp(mode, "getdents") && !readdirplus_supported())
+		return 4;	/* KSFT_SKIP */
+
+	if (!strcmp(mode, "getdents") || !strcmp(mode, "both"))
+		ret |= scan_tree(false);
+	if (!strcmp(mode, "plus") || !strcmp(mode, "both"))
+		ret |= scan_tree(true);
+	return ret ? 1 : 0;
+}
@@ -0,0 +1,462 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Tests for FS_IOC_READDIRPLUS.
+ *
+ * Reads a directory of files of every type with the ioctl and checks
+ * that every entry is there once, with the attributes fstatat() with
+ * AT_SYMLINK_NOFOLLOW returns, except for "." and ".." and a mount point,
+ * which must come back with stx_mask 0.  Checks that reserved fields, bad
+ * flags and bad masks are refused with EINVAL, and that a buffer with
+ * room for one entry, or not even that, behaves like it does with
+ * getdents64(), including the directory offset.
+ *
+ * The mount point is only checked when run as root.
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#include <linux/readdirplus.h>
+
+#define NR_FILES	300
+#define MAX_ENTRIES	(NR_FILES + 16)
+#define BUF_SIZE	(64 * 1024)
+#define ENTRY_HDR	offsetof(struct fs_readdirplus_entry, d_name)
+
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+struct entry {
+	char name[64];
+	uint64_t ino;
+	unsigned char type;
+};
+
+static char top[] = "/tmp/readdirplus_test.XXXXXX";
+static char mnt[sizeof(top) + 8];
+static bool mounted;
+static int failures;
+
+static void fail(const char *fmt, const char *name)
+{
+	printf("FAIL: ");
+	printf(fmt, name);
+	printf("\n");
+	failures++;
+}
+
+static int readdirplus(int fd, void *buf, unsigned int size, unsigned int mask,
+		       unsigned int flags, unsigned int reserved)
+{
+	struct fs_readdirplus args = {
+		.buf = (uintptr_t)buf,
+		.size = size,
+		.mask = mask,
+		.flags = flags,
+		.reserved = reserved,
+	};
+	int ret = ioctl(fd, FS_IOC_READDIRPLUS, &args);
+
+	return ret < 0 ? -errno : ret;
+}
+
+static int create_file(const char *name, size_t size)
+{
+	char path[sizeof(top) + 64];
+	char data[4096];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", top, name);
+	fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0640);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	memset(data, 'x', sizeof(data));
+	if (size && write(fd, data, size) != (ssize_t)size) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+static int setup(void)
+{
+	char path[sizeof(top) + 64], path2[sizeof(top) + 64];
+	int i;
+
+	if (!mkdtemp(top)) {
+		perror("mkdtemp");
+		return -1;
+	}
+	if (create_file("file", 1000) || create_file("empty", 0))
+		return -1;
+	for (i = 0; i < NR_FILES; i++) {
+		snprintf(path, sizeof(path), "f%04d", i);
+		if (create_file(path, i))
+			return -1;
+	}
+
+	snprintf(path, sizeof(path), "%s/file", top);
+	snprintf(path2, sizeof(path2), "%s/hardlink", top);
+	if (link(path, path2))
+		return -1;
+	snprintf(path, sizeof(path), "%s/dir", top);
+	if (mkdir(path, 0750))
+		return -1;
+	snprintf(path, sizeof(path), "%s/symlink", top);
+	if (symlink("file", path))
+		return -1;
+	snprintf(path, sizeof(path), "%s/dangling", top);
+	if (symlink("nowhere", path))
+		return -1;
+	snprintf(path, sizeof(path), "%s/fifo", top);
+	if (mkfifo(path, 0600))
+		return -1;
+
+	snprintf(mnt, sizeof(mnt), "%s/mnt", top);
+	if (mkdir(mnt, 0755))
+		return -1;
+	if (!geteuid()) {
+		if (mount("none", mnt, "tmpfs", 0, NULL)) {
+			perror("mount");
+			return -1;
+		}
+		mounted = true;
+	}
+	return 0;
+}
+
+static void cleanup(void)
+{
+	char cmd[sizeof(top) + 16];
+
+	if (mounted)
+		umount(mnt);
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", top);
+	if (system(cmd))
+		fprintf(stderr, "cannot remove %s\n", top);
+}
+
+static bool same_time(const struct statx_timestamp *a,
+		      const struct timespec *b)
+{
+	return a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec;
+}
+
+static void check_stx(int dfd, const struct fs_readdirplus_entry *de)
+{
+	const struct statx *stx = &de->stx;
+	const char *name = de->d_name;
+	struct stat st;
+
+	if (!strcmp(name, ".") || !strcmp(name, "..") ||
+	    (mounted && !strcmp(name, "mnt"))) {
+		if (stx->stx_mask)
+			fail("%s: stx_mask is not 0", name);
+		return;
+	}
+
+	if ((stx->stx_mask & STATX_BASIC_STATS) != STATX_BASIC_STATS) {
+		fail("%s: basic stats missing from stx_mask", name);
+		return;
+	}
+	if (fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW)) {
+		fail("%s: fstatat failed", name);
+		return;
+	}
+
+	if (stx->stx_ino != st.st_ino || de->d_ino != st.st_ino)
+		fail("%s: inode number differs", name);
+	if (stx->stx_mode != st.st_mode)
+		fail("%s: mode differs", name);
+	if (de->d_type != DT_UNKNOWN && de->d_type != IFTODT(st.st_mode))
+		fail("%s: d_type does not match the mode", name);
+	if (stx->stx_nlink != st.st_nlink)
+		fail("%s: link count differs", name);
+	if (stx->stx_uid != st.st_uid || stx->stx_gid != st.st_gid)
+		fail("%s: owner differs", name);
+	if (stx->stx_size != (uint64_t)st.st_size ||
+	    stx->stx_blocks != (uint64_t)st.st_blocks)
+		fail("%s: size differs", name);
+	if (makedev(stx->stx_dev_major, stx->stx_dev_minor) != st.st_dev ||
+	    makedev(stx->stx_rdev_major, stx->stx_rdev_minor) != st.st_rdev)
+		fail("%s: device differs", name);
+	if (!same_time(&stx->stx_mtime, &st.st_mtim) ||
+	    !same_time(&stx->stx_ctime, &st.st_ctim) ||
+	    !same_time(&stx->stx_atime, &st.st_atim))
+		fail("%s: timestamps differ", name);
+}
+
+/* Every entry once, with the same attributes as fstatat() */
+static void test_attributes(void)
+{
+	char *buf = malloc(BUF_SIZE);
+	int dfd, ret, nr = 0, pos, i;
+	bool seen[NR_FILES] = { false };
+
+	dfd = open(top, O_RDONLY | O_DIRECTORY);
+	if (dfd < 0 || !buf) {
+		perror(top);
+		failures++;
+		return;
+	}
+
+	while ((ret = readdirplus(dfd, buf, BUF_SIZE, STATX_BASIC_STATS,
+				  AT_STATX_SYNC_AS_STAT, 0)) > 0) {
+		for (pos = 0; pos < ret; ) {
+			struct fs_readdirplus_entry *de = (void *)(buf + pos);
+
+			if (de->d_reclen < ENTRY_HDR || de->d_reclen % 8 ||
+			    pos + de->d_reclen > ret) {
+				fail("%s: bad d_reclen", de->d_name);
+				goto out;
+			}
+			check_stx(dfd, de);
+			if (sscanf(de->d_name, "f%d", &i) == 1 &&
+			    i >= 0 && i < NR_FILES) {
+				if (seen[i])
+					fail("%s: returned twice", de->d_name);
+				seen[i] = true;
+			}
+			nr++;
+			pos += de->d_reclen;
+		}
+	}
+	if (ret < 0) {
+		printf("FAIL: FS_IOC_READDIRPLUS: %s\n", strerror(-ret));
+		failures++;
+		goto out;
+	}
+	/* the files, ".", "..", and the 8 others */
+	if (nr != NR_FILES + 10) {
+		printf("FAIL: %d entries, expected %d\n", nr, NR_FILES + 10);
+		failures++;
+	}
+	for (i = 0; i < NR_FILES; i++) {
+		if (!seen[i]) {
+			printf("FAIL: f%04d missing\n", i);
+			failures++;
+			break;
+		}
+	}
+	printf("%s: attributes of %d entries\n",
+	       failures ? "FAIL" : "ok", nr);
+out:
+	close(dfd);
+	free(buf);
+}
+
+static void expect_einval(int dfd, const char *what, unsigned int size,
+			  unsigned int mask, unsigned int flags,
+			  unsigned int reserved)
+{
+	char buf[4096];
+	int ret;
+
+	ret = readdirplus(dfd, buf, size, mask, flags, reserved);
+	if (ret != -EINVAL) {
+		printf("FAIL: %s: %s, expected EINVAL\n", what,
+		       ret < 0 ? strerror(-ret) : "success");
+		failures++;
+	} else {
+		printf("ok: %s\n", what);
+	}
+}
+
+static void test_einval(void)
+{
+	char path[sizeof(top) + 16];
+	char buf[4096];
+	int dfd, fd, ret;
+
+	dfd = open(top, O_RDONLY | O_DIRECTORY);
+	if (dfd < 0) {
+		perror(top);
+		failures++;
+		return;
+	}
+	expect_einval(dfd, "reserved field set", sizeof(buf),
+		      STATX_BASIC_STATS, 0, 1);
+	expect_einval(dfd, "reserved mask bit", sizeof(buf), STATX__RESERVED,
+		      0, 0);
+	expect_einval(dfd, "AT_SYMLINK_NOFOLLOW in flags", sizeof(buf),
+		      STATX_BASIC_STATS, AT_SYMLINK_NOFOLLOW, 0);
+	expect_einval(dfd, "both sync flags", sizeof(buf), STATX_BASIC_STATS,
+		      AT_STATX_FORCE_SYNC | AT_STATX_DONT_SYNC, 0);
+	expect_einval(dfd, "empty buffer", 0, STATX_BASIC_STATS, 0, 0);
+	close(dfd);
+
+	snprintf(path, sizeof(path), "%s/file", top);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		failures++;
+		return;
+	}
+	ret = readdirplus(fd, buf, sizeof(buf), STATX_BASIC_STATS, 0, 0);
+	if (ret != -ENOTDIR) {
+		printf("FAIL: regular file: %s, expected ENOTDIR\n",
+		       ret < 0 ? strerror(-ret) : "success");
+		failures++;
+	} else {
+		printf("ok: regular file\n");
+	}
+	close(fd);
+}
+
+static int cmp_entry(const void *a, const void *b)
+{
+	return strcmp(((const struct entry *)a)->name,
+		      ((const struct entry *)b)->name);
+}
+
+/* Read what is left of @dfd with getdents64() */
+static int read_getdents(int dfd, struct entry *ents, int nr)
+{
+	char buf[BUF_SIZE];
+	int ret, pos;
+
+	while ((ret = syscall(SYS_getdents64, dfd, buf, sizeof(buf))) > 0) {
+		for (pos = 0; pos < ret; ) {
+			struct linux_dirent64 *d = (void *)(buf + pos);
+
+			if (nr == MAX_ENTRIES)
+				return -1;
+			snprintf(ents[nr].name, sizeof(ents[nr].name), "%s",
+				 d->d_name);
+			ents[nr].ino = d->d_ino;
+			ents[nr++].type = d->d_type;
+			pos += d->d_reclen;
+		}
+	}
+	return ret < 0 ? -1 : nr;
+}
+
+static bool same_entries(struct entry *a, int nr_a, struct entry *b, int nr_b)
+{
+	int i;
+
+	if (nr_a != nr_b)
+		return false;
+	qsort(a, nr_a, sizeof(*a), cmp_entry);
+	qsort(b, nr_b, sizeof(*b), cmp_entry);
+	for (i = 0; i < nr_a; i++)
+		if (strcmp(a[i].name, b[i].name) || a[i].ino != b[i].ino ||
+		    a[i].type != b[i].type)
+			return false;
+	return true;
+}
+
+/*
+ * A buffer with room for only one entry returns one entry per call, and
+ * one too small for any fails with EINVAL, like getdents64().  Half of
+ * the directory is read that way and the rest with getdents64() on the
+ * same file, which must carry on where the ioctl stopped.
+ */
+static void test_small_buffer(void)
+{
+	static struct entry ref[MAX_ENTRIES], ents[MAX_ENTRIES];
+	size_t size = ENTRY_HDR + 32;
+	char small[ENTRY_HDR + 32] __attribute__((aligned(8)));
+	struct fs_readdirplus_entry *de = (void *)small;
+	char tiny[sizeof(struct linux_dirent64) + 2];
+	int dfd, nr_ref, nr = 0, ret, ret2;
+
+	dfd = open(top, O_RDONLY | O_DIRECTORY);
+	if (dfd < 0) {
+		perror(top);
+		failures++;
+		return;
+	}
+	nr_ref = read_getdents(dfd, ref, 0);
+	lseek(dfd, 0, SEEK_SET);
+
+	ret = readdirplus(dfd, small, ENTRY_HDR, STATX_BASIC_STATS, 0, 0);
+	ret2 = syscall(SYS_getdents64, dfd, tiny, sizeof(tiny));
+	if (ret != -EINVAL || ret2 != -1 || errno != EINVAL) {
+		printf("FAIL: buffer too small for one entry: %s, getdents64: %s\n",
+		       ret < 0 ? strerror(-ret) : "success",
+		       ret2 < 0 ? strerror(errno) : "success");
+		failures++;
+	} else {
+		printf("ok: buffer too small for one entry\n");
+	}
+
+	while (nr < nr_ref / 2) {
+		ret = readdirplus(dfd, small, size, STATX_BASIC_STATS, 0, 0);
+		if (ret <= 0 || ret != de->d_reclen) {
+			printf("FAIL: one entry buffer returned %d bytes: %s\n",
+			       ret, ret < 0 ? strerror(-ret) : "");
+			failures++;
+			goto out;
+		}
+		snprintf(ents[nr].name, sizeof(ents[nr].name), "%s",
+			 de->d_name);
+		ents[nr].ino = de->d_ino;
+		ents[nr++].type = de->d_type;
+		if (lseek(dfd, 0, SEEK_CUR) != de->d_off) {
+			fail("%s: d_off is not the directory offset",
+			     de->d_name);
+			goto out;
+		}
+	}
+	nr = read_getdents(dfd, ents, nr);
+
+	if (nr_ref < 0 || nr < 0 || !same_entries(ref, nr_ref, ents, nr)) {
+		printf("FAIL: one entry at a time and getdents64() differ\n");
+		failures++;
+	} else {
+		printf("ok: one entry at a time, %d entries\n", nr);
+	}
+out:
+	close(dfd);
+}
+
+int main(void)
+{
+	char buf[4096];
+	int dfd, ret;
+
+	dfd = open("/", O_RDONLY | O_DIRECTORY);
+	ret = readdirplus(dfd, buf, sizeof(buf), STATX_BASIC_STATS, 0, 0);
+	close(dfd);
+	if (ret == -ENOTTY || ret == -EOPNOTSUPP) {
+		printf("SKIP: FS_IOC_READDIRPLUS not supported\n");
+		return 4;
+	}
+
+	if (setup()) {
+		cleanup();
+		return 1;
+	}
+	if (!mounted)
+		printf("not root, the mount point is not checked\n");
+
+	test_attributes();
+	test_einval();
+	test_small_buffer();
+
+	cleanup();
+	printf("%s\n", failures ? "FAIL" : "PASS");
+	return failures ? 1 : 0;
+}
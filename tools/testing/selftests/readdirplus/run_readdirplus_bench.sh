@@ -0,0 +1,54 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Scan a tree of 100 directories of 1000 files with getdents64() and
+# fstatat() and with FS_IOC_READDIRPLUS, on f2fs on a loop device and, if
+# bindfs is installed, on a FUSE mount of the same tree.  Each scan is run
+# with cold caches and then again with warm caches.
+#
+# usage: run_readdirplus_bench.sh [dirs] [files per dir]
+
+readonly NR_DIRS="${1:-100}"
+readonly NR_FILES="${2:-1000}"
+readonly BIN="$(dirname "$0")/readdirplus_bench"
+
+source "$(dirname "$0")/../lib/scratch_fs.sh"
+
+scan() {
+	local mode
+
+	for mode in getdents plus; do
+		sync
+		echo 3 > /proc/sys/vm/drop_caches
+		echo -n "cold: "
+		"$BIN" -m "$mode" "$1" || return
+		echo -n "warm: "
+		"$BIN" -m "$mode" "$1" || return
+	done
+}
+
+set -e
+
+loop_image_setup f2fs 2G mkfs.f2fs -q
+readonly FUSE_MNT="${DIR}/fuse"
+mkdir "$FUSE_MNT"
+loop_image_mount
+mkdir "${MNT}/DCIM"
+"$BIN" -C -d "$NR_DIRS" -n "$NR_FILES" "${MNT}/DCIM"
+
+set +e
+
+echo "f2fs"
+scan "${MNT}/DCIM"
+ret=$?
+[[ $ret -ne 0 ]] && exit $ret
+
+if command -v bindfs > /dev/null && bindfs "${MNT}/DCIM" "$FUSE_MNT"; then
+	SCRATCH_MOUNTS+=("$FUSE_MNT")
+	echo "FUSE (bindfs)"
+	scan "$FUSE_MNT"
+	ret=$?
+else
+	echo "bindfs not available, skipping FUSE"
+fi
+exit $ret
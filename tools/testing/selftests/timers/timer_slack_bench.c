@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Timer slack benchmark: runs a synthetic background workload of tasks
+ * sleeping for random periods, once without slack and once with it, and
+ * reports system wakeups per second (idle state entries), idle residency
+ * and how late the tasks woke up.
+ *
+ * With -c the slack is set on a cpu cgroup (cpu.timer_slack_ns) and the
+ * tasks are moved into it, otherwise each task sets its own slack with
+ * PR_SET_TIMERSLACK.  Run it on an otherwise idle system.
+ *
+ *   timer_slack_bench [-n tasks] [-t seconds] [-p max_period_us]
+ *                     [-s slack_ns] [-c cgroup_dir]
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#define NSEC_PER_SEC	1000000000LL
+#define MAX_LATE	4096
+
+struct task_stats {
+	unsigned long	wakeups;
+	unsigned long	nr_late;
+	long long	late_ns[MAX_LATE];
+};
+
+static int nr_tasks = 16;
+static int seconds = 10;
+static long max_period_us = 100000;
+static unsigned long long slack_ns = 20000000;
+static const char *cgroup;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int write_file(const char *dir, const char *name,
+		      unsigned long long val)
+{
+	char path[4096];
+	FILE *f;
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	f = fopen(path, "w");
+	if (!f)
+		return -1;
+	ret = fprintf(f, "%llu\n", val) < 0;
+	ret |= fclose(f);
+	return ret ? -1 : 0;
+}
+
+static unsigned long long read_ull(const char *path)
+{
+	unsigned long long val = 0;
+	FILE *f = fopen(path, "r");
+
+	if (f) {
+		if (fscanf(f, "%llu", &val) != 1)
+			val = 0;
+		fclose(f);
+	}
+	return val;
+}
+
+/* sum of idle state entries and residency (us) over all cpus */
+static int idle_stats(unsigned long long *usage, unsigned long long *time_us)
+{
+	char path[512];
+	int cpu, state, found = 0;
+
+	*usage = *time_us = 0;
+	for (cpu = 0; ; cpu++) {
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/cpu/cpu%d", cpu);
+		if (access(path, F_OK))
+			break;
+		for (state = 0; ; state++) {
+			snprintf(path, sizeof(path),
+				 "/sys/devices/system/cpu/cpu%d/cpuidle/state%d/usage",
+				 cpu, state);
+			if (access(path, F_OK))
+				break;
+			*usage += read_ull(path);
+			snprintf(path, sizeof(path),
+				 "/sys/devices/system/cpu/cpu%d/cpuidle/state%d/time",
+				 cpu, state);
+			*time_us += read_ull(path);
+			found = 1;
+		}
+	}
+	return found ? cpu : -1;
+}
+
+static void sleeper(struct task_stats *st, long long end, unsigned int seed)
+{
+	struct timespec ts;
+	long long period, start, late;
+
+	while ((start = now_ns()) < end) {
+		period = (max_period_us / 10 +
+			  rand_r(&seed) % (max_period_us - max_period_us / 10 + 1))
+			 * 1000;
+		ts.tv_sec = period / NSEC_PER_SEC;
+		ts.tv_nsec = period % NSEC_PER_SEC;
+		clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+
+		late = now_ns() - start - period;
+		st->late_ns[st->nr_late++ % MAX_LATE] = late;
+		st->wakeups++;
+	}
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+	long long x = *(const long long *)a, y = *(const long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int run(unsigned long long slack)
+{
+	unsigned long long usage0, usage1, idle0, idle1, wakeups = 0;
+	struct task_stats *stats;
+	long long start, end, elapsed, *late;
+	unsigned long nr_late = 0, n, i;
+	double late_sum = 0;
+	int t, nr_cpus;
+
+	if (cgroup && write_file(cgroup, "cpu.timer_slack_ns", slack)) {
+		perror("cpu.timer_slack_ns");
+		return -1;
+	}
+
+	stats = mmap(NULL, nr_tasks * sizeof(*stats), PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (stats == MAP_FAILED)
+		return -1;
+
+	nr_cpus = idle_stats(&usage0, &idle0);
+	start = now_ns();
+	end = start + seconds * NSEC_PER_SEC;
+
+	for (t = 0; t < nr_tasks; t++) {
+		pid_t pid = fork();
+
+		if (pid < 0)
+			return -1;
+		if (pid)
+			continue;
+
+		if (cgroup) {
+			if (write_file(cgroup, "cgroup.procs", getpid()) &&
+			    write_file(cgroup, "tasks", getpid()))
+				_exit(1);
+			prctl(PR_SET_TIMERSLACK, 1);
+		} else {
+			prctl(PR_SET_TIMERSLACK, slack ? slack : 1);
+		}
+		sleeper(&stats[t], end, t + 1);
+		_exit(0);
+	}
+
+	while (wait(NULL) > 0)
+		;
+	elapsed = now_ns() - start;
+	idle_stats(&usage1, &idle1);
+
+	late = malloc(nr_tasks * MAX_LATE * sizeof(*late));
+	if (!late)
+		return -1;
+	for (t = 0; t < nr_tasks; t++) {
+		wakeups += stats[t].wakeups;
+		n = stats[t].nr_late < MAX_LATE ? stats[t].nr_late : MAX_LATE;
+		for (i = 0; i < n; i++) {
+			late[nr_late++] = stats[t].late_ns[i];
+			late_sum += stats[t].late_ns[i];
+		}
+	}
+	qsort(late, nr_late, sizeof(*late), cmp_ll);
+
+	printf("slack %10llu ns: ", slack);
+	if (nr_cpus > 0)
+		printf("%8.1f wakeups/s, %5.1f%% idle, ",
+		       (usage1 - usage0) * (double)NSEC_PER_SEC / elapsed,
+		       (idle1 - idle0) * 1000.0 * 100 / nr_cpus / elapsed);
+	else
+		printf("(no cpuidle stats), ");
+	printf("%7.1f task wakeups/s, late avg %lld us p99 %lld us\n",
+	       wakeups * (double)NSEC_PER_SEC / elapsed,
+	       nr_late ? (long long)(late_sum / nr_late / 1000) : 0,
+	       nr_late ? late[nr_late * 99 / 100] / 1000 : 0);
+
+	free(late);
+	munmap(stats, nr_tasks * sizeof(*stats));
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:t:p:s:c:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_tasks = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'p':
+			max_period_us = atol(optarg);
+			break;
+		case 's':
+			slack_ns = strtoull(optarg, NULL, 0);
+			break;
+		case 'c':
+			cgroup = optarg;
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-n tasks] [-t seconds] [-p max_period_us] [-s slack_ns] [-c cgroup_dir]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (nr_tasks < 1 || seconds < 1 || max_period_us < 10) {
+		fprintf(stderr, "bad arguments\n");
+		return 1;
+	}
+
+	printf("%d tasks, periods %ld-%ld us, %d s per run%s%s\n", nr_tasks,
+	       max_period_us / 10, max_period_us, seconds,
+	       cgroup ? ", cgroup " : "", cgroup ? cgroup : "");
+
+	if (run(0) || run(slack_ns))
+		return 1;
+
+	if (cgroup)
+		write_file(cgroup, "cpu.timer_slack_ns", 0);
+
+	return 0;
+}
@@ -0,0 +1,282 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * mmap_sem convoy stress test.
+ *
+ * Reader threads fault in pages of their own part of a shared anonymous
+ * mapping, throwing them away with MADV_DONTNEED after each pass, so that
+ * they take mmap_sem for read once per page.  Writer threads keep calling
+ * mprotect() on a small separate mapping, each call taking mmap_sem for
+ * write for a few microseconds.  Without reader spinning every such write
+ * hold sends the faulting readers to sleep in the rwsem wait queue, and
+ * the fault latency tail grows with the number of readers.
+ *
+ * Prints the fault rate, fault latency percentiles, the mprotect() rate
+ * and, when <debugfs>/rwsem_stat exists, the rwsem counters for the run.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LAT_BUCKET_US	1
+#define LAT_BUCKETS	100000	/* up to 100 ms */
+
+#define RWSEM_STAT	"/sys/kernel/debug/rwsem_stat"
+
+static int nr_readers = 4;
+static int nr_writers = 1;
+static int seconds = 5;
+static size_t pages_per_reader = 1024;
+static size_t page_sz;
+
+static volatile bool stop;
+
+struct worker {
+	pthread_t thread;
+	char *area;
+	unsigned long ops;
+	unsigned long errors;
+	unsigned long long max_us;
+	unsigned int *lat;	/* fault latency histogram, readers only */
+};
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *reader_thread(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long long start, us;
+	size_t i;
+
+	while (!stop) {
+		for (i = 0; i < pages_per_reader && !stop; i++) {
+			start = now_ns();
+			w->area[i * page_sz] = 1;
+			us = (now_ns() - start) / 1000;
+
+			w->ops++;
+			if (us > w->max_us)
+				w->max_us = us;
+			w->lat[us / LAT_BUCKET_US < LAT_BUCKETS ?
+			       us / LAT_BUCKET_US : LAT_BUCKETS - 1]++;
+		}
+		if (madvise(w->area, pages_per_reader * page_sz,
+			    MADV_DONTNEED)) {
+			perror("madvise");
+			w->errors++;
+			break;
+		}
+	}
+	return NULL;
+}
+
+static void *writer_thread(void *arg)
+{
+	struct worker *w = arg;
+	int prot = PROT_READ;
+
+	while (!stop) {
+		if (mprotect(w->area, page_sz, prot)) {
+			perror("mprotect");
+			w->errors++;
+			break;
+		}
+		prot ^= PROT_WRITE;
+		w->ops++;
+	}
+	return NULL;
+}
+
+static unsigned long percentile(unsigned int *lat, unsigned long total,
+				double pct)
+{
+	unsigned long want = total * pct / 100, seen = 0;
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += lat[i];
+		if (seen > want)
+			break;
+	}
+	return (unsigned long)(i + 1) * LAT_BUCKET_US;
+}
+
+static bool rwsem_stat_reset(void)
+{
+	int fd;
+
+	fd = open(RWSEM_STAT "/reset_counters", O_WRONLY);
+	if (fd < 0)
+		return false;
+	if (write(fd, "1", 1) != 1) {
+		close(fd);
+		return false;
+	}
+	close(fd);
+	return true;
+}
+
+static void rwsem_stat_print(void)
+{
+	static const char * const names[] = {
+		"rlock_spin", "rlock_spin_fail", "rlock_sleep", "rlock_wait",
+		"wlock_spin", "wlock_spin_fail", "wlock_sleep", "wlock_wait",
+		"handoff",
+	};
+	char path[64], buf[64];
+	unsigned int i;
+	ssize_t n;
+	int fd;
+
+	printf("rwsem_stat:");
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		snprintf(path, sizeof(path), RWSEM_STAT "/%s", names[i]);
+		fd = open(path, O_RDONLY);
+		if (fd < 0)
+			continue;
+		n = read(fd, buf, sizeof(buf) - 1);
+		close(fd);
+		if (n <= 0)
+			continue;
+		buf[strcspn(buf, "\n")] = '\0';
+		printf(" %s %s", names[i], buf);
+	}
+	printf("\n");
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-r readers] [-w writers] [-s seconds]\n"
+		"          [-p pages per reader]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long faults = 0, mprotects = 0, errors = 0;
+	unsigned long long max_us = 0;
+	struct worker *workers;
+	struct timespec start, end;
+	unsigned int *lat;
+	bool have_stat;
+	double elapsed;
+	char *area;
+	int opt, i, j;
+
+	while ((opt = getopt(argc, argv, "r:w:s:p:")) != -1) {
+		switch (opt) {
+		case 'r':
+			nr_readers = atoi(optarg);
+			break;
+		case 'w':
+			nr_writers = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'p':
+			pages_per_reader = atol(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || nr_readers < 1 || nr_writers < 0 ||
+	    seconds < 1 || pages_per_reader < 1)
+		usage(argv[0]);
+
+	page_sz = sysconf(_SC_PAGESIZE);
+
+	/* all readers share one mapping, and so one VMA, as a heap would */
+	area = mmap(NULL, nr_readers * pages_per_reader * page_sz,
+		    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	workers = calloc(nr_readers + nr_writers, sizeof(*workers));
+	lat = calloc(LAT_BUCKETS, sizeof(*lat));
+	if (!workers || !lat)
+		return 1;
+
+	for (i = 0; i < nr_readers; i++) {
+		workers[i].area = area + i * pages_per_reader * page_sz;
+		workers[i].lat = calloc(LAT_BUCKETS, sizeof(*lat));
+		if (!workers[i].lat)
+			return 1;
+	}
+	for (; i < nr_readers + nr_writers; i++) {
+		workers[i].area = mmap(NULL, page_sz, PROT_READ,
+				       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (workers[i].area == MAP_FAILED) {
+			perror("mmap");
+			return 1;
+		}
+	}
+
+	have_stat = rwsem_stat_reset();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nr_readers + nr_writers; i++) {
+		if (pthread_create(&workers[i].thread, NULL,
+				   i < nr_readers ? reader_thread :
+						    writer_thread,
+				   &workers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	sleep(seconds);
+	stop = true;
+
+	for (i = 0; i < nr_readers + nr_writers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		errors += workers[i].errors;
+		if (i >= nr_readers) {
+			mprotects += workers[i].ops;
+			continue;
+		}
+		faults += workers[i].ops;
+		if (workers[i].max_us > max_us)
+			max_us = workers[i].max_us;
+		for (j = 0; j < LAT_BUCKETS; j++)
+			lat[j] += workers[i].lat[j];
+		free(workers[i].lat);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+		  (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("%d readers %d writers: %.0f faults/s p50 %lu us p99 %lu us p99.9 %lu us max %llu us, %.0f mprotect/s\n",
+	       nr_readers, nr_writers, faults / elapsed,
+	       percentile(lat, faults, 50), percentile(lat, faults, 99),
+	       percentile(lat, faults, 99.9), max_us, mprotects / elapsed);
+	if (have_stat)
+		rwsem_stat_print();
+
+	free(lat);
+	free(workers);
+
+	if (errors) {
+		printf("%lu errors\n", errors);
+		return 1;
+	}
+	return 0;
+}